@@ -0,0 +1,350 @@
+// Native heap benchmark.
+//
+// Replays one workload against every heap implementation and reports
+// throughput, per-op latency percentiles, the longest free-list walk any op
+// needed, peak metadata and final external and internal fragmentation. Each
+// heap is linked from its own static library with prefixed symbols (see
+// c/heap_namespace.h).
+//
+//   make bench                                     built-in synthetic churn
+//   make bench BENCH_ARGS="trace.txt"              replay a text trace
+//   make bench BENCH_ARGS="-n 500000 -s 7"         synthetic, 500k ops, seed 7
+//   make bench BENCH_ARGS="-m 67108864 -b 1000000 -l 100000"
+//                                                  64 MB heap, 1M block capacity,
+//                                                  100k live objects
+//   make bench BENCH_ARGS="-w powerlaw,fifo,max=4096 -n 1000000"
+//                                                  generated workload (common_workload_generate)
+//   make bench-layouts                             once per block layout variant
+//
+// -w takes comma-separated words: a size distribution (uniform, powerlaw,
+// bimodal, classes), a lifetime model (lifo, fifo, random, longlived) and
+// min= max= shape= alloc= long= settings, plus fast= dma= uncached= pinned=
+// for the percentage of mallocs asking for each heap_5 region flag. -n, -s
+// and -l set its op count, seed and live-set bound.
+//
+// Trace format, one op per line:
+//   a <size> [flags]    allocate; allocations are numbered from 0 in order
+//   f <n>               free the n-th allocation (skipped if it failed)
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "bench_heaps.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_OPS   200000
+#define BENCH_DEFAULT_SEED  1
+#define BENCH_DEFAULT_LIVE  96
+#define BENCH_REPEAT        3
+
+static size_t heap_size = DEFAULT_HEAP_SIZE;
+static size_t max_blocks = 0;       // 0 = module default
+
+// Workload: op_t tape where OP_FREE's ptr_index is an allocation ordinal
+typedef struct {
+    op_t* ops;
+    int count;
+    int capacity;
+    int alloc_count;
+} workload_t;
+
+typedef struct {
+    double ops_per_sec;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+    int failures;
+    size_t peak_metadata;   // largest heap_stats_t.metadata_bytes between ops
+    uint32_t max_visited;   // from the heap's own op profile
+    float fragmentation;
+    float internal_fragmentation;   // header and rounding overhead of live blocks
+} bench_result_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void workload_push(workload_t* w, uint32_t kind, uint32_t size, int32_t ptr_index, uint32_t flags) {
+    if (w->count == w->capacity) {
+        w->capacity = w->capacity ? w->capacity * 2 : 1024;
+        w->ops = realloc(w->ops, (size_t)w->capacity * sizeof(op_t));
+        if (!w->ops) {
+            fprintf(stderr, "bench: out of memory\n");
+            exit(1);
+        }
+    }
+
+    op_t* op = &w->ops[w->count++];
+    op->kind = kind;
+    op->size = size;
+    op->ptr_index = ptr_index;
+    op->flags = flags;
+    if (kind == OP_MALLOC) w->alloc_count++;
+}
+
+// Random churn over a bounded live set, mostly small sizes with a long tail
+static void workload_synthetic(workload_t* w, int op_count, unsigned seed, int max_live) {
+    int* live = malloc((size_t)max_live * sizeof(int));
+    int live_count = 0;
+    if (!live) {
+        fprintf(stderr, "bench: out of memory\n");
+        exit(1);
+    }
+
+    srand(seed);
+    for (int i = 0; i < op_count; i++) {
+        if (live_count == 0 || (live_count < max_live && rand() % 100 < 55)) {
+            int bucket = rand() % 100;
+            uint32_t size = bucket < 70 ? 8 + rand() % 120 :
+                            bucket < 95 ? 128 + rand() % 384 :
+                                          512 + rand() % 1536;
+            live[live_count++] = w->alloc_count;
+            workload_push(w, OP_MALLOC, size, -1, 0);
+        } else {
+            int k = rand() % live_count;
+            workload_push(w, OP_FREE, 0, live[k], 0);
+            live[k] = live[--live_count];
+        }
+    }
+    free(live);
+}
+
+static int workload_parse(workload_config_t* config, const char* spec) {
+    static const char* const sizes[] = { "uniform", "powerlaw", "bimodal", "classes" };
+    static const char* const lifetimes[] = { "lifo", "fifo", "random", "longlived" };
+    static const char* const flags[WORKLOAD_FLAGS] = { "fast", "dma", "uncached", "pinned" };
+    char word[64];
+
+    while (*spec) {
+        size_t len = strcspn(spec, ",");
+        if (len >= sizeof(word)) len = sizeof(word) - 1;
+        memcpy(word, spec, len);
+        word[len] = '\0';
+        spec += len + (spec[len] == ',');
+
+        char* value = strchr(word, '=');
+        uint32_t number = 0;
+        if (value) {
+            *value++ = '\0';
+            number = (uint32_t)strtoul(value, NULL, 10);
+        }
+        int known = 0;
+        for (int i = 0; i < 4 && !known; i++) {
+            if (!value && strcmp(word, sizes[i]) == 0) config->size_dist = (uint32_t)i, known = 1;
+            if (!value && strcmp(word, lifetimes[i]) == 0) config->lifetime = (uint32_t)i, known = 1;
+            if (value && strcmp(word, flags[i]) == 0) config->flag_percent[i] = number, known = 1;
+        }
+        if (value && !known) {
+            known = 1;
+            if (strcmp(word, "min") == 0) config->min_size = number;
+            else if (strcmp(word, "max") == 0) config->max_size = number;
+            else if (strcmp(word, "shape") == 0) config->shape = number;
+            else if (strcmp(word, "alloc") == 0) config->alloc_percent = number;
+            else if (strcmp(word, "long") == 0) config->long_lived_percent = number;
+            else known = 0;
+        }
+        if (!known && word[0]) {
+            fprintf(stderr, "bench: unknown workload setting '%s'\n", word);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// A generated workload; OP_FLAG_KEEP_SLOT already numbers every malloc the
+// way bench does
+static int workload_generate(workload_t* w, const workload_config_t* config) {
+    w->ops = malloc((size_t)config->op_count * sizeof(op_t));
+    int count = w->ops ? common_workload_generate(config, w->ops, (int)config->op_count) : -1;
+    if (count < 0) {
+        fprintf(stderr, "bench: out of memory\n");
+        exit(1);
+    }
+    w->count = w->capacity = count;
+    for (int i = 0; i < count; i++) w->alloc_count += w->ops[i].kind == OP_MALLOC;
+    return 1;
+}
+
+static int workload_load(workload_t* w, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return 0;
+    }
+
+    char line[128];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        unsigned long a = 0, b = 0;
+        char kind = 0;
+        int fields = sscanf(line, " %c %lu %lu", &kind, &a, &b);
+
+        if (fields <= 0 || kind == '#') continue;
+        if (kind == 'a' && fields >= 2) {
+            workload_push(w, OP_MALLOC, (uint32_t)a, -1, fields == 3 ? (uint32_t)b : 0);
+        } else if (kind == 'f' && fields >= 2) {
+            workload_push(w, OP_FREE, 0, (int32_t)a, 0);
+        } else {
+            fprintf(stderr, "%s:%d: unrecognised op\n", path, line_no);
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+static inline void run_op(const bench_heap_t* heap, const op_t* op, void** ptrs, int* next_alloc, int* failures) {
+    if (op->kind == OP_MALLOC) {
+        uint8_t flags = (uint8_t)op->flags;     // region flags; the OP_FLAG_* bits are above them
+        void* ptr = flags && heap->malloc_flags ? heap->malloc_flags(op->size, flags) : heap->malloc(op->size);
+        if (!ptr) (*failures)++;
+        ptrs[(*next_alloc)++] = ptr;
+    } else if (op->ptr_index >= 0 && op->ptr_index < *next_alloc && ptrs[op->ptr_index]) {
+        heap->free(ptrs[op->ptr_index]);
+        ptrs[op->ptr_index] = NULL;
+    }
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_heap(const bench_heap_t* heap, const workload_t* w, bench_result_t* result) {
+    void** ptrs = calloc((size_t)w->alloc_count + 1, sizeof(void*));
+    uint64_t* latency = malloc((size_t)w->count * sizeof(uint64_t));
+    if (!ptrs || !latency) {
+        fprintf(stderr, "bench: out of memory\n");
+        exit(1);
+    }
+
+    // Latency pass: time every op, sample metadata between ops
+    int next_alloc = 0;
+    result->failures = 0;
+    result->peak_metadata = 0;
+    heap->init(heap_size, max_blocks);
+
+    for (int i = 0; i < w->count; i++) {
+        uint64_t start = now_ns();
+        run_op(heap, &w->ops[i], ptrs, &next_alloc, &result->failures);
+        latency[i] = now_ns() - start;
+
+        if (w->ops[i].kind == OP_MALLOC && heap->alignment &&
+            (uintptr_t)ptrs[next_alloc - 1] % heap->alignment) {
+            fprintf(stderr, "bench: %s returned %p, not %zu-byte aligned\n",
+                    heap->name, ptrs[next_alloc - 1], heap->alignment);
+            exit(1);
+        }
+
+        size_t metadata = heap->stats()->metadata_bytes;
+        if (metadata > result->peak_metadata) result->peak_metadata = metadata;
+    }
+    result->fragmentation = heap->stats()->external_fragmentation;
+    result->internal_fragmentation = heap->stats()->internal_fragmentation;
+
+    result->max_visited = 0;
+    for (int kind = 0; kind < PROFILE_OP_KINDS; kind++) {
+        uint32_t visited = heap->op_max(kind, PROFILE_VISITED);
+        if (visited > result->max_visited) result->max_visited = visited;
+    }
+
+    qsort(latency, (size_t)w->count, sizeof(uint64_t), compare_u64);
+    result->p50_ns = latency[w->count / 2];
+    result->p99_ns = latency[(size_t)((double)w->count * 0.99)];
+    result->max_ns = latency[w->count - 1];
+
+    // Throughput pass: no per-op timers, best of BENCH_REPEAT runs
+    uint64_t best = UINT64_MAX;
+    for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+        int failures = 0;
+        next_alloc = 0;
+        memset(ptrs, 0, ((size_t)w->alloc_count + 1) * sizeof(void*));
+        heap->init(heap_size, max_blocks);
+
+        uint64_t start = now_ns();
+        for (int i = 0; i < w->count; i++) {
+            run_op(heap, &w->ops[i], ptrs, &next_alloc, &failures);
+        }
+        uint64_t elapsed = now_ns() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    result->ops_per_sec = best > 0 ? (double)w->count * 1e9 / (double)best : 0.0;
+
+    free(latency);
+    free(ptrs);
+}
+
+int main(int argc, char** argv) {
+    workload_t workload = {0};
+    int op_count = BENCH_DEFAULT_OPS;
+    unsigned seed = BENCH_DEFAULT_SEED;
+    int max_live = BENCH_DEFAULT_LIVE;
+    const char* trace = NULL;
+    const char* spec = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            op_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            heap_size = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            max_blocks = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            max_live = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            spec = argv[++i];
+        } else {
+            trace = argv[i];
+        }
+    }
+
+    if (trace) {
+        if (!workload_load(&workload, trace)) return 1;
+        printf("Workload: %s (%d ops, %d allocations)\n", trace, workload.count, workload.alloc_count);
+    } else if (spec) {
+        workload_config_t config = {
+            .seed = seed,
+            .op_count = op_count > 0 ? (uint32_t)op_count : 0,
+            .max_live = max_live > 0 ? (uint32_t)max_live : 0
+        };
+        if (!workload_parse(&config, spec)) return 1;
+        workload_generate(&workload, &config);
+        printf("Workload: generated %s, seed %u (%d ops, %d allocations)\n",
+               spec, seed, workload.count, workload.alloc_count);
+    } else {
+        if (max_live < 1) max_live = 1;
+        workload_synthetic(&workload, op_count, seed, max_live);
+        printf("Workload: synthetic churn, seed %u, up to %d live (%d ops, %d allocations)\n",
+               seed, max_live, workload.count, workload.alloc_count);
+    }
+    if (workload.count == 0) {
+        fprintf(stderr, "bench: empty workload\n");
+        return 1;
+    }
+    printf("Heap: %zu bytes, block capacity %zu\n", heap_size, max_blocks ? max_blocks : (size_t)DEFAULT_MAX_BLOCKS);
+    printf("Layout (heap_2/4/5): %d-byte alignment, %zu-byte header, split slack %d\n",
+           HEAP_ALIGNMENT, (size_t)HEAP_HEADER_SIZE, HEAP_SPLIT_SLACK);
+
+    printf("\n%-22s %12s %8s %8s %10s %9s %8s %12s %10s %10s\n",
+           "heap", "ops/s", "p50 ns", "p99 ns", "max ns", "max visit", "fails", "peak meta B", "frag %", "int frag %");
+
+    for (int h = 0; h < BENCH_HEAP_COUNT; h++) {
+        bench_result_t r;
+        bench_heap(&bench_heaps[h], &workload, &r);
+        printf("%-22s %12.0f %8llu %8llu %10llu %9u %8d %12zu %10.2f %10.2f\n",
+               bench_heaps[h].name, r.ops_per_sec,
+               (unsigned long long)r.p50_ns, (unsigned long long)r.p99_ns, (unsigned long long)r.max_ns,
+               r.max_visited, r.failures, r.peak_metadata, r.fragmentation,
+               r.internal_fragmentation);
+    }
+
+    free(workload.ops);
+    return 0;
+}
\ No newline at end of file
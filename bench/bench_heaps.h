@@ -0,0 +1,59 @@
+#ifndef BENCH_HEAPS_H
+#define BENCH_HEAPS_H
+
+// Every heap built as a static library with prefixed symbols, behind one
+// function table so bench drivers can run them side by side
+
+#include "../c/heap_common.h"
+
+#define DECLARE_HEAP(ns) \
+    void ns##_heap_init(size_t size, size_t max_blocks); \
+    void* ns##_heap_malloc(size_t size); \
+    void ns##_heap_free(void* ptr); \
+    heap_stats_t* ns##_get_heap_stats(void); \
+    int ns##_get_block_table_len(void); \
+    uint32_t ns##_get_op_max(int op_kind, int metric);
+
+DECLARE_HEAP(heap1)
+DECLARE_HEAP(heap2)
+DECLARE_HEAP(heap3)
+DECLARE_HEAP(heap4)
+DECLARE_HEAP(heap5)
+DECLARE_HEAP(heap6)
+
+void heap3_heap_flush_thread(void);
+void* heap5_heap_malloc_flags(size_t size, uint8_t flags);
+
+// heap_5 built with a lock per region (libheap5mt.a), linked by bench/threads.c
+DECLARE_HEAP(heap5mt)
+void* heap5mt_heap_malloc_flags(size_t size, uint8_t flags);
+
+typedef struct {
+    const char* name;
+    void (*init)(size_t size, size_t max_blocks);
+    void* (*malloc)(size_t size);
+    void* (*malloc_flags)(size_t size, uint8_t flags);  // NULL if flags are ignored
+    void (*free)(void* ptr);
+    heap_stats_t* (*stats)(void);
+    int (*block_count)(void);
+    uint32_t (*op_max)(int op_kind, int metric);
+    size_t alignment;   // payload alignment bench checks every malloc against, 0 for none
+} bench_heap_t;
+
+#define HEAP_ENTRY(ns, label, malloc_flags, alignment) \
+    { label, ns##_heap_init, ns##_heap_malloc, malloc_flags, ns##_heap_free, \
+      ns##_get_heap_stats, ns##_get_block_table_len, ns##_get_op_max, alignment }
+
+// heap_3 stands in for the system malloc, so it keeps malloc's alignment
+static const bench_heap_t bench_heaps[] = {
+    HEAP_ENTRY(heap1, "heap_1 bump", NULL, 0),
+    HEAP_ENTRY(heap2, "heap_2 best fit", NULL, 0),
+    HEAP_ENTRY(heap3, "heap_3 thread safe", NULL, _Alignof(max_align_t)),
+    HEAP_ENTRY(heap4, "heap_4 coalescing", NULL, 0),
+    HEAP_ENTRY(heap5, "heap_5 multi-region", heap5_heap_malloc_flags, 0),
+    HEAP_ENTRY(heap6, "heap_6 tlsf", NULL, 0)
+};
+
+#define BENCH_HEAP_COUNT ((int)(sizeof(bench_heaps) / sizeof(bench_heaps[0])))
+
+#endif
\ No newline at end of file
@@ -0,0 +1,190 @@
+// Streaming replay of binary allocation traces (c/heap_trace.h).
+//
+// The trace is memory-mapped and consumed in fixed-size chunks; pages behind
+// the cursor are dropped as soon as a chunk is done, so resident memory stays
+// at roughly one chunk plus the live-id map however long the trace is.
+//
+//   make replay TRACE=trace.htrc         replay against every heap
+//   bench/bin/replay -H 4 trace.htrc     replay against heap_4 only
+//   bench/bin/replay -B 200000 t.htrc    room for 200k tracked blocks
+//
+// Thread ids are reported but ops are replayed in file order on one thread.
+
+#define _DEFAULT_SOURCE
+
+#include "bench_heaps.h"
+#include "../c/heap_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define REPLAY_CHUNK_RECORDS 65536
+
+typedef struct {
+    uint64_t records;
+    uint64_t mallocs;
+    uint64_t frees;
+    uint64_t resets;
+    uint64_t failures;
+    uint64_t unmatched_frees;   // id not live: failed, never seen, or map full
+    size_t peak_metadata;       // largest heap_stats_t.metadata_bytes between chunks
+    double seconds;
+} replay_result_t;
+
+static trace_map_t live;
+static uint8_t thread_seen[65536];
+static size_t max_blocks = 0;   // heap_init block capacity, 0 = module default
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void replay_record(const bench_heap_t* heap, const trace_record_t* rec, replay_result_t* result) {
+    uintptr_t value;
+
+    switch (rec->kind) {
+        case TRACE_MALLOC: {
+            void* ptr = rec->flags && heap->malloc_flags ?
+                        heap->malloc_flags(rec->size, rec->flags) : heap->malloc(rec->size);
+            result->mallocs++;
+            if (!ptr) {
+                result->failures++;
+            } else {
+                // If the map is full the block stays allocated and its free is unmatched
+                trace_map_put(&live, rec->id, (uintptr_t)ptr);
+            }
+            break;
+        }
+        case TRACE_FREE:
+            result->frees++;
+            if (trace_map_take(&live, rec->id, &value)) {
+                heap->free((void*)value);
+            } else {
+                result->unmatched_frees++;
+            }
+            break;
+        case TRACE_RESET:
+            result->resets++;
+            heap->init(rec->size ? rec->size : DEFAULT_HEAP_SIZE, max_blocks);
+            trace_map_clear(&live);
+            break;
+    }
+}
+
+static int replay_heap(const bench_heap_t* heap, uint8_t* map, size_t len, uint32_t heap_size,
+                       replay_result_t* result) {
+    long page = sysconf(_SC_PAGESIZE);
+    size_t chunk_bytes = (size_t)REPLAY_CHUNK_RECORDS * TRACE_RECORD_SIZE;
+    size_t pos = TRACE_HEADER_SIZE;
+    size_t dropped = 0;
+
+    memset(result, 0, sizeof(*result));
+    trace_map_clear(&live);
+    heap->init(heap_size ? heap_size : DEFAULT_HEAP_SIZE, max_blocks);
+
+    madvise(map, len, MADV_SEQUENTIAL);
+    double start = now_seconds();
+
+    while (pos + TRACE_RECORD_SIZE <= len) {
+        size_t end = pos + chunk_bytes;
+        if (end > len) end = len;
+
+        for (; pos + TRACE_RECORD_SIZE <= end; pos += TRACE_RECORD_SIZE) {
+            trace_record_t rec;
+            trace_decode(map + pos, &rec);
+            thread_seen[rec.thread_id] = 1;
+            replay_record(heap, &rec, result);
+            result->records++;
+        }
+
+        size_t metadata = heap->stats()->metadata_bytes;
+        if (metadata > result->peak_metadata) result->peak_metadata = metadata;
+
+        // Release the pages this chunk used
+        size_t release = (pos / (size_t)page) * (size_t)page;
+        if (release > dropped) {
+            madvise(map + dropped, release - dropped, MADV_DONTNEED);
+            dropped = release;
+        }
+    }
+
+    result->seconds = now_seconds() - start;
+    return (len - TRACE_HEADER_SIZE) % TRACE_RECORD_SIZE == 0;
+}
+
+int main(int argc, char** argv) {
+    int only_heap = 0;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-H") == 0 && i + 1 < argc) {
+            only_heap = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc) {
+            max_blocks = (size_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path || only_heap < 0 || only_heap > BENCH_HEAP_COUNT) {
+        fprintf(stderr, "usage: %s [-H heap] [-B max_blocks] trace.htrc\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        return 1;
+    }
+
+    size_t len = (size_t)st.st_size;
+    uint8_t* map = len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return 1;
+    }
+
+    uint32_t heap_size;
+    if (!trace_read_header(map, len, &heap_size)) {
+        fprintf(stderr, "%s: not a version %d trace\n", path, TRACE_VERSION);
+        munmap(map, len);
+        return 1;
+    }
+
+    printf("Trace: %s (%zu records, heap size %u)\n", path,
+           (len - TRACE_HEADER_SIZE) / TRACE_RECORD_SIZE, heap_size);
+    printf("\n%-22s %12s %10s %10s %8s %10s %10s %12s %10s\n",
+           "heap", "ops/s", "mallocs", "frees", "resets", "fails", "unmatched", "peak meta B", "frag %");
+
+    int complete = 1;
+    for (int h = 0; h < BENCH_HEAP_COUNT; h++) {
+        if (only_heap && only_heap != h + 1) continue;
+
+        replay_result_t r;
+        complete = replay_heap(&bench_heaps[h], map, len, heap_size, &r);
+        printf("%-22s %12.0f %10llu %10llu %8llu %10llu %10llu %12zu %10.2f\n",
+               bench_heaps[h].name, r.seconds > 0 ? (double)r.records / r.seconds : 0.0,
+               (unsigned long long)r.mallocs, (unsigned long long)r.frees,
+               (unsigned long long)r.resets, (unsigned long long)r.failures,
+               (unsigned long long)r.unmatched_frees,
+               r.peak_metadata,
+               bench_heaps[h].stats()->external_fragmentation);
+    }
+
+    int threads = 0;
+    for (int t = 0; t < 65536; t++) threads += thread_seen[t];
+    printf("\nThreads in trace: %d\n", threads);
+    if (!complete) fprintf(stderr, "%s: trailing partial record ignored\n", path);
+
+    munmap(map, len);
+    trace_map_free(&live);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,186 @@
+// Thread-scaling benchmark for heap_3 and the region-locked heap_5 build.
+//
+// Every thread runs the same small-object churn against one shared heap;
+// total throughput is reported for 1, 2, 4, ... threads. For heap_3 this shows
+// the per-thread caches and batched publishing. For heap_5 the same run is
+// repeated with every thread in one region (so on one lock), each thread in
+// its own region, and threads asking for any region, where the try-lock
+// passes them over regions other threads hold.
+//
+//   make bench-threads
+//   bench/bin/threads -t 16 -n 500000    up to 16 threads, 500k ops each
+//   bench/bin/threads -H 5               heap_5 only
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "bench_heaps.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define THREADS_MAX         64
+#define THREADS_DEFAULT     8
+#define THREAD_OPS_DEFAULT  200000
+#define THREAD_LIVE         64
+#define REGION_HEAP_SIZE    (16u << 20)     // room for every thread in any one region
+
+// heap_5's default layout: FAST, DMA, UNCACHED
+static const uint8_t region_flags[] = { 0x01, 0x02, 0x04 };
+#define REGION_FLAG_COUNT ((int)(sizeof(region_flags) / sizeof(region_flags[0])))
+
+typedef struct {
+    const char* name;
+    void (*init)(size_t size, size_t max_blocks);
+    void* (*malloc)(size_t size, uint8_t flags);
+    void (*free)(void* ptr);
+    void (*flush)(void);            // NULL if threads keep nothing back
+    heap_stats_t* (*stats)(void);
+    size_t heap_size;
+} thread_heap_t;
+
+// Which allocation flags thread `t` passes
+typedef enum {
+    FLAGS_NONE = 0,                 // heap_3: no regions
+    FLAGS_ONE_REGION,
+    FLAGS_OWN_REGION,
+    FLAGS_ANY_REGION
+} flags_mode_t;
+
+typedef struct {
+    const thread_heap_t* heap;
+    unsigned seed;
+    int ops;
+    uint8_t flags;
+    pthread_barrier_t* start;
+} worker_t;
+
+static void* heap3_malloc(size_t size, uint8_t flags) {
+    (void)flags;
+    return heap3_heap_malloc(size);
+}
+
+static const thread_heap_t heap3 = {
+    "heap_3 thread caches", heap3_heap_init, heap3_malloc, heap3_heap_free,
+    heap3_heap_flush_thread, heap3_get_heap_stats, DEFAULT_HEAP_SIZE
+};
+
+static const thread_heap_t heap5 = {
+    "heap_5 region locks", heap5mt_heap_init, heap5mt_heap_malloc_flags, heap5mt_heap_free,
+    NULL, heap5mt_get_heap_stats, REGION_HEAP_SIZE
+};
+
+static uint8_t thread_flags(flags_mode_t mode, int t) {
+    switch (mode) {
+        case FLAGS_ONE_REGION: return region_flags[0];
+        case FLAGS_OWN_REGION: return region_flags[t % REGION_FLAG_COUNT];
+        default: return 0;
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void* worker_main(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    const thread_heap_t* heap = w->heap;
+    void* live[THREAD_LIVE];
+    int live_count = 0;
+    unsigned seed = w->seed;
+
+    pthread_barrier_wait(w->start);
+
+    for (int i = 0; i < w->ops; i++) {
+        if (live_count == THREAD_LIVE || (live_count > 0 && rand_r(&seed) % 2)) {
+            int k = rand_r(&seed) % live_count;
+            heap->free(live[k]);
+            live[k] = live[--live_count];
+        } else {
+            void* ptr = heap->malloc(16 + rand_r(&seed) % 240, w->flags);
+            if (ptr) live[live_count++] = ptr;
+        }
+    }
+    while (live_count > 0) heap->free(live[--live_count]);
+
+    if (heap->flush) heap->flush();
+    return NULL;
+}
+
+// Returns total ops per second across `threads` workers
+static double run_threads(const thread_heap_t* heap, flags_mode_t mode, int threads, int ops) {
+    pthread_t tid[THREADS_MAX];
+    worker_t workers[THREADS_MAX];
+    pthread_barrier_t start;
+
+    heap->init(heap->heap_size, 0);
+    pthread_barrier_init(&start, NULL, (unsigned)threads + 1);
+
+    for (int t = 0; t < threads; t++) {
+        workers[t].heap = heap;
+        workers[t].seed = (unsigned)t * 7919u + 1u;
+        workers[t].ops = ops;
+        workers[t].flags = thread_flags(mode, t);
+        workers[t].start = &start;
+        pthread_create(&tid[t], NULL, worker_main, &workers[t]);
+    }
+
+    pthread_barrier_wait(&start);
+    double begin = now_seconds();
+    for (int t = 0; t < threads; t++) pthread_join(tid[t], NULL);
+    double elapsed = now_seconds() - begin;
+
+    pthread_barrier_destroy(&start);
+    return elapsed > 0 ? (double)threads * ops / elapsed : 0.0;
+}
+
+static void run_scaling(const thread_heap_t* heap, flags_mode_t mode, const char* label,
+                        int max_threads, int ops) {
+    printf("%s%s\n", heap->name, label);
+    printf("%8s %14s %9s %11s\n", "threads", "ops/s", "speedup", "efficiency");
+
+    double single = 0.0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double rate = run_threads(heap, mode, threads, ops);
+        if (threads == 1) single = rate;
+        double speedup = single > 0 ? rate / single : 0.0;
+        printf("%8d %14.0f %8.2fx %10.0f%%\n", threads, rate, speedup, speedup * 100.0 / threads);
+    }
+
+    heap_stats_t* stats = heap->stats();
+    printf("Last run: %u allocations, %u still tracked\n\n",
+           stats->next_allocation_id - 1, stats->allocation_count);
+}
+
+int main(int argc, char** argv) {
+    int max_threads = THREADS_DEFAULT;
+    int ops = THREAD_OPS_DEFAULT;
+    int only = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-t") == 0) {
+            max_threads = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            ops = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-H") == 0) {
+            only = atoi(argv[i + 1]);
+        }
+    }
+    if (max_threads < 1) max_threads = 1;
+    if (max_threads > THREADS_MAX) max_threads = THREADS_MAX;
+
+    printf("Thread scaling, %d ops per thread\n\n", ops);
+
+    if (only == 0 || only == 3) {
+        run_scaling(&heap3, FLAGS_NONE, "", max_threads, ops);
+    }
+    if (only == 0 || only == 5) {
+        run_scaling(&heap5, FLAGS_ONE_REGION, ", every thread in FAST", max_threads, ops);
+        run_scaling(&heap5, FLAGS_OWN_REGION, ", thread t in region t % 3", max_threads, ops);
+        run_scaling(&heap5, FLAGS_ANY_REGION, ", any region", max_threads, ops);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -1,28 +1,56 @@
 #include "heap_common.h"
 
+#define MAX_SCOPES 32
+#define NO_TOP ((size_t)-1)
+
+// What heap_release() rolls a heap_mark() scope back to
+typedef struct {
+    size_t heap_offset;
+    size_t top_offset;
+    int allocated_entries;
+    uint32_t allocations;   // stats.allocation_count at the mark
+    uint32_t live_bytes;    // lifetimes.live_bytes at the mark
+} scope_t;
+
 // Global state
-static uint8_t heap_memory[MAX_HEAP_SIZE];
-static block_info_t allocations[MAX_LOG_ENTRIES];
-static log_entry_t logs[MAX_LOG_ENTRIES];
+static heap_arena_t arena;
+static uint8_t* heap_memory = NULL;
+static block_info_t* allocations = NULL;   // The free tail (while any is left), then allocations in order
+static int allocation_capacity = 0;
+#ifndef HEAP_HEADLESS
+static int allocation_limit = 0;
+#endif
+static log_ring_t event_log;
 static heap_stats_t stats;
 static size_t heap_offset = 0;
+static size_t top_offset = 0;        // Most recent allocation, which realloc can resize in place
+static scope_t scopes[MAX_SCOPES];
+static int scope_depth = 0;
 static int allocation_count = 0;
-static int log_count = 0;
+static int allocated_entries = 0;
+static uint32_t heap_version = 0;
+static block_table_t block_table;
+static op_profile_t profile;
+static lifetime_profile_t lifetimes;   // blocks are never freed one by one, so no lifetimes either
+#ifdef HEAP_HEADLESS
+static uint32_t snapshot_version = 0;
+#endif
 
 static void update_stats() {
+    // The free tail is the only free block, so it moves between buckets as it shrinks
+    if (stats.free_bytes > 0) stats.free_size_histogram[common_size_bucket(stats.free_bytes)]--;
     stats.allocated_bytes = heap_offset;
     stats.free_bytes = stats.total_size - heap_offset;
-    stats.allocation_count = 0;
-    stats.free_block_count = 0;
-    
-    // Count actual allocations
-    for (int i = 0; i < allocation_count; i++) {
-        if (allocations[i].state == BLOCK_ALLOCATED) {
-            stats.allocation_count++;
-        } else if (allocations[i].state == BLOCK_FREE) {
-            stats.free_block_count = 1; // heap_1 has at most one free block at the end
-        }
-    }
+    if (stats.free_bytes > 0) stats.free_size_histogram[common_size_bucket(stats.free_bytes)]++;
+    
+    // Entries are never freed, so the free count follows from the table; the
+    // allocation count is kept by allocate_block, as a full table stops
+    // recording allocations that still succeed
+#ifndef HEAP_HEADLESS
+    stats.free_block_count = allocation_count > allocated_entries ? 1 : 0; // heap_1 has at most one free block at the end
+#else
+    stats.free_block_count = stats.free_bytes > 0 ? 1 : 0;
+#endif
     
     // For heap_1, there's only one free block at the end
     if (stats.free_bytes > 0) {
@@ -43,16 +71,54 @@ static void update_stats() {
     }
 }
 
+#ifdef HEAP_HEADLESS
+// Headless builds keep no table and blocks carry no headers, so the snapshot
+// is the free tail followed by one entry spanning every allocation
+static void refresh_snapshot(void) {
+    if (snapshot_version == heap_version) return;
+    snapshot_version = heap_version;
+    
+    allocation_count = 0;
+    if (!common_grow((void**)&allocations, &allocation_capacity, 2, sizeof(block_info_t))) return;
+    
+    if (heap_offset < stats.total_size) {
+        block_info_t tail = { .offset = heap_offset, .size = stats.total_size - heap_offset, .state = BLOCK_FREE };
+        allocations[allocation_count++] = tail;
+    }
+    if (heap_offset > 0) {
+        block_info_t used = { .offset = 0, .size = heap_offset, .state = BLOCK_ALLOCATED };
+        allocations[allocation_count++] = used;
+    }
+}
+#else
+static inline void refresh_snapshot(void) {}
+#endif
+
 // Exported functions
-void heap_init(size_t size) {
+
+// `size` bytes of heap and room for `max_blocks` table entries (0 keeps the
+// current capacity)
+void heap_init(size_t size, size_t max_blocks) {
+    heap_version++;
+    
     memset(&stats, 0, sizeof(stats));
-    stats.total_size = size > MAX_HEAP_SIZE ? MAX_HEAP_SIZE : size;
+    stats.total_size = common_arena_reserve(&arena, common_heap_size(size));
     stats.next_allocation_id = 1;
     stats.min_free_bytes = stats.total_size;
+    heap_memory = arena.base;
     
     heap_offset = 0;
+    top_offset = 0;
+    scope_depth = 0;
     allocation_count = 0;
-    log_count = 0;
+    allocated_entries = 0;
+    common_log_init(&event_log, stats.total_size);
+    common_profile_clear(&profile);
+    common_lifetime_clear(&lifetimes);
+    
+#ifndef HEAP_HEADLESS
+    allocation_limit = common_block_limit(stats.total_size, max_blocks, allocation_limit);
+    common_grow((void**)&allocations, &allocation_capacity, 1, sizeof(block_info_t));
     
     // Start with one free block representing all memory
     allocations[0].offset = 0;
@@ -61,34 +127,36 @@ void heap_init(size_t size) {
     allocations[0].allocation_id = 0;
     allocations[0].timestamp = stats.timestamp_counter++;
     allocations[0].requested_size = 0;
+    allocations[0].region_id = 0;
     allocation_count = 1;
+#else
+    (void)max_blocks;
+#endif
     
     stats.free_block_count = 1; // Start with 1 free block
     update_stats();
-    common_add_log(logs, &log_count, &stats, "INIT", 0, size, 0, 1);
+    common_add_log(&event_log, &stats, LOG_INIT, 0, size, 0, 1);
 }
 
-void* heap_malloc(size_t size) {
+static void* allocate_block(size_t size) {
+    heap_version++;
+    
     size_t requested_size = size;
     size_t aligned_size = (size + 7) & ~7;
     
     if (heap_offset + aligned_size > stats.total_size) {
-        common_add_log(logs, &log_count, &stats, "MALLOC", stats.next_allocation_id, size, 0, 0);
+        common_add_log(&event_log, &stats, LOG_MALLOC, stats.next_allocation_id, size, 0, 0);
         return NULL;
     }
     
     void* ptr = heap_memory + heap_offset;
     
-    // Find the free block and split it
-    int free_idx = -1;
-    for (int i = 0; i < allocation_count; i++) {
-        if (allocations[i].state == BLOCK_FREE) {
-            free_idx = i;
-            break;
-        }
-    }
+#ifndef HEAP_HEADLESS
+    // The free block, if still present, is always entry 0
+    int free_idx = allocation_count > 0 && allocations[0].state == BLOCK_FREE ? 0 : -1;
     
-    if (free_idx != -1 && allocation_count < MAX_LOG_ENTRIES - 1) {
+    if (free_idx != -1 && allocation_count < allocation_limit - 1 &&
+        common_grow((void**)&allocations, &allocation_capacity, allocation_count + 1, sizeof(block_info_t))) {
         // Add new allocation
         allocations[allocation_count].offset = heap_offset;
         allocations[allocation_count].size = aligned_size;
@@ -96,7 +164,9 @@ void* heap_malloc(size_t size) {
         allocations[allocation_count].allocation_id = stats.next_allocation_id;
         allocations[allocation_count].timestamp = stats.timestamp_counter++;
         allocations[allocation_count].requested_size = requested_size;
+        allocations[allocation_count].region_id = 0;
         allocation_count++;
+        allocated_entries++;
         
         // Update free block to start after this allocation
         allocations[free_idx].offset = heap_offset + aligned_size;
@@ -110,57 +180,411 @@ void* heap_malloc(size_t size) {
             allocation_count--;
         }
     }
+#else
+    (void)requested_size;
+    allocated_entries++;
+#endif
     
-    common_add_log(logs, &log_count, &stats, "MALLOC", stats.next_allocation_id, size, heap_offset, 1);
+    common_lifetime_alloc(&lifetimes, requested_size, stats.timestamp_counter);
+    common_add_log(&event_log, &stats, LOG_MALLOC, stats.next_allocation_id, size, heap_offset, 1);
     stats.next_allocation_id++;
+    stats.allocation_count++;
+    top_offset = heap_offset;
     heap_offset += aligned_size;
     
     update_stats();
     return ptr;
 }
 
-void heap_free(void* ptr) {
+void* heap_malloc(size_t size) {
+    common_profile_begin(&profile, PROFILE_OP_MALLOC);
+    void* ptr = allocate_block(size);
+    common_profile_end(&profile);
+    return ptr;
+}
+
+static void release_block(void* ptr) {
+    heap_version++;
+    
     if (!ptr) return;
     
     size_t offset = (uint8_t*)ptr - heap_memory;
-    common_add_log(logs, &log_count, &stats, "FREE", 0, 0, offset, 0);
+    common_add_log(&event_log, &stats, LOG_FREE, 0, 0, offset, 0);
     // Heap 1 doesn't support free - no state change
 }
 
+#ifndef HEAP_HEADLESS
+// Table entry of the allocation at `offset`: allocations are appended in
+// address order after the free tail, so this is a binary search
+static block_info_t* find_allocation(size_t offset) {
+    int lo = allocation_count > 0 && allocations[0].state == BLOCK_FREE ? 1 : 0;
+    int hi = allocation_count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        if (allocations[mid].offset < offset) {
+            lo = mid + 1;
+        } else if (allocations[mid].offset > offset) {
+            hi = mid - 1;
+        } else {
+            return &allocations[mid];
+        }
+    }
+    return NULL;
+}
+
+// Point the free tail entry at what is left after heap_offset, adding or
+// dropping it as the tail appears or disappears
+static void update_free_tail(void) {
+    int has_tail = allocation_count > 0 && allocations[0].state == BLOCK_FREE;
+    size_t tail_size = stats.total_size - heap_offset;
+    
+    if (!has_tail && tail_size > 0) {
+        if (allocation_count >= allocation_limit ||
+            !common_grow((void**)&allocations, &allocation_capacity, allocation_count + 1, sizeof(block_info_t))) {
+            return;
+        }
+        memmove(&allocations[1], &allocations[0], (size_t)allocation_count * sizeof(block_info_t));
+        allocations[0].state = BLOCK_FREE;
+        allocations[0].allocation_id = 0;
+        allocations[0].timestamp = stats.timestamp_counter++;
+        allocations[0].requested_size = 0;
+        allocations[0].region_id = 0;
+        allocation_count++;
+        has_tail = 1;
+    } else if (has_tail && tail_size == 0) {
+        memmove(&allocations[0], &allocations[1], (size_t)(allocation_count - 1) * sizeof(block_info_t));
+        allocation_count--;
+        return;
+    }
+    
+    if (has_tail) {
+        allocations[0].offset = heap_offset;
+        allocations[0].size = tail_size;
+    }
+}
+#endif
+
+// The most recent allocation can move the bump pointer either way; any other
+// block keeps its place when it shrinks and is copied to the top to grow
+static void* reallocate_block(void* ptr, size_t size) {
+    if (!ptr) return allocate_block(size);
+    if (size == 0) {
+        release_block(ptr);
+        return NULL;
+    }
+    
+    heap_version++;
+    
+    size_t offset = (uint8_t*)ptr - heap_memory;
+    size_t aligned_size = (size + 7) & ~7;
+    
+    if ((uint8_t*)ptr < heap_memory || offset >= heap_offset) {
+        common_add_log(&event_log, &stats, LOG_REALLOC, 0, size, offset, 0);
+        return NULL;
+    }
+    
+    // Without the table a block's size is unknown: any block but the top one
+    // moves, copying what lies between it and the bump pointer (all of it heap)
+    size_t old_size = heap_offset - offset;
+    int known_size = 0;
+    uint32_t alloc_id = 0;
+#ifndef HEAP_HEADLESS
+    block_info_t* entry = find_allocation(offset);
+    if (entry) {
+        old_size = entry->size;
+        known_size = 1;
+        alloc_id = entry->allocation_id;
+    }
+#endif
+    
+    int kind;
+    if (offset == top_offset) {
+        if (offset + aligned_size > stats.total_size) {
+            common_add_log(&event_log, &stats, LOG_REALLOC, alloc_id, size, offset, 0);
+            return NULL;
+        }
+        kind = aligned_size > heap_offset - offset ? REALLOC_GREW :
+               aligned_size < heap_offset - offset ? REALLOC_SHRUNK : REALLOC_SAME;
+        heap_offset = offset + aligned_size;
+#ifndef HEAP_HEADLESS
+        if (entry) {
+            common_lifetime_resize(&lifetimes, entry->requested_size, size, entry->timestamp,
+                                   stats.timestamp_counter);
+            entry->size = aligned_size;
+            entry->requested_size = size;
+        }
+        update_free_tail();
+#endif
+    } else if (known_size && aligned_size <= old_size) {
+        kind = REALLOC_SAME;
+#ifndef HEAP_HEADLESS
+        if (entry) {
+            common_lifetime_resize(&lifetimes, entry->requested_size, size, entry->timestamp,
+                                   stats.timestamp_counter);
+            entry->requested_size = size;
+        }
+#endif
+    } else {
+        void* moved = allocate_block(size);
+        if (!moved) {
+            common_add_log(&event_log, &stats, LOG_REALLOC, alloc_id, size, offset, 0);
+            return NULL;
+        }
+        memcpy(moved, ptr, old_size < size ? old_size : size);
+        release_block(ptr);
+        common_log_event(&event_log, &stats, LOG_REALLOC, stats.next_allocation_id - 1, size, top_offset, 1, 0,
+                         REALLOC_MOVED);
+        return moved;
+    }
+    
+    common_log_event(&event_log, &stats, LOG_REALLOC, alloc_id, size, offset, 1, 0, (uint8_t)kind);
+    update_stats();
+    return ptr;
+}
+
+void heap_free(void* ptr) {
+    if (!ptr) {
+        heap_version++;
+        return;
+    }
+    
+    common_profile_begin(&profile, PROFILE_OP_FREE);
+    release_block(ptr);
+    common_profile_end(&profile);
+}
+
+// Resize the block at `ptr`; NULL `ptr` allocates and size 0 frees (which
+// heap_1 ignores). Returns NULL, leaving the block alone, on failure.
+void* heap_realloc(void* ptr, size_t size) {
+    common_profile_begin(&profile, PROFILE_OP_REALLOC);
+    void* result = reallocate_block(ptr, size);
+    common_profile_end(&profile);
+    return result;
+}
+
+// Open a scope: everything allocated from here on is freed at once by
+// heap_release() with the returned mark. Scopes nest; returns 0 if
+// MAX_SCOPES are already open.
+int heap_mark() {
+    if (scope_depth == MAX_SCOPES) return 0;
+    
+    scope_t* scope = &scopes[scope_depth++];
+    scope->heap_offset = heap_offset;
+    scope->top_offset = top_offset;
+    scope->allocated_entries = allocated_entries;
+    scope->allocations = stats.allocation_count;
+    scope->live_bytes = lifetimes.live_bytes;
+    
+    // A block from before the mark must not grow into the scope in place;
+    // reallocating one moves it into the scope, and it is released with it
+    top_offset = NO_TOP;
+    return scope_depth;
+}
+
+// Free everything allocated since heap_mark() returned `mark`, closing that
+// scope and any opened inside it. O(1): the bump pointer and the table length
+// are rolled back. Returns 0, or -1 if `mark` is not an open scope.
+int heap_release(int mark) {
+    heap_version++;
+    
+    if (mark < 1 || mark > scope_depth) {
+        common_add_log(&event_log, &stats, LOG_RELEASE, 0, 0, 0, 0);
+        return -1;
+    }
+    
+    const scope_t* scope = &scopes[mark - 1];
+    size_t released = heap_offset - scope->heap_offset;
+    scope_depth = mark - 1;
+    heap_offset = scope->heap_offset;
+    top_offset = scope->top_offset;
+    allocated_entries = scope->allocated_entries;
+    stats.allocation_count = scope->allocations;
+    common_lifetime_rollback(&lifetimes, scope->live_bytes, stats.timestamp_counter);
+    
+#ifndef HEAP_HEADLESS
+    // Entries past the scope's are exactly its allocations
+    int has_tail = allocation_count > 0 && allocations[0].state == BLOCK_FREE;
+    allocation_count = allocated_entries + has_tail;
+    update_free_tail();
+#endif
+    
+    common_add_log(&event_log, &stats, LOG_RELEASE, 0, released, heap_offset, 1);
+    update_stats();
+    return 0;
+}
+
 void heap_reset() {
-    heap_init(stats.total_size);
+    heap_init(stats.total_size, 0);
+}
+
+// 0 (the only region) if heap_malloc(size) would succeed now, -1 if it would fail
+int heap_can_allocate(size_t size) {
+    return heap_offset + ((size + 7) & ~7) <= stats.total_size ? 0 : -1;
+}
+
+static void* run_op_malloc(size_t size, uint8_t flags) {
+    (void)flags;
+    return heap_malloc(size);
+}
+
+int heap_run_ops(const op_t* ops, int n, uint32_t* out_ptrs) {
+    return common_run_ops(ops, n, out_ptrs, run_op_malloc, heap_free);
+}
+
+// Fill `ops` with a synthetic workload for heap_run_ops; the heap is not touched
+int heap_generate_ops(const workload_config_t* config, op_t* ops, int capacity) {
+    return common_workload_generate(config, ops, capacity);
+}
+
+// Write a checkpoint of the heap to `buf` (NULL measures); returns its size,
+// and only wrote it if that is <= capacity. Only the bytes handed out so far
+// are saved, so a checkpoint grows with heap_offset rather than the heap.
+size_t heap_snapshot(void* buf, size_t capacity) {
+    checkpoint_writer_t w;
+    common_checkpoint_begin(&w, buf, capacity, 1);
+    common_checkpoint_put_value(&w, stats);
+    common_checkpoint_put_log(&w, &event_log);
+    common_checkpoint_put_value(&w, heap_offset);
+    common_checkpoint_put_value(&w, top_offset);
+    common_checkpoint_put_value(&w, allocated_entries);
+    common_checkpoint_put_value(&w, scope_depth);
+    common_checkpoint_put(&w, scopes, (size_t)scope_depth * sizeof(scope_t));
+#ifndef HEAP_HEADLESS
+    common_checkpoint_put_value(&w, allocation_limit);
+    common_checkpoint_put_value(&w, allocation_count);
+    common_checkpoint_put(&w, allocations, (size_t)allocation_count * sizeof(block_info_t));
+#endif
+    common_checkpoint_put(&w, heap_memory, heap_offset);
+    return common_checkpoint_end(&w);
+}
+
+// Put the heap back as heap_snapshot() saw it; returns 0, or -1 if `buf` is
+// not a checkpoint of this module (the heap is left alone) or is truncated
+// inside (the heap is re-initialised empty)
+int heap_restore(const void* buf, size_t size) {
+    checkpoint_reader_t r;
+    if (!common_checkpoint_open(&r, buf, size, 1)) return -1;
+    heap_version++;
+    
+    common_checkpoint_get_value(&r, stats);
+    common_checkpoint_get_log(&r, &event_log);
+    common_checkpoint_get_value(&r, heap_offset);
+    common_checkpoint_get_value(&r, top_offset);
+    common_checkpoint_get_value(&r, allocated_entries);
+    common_checkpoint_get_value(&r, scope_depth);
+    if (scope_depth < 0 || scope_depth > MAX_SCOPES) r.ok = 0;
+    common_checkpoint_get(&r, scopes, (size_t)scope_depth * sizeof(scope_t));
+#ifndef HEAP_HEADLESS
+    common_checkpoint_get_value(&r, allocation_limit);
+    common_checkpoint_get_value(&r, allocation_count);
+    if (allocation_count < 0 || allocation_count > allocation_limit ||
+        !common_grow((void**)&allocations, &allocation_capacity, allocation_count, sizeof(block_info_t))) {
+        r.ok = 0;
+    }
+    common_checkpoint_get(&r, allocations, (size_t)allocation_count * sizeof(block_info_t));
+#endif
+    
+    if (r.ok && common_arena_reserve(&arena, stats.total_size) < stats.total_size) r.ok = 0;
+    heap_memory = arena.base;
+    if (!r.ok || heap_offset > stats.total_size || !common_checkpoint_get(&r, heap_memory, heap_offset)) {
+        heap_init(DEFAULT_HEAP_SIZE, 0);
+        return -1;
+    }
+    return 0;
 }
 
 heap_stats_t* get_heap_stats() {
+    stats.metadata_bytes = common_metadata_bytes(NULL, &block_table, &event_log, NULL) +
+                           (size_t)allocation_capacity * sizeof(block_info_t);
     return &stats;
 }
 
+// Headless builds rebuild the table before it is read
 int get_allocation_count() {
+    refresh_snapshot();
     return allocation_count;
 }
 
 block_info_t* get_allocation_info(int index) {
+    refresh_snapshot();
     if (index >= 0 && index < allocation_count) {
         return &allocations[index];
     }
     return NULL;
 }
 
+// Structure-of-arrays snapshot of allocations[] for zero-copy reads from JS,
+// in address order (the free tail, entry 0, goes last)
+uint32_t* get_block_table_ptr() {
+    refresh_snapshot();
+    if (common_block_table_current(&block_table, heap_version)) return block_table.words;
+    
+    int length = common_block_table_begin(&block_table, allocation_count, allocation_capacity, heap_version);
+    int tail = allocation_count > 0 && allocations[0].state == BLOCK_FREE ? 1 : 0;
+    for (int i = 0; i < length; i++) {
+        common_block_table_set(&block_table, i, &allocations[(i + tail) % allocation_count]);
+    }
+    if (common_block_table_current(&block_table, heap_version)) common_block_table_end(&block_table);
+    return block_table.words;
+}
+
+int get_block_table_len() {
+    refresh_snapshot();
+    return allocation_count;
+}
+
+uint32_t get_heap_version() {
+    return heap_version;
+}
+
 int get_log_count() {
-    return log_count;
+    return (int)event_log.count;
 }
 
 log_entry_t* get_log_entry(int index) {
-    if (index >= 0 && index < log_count) {
-        return &logs[index];
-    }
-    return NULL;
+    return common_log_at(&event_log, index);
+}
+
+// Copy events with seq > `seq` into `out`, oldest first; returns the number copied
+int get_log_since(uint32_t seq, log_entry_t* out, int max) {
+    return common_log_since(&event_log, seq, out, max);
+}
+
+// Events overwritten before they could be read
+uint32_t get_log_lost() {
+    return event_log.lost;
 }
 
 void clear_log() {
-    log_count = 0;
+    heap_version++;
+    common_log_clear(&event_log);
 }
 
 size_t get_heap_offset() {
     return heap_offset;
+}
+
+// Log2 histogram of `op_kind` latencies in ns (PROFILE_BUCKETS words into
+// `out`); returns the number of calls recorded
+int get_latency_histogram(int op_kind, uint32_t* out) {
+    return common_profile_histogram(&profile, op_kind, PROFILE_NS, out);
+}
+
+// The same for any profile_metric_t, e.g. free-list nodes visited
+int get_op_histogram(int op_kind, int metric, uint32_t* out) {
+    return common_profile_histogram(&profile, op_kind, metric, out);
+}
+
+// Worst case of `metric` over every recorded `op_kind` call
+uint32_t get_op_max(int op_kind, int metric) {
+    return common_profile_max(&profile, op_kind, metric);
+}
+
+void reset_op_profile() {
+    common_profile_clear(&profile);
+}
+
+// Size-class counts and the live-bytes timeline since heap_init
+lifetime_profile_t* get_lifetime_profile() {
+    return &lifetimes;
 }
\ No newline at end of file
@@ -2,112 +2,97 @@
 
 // Free block structure for linked list
 typedef struct free_block {
-    size_t size;
+    heap_header_t size;
     struct free_block* next;
 } free_block_t;
 
 // Global state
-static uint8_t heap_memory[MAX_HEAP_SIZE];
-static block_info_t blocks[MAX_BLOCKS];
-static log_entry_t logs[MAX_LOG_ENTRIES];
+static heap_arena_t arena;
+static uint8_t* heap_memory = NULL;
+static block_list_t shadow;
+static log_ring_t event_log;
 static heap_stats_t stats;
+static stats_tracker_t tracker;
 static free_block_t* free_list = NULL;
-static int block_count = 0;
-static int log_count = 0;
+static uint32_t heap_version = 0;
+static block_table_t block_table;
+static op_profile_t profile;
+static lifetime_profile_t lifetimes;
+#ifdef HEAP_HEADLESS
+static uint32_t snapshot_version = 0;
+static free_block_t** snapshot_free = NULL;    // Free list sorted by address
+static int snapshot_free_capacity = 0;
+#endif
 
-static void add_log(const char* action, uint32_t alloc_id, size_t size, size_t offset, int success) {
-    if (log_count >= MAX_LOG_ENTRIES) return;
-    
-    log_entry_t* entry = &logs[log_count++];
-    strncpy(entry->action, action, sizeof(entry->action) - 1);
-    entry->action[sizeof(entry->action) - 1] = '\0';
-    entry->allocation_id = alloc_id;
-    entry->size = size;
-    entry->offset = offset;
-    entry->success = success;
-    entry->timestamp = stats.timestamp_counter++;
-}
+// Use common utility functions
+#define add_log(action, alloc_id, size, offset, success) \
+    common_add_log(&event_log, &stats, action, alloc_id, size, offset, success)
 
+// Stats are maintained incrementally; this only derives the O(1) summary fields
 static void update_stats() {
-    stats.allocated_bytes = 0;
-    stats.free_bytes = 0;
-    stats.allocation_count = 0;
-    stats.free_block_count = 0;
-    stats.largest_free_block = 0;
-    stats.smallest_free_block = stats.total_size;
-    
-    size_t total_requested = 0;
-    size_t total_allocated = 0;
-    int has_free_blocks = 0;
-    
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].state == BLOCK_ALLOCATED) {
-            stats.allocated_bytes += blocks[i].size;
-            stats.allocation_count++;
-            
-            // Track for internal fragmentation
-            if (blocks[i].requested_size > 0) {
-                total_requested += blocks[i].requested_size;
-                total_allocated += blocks[i].size;
-            }
-        } else if (blocks[i].state == BLOCK_FREE || blocks[i].state == BLOCK_FREED) {
-            // Both FREE and FREED count as free memory
-            stats.free_bytes += blocks[i].size;
-            stats.free_block_count++;
-            has_free_blocks = 1;
-            
-            if (blocks[i].size > stats.largest_free_block) {
-                stats.largest_free_block = blocks[i].size;
-            }
-            if (blocks[i].size < stats.smallest_free_block) {
-                stats.smallest_free_block = blocks[i].size;
-            }
-        }
-    }
-    
-    // Calculate external fragmentation
-    if (stats.free_bytes > 0 && stats.largest_free_block > 0) {
-        stats.external_fragmentation = (1.0f - (float)stats.largest_free_block / (float)stats.free_bytes) * 100.0f;
-    } else {
-        stats.external_fragmentation = 0.0f;
-    }
-    
-    // Calculate internal fragmentation
-    if (total_allocated > 0 && total_requested > 0) {
-        stats.internal_fragmentation = ((float)(total_allocated - total_requested) / (float)total_allocated) * 100.0f;
-    } else {
-        stats.internal_fragmentation = 0.0f;
-    }
-    
-    // Update minimum free bytes
-    if (stats.min_free_bytes == 0 || stats.free_bytes < stats.min_free_bytes) {
-        stats.min_free_bytes = stats.free_bytes;
-    }
+    common_stats_finish(&stats, &tracker);
+    COMMON_VERIFY_STATS(&shadow, -1, &stats, "heap_2");
+}
+
+// Cut `block` down to `total_size` and put the rest on the free list
+static void split_free_block(free_block_t* block, size_t total_size) {
+    free_block_t* remainder = (free_block_t*)((uint8_t*)block + total_size);
+    remainder->size = block->size - total_size;
+    remainder->next = free_list;
+    free_list = remainder;
+    block->size = total_size;
     
-    // If no free blocks, reset smallest
-    if (!has_free_blocks) {
-        stats.smallest_free_block = 0;
-    }
+    common_stats_add_free(&stats, &tracker, remainder->size);
+    common_profile_count(&profile, PROFILE_SPLITS, 1);
 }
 
-static void sort_blocks() {
-    for (int i = 0; i < block_count - 1; i++) {
-        for (int j = i + 1; j < block_count; j++) {
-            if (blocks[i].offset > blocks[j].offset) {
-                block_info_t temp = blocks[i];
-                blocks[i] = blocks[j];
-                blocks[j] = temp;
-            }
+#ifdef HEAP_HEADLESS
+// Rebuild the block list by walking the heap. A block is free when it is the
+// next free-list node in address order; otherwise its header holds its size.
+static void refresh_snapshot(void) {
+    if (!common_snapshot_begin(&shadow, &snapshot_version, heap_version)) return;
+    
+    int free_count = 0;
+    for (free_block_t* node = free_list; node; node = node->next) {
+        if (!common_grow((void**)&snapshot_free, &snapshot_free_capacity, free_count + 1,
+                         sizeof(free_block_t*))) {
+            break;
         }
+        snapshot_free[free_count++] = node;
     }
+    if (free_count > 1) qsort(snapshot_free, (size_t)free_count, sizeof(free_block_t*), common_ptr_compare);
+    
+    int next_free = 0;
+    size_t offset = 0;
+    while (offset < stats.total_size) {
+        free_block_t* block = (free_block_t*)(heap_memory + offset);
+        int is_free = next_free < free_count && snapshot_free[next_free] == block;
+        size_t size = is_free ? block->size : block->size + HEAP_HEADER_SIZE;
+        if (size == 0 || size > stats.total_size - offset) break;
+        
+        next_free += is_free;
+        common_snapshot_add(&shadow, 0, offset, size, is_free ? BLOCK_FREE : BLOCK_ALLOCATED);
+        offset += size;
+    }
+    heap_stats_t* all = &stats;
+    common_snapshot_stats(&block_table, &shadow, heap_version, &all, 1);
 }
+#else
+static inline void refresh_snapshot(void) {}
+#endif
 
 // Exported functions
-void heap_init(size_t size) {
+
+// `size` bytes of heap and room for `max_blocks` shadow entries (0 keeps the
+// current capacity)
+void heap_init(size_t size, size_t max_blocks) {
+    heap_version++;
+    
     memset(&stats, 0, sizeof(stats));
-    stats.total_size = size > MAX_HEAP_SIZE ? MAX_HEAP_SIZE : size;
+    stats.total_size = common_align_down(common_arena_reserve(&arena, common_heap_size(size)));
     stats.next_allocation_id = 1;
     stats.min_free_bytes = stats.total_size;
+    heap_memory = arena.base;
     
     // Initialize with one large free block
     free_list = (free_block_t*)heap_memory;
@@ -115,30 +100,47 @@ void heap_init(size_t size) {
     free_list->next = NULL;
     
     // Initialize block tracking
-    block_count = 1;
-    blocks[0].offset = 0;
-    blocks[0].size = stats.total_size;
-    blocks[0].state = BLOCK_FREE;
-    blocks[0].allocation_id = 0;
-    blocks[0].timestamp = stats.timestamp_counter++;
-    blocks[0].requested_size = 0;
-    
-    log_count = 0;
+#ifndef HEAP_HEADLESS
+    common_blocks_init(&shadow, common_block_limit(stats.total_size, max_blocks, shadow.limit));
+    block_info_t whole = {
+        .offset = 0,
+        .size = stats.total_size,
+        .state = BLOCK_FREE,
+        .allocation_id = 0,
+        .timestamp = stats.timestamp_counter++,
+        .requested_size = 0,
+        .region_id = 0
+    };
+    common_blocks_append(&shadow, &whole);
+#else
+    (void)max_blocks;
+#endif
+    
+    common_stats_reset(&stats, &tracker);
+    common_stats_add_free(&stats, &tracker, stats.total_size);
+    
+    common_log_init(&event_log, stats.total_size);
+    common_profile_clear(&profile);
+    common_lifetime_clear(&lifetimes);
     update_stats();
-    add_log("INIT", 0, size, 0, 1);
+    add_log(LOG_INIT, 0, size, 0, 1);
 }
 
-void* heap_malloc(size_t size) {
+static void* allocate_block(size_t size) {
+    heap_version++;
+    
     size_t requested_size = size;
     
-    // Align to 8 bytes and add header size
-    size_t aligned_size = (size + 7) & ~7;
-    size_t total_size = aligned_size + sizeof(size_t);
+    // Round to the layout's alignment and add the header; a freed block must
+    // be able to hold its free-list node
+    size_t total_size = common_block_total(size);
+    if (total_size < sizeof(free_block_t)) total_size = sizeof(free_block_t);
     
     // Find best fit
     free_block_t** current = &free_list;
     free_block_t* best_fit = NULL;
     free_block_t** best_prev = NULL;
+    uint32_t visited = 0;
     
     while (*current) {
         if ((*current)->size >= total_size) {
@@ -148,90 +150,113 @@ void* heap_malloc(size_t size) {
             }
         }
         current = &((*current)->next);
+        visited++;
     }
+    common_profile_count(&profile, PROFILE_VISITED, visited);
     
     if (!best_fit) {
-        add_log("MALLOC", stats.next_allocation_id, size, 0, 0);
+        add_log(LOG_MALLOC, stats.next_allocation_id, size, 0, 0);
         return NULL;
     }
     
     // Remove from free list
     *best_prev = best_fit->next;
     
-    // Store allocation size at the beginning
-    *(size_t*)best_fit = aligned_size;
-    void* user_ptr = (uint8_t*)best_fit + sizeof(size_t);
-    
+    void* user_ptr = common_block_payload(best_fit);
     size_t offset = (uint8_t*)best_fit - heap_memory;
     
+#ifndef HEAP_HEADLESS
     // Update block tracking
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].offset == offset && (blocks[i].state == BLOCK_FREE || blocks[i].state == BLOCK_FREED)) {
-            size_t original_block_size = blocks[i].size;
+    int i = common_blocks_find(&shadow, 0, offset);
+    block_info_t* block = i != NO_SLOT ? &shadow.blocks[i] : NULL;
+    if (block && (block->state == BLOCK_FREE || block->state == BLOCK_FREED)) {
+        size_t original_block_size = block->size;
+        common_stats_remove_free(&stats, &tracker, original_block_size);
+        
+        // Only split if remainder is large enough to be useful
+        if (common_split_fits(original_block_size, total_size, sizeof(free_block_t))) {
+            // Split the block; the remainder is linked in right after it
+            block_info_t rest = {
+                .offset = offset + total_size,
+                .size = original_block_size - total_size,
+                .state = block->state, // Preserve FREE or FREED state
+                .allocation_id = 0,
+                .timestamp = stats.timestamp_counter,
+                .requested_size = 0,
+                .region_id = 0
+            };
             
-            // Only split if remainder is large enough to be useful
-            if (original_block_size > total_size + sizeof(free_block_t) + 16) {
-                // Split the block
-                if (block_count < MAX_BLOCKS) {
-                    blocks[block_count].offset = offset + total_size;
-                    blocks[block_count].size = original_block_size - total_size;
-                    blocks[block_count].state = blocks[i].state; // Preserve FREE or FREED state
-                    blocks[block_count].allocation_id = 0;
-                    blocks[block_count].timestamp = stats.timestamp_counter++;
-                    blocks[block_count].requested_size = 0;
-                    
-                    // Add remainder to free list
-                    free_block_t* remainder = (free_block_t*)(heap_memory + offset + total_size);
-                    remainder->size = blocks[block_count].size;
-                    remainder->next = free_list;
-                    free_list = remainder;
-                    
-                    block_count++;
-                    
-                    // Update current block to exact size
-                    blocks[i].size = total_size;
-                }
+            // Inserting may grow the slot pool, so `block` is re-read after it
+            int rest_slot = common_blocks_insert_after(&shadow, i, &rest);
+            block = &shadow.blocks[i];
+            if (rest_slot != NO_SLOT) {
+                stats.timestamp_counter++;
+                split_free_block(best_fit, total_size);
+                
+                // Update current block to exact size
+                block->size = total_size;
             }
-            // If not splitting, allocate the ENTIRE block (no else needed, size stays original)
-            
-            // Update block state
-            blocks[i].state = BLOCK_ALLOCATED;
-            blocks[i].allocation_id = stats.next_allocation_id;
-            blocks[i].timestamp = stats.timestamp_counter++;
-            blocks[i].requested_size = requested_size;
-            break;
         }
+        // If not splitting, allocate the ENTIRE block (no else needed, size stays original)
+        
+        // Update block state
+        block->state = BLOCK_ALLOCATED;
+        block->allocation_id = stats.next_allocation_id;
+        block->timestamp = stats.timestamp_counter++;
+        block->requested_size = requested_size;
+        common_stats_add_alloc(&stats, &tracker, block->size, requested_size);
+        common_lifetime_alloc(&lifetimes, requested_size, stats.timestamp_counter);
     }
+#else
+    (void)requested_size;
+    common_stats_remove_free(&stats, &tracker, best_fit->size);
+    if (common_split_fits(best_fit->size, total_size, sizeof(free_block_t))) {
+        split_free_block(best_fit, total_size);
+    }
+    common_stats_add_alloc(&stats, &tracker, best_fit->size, 0);
+#endif
+    
+    // The header records everything the block spans, so an unsplit block is
+    // returned whole when it is freed
+    best_fit->size -= HEAP_HEADER_SIZE;
     
-    add_log("MALLOC", stats.next_allocation_id, size, offset, 1);
+    add_log(LOG_MALLOC, stats.next_allocation_id, size, offset, 1);
     stats.next_allocation_id++;
     
-    sort_blocks();
     update_stats();
     return user_ptr;
 }
 
-void heap_free(void* ptr) {
+static void release_block(void* ptr) {
+    heap_version++;
+    
     if (!ptr) return;
     
     // Get the actual block start and size
-    size_t* block_start = (size_t*)ptr - 1;
+    heap_header_t* block_start = common_block_header(ptr);
     size_t user_size = *block_start;
-    size_t total_size = user_size + sizeof(size_t);
+    size_t total_size = user_size + HEAP_HEADER_SIZE;
     size_t offset = (uint8_t*)block_start - heap_memory;
     
     uint32_t alloc_id = 0;
     
+#ifndef HEAP_HEADLESS
     // Find and update block - mark as FREED not FREE
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].offset == offset && blocks[i].state == BLOCK_ALLOCATED) {
-            blocks[i].state = BLOCK_FREED;  // Mark as FREED for visualization
-            alloc_id = blocks[i].allocation_id;
-            blocks[i].allocation_id = 0;
-            blocks[i].requested_size = 0;  // Clear requested size
-            break;
-        }
+    int i = common_blocks_find(&shadow, 0, offset);
+    if (i != NO_SLOT && shadow.blocks[i].state == BLOCK_ALLOCATED) {
+        block_info_t* block = &shadow.blocks[i];
+        common_stats_remove_alloc(&stats, &tracker, block->size, block->requested_size);
+        common_lifetime_free(&lifetimes, block->requested_size, block->timestamp, stats.timestamp_counter);
+        common_stats_add_free(&stats, &tracker, block->size);
+        block->state = BLOCK_FREED;  // Mark as FREED for visualization
+        alloc_id = block->allocation_id;
+        block->allocation_id = 0;
+        block->requested_size = 0;  // Clear requested size
     }
+#else
+    common_stats_remove_alloc(&stats, &tracker, total_size, 0);
+    common_stats_add_free(&stats, &tracker, total_size);
+#endif
     
     // Add to free list (heap_2 doesn't coalesce)
     free_block_t* free_block = (free_block_t*)block_start;
@@ -239,42 +264,281 @@ void heap_free(void* ptr) {
     free_block->next = free_list;
     free_list = free_block;
     
-    add_log("FREE", alloc_id, 0, offset, 1);
-    sort_blocks();
+    add_log(LOG_FREE, alloc_id, 0, offset, 1);
     update_stats();
 }
 
+// heap_2 never merges blocks, so a block can only shrink in place: the tail
+// is split off onto the free list. Growing always moves.
+static void* reallocate_block(void* ptr, size_t size) {
+    if (!ptr) return allocate_block(size);
+    if (size == 0) {
+        release_block(ptr);
+        return NULL;
+    }
+    
+    heap_version++;
+    
+    heap_header_t* block_start = common_block_header(ptr);
+    size_t current = *block_start + HEAP_HEADER_SIZE;
+    size_t offset = (uint8_t*)block_start - heap_memory;
+    size_t total_size = common_block_total(size);
+    if (total_size < sizeof(free_block_t)) total_size = sizeof(free_block_t);
+    uint32_t alloc_id = 0;
+    
+#ifndef HEAP_HEADLESS
+    int i = common_blocks_find(&shadow, 0, offset);
+    if (i == NO_SLOT || shadow.blocks[i].state != BLOCK_ALLOCATED) {
+        add_log(LOG_REALLOC, 0, size, offset, 0);
+        return NULL;
+    }
+    block_info_t* block = &shadow.blocks[i];
+    alloc_id = block->allocation_id;
+    current = block->size;
+#else
+    if ((uint8_t*)ptr < heap_memory + HEAP_HEADER_SIZE || offset >= stats.total_size) {
+        add_log(LOG_REALLOC, 0, size, offset, 0);
+        return NULL;
+    }
+#endif
+    
+    if (total_size <= current) {
+        int kind = REALLOC_SAME;
+        size_t final_size = current;
+        
+#ifndef HEAP_HEADLESS
+        common_stats_remove_alloc(&stats, &tracker, current, block->requested_size);
+        if (common_split_fits(current, total_size, sizeof(free_block_t))) {
+            block_info_t rest = {
+                .offset = offset + total_size,
+                .size = current - total_size,
+                .state = BLOCK_FREED,
+                .allocation_id = 0,
+                .timestamp = stats.timestamp_counter,
+                .requested_size = 0,
+                .region_id = 0
+            };
+            int rest_slot = common_blocks_insert_after(&shadow, i, &rest);
+            block = &shadow.blocks[i];
+            if (rest_slot != NO_SLOT) {
+                stats.timestamp_counter++;
+                final_size = total_size;
+            }
+        }
+        common_lifetime_resize(&lifetimes, block->requested_size, size, block->timestamp, stats.timestamp_counter);
+        block->size = final_size;
+        block->requested_size = size;
+        common_stats_add_alloc(&stats, &tracker, final_size, size);
+#else
+        common_stats_remove_alloc(&stats, &tracker, current, 0);
+        if (common_split_fits(current, total_size, sizeof(free_block_t))) final_size = total_size;
+        common_stats_add_alloc(&stats, &tracker, final_size, 0);
+#endif
+        
+        if (final_size < current) {
+            free_block_t* head = (free_block_t*)block_start;
+            head->size = current;
+            split_free_block(head, total_size);
+            kind = REALLOC_SHRUNK;
+        }
+        *block_start = final_size - HEAP_HEADER_SIZE;
+        
+        common_log_event(&event_log, &stats, LOG_REALLOC, alloc_id, size, offset, 1, 0, (uint8_t)kind);
+        update_stats();
+        return ptr;
+    }
+    
+    void* moved = allocate_block(size);
+    if (!moved) {
+        add_log(LOG_REALLOC, alloc_id, size, offset, 0);
+        return NULL;
+    }
+    memcpy(moved, ptr, *block_start);
+    release_block(ptr);
+    
+    size_t moved_offset = (uint8_t*)moved - HEAP_HEADER_SIZE - heap_memory;
+    common_log_event(&event_log, &stats, LOG_REALLOC, stats.next_allocation_id - 1, size, moved_offset, 1, 0,
+                     REALLOC_MOVED);
+    return moved;
+}
+
+void* heap_malloc(size_t size) {
+    common_profile_begin(&profile, PROFILE_OP_MALLOC);
+    void* ptr = allocate_block(size);
+    common_profile_end(&profile);
+    return ptr;
+}
+
+void heap_free(void* ptr) {
+    common_profile_begin(&profile, PROFILE_OP_FREE);
+    release_block(ptr);
+    common_profile_end(&profile);
+}
+
+// Resize the block at `ptr`, in place when it shrinks; NULL `ptr` allocates
+// and size 0 frees. Returns NULL (leaving the block alone) if it cannot be resized.
+void* heap_realloc(void* ptr, size_t size) {
+    common_profile_begin(&profile, PROFILE_OP_REALLOC);
+    void* result = reallocate_block(ptr, size);
+    common_profile_end(&profile);
+    return result;
+}
+
 void heap_reset() {
-    heap_init(stats.total_size);
+    heap_init(stats.total_size, 0);
+}
+
+// 0 (the only region) if heap_malloc(size) would find a block now, -1 if not;
+// O(log free blocks), or O(1) from the histogram in headless builds
+int heap_can_allocate(size_t size) {
+    size_t total_size = common_block_total(size);
+    if (total_size < sizeof(free_block_t)) total_size = sizeof(free_block_t);
+    return common_free_fit(&stats, &tracker, total_size) ? 0 : -1;
+}
+
+static void* run_op_malloc(size_t size, uint8_t flags) {
+    (void)flags;
+    return heap_malloc(size);
+}
+
+int heap_run_ops(const op_t* ops, int n, uint32_t* out_ptrs) {
+    return common_run_ops(ops, n, out_ptrs, run_op_malloc, heap_free);
+}
+
+// Fill `ops` with a synthetic workload for heap_run_ops; the heap is not touched
+int heap_generate_ops(const workload_config_t* config, op_t* ops, int capacity) {
+    return common_workload_generate(config, ops, capacity);
+}
+
+// Write a checkpoint of the heap to `buf` (NULL measures); returns its size,
+// and only wrote it if that is <= capacity
+size_t heap_snapshot(void* buf, size_t capacity) {
+    checkpoint_writer_t w;
+    common_checkpoint_begin(&w, buf, capacity, 2);
+    common_checkpoint_put_stats(&w, &stats, &tracker);
+    common_checkpoint_put_log(&w, &event_log);
+#ifndef HEAP_HEADLESS
+    common_checkpoint_put_blocks(&w, &shadow, NO_SLOT);
+#endif
+    
+    uintptr_t head = common_checkpoint_offset(free_list, heap_memory);
+    common_checkpoint_put_value(&w, head);
+    uint8_t* image = common_checkpoint_put(&w, heap_memory, stats.total_size);
+    for (free_block_t* block = image ? free_list : NULL; block; block = block->next) {
+        common_checkpoint_pack(image, (uint8_t*)&block->next - heap_memory, block->next, heap_memory);
+    }
+    return common_checkpoint_end(&w);
+}
+
+// Put the heap back as heap_snapshot() saw it; returns 0, or -1 if `buf` is
+// not a checkpoint of this module (the heap is left alone) or is truncated
+// inside (the heap is re-initialised empty)
+int heap_restore(const void* buf, size_t size) {
+    checkpoint_reader_t r;
+    if (!common_checkpoint_open(&r, buf, size, 2)) return -1;
+    heap_version++;
+    
+    common_checkpoint_get_stats(&r, &stats, &tracker);
+    common_checkpoint_get_log(&r, &event_log);
+#ifndef HEAP_HEADLESS
+    common_checkpoint_get_blocks(&r, &shadow);
+#endif
+    
+    uintptr_t head = 0;
+    common_checkpoint_get_value(&r, head);
+    if (r.ok && common_arena_reserve(&arena, stats.total_size) < stats.total_size) r.ok = 0;
+    heap_memory = arena.base;
+    if (!r.ok || !common_checkpoint_get(&r, heap_memory, stats.total_size)) {
+        heap_init(DEFAULT_HEAP_SIZE, 0);
+        return -1;
+    }
+    
+    free_list = (free_block_t*)common_checkpoint_pointer(head, heap_memory);
+    for (free_block_t* block = free_list; block; block = block->next) {
+        block->next = (free_block_t*)common_checkpoint_pointer((uintptr_t)block->next, heap_memory);
+    }
+    update_stats();
+    return 0;
 }
 
 // Query functions for JavaScript
+// Headless builds rebuild the block list and stats before they are read
 heap_stats_t* get_heap_stats() {
+    refresh_snapshot();
+    stats.metadata_bytes = common_metadata_bytes(&shadow, &block_table, &event_log, &tracker);
     return &stats;
 }
 
 int get_block_count() {
-    return block_count;
+    refresh_snapshot();
+    return shadow.count;
 }
 
+// Blocks in address order
 block_info_t* get_block_info(int index) {
-    if (index >= 0 && index < block_count) {
-        return &blocks[index];
-    }
-    return NULL;
+    refresh_snapshot();
+    return common_blocks_at(&shadow, index);
+}
+
+// Structure-of-arrays snapshot of the block list for zero-copy reads from JS
+uint32_t* get_block_table_ptr() {
+    refresh_snapshot();
+    return common_block_table_refresh(&block_table, &shadow, heap_version);
+}
+
+int get_block_table_len() {
+    refresh_snapshot();
+    return shadow.count;
+}
+
+uint32_t get_heap_version() {
+    return heap_version;
 }
 
 int get_log_count() {
-    return log_count;
+    return (int)event_log.count;
 }
 
 log_entry_t* get_log_entry(int index) {
-    if (index >= 0 && index < log_count) {
-        return &logs[index];
-    }
-    return NULL;
+    return common_log_at(&event_log, index);
+}
+
+// Copy events with seq > `seq` into `out`, oldest first; returns the number copied
+int get_log_since(uint32_t seq, log_entry_t* out, int max) {
+    return common_log_since(&event_log, seq, out, max);
+}
+
+// Events overwritten before they could be read
+uint32_t get_log_lost() {
+    return event_log.lost;
 }
 
 void clear_log() {
-    log_count = 0;
+    heap_version++;
+    common_log_clear(&event_log);
+}
+
+// Log2 histogram of `op_kind` latencies in ns (PROFILE_BUCKETS words into
+// `out`); returns the number of calls recorded
+int get_latency_histogram(int op_kind, uint32_t* out) {
+    return common_profile_histogram(&profile, op_kind, PROFILE_NS, out);
+}
+
+// The same for any profile_metric_t, e.g. free-list nodes visited
+int get_op_histogram(int op_kind, int metric, uint32_t* out) {
+    return common_profile_histogram(&profile, op_kind, metric, out);
+}
+
+// Worst case of `metric` over every recorded `op_kind` call
+uint32_t get_op_max(int op_kind, int metric) {
+    return common_profile_max(&profile, op_kind, metric);
+}
+
+void reset_op_profile() {
+    common_profile_clear(&profile);
+}
+
+// Size-class churn, block lifetimes and the live-bytes timeline since heap_init
+lifetime_profile_t* get_lifetime_profile() {
+    return &lifetimes;
 }
\ No newline at end of file
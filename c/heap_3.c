@@ -1,6 +1,25 @@
 #include "heap_common.h"
 #include <stdlib.h>
 #include <pthread.h>
+#include <stdatomic.h>
+
+// heap_3 wraps the system allocator. Each thread serves small requests from
+// its own size-class cache and queues its malloc/free events; the global lock
+// is only taken to publish a batch of events into the tracking table, block
+// layout and log. Query functions publish the calling thread's queue first,
+// so a single-threaded caller always sees its own operations.
+//
+// Headless builds keep the caches but drop the tracking table, queues and
+// global lock: each block carries a small header with its size and links on
+// a live list, and stats are a few atomic counters.
+
+#define THREAD_CACHE_MAX_SIZE 256                       // largest cached request
+#define THREAD_CACHE_CLASSES  (THREAD_CACHE_MAX_SIZE / 8)
+#define THREAD_CACHE_DEPTH    16                        // cached blocks per class
+#define THREAD_BATCH          64                        // queued events per publish
+#define ALLOC_TABLE_MIN       1024
+#define NODE_CHUNK_NODES      256                       // tracking nodes per pool chunk
+#define NO_BLOCK              ((size_t)-1)
 
 // Thread safety mutex
 static pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -12,218 +31,897 @@ typedef struct allocation_node {
     size_t requested_size;
     uint32_t id;
     uint32_t timestamp;
-    struct allocation_node* next;
+    size_t block_offset;    // offset in the block list, NO_BLOCK if not shown
+    uint8_t orphan;         // free published before its malloc (cross-thread)
+    struct allocation_node* next;   // pool free list while unused
 } allocation_node_t;
 
-// Global state
-static allocation_node_t* allocation_list = NULL;
-static block_info_t blocks[MAX_BLOCKS];
-static log_entry_t logs[MAX_LOG_ENTRIES];
+// Tracking nodes are carved from fixed chunks that are never returned, so
+// node bookkeeping stops allocating once the pool has grown to the live set
+typedef struct node_chunk {
+    struct node_chunk* next;
+    allocation_node_t nodes[NODE_CHUNK_NODES];
+} node_chunk_t;
+
+typedef enum {
+    EVENT_MALLOC = 0,
+    EVENT_FREE = 1,
+    EVENT_REALLOC = 2       // logged after the MALLOC/FREE pair of a move
+} event_kind_t;
+
+typedef struct {
+    uint8_t kind;           // event_kind_t
+    void* ptr;
+    size_t size;            // EVENT_MALLOC: aligned size
+    size_t requested_size;
+    uint32_t id;
+} thread_event_t;
+
+typedef struct {
+    void* cache[THREAD_CACHE_CLASSES][THREAD_CACHE_DEPTH];
+    int cache_count[THREAD_CACHE_CLASSES];
+    thread_event_t events[THREAD_BATCH];
+    int event_count;
+    uint32_t epoch;         // heap_init generation the queued events belong to
+    int registered;
+#ifdef HEAP_HEADLESS
+    uint32_t shard;         // live list this thread links its blocks into
+#endif
+    op_profile_t profile;   // folded into the shared profile when events are published
+} thread_state_t;
+
+#ifdef HEAP_HEADLESS
+// Aligned like max_align_t, so its size is a multiple of that and user
+// pointers keep the alignment of the malloc'd block (32 bytes on LP64)
+typedef struct block_header {
+    _Alignas(max_align_t) struct block_header* next;    // live list, while the block is handed out
+    struct block_header* prev;
+    uint32_t size;          // aligned size, selects the cache class on free
+    uint32_t shard;
+} block_header_t;
+
+#define BLOCK_HEADER_SIZE sizeof(block_header_t)
+
+// Live blocks are linked so heap_init can give them back to the system. Each
+// thread links into its own shard, so a shard lock is only contended when a
+// block is freed by another thread.
+#define LIVE_SHARDS 16
+
+typedef struct {
+    _Alignas(64) pthread_mutex_t lock;
+    block_header_t* head;
+} live_shard_t;
+#endif
+
+// Global state (guarded by heap_mutex)
+#ifndef HEAP_HEADLESS
+static allocation_node_t** alloc_table = NULL;  // open addressing keyed by ptr
+static size_t alloc_table_capacity = 0;
+static size_t alloc_table_count = 0;
+static node_chunk_t* node_chunks = NULL;
+static allocation_node_t* node_free_list = NULL;
+static size_t node_chunk_count = 0;
+static int free_tail = NO_SLOT;     // the unplaced tail, the layout's only FREE entry
+#else
+static uint32_t snapshot_version = 0;
+#endif
+static block_list_t shadow;
+static log_ring_t event_log;
 static heap_stats_t stats;
-static int block_count = 0;
-static int log_count = 0;
+static stats_tracker_t tracker;
+static block_table_t block_table;
+static op_profile_t profile;
+static lifetime_profile_t lifetimes;
+
+// Lock-free counters, merged into stats when queried
+static atomic_uint next_allocation_id = 1;
+static atomic_uint heap_epoch = 0;
+static atomic_uint heap_version = 0;
+static atomic_uint thread_count = 0;
+#ifdef HEAP_HEADLESS
+static atomic_size_t live_bytes = 0;
+static atomic_uint live_count = 0;
+static live_shard_t live_shards[LIVE_SHARDS];
+#endif
+
+static __thread thread_state_t thread_state;
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
 
 // Use common utility functions
 #define add_log(action, alloc_id, size, offset, success) \
-    common_add_log(logs, &log_count, &stats, action, alloc_id, size, offset, success)
+    common_add_log(&event_log, &stats, action, alloc_id, size, offset, success)
 
+// Stats are maintained incrementally; this only derives the O(1) summary fields
 static void update_stats(void) {
-    common_update_stats(blocks, block_count, &stats);
+    common_stats_finish(&stats, &tracker);
+    COMMON_VERIFY_STATS(&shadow, -1, &stats, "heap_3");
+#ifndef HEAP_HEADLESS
+    stats.metadata_bytes = node_chunk_count * sizeof(node_chunk_t) +
+                           alloc_table_capacity * sizeof(allocation_node_t*) +
+                           atomic_load(&thread_count) * sizeof(thread_state_t);
+#else
+    stats.metadata_bytes = stats.allocation_count * BLOCK_HEADER_SIZE + sizeof(live_shards) +
+                           atomic_load(&thread_count) * sizeof(thread_state_t);
+#endif
+    stats.metadata_bytes += common_metadata_bytes(&shadow, &block_table, &event_log, &tracker);
 }
 
-static allocation_node_t* find_allocation(void* ptr) {
-    allocation_node_t* current = allocation_list;
-    while (current) {
-        if (current->ptr == ptr) {
-            return current;
+#ifndef HEAP_HEADLESS
+// Tracking node pool
+
+static allocation_node_t* node_alloc(void) {
+    if (!node_free_list) {
+        node_chunk_t* chunk = (node_chunk_t*)malloc(sizeof(node_chunk_t));
+        if (!chunk) return NULL;
+
+        chunk->next = node_chunks;
+        node_chunks = chunk;
+        node_chunk_count++;
+        for (int i = NODE_CHUNK_NODES - 1; i >= 0; i--) {
+            chunk->nodes[i].next = node_free_list;
+            node_free_list = &chunk->nodes[i];
         }
-        current = current->next;
+    }
+
+    allocation_node_t* node = node_free_list;
+    node_free_list = node->next;
+    memset(node, 0, sizeof(*node));
+    return node;
+}
+
+static void node_free(allocation_node_t* node) {
+    node->next = node_free_list;
+    node_free_list = node;
+}
+
+// Pointer hash map: linear probing, backward-shift deletion
+
+static inline size_t alloc_slot(const void* ptr, size_t capacity) {
+    uintptr_t h = (uintptr_t)ptr >> 3;
+    h ^= h >> 16;
+    h *= 0x45d9f3bu;
+    h ^= h >> 16;
+    return (size_t)h & (capacity - 1);
+}
+
+static allocation_node_t* find_allocation(void* ptr) {
+    if (alloc_table_count == 0) return NULL;
+
+    size_t slot = alloc_slot(ptr, alloc_table_capacity);
+    while (alloc_table[slot]) {
+        if (alloc_table[slot]->ptr == ptr) return alloc_table[slot];
+        slot = (slot + 1) & (alloc_table_capacity - 1);
     }
     return NULL;
 }
 
-static void remove_allocation(void* ptr) {
-    allocation_node_t** current = &allocation_list;
-    while (*current) {
-        if ((*current)->ptr == ptr) {
-            allocation_node_t* to_remove = *current;
-            *current = (*current)->next;
-            free(to_remove);
-            return;
+static void place_allocation(allocation_node_t** table, size_t capacity, allocation_node_t* node) {
+    size_t slot = alloc_slot(node->ptr, capacity);
+    while (table[slot]) slot = (slot + 1) & (capacity - 1);
+    table[slot] = node;
+}
+
+// Returns 0 if the table could not grow
+static int insert_allocation(allocation_node_t* node) {
+    if ((alloc_table_count + 1) * 10 > alloc_table_capacity * 7) {
+        size_t capacity = alloc_table_capacity ? alloc_table_capacity * 2 : ALLOC_TABLE_MIN;
+        allocation_node_t** table = calloc(capacity, sizeof(allocation_node_t*));
+        if (!table) return 0;
+
+        for (size_t i = 0; i < alloc_table_capacity; i++) {
+            if (alloc_table[i]) place_allocation(table, capacity, alloc_table[i]);
         }
-        current = &(*current)->next;
+        free(alloc_table);
+        alloc_table = table;
+        alloc_table_capacity = capacity;
     }
+
+    place_allocation(alloc_table, alloc_table_capacity, node);
+    alloc_table_count++;
+    return 1;
 }
 
-void heap_init(size_t size) {
+static allocation_node_t* remove_allocation(void* ptr) {
+    if (alloc_table_count == 0) return NULL;
+
+    size_t mask = alloc_table_capacity - 1;
+    size_t slot = alloc_slot(ptr, alloc_table_capacity);
+    while (alloc_table[slot] && alloc_table[slot]->ptr != ptr) slot = (slot + 1) & mask;
+
+    allocation_node_t* node = alloc_table[slot];
+    if (!node) return NULL;
+
+    // Shift later entries of the probe run back into the hole
+    size_t hole = slot;
+    for (size_t next = (slot + 1) & mask; alloc_table[next]; next = (next + 1) & mask) {
+        size_t home = alloc_slot(alloc_table[next]->ptr, alloc_table_capacity);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            alloc_table[hole] = alloc_table[next];
+            hole = next;
+        }
+    }
+    alloc_table[hole] = NULL;
+    alloc_table_count--;
+    return node;
+}
+
+// Simulated memory layout
+//
+// Blocks are placed bump-style from the tail; freed blocks are only marked,
+// so the tail is the one FREE entry and placing a block is O(1).
+
+static size_t place_block(size_t aligned_size, size_t requested_size, uint32_t id) {
+    if (shadow.count >= shadow.limit) return NO_BLOCK;
+    if (free_tail == NO_SLOT || shadow.blocks[free_tail].size < aligned_size) return NO_BLOCK;
+
+    int i = free_tail;
+    size_t original_size = shadow.blocks[i].size;
+    size_t original_offset = shadow.blocks[i].offset;
+    common_stats_remove_free(&stats, &tracker, original_size);
+    free_tail = NO_SLOT;
+
+    // Create remainder free block if significant space left
+    if (original_size > aligned_size + 64) {
+        block_info_t rest = {
+            .offset = original_offset + aligned_size,
+            .size = original_size - aligned_size,
+            .state = BLOCK_FREE,
+            .allocation_id = 0,
+            .timestamp = 0,
+            .requested_size = 0,
+            .region_id = 0
+        };
+        free_tail = common_blocks_insert_after(&shadow, i, &rest);
+    }
+
+    // Create allocated block
+    block_info_t* block = &shadow.blocks[i];
+    block->size = aligned_size;
+    block->state = BLOCK_ALLOCATED;
+    block->allocation_id = id;
+    block->timestamp = stats.timestamp_counter++;
+    block->requested_size = requested_size;
+    common_stats_add_alloc(&stats, &tracker, aligned_size, requested_size);
+    common_lifetime_alloc(&lifetimes, requested_size, stats.timestamp_counter);
+
+    if (free_tail != NO_SLOT) {
+        shadow.blocks[free_tail].timestamp = stats.timestamp_counter++;
+        common_stats_add_free(&stats, &tracker, shadow.blocks[free_tail].size);
+    }
+    return original_offset;
+}
+
+static void release_block(size_t offset) {
+    if (offset == NO_BLOCK) return;
+
+    int i = common_blocks_find(&shadow, 0, offset);
+    if (i != NO_SLOT && shadow.blocks[i].state == BLOCK_ALLOCATED) {
+        block_info_t* block = &shadow.blocks[i];
+        common_stats_remove_alloc(&stats, &tracker, block->size, block->requested_size);
+        common_lifetime_free(&lifetimes, block->requested_size, block->timestamp, stats.timestamp_counter);
+        common_stats_add_free(&stats, &tracker, block->size);
+        block->state = BLOCK_FREED;
+        block->allocation_id = 0;
+        block->requested_size = 0;
+    }
+}
+
+static inline void refresh_snapshot(void) {}
+#else
+// Headless: the system heap cannot be walked, so the layout is one entry for
+// the live bytes followed by the rest of the nominal heap
+static void refresh_snapshot(void) {
     pthread_mutex_lock(&heap_mutex);
     
-    memset(&stats, 0, sizeof(stats));
-    stats.total_size = size;
-    stats.next_allocation_id = 1;
-    stats.min_free_bytes = stats.total_size;
-    
-    // Clear previous allocations
-    while (allocation_list) {
-        allocation_node_t* temp = allocation_list;
-        allocation_list = allocation_list->next;
-        free(temp->ptr);
-        free(temp);
+    uint32_t version = atomic_load_explicit(&heap_version, memory_order_relaxed);
+    if (common_snapshot_begin(&shadow, &snapshot_version, version)) {
+        size_t used = atomic_load_explicit(&live_bytes, memory_order_relaxed);
+        size_t shown = used < stats.total_size ? used : stats.total_size;
+        if (shown > 0) common_snapshot_add(&shadow, 0, 0, shown, BLOCK_ALLOCATED);
+        if (shown < stats.total_size) common_snapshot_add(&shadow, 0, shown, stats.total_size - shown, BLOCK_FREE);
+        
+        heap_stats_t* all = &stats;
+        common_snapshot_stats(&block_table, &shadow, version, &all, 1);
+        stats.allocated_bytes = used;
+        stats.allocation_count = atomic_load_explicit(&live_count, memory_order_relaxed);
+        update_stats();
     }
     
-    block_count = 1;
-    blocks[0].offset = 0;
-    blocks[0].size = stats.total_size;
-    blocks[0].state = BLOCK_FREE;
-    blocks[0].allocation_id = 0;
-    blocks[0].timestamp = stats.timestamp_counter++;
-    blocks[0].requested_size = 0;
-    blocks[0].region_id = 0;
-    
-    log_count = 0;
-    stats.free_block_count = 1;
-    stats.free_bytes = stats.total_size;
-    update_stats();
-    add_log("INIT", 0, size, 0, 1);
-    
     pthread_mutex_unlock(&heap_mutex);
 }
+#endif
 
-void* heap_malloc(size_t size) {
-    pthread_mutex_lock(&heap_mutex);
-    
-    size_t requested_size = size;
-    size_t aligned_size = (size + 7) & ~7;
-    
-    // Thread-safe wrapper: call system malloc
-    void* ptr = malloc(aligned_size);
-    
-    if (ptr) {
-        uint32_t id = stats.next_allocation_id++;
-        
-        // Track allocation in linked list
-        allocation_node_t* node = (allocation_node_t*)malloc(sizeof(allocation_node_t));
+// Per-thread caches and event queues
+
+static inline int cache_class(size_t aligned_size) {
+    if (aligned_size < 8 || aligned_size > THREAD_CACHE_MAX_SIZE) return -1;
+    return (int)(aligned_size >> 3) - 1;
+}
+
+// Keep a freed block for reuse by this thread, or hand it back to the system
+static void cache_put(thread_state_t* ts, void* ptr, size_t aligned_size) {
+    int cls = cache_class(aligned_size);
+    if (cls >= 0 && ts->cache_count[cls] < THREAD_CACHE_DEPTH) {
+        ts->cache[cls][ts->cache_count[cls]++] = ptr;
+    } else {
+        free(ptr);
+    }
+}
+
+#ifndef HEAP_HEADLESS
+// Whether the free `ev` of an untracked pointer repeats an earlier one: the
+// block is waiting in this thread's cache, or the cache handed it out again
+// later in the same batch (a system block cannot come back before its free
+// is published)
+static int repeated_free(const thread_state_t* ts, const thread_event_t* ev) {
+    for (int cls = 0; cls < THREAD_CACHE_CLASSES; cls++) {
+        for (int i = 0; i < ts->cache_count[cls]; i++) {
+            if (ts->cache[cls][i] == ev->ptr) return 1;
+        }
+    }
+    for (const thread_event_t* later = ev + 1; later < ts->events + ts->event_count; later++) {
+        if (later->kind == EVENT_MALLOC && later->ptr == ev->ptr) return 1;
+    }
+    return 0;
+}
+
+static void publish_malloc(const thread_event_t* ev) {
+    size_t offset = (size_t)ev->ptr & 0xFFFF;
+
+    if (!ev->ptr) {
+        add_log(LOG_MALLOC, ev->id, ev->requested_size, 0, 0);
+        return;
+    }
+
+    // Another thread already published the free of this pointer
+    allocation_node_t* orphan = find_allocation(ev->ptr);
+    if (orphan && orphan->orphan) {
+        node_free(remove_allocation(ev->ptr));
+        add_log(LOG_MALLOC, ev->id, ev->requested_size, offset, 1);
+        return;
+    }
+
+    allocation_node_t* node = node_alloc();
+    if (node) {
+        node->ptr = ev->ptr;
+        node->size = ev->size;
+        node->requested_size = ev->requested_size;
+        node->id = ev->id;
+        node->timestamp = stats.timestamp_counter++;
+        node->block_offset = place_block(ev->size, ev->requested_size, ev->id);
+        node->orphan = 0;
+        if (!insert_allocation(node)) {
+            release_block(node->block_offset);
+            node_free(node);
+        }
+    }
+
+    add_log(LOG_MALLOC, ev->id, ev->requested_size, offset, 1);
+}
+
+static void publish_free(thread_state_t* ts, const thread_event_t* ev) {
+    allocation_node_t* node = remove_allocation(ev->ptr);
+    uint32_t id = 0;
+
+    if (node && !node->orphan) {
+        id = node->id;
+        release_block(node->block_offset);
+        cache_put(ts, ev->ptr, node->size);
+        node_free(node);
+    } else if (node || repeated_free(ts, ev)) {
+        // Repeated free: the block already went back to the system or sits in
+        // the cache, and releasing it again would hand it out twice
+        if (node && !insert_allocation(node)) node_free(node);
+        add_log(LOG_FREE, 0, 0, (size_t)ev->ptr & 0xFFFF, 0);
+        return;
+    } else {
+        // Malloc not published yet: remember the pointer so the malloc
+        // cancels against it, and let the system have the block
+        node = node_alloc();
         if (node) {
-            node->ptr = ptr;
-            node->size = aligned_size;
-            node->requested_size = requested_size;
-            node->id = id;
-            node->timestamp = stats.timestamp_counter++;
-            node->next = allocation_list;
-            allocation_list = node;
+            node->ptr = ev->ptr;
+            node->block_offset = NO_BLOCK;
+            node->orphan = 1;
+            if (!insert_allocation(node)) node_free(node);
         }
-        
-        // Update blocks for visualization (simulate memory layout)
-        int free_idx = -1;
-        for (int i = 0; i < block_count; i++) {
-            if (blocks[i].state == BLOCK_FREE && blocks[i].size >= aligned_size) {
-                free_idx = i;
+        free(ev->ptr);
+    }
+
+    add_log(LOG_FREE, id, 0, (size_t)ev->ptr & 0xFFFF, 1);
+}
+
+static void publish_realloc(const thread_event_t* ev) {
+    allocation_node_t* node = find_allocation(ev->ptr);
+    uint32_t id = node && !node->orphan ? node->id : 0;
+    common_log_event(&event_log, &stats, LOG_REALLOC, id, ev->requested_size, (size_t)ev->ptr & 0xFFFF, 1, 0,
+                     REALLOC_MOVED);
+}
+
+// Events queued before the last heap_init refer to a heap that no longer
+// exists. Tracked blocks were already released by heap_init; blocks that were
+// allocated in this batch and never published are released here.
+static void discard_stale_events(thread_state_t* ts) {
+    for (int i = 0; i < ts->event_count; i++) {
+        thread_event_t* ev = &ts->events[i];
+        if (ev->kind != EVENT_MALLOC || !ev->ptr) continue;
+
+        int freed_later = 0;
+        for (int j = i + 1; j < ts->event_count; j++) {
+            if (ts->events[j].kind == EVENT_FREE && ts->events[j].ptr == ev->ptr) {
+                freed_later = 1;
                 break;
             }
         }
-        
-        if (free_idx >= 0 && block_count < MAX_BLOCKS) {
-            size_t original_size = blocks[free_idx].size;
-            size_t original_offset = blocks[free_idx].offset;
-            
-            // Create allocated block
-            blocks[free_idx].size = aligned_size;
-            blocks[free_idx].state = BLOCK_ALLOCATED;
-            blocks[free_idx].allocation_id = id;
-            blocks[free_idx].timestamp = stats.timestamp_counter++;
-            blocks[free_idx].requested_size = requested_size;
-            
-            // Create remainder free block if significant space left
-            if (original_size > aligned_size + 64 && block_count < MAX_BLOCKS - 1) {
-                blocks[block_count].offset = original_offset + aligned_size;
-                blocks[block_count].size = original_size - aligned_size;
-                blocks[block_count].state = BLOCK_FREE;
-                blocks[block_count].allocation_id = 0;
-                blocks[block_count].timestamp = stats.timestamp_counter++;
-                blocks[block_count].requested_size = 0;
-                blocks[block_count].region_id = 0;
-                block_count++;
-            }
+        if (freed_later) {
+            cache_put(ts, ev->ptr, ev->size);
+        } else {
+            free(ev->ptr);
         }
-        
-        add_log("MALLOC", id, size, (size_t)ptr & 0xFFFF, 1);
-    } else {
-        add_log("MALLOC", stats.next_allocation_id, size, 0, 0);
     }
-    
-    common_sort_blocks(blocks, block_count);
+    ts->event_count = 0;
+    ts->epoch = atomic_load(&heap_epoch);
+}
+
+// Called with heap_mutex held
+static void publish_events(thread_state_t* ts) {
+    common_profile_merge(&profile, &ts->profile);
+    if (ts->epoch != atomic_load(&heap_epoch)) {
+        discard_stale_events(ts);
+        return;
+    }
+    if (ts->event_count == 0) return;
+
+    for (int i = 0; i < ts->event_count; i++) {
+        if (ts->events[i].kind == EVENT_MALLOC) {
+            publish_malloc(&ts->events[i]);
+        } else if (ts->events[i].kind == EVENT_FREE) {
+            publish_free(ts, &ts->events[i]);
+        } else {
+            publish_realloc(&ts->events[i]);
+        }
+    }
+    ts->event_count = 0;
+
+    atomic_fetch_add(&heap_version, 1);
     update_stats();
-    
+}
+
+#endif
+
+static void thread_state_destroy(void* arg) {
+    thread_state_t* ts = (thread_state_t*)arg;
+
+#ifndef HEAP_HEADLESS
+    pthread_mutex_lock(&heap_mutex);
+    publish_events(ts);
     pthread_mutex_unlock(&heap_mutex);
-    return ptr;
+#endif
+
+    for (int cls = 0; cls < THREAD_CACHE_CLASSES; cls++) {
+        while (ts->cache_count[cls] > 0) free(ts->cache[cls][--ts->cache_count[cls]]);
+    }
+    ts->registered = 0;
+    atomic_fetch_sub(&thread_count, 1);
 }
 
-void heap_free(void* ptr) {
-    if (!ptr) return;
-    
+static void thread_key_create(void) {
+    pthread_key_create(&thread_key, thread_state_destroy);
+#ifdef HEAP_HEADLESS
+    for (int s = 0; s < LIVE_SHARDS; s++) pthread_mutex_init(&live_shards[s].lock, NULL);
+#endif
+}
+
+static inline thread_state_t* thread_state_get(void) {
+    thread_state_t* ts = &thread_state;
+    if (!ts->registered) {
+        // The key destructor publishes whatever is queued when the thread exits
+        pthread_once(&thread_key_once, thread_key_create);
+        pthread_setspecific(thread_key, ts);
+        ts->epoch = atomic_load(&heap_epoch);
+        ts->registered = 1;
+#ifdef HEAP_HEADLESS
+        ts->shard = atomic_fetch_add(&thread_count, 1) % LIVE_SHARDS;
+#else
+        atomic_fetch_add(&thread_count, 1);
+#endif
+    }
+    return ts;
+}
+
+#ifndef HEAP_HEADLESS
+static void flush_thread(thread_state_t* ts) {
+    if (ts->event_count == 0 && ts->epoch == atomic_load(&heap_epoch)) return;
+
     pthread_mutex_lock(&heap_mutex);
-    
-    // Find allocation info
-    allocation_node_t* node = find_allocation(ptr);
-    uint32_t id = 0;
-    
-    if (node) {
-        id = node->id;
-        
-        // Update blocks for visualization
-        for (int i = 0; i < block_count; i++) {
-            if (blocks[i].allocation_id == id && blocks[i].state == BLOCK_ALLOCATED) {
-                blocks[i].state = BLOCK_FREED;
-                blocks[i].allocation_id = 0;
-                blocks[i].requested_size = 0;
-                stats.free_block_count++;
-                break;
-            }
+    publish_events(ts);
+    pthread_mutex_unlock(&heap_mutex);
+}
+
+static inline void queue_event(thread_state_t* ts, uint8_t kind, void* ptr,
+                               size_t size, size_t requested_size, uint32_t id) {
+    thread_event_t* ev = &ts->events[ts->event_count++];
+    ev->kind = kind;
+    ev->ptr = ptr;
+    ev->size = size;
+    ev->requested_size = requested_size;
+    ev->id = id;
+
+    if (ts->event_count == THREAD_BATCH) flush_thread(ts);
+}
+#else
+// Nothing is queued in headless builds
+static void flush_thread(thread_state_t* ts) {
+    (void)ts;
+}
+#endif
+
+// `size` is the nominal heap the layout is drawn in and `max_blocks` the
+// block-list capacity (0 keeps the current one)
+void heap_init(size_t size, size_t max_blocks) {
+    thread_state_t* ts = thread_state_get();
+
+    pthread_mutex_lock(&heap_mutex);
+    atomic_fetch_add(&heap_version, 1);
+
+    // Queued events of every thread now belong to the previous heap
+    atomic_fetch_add(&heap_epoch, 1);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.total_size = size;
+    stats.min_free_bytes = stats.total_size;
+    atomic_store(&next_allocation_id, 1);
+
+#ifndef HEAP_HEADLESS
+    discard_stale_events(ts);
+
+    // Clear previous allocations
+    for (size_t i = 0; i < alloc_table_capacity; i++) {
+        allocation_node_t* node = alloc_table[i];
+        if (!node) continue;
+        if (!node->orphan) free(node->ptr);
+        node_free(node);
+        alloc_table[i] = NULL;
+    }
+    alloc_table_count = 0;
+
+    common_blocks_init(&shadow, common_block_limit(stats.total_size, max_blocks, shadow.limit));
+    block_info_t whole = {
+        .offset = 0,
+        .size = stats.total_size,
+        .state = BLOCK_FREE,
+        .allocation_id = 0,
+        .timestamp = stats.timestamp_counter++,
+        .requested_size = 0,
+        .region_id = 0
+    };
+    free_tail = common_blocks_append(&shadow, &whole);
+
+    common_stats_reset(&stats, &tracker);
+    common_stats_add_free(&stats, &tracker, whole.size);
+#else
+    // Clear previous allocations
+    (void)max_blocks;
+    for (int s = 0; s < LIVE_SHARDS; s++) {
+        pthread_mutex_lock(&live_shards[s].lock);
+        while (live_shards[s].head) {
+            block_header_t* header = live_shards[s].head;
+            live_shards[s].head = header->next;
+            free(header);
         }
-        
-        remove_allocation(ptr);
+        pthread_mutex_unlock(&live_shards[s].lock);
     }
-    
-    // Thread-safe wrapper: call system free
-    free(ptr);
-    
-    add_log("FREE", id, 0, (size_t)ptr & 0xFFFF, 1);
+    atomic_store(&live_bytes, 0);
+    atomic_store(&live_count, 0);
+    common_stats_reset(&stats, &tracker);
+    common_stats_add_free(&stats, &tracker, stats.total_size);
+#endif
+
+    common_log_init(&event_log, stats.total_size);
+    common_profile_clear(&profile);
+    common_lifetime_clear(&lifetimes);
+    common_profile_clear(&ts->profile);
     update_stats();
-    
+    add_log(LOG_INIT, 0, size, 0, 1);
+
     pthread_mutex_unlock(&heap_mutex);
 }
 
+#ifndef HEAP_HEADLESS
+static void* cached_malloc(thread_state_t* ts, size_t size) {
+    size_t aligned_size = (size + 7) & ~7;
+    void* ptr = NULL;
+
+    // Small requests come from this thread's cache before the system
+    int cls = cache_class(aligned_size);
+    if (cls >= 0 && ts->cache_count[cls] > 0) {
+        ptr = ts->cache[cls][--ts->cache_count[cls]];
+    } else {
+        ptr = malloc(aligned_size);
+    }
+
+    uint32_t id = ptr ? atomic_fetch_add(&next_allocation_id, 1) : atomic_load(&next_allocation_id);
+    queue_event(ts, EVENT_MALLOC, ptr, aligned_size, size, id);
+    return ptr;
+}
+
+static void cached_free(thread_state_t* ts, void* ptr) {
+    if (!ptr) return;
+
+    // The block goes back to the cache or the system once the free is published
+    queue_event(ts, EVENT_FREE, ptr, 0, 0, 0);
+}
+
+// Blocks are sized to their class, so a resize always moves. The old size is
+// only known to the tracking table, which means publishing this thread's
+// queue first: unlike malloc and free, realloc takes the lock every call.
+static void* cached_realloc(thread_state_t* ts, void* ptr, size_t size) {
+    pthread_mutex_lock(&heap_mutex);
+    publish_events(ts);
+    allocation_node_t* node = find_allocation(ptr);
+    size_t old_size = node && !node->orphan ? node->size : 0;
+    if (!old_size) add_log(LOG_REALLOC, 0, size, (size_t)ptr & 0xFFFF, 0);
+    pthread_mutex_unlock(&heap_mutex);
+    if (!old_size) return NULL;
+
+    void* moved = cached_malloc(ts, size);
+    if (!moved) return NULL;
+    memcpy(moved, ptr, old_size < size ? old_size : size);
+    cached_free(ts, ptr);
+    queue_event(ts, EVENT_REALLOC, moved, 0, size, 0);
+    return moved;
+}
+#else
+static void live_link(uint32_t shard, block_header_t* header) {
+    live_shard_t* s = &live_shards[shard];
+    header->shard = shard;
+    header->prev = NULL;
+    pthread_mutex_lock(&s->lock);
+    header->next = s->head;
+    if (s->head) s->head->prev = header;
+    s->head = header;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void live_unlink(block_header_t* header) {
+    live_shard_t* s = &live_shards[header->shard];
+    pthread_mutex_lock(&s->lock);
+    if (header->prev) {
+        header->prev->next = header->next;
+    } else {
+        s->head = header->next;
+    }
+    if (header->next) header->next->prev = header->prev;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void* cached_malloc(thread_state_t* ts, size_t size) {
+    size_t aligned_size = (size + 7) & ~7;
+    block_header_t* header;
+
+    // Cached blocks already have room for the header
+    int cls = cache_class(aligned_size);
+    if (cls >= 0 && ts->cache_count[cls] > 0) {
+        header = (block_header_t*)ts->cache[cls][--ts->cache_count[cls]];
+    } else {
+        header = (block_header_t*)malloc(aligned_size + BLOCK_HEADER_SIZE);
+        if (!header) return NULL;
+    }
+
+    header->size = (uint32_t)aligned_size;
+    live_link(ts->shard, header);
+    atomic_fetch_add_explicit(&next_allocation_id, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&live_bytes, aligned_size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&live_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&heap_version, 1, memory_order_relaxed);
+    return (uint8_t*)header + BLOCK_HEADER_SIZE;
+}
+
+static void cached_free(thread_state_t* ts, void* ptr) {
+    if (!ptr) return;
+
+    block_header_t* header = (block_header_t*)((uint8_t*)ptr - BLOCK_HEADER_SIZE);
+    live_unlink(header);
+    atomic_fetch_sub_explicit(&live_bytes, header->size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&live_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&heap_version, 1, memory_order_relaxed);
+    cache_put(ts, header, header->size);
+}
+
+// The header has the old size, so no lock is needed
+static void* cached_realloc(thread_state_t* ts, void* ptr, size_t size) {
+    size_t old_size = ((block_header_t*)((uint8_t*)ptr - BLOCK_HEADER_SIZE))->size;
+    void* moved = cached_malloc(ts, size);
+    if (!moved) return NULL;
+    memcpy(moved, ptr, old_size < size ? old_size : size);
+    cached_free(ts, ptr);
+    return moved;
+}
+#endif
+
+// Each thread profiles its own calls; publishing folds them into the shared profile
+void* heap_malloc(size_t size) {
+    thread_state_t* ts = thread_state_get();
+    common_profile_begin(&ts->profile, PROFILE_OP_MALLOC);
+    void* ptr = cached_malloc(ts, size);
+    common_profile_end(&ts->profile);
+    return ptr;
+}
+
+void heap_free(void* ptr) {
+    thread_state_t* ts = thread_state_get();
+    common_profile_begin(&ts->profile, PROFILE_OP_FREE);
+    cached_free(ts, ptr);
+    common_profile_end(&ts->profile);
+}
+
+// NULL `ptr` allocates and size 0 frees; otherwise the block moves (see
+// cached_realloc()). Returns NULL, leaving the block alone, on failure.
+void* heap_realloc(void* ptr, size_t size) {
+    if (!ptr) return heap_malloc(size);
+    if (size == 0) {
+        heap_free(ptr);
+        return NULL;
+    }
+
+    thread_state_t* ts = thread_state_get();
+    common_profile_begin(&ts->profile, PROFILE_OP_REALLOC);
+    void* moved = cached_realloc(ts, ptr, size);
+    common_profile_end(&ts->profile);
+    return moved;
+}
+
+// Publish the calling thread's queued events; worker threads call this before
+// handing results to a thread that will query the heap
+void heap_flush_thread() {
+    flush_thread(thread_state_get());
+}
+
 void heap_reset() {
-    heap_init(stats.total_size);
+    heap_init(stats.total_size, 0);
+}
+
+// Requests are served by the system allocator, which the nominal heap size
+// does not limit, so every allocation is expected to succeed
+int heap_can_allocate(size_t size) {
+    (void)size;
+    return 0;
+}
+
+static void* run_op_malloc(size_t size, uint8_t flags) {
+    (void)flags;
+    return heap_malloc(size);
+}
+
+int heap_run_ops(const op_t* ops, int n, uint32_t* out_ptrs) {
+    return common_run_ops(ops, n, out_ptrs, run_op_malloc, heap_free);
+}
+
+// Fill `ops` with a synthetic workload for heap_run_ops; the heap is not touched
+int heap_generate_ops(const workload_config_t* config, op_t* ops, int capacity) {
+    return common_workload_generate(config, ops, capacity);
+}
+
+// Blocks live in the system heap, where they cannot be copied out and put
+// back at the same addresses, so heap_3 has no checkpoints: heap_snapshot
+// reports size 0 and heap_restore always fails. Callers replay instead.
+size_t heap_snapshot(void* buf, size_t capacity) {
+    (void)buf;
+    (void)capacity;
+    return 0;
+}
+
+int heap_restore(const void* buf, size_t size) {
+    (void)buf;
+    (void)size;
+    return -1;
 }
 
 // Query functions
 heap_stats_t* get_heap_stats() {
+    heap_flush_thread();
+    refresh_snapshot();
+
+    pthread_mutex_lock(&heap_mutex);
+    stats.next_allocation_id = atomic_load(&next_allocation_id);
+    pthread_mutex_unlock(&heap_mutex);
     return &stats;
 }
 
 int get_block_count() {
-    return block_count;
+    heap_flush_thread();
+    refresh_snapshot();
+    return shadow.count;
 }
 
+// Blocks in address order
 block_info_t* get_block_info(int index) {
-    if (index >= 0 && index < block_count) {
-        return &blocks[index];
-    }
-    return NULL;
+    heap_flush_thread();
+    refresh_snapshot();
+    return common_blocks_at(&shadow, index);
+}
+
+// Structure-of-arrays snapshot of the block list for zero-copy reads from JS
+uint32_t* get_block_table_ptr() {
+    heap_flush_thread();
+    refresh_snapshot();
+    return common_block_table_refresh(&block_table, &shadow, atomic_load(&heap_version));
+}
+
+int get_block_table_len() {
+    heap_flush_thread();
+    refresh_snapshot();
+    return shadow.count;
+}
+
+uint32_t get_heap_version() {
+    heap_flush_thread();
+    return atomic_load(&heap_version);
 }
 
 int get_log_count() {
-    return log_count;
+    heap_flush_thread();
+    return (int)event_log.count;
 }
 
 log_entry_t* get_log_entry(int index) {
-    if (index >= 0 && index < log_count) {
-        return &logs[index];
-    }
-    return NULL;
+    heap_flush_thread();
+    return common_log_at(&event_log, index);
+}
+
+// Copy events with seq > `seq` into `out`, oldest first; returns the number copied
+int get_log_since(uint32_t seq, log_entry_t* out, int max) {
+    heap_flush_thread();
+    return common_log_since(&event_log, seq, out, max);
+}
+
+// Events overwritten before they could be read
+uint32_t get_log_lost() {
+    return event_log.lost;
 }
 
 void clear_log() {
-    log_count = 0;
+    heap_flush_thread();
+    atomic_fetch_add(&heap_version, 1);
+    common_log_clear(&event_log);
+}
+
+// The shared profile with the calling thread's calls folded in
+static const op_profile_t* current_profile(void) {
+    thread_state_t* ts = thread_state_get();
+
+    pthread_mutex_lock(&heap_mutex);
+    common_profile_merge(&profile, &ts->profile);
+    pthread_mutex_unlock(&heap_mutex);
+    return &profile;
+}
+
+// Log2 histogram of `op_kind` latencies in ns (PROFILE_BUCKETS words into
+// `out`); returns the number of calls recorded
+int get_latency_histogram(int op_kind, uint32_t* out) {
+    return common_profile_histogram(current_profile(), op_kind, PROFILE_NS, out);
+}
+
+// The same for any profile_metric_t, e.g. free-list nodes visited
+int get_op_histogram(int op_kind, int metric, uint32_t* out) {
+    return common_profile_histogram(current_profile(), op_kind, metric, out);
+}
+
+// Worst case of `metric` over every recorded `op_kind` call
+uint32_t get_op_max(int op_kind, int metric) {
+    return common_profile_max(current_profile(), op_kind, metric);
+}
+
+void reset_op_profile() {
+    thread_state_t* ts = thread_state_get();
+
+    pthread_mutex_lock(&heap_mutex);
+    common_profile_clear(&profile);
+    common_profile_clear(&ts->profile);
+    pthread_mutex_unlock(&heap_mutex);
+}
+
+// Size-class churn, block lifetimes and the live-bytes timeline since heap_init
+lifetime_profile_t* get_lifetime_profile() {
+    return &lifetimes;
 }
\ No newline at end of file
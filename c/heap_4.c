@@ -1,322 +1,832 @@
 #include "heap_common.h"
 
-#define FRAGMENTATION_THRESHOLD 30.0f  // Trigger coalescing at 30% fragmentation
-
-// Free block structure for linked list
+// Free block structure for linked list. The list is kept in address order, so
+// a block's physical neighbours are the list entries either side of it and
+// merging on free never needs a separate pass (as in FreeRTOS heap_4).
 typedef struct free_block {
-    size_t size;
+    heap_header_t size;
     struct free_block* next;
 } free_block_t;
 
 // Global state
-static uint8_t heap_memory[MAX_HEAP_SIZE];
-static block_info_t blocks[MAX_BLOCKS];
-static log_entry_t logs[MAX_LOG_ENTRIES];
+static heap_arena_t arena;
+static uint8_t* heap_memory = NULL;
+static block_list_t shadow;
+static log_ring_t event_log;
 static heap_stats_t stats;
+static stats_tracker_t tracker;
 static free_block_t* free_list = NULL;
-static int block_count = 0;
-static int log_count = 0;
-static int coalesce_pending = 0;
+static uint32_t heap_version = 0;
+static block_table_t block_table;
+static op_profile_t profile;
+static lifetime_profile_t lifetimes;
+static coalesce_policy_t coalesce_policy = COALESCE_IMMEDIATE;
+static int coalesce_budget = DEFAULT_COALESCE_BUDGET;
+#ifndef HEAP_HEADLESS
+static int coalesce_cursor = NO_SLOT;    // Slot the next deferred step starts at
+#else
+static free_block_t* coalesce_cursor = NULL;    // Free block the next deferred step starts at
+static uint32_t snapshot_version = 0;
+#endif
 
 // Use common utility functions
 #define add_log(action, alloc_id, size, offset, success) \
-    common_add_log(logs, &log_count, &stats, action, alloc_id, size, offset, success)
-
-#define update_stats() common_update_stats(blocks, block_count, &stats)
+    common_add_log(&event_log, &stats, action, alloc_id, size, offset, success)
 
-#define sort_blocks() common_sort_blocks(blocks, block_count)
+// Stats are maintained incrementally; this only derives the O(1) summary fields
+static void update_stats(void) {
+    common_stats_finish(&stats, &tracker);
+    COMMON_VERIFY_STATS(&shadow, -1, &stats, "heap_4");
+}
 
-static void immediate_neighbor_coalesce(size_t freed_offset) {
-    sort_blocks();
+#ifndef HEAP_HEADLESS
+// Merge the entry after slot `left` into it in the visualization table
+static void merge_shadow_blocks(int left) {
+    block_info_t* block = &shadow.blocks[left];
+    int right = shadow.next[left];
     
-    int freed_idx = -1;
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].offset == freed_offset) {
-            freed_idx = i;
-            break;
-        }
-    }
+    common_stats_remove_free(&stats, &tracker, block->size);
+    common_stats_remove_free(&stats, &tracker, shadow.blocks[right].size);
+    block->size += shadow.blocks[right].size;
+    block->state = BLOCK_FREE;  // Coalesced blocks become FREE
+    common_stats_add_free(&stats, &tracker, block->size);
     
-    if (freed_idx == -1) return;
+    if (coalesce_cursor == right) coalesce_cursor = left;
+    common_blocks_remove(&shadow, right);
+}
+#else
+// Headless: account for free block `right` being folded into `left`
+static void merge_free_blocks(free_block_t* left, free_block_t* right) {
+    common_stats_remove_free(&stats, &tracker, left->size);
+    common_stats_remove_free(&stats, &tracker, right->size);
+    left->size += right->size;
+    left->next = right->next;
+    common_stats_add_free(&stats, &tracker, left->size);
+    
+    if (coalesce_cursor == right) coalesce_cursor = left;
+}
+#endif
+
+// Insert a freed block at its address-ordered position and, if `merge` is set,
+// merge it with the neighbouring free blocks it touches. Slot `index` is the
+// block's shadow entry and is merged the same way.
+static void insert_block_into_free_list(free_block_t* block, int index, int merge) {
+#ifdef HEAP_HEADLESS
+    (void)index;
+#endif
+    free_block_t* prev = NULL;
+    free_block_t* next = free_list;
+    uint32_t visited = 0;
+    while (next && next < block) {
+        prev = next;
+        next = next->next;
+        visited++;
+    }
+    common_profile_count(&profile, PROFILE_VISITED, visited);
     
     int coalesced = 0;
     
-    // Check left neighbor
-    if (freed_idx > 0 && 
-        (blocks[freed_idx - 1].state == BLOCK_FREE || blocks[freed_idx - 1].state == BLOCK_FREED) &&
-        blocks[freed_idx - 1].offset + blocks[freed_idx - 1].size == blocks[freed_idx].offset) {
-        
-        blocks[freed_idx - 1].size += blocks[freed_idx].size;
-        blocks[freed_idx - 1].state = BLOCK_FREE;  // Coalesced blocks become FREE
-        
-        for (int i = freed_idx; i < block_count - 1; i++) {
-            blocks[i] = blocks[i + 1];
-        }
-        block_count--;
-        stats.free_block_count--;  // Decrement when coalescing
-        freed_idx--;
-        coalesced = 1;
+    // Merge with the following block
+    if (merge && next && (uint8_t*)block + block->size == (uint8_t*)next) {
+#ifndef HEAP_HEADLESS
+        block->size += next->size;
+        block->next = next->next;
+        if (index != NO_SLOT && shadow.next[index] != NO_SLOT) merge_shadow_blocks(index);
+#else
+        merge_free_blocks(block, next);
+#endif
+        coalesced++;
+    } else {
+        block->next = next;
     }
     
-    // Check right neighbor
-    if (freed_idx >= 0 && freed_idx < block_count - 1 &&
-        (blocks[freed_idx + 1].state == BLOCK_FREE || blocks[freed_idx + 1].state == BLOCK_FREED) &&
-        blocks[freed_idx].offset + blocks[freed_idx].size == blocks[freed_idx + 1].offset) {
-        
-        blocks[freed_idx].size += blocks[freed_idx + 1].size;
-        blocks[freed_idx].state = BLOCK_FREE;
-        
-        for (int i = freed_idx + 1; i < block_count - 1; i++) {
-            blocks[i] = blocks[i + 1];
-        }
-        block_count--;
-        stats.free_block_count--;  // Decrement when coalescing
-        coalesced = 1;
+    // Merge into the preceding block
+    if (merge && prev && (uint8_t*)prev + prev->size == (uint8_t*)block) {
+#ifndef HEAP_HEADLESS
+        prev->size += block->size;
+        prev->next = block->next;
+        if (index != NO_SLOT && shadow.prev[index] != NO_SLOT) merge_shadow_blocks(shadow.prev[index]);
+#else
+        merge_free_blocks(prev, block);
+#endif
+        coalesced++;
+    } else if (prev) {
+        prev->next = block;
+    } else {
+        free_list = block;
     }
     
     if (coalesced) {
-        add_log("COALESCE", 0, 0, freed_offset, 1);
+        common_profile_count(&profile, PROFILE_MERGES, coalesced);
+        add_log(LOG_COALESCE, 0, 0, (uint8_t*)block - heap_memory, 1);
     }
 }
 
-static void full_coalesce() {
-    sort_blocks();
-    
-    int write_idx = 0;
-    int coalesce_count = 0;
+#ifndef HEAP_HEADLESS
+// Examine at most `budget` adjacent pairs of shadow entries, starting where
+// the previous call stopped, and merge the free ones. Returns the merge count.
+static int coalesce_steps(int budget) {
+    int merged = 0;
+    int step;
     
-    for (int i = 0; i < block_count; i++) {
-        blocks[write_idx] = blocks[i];
-        
-        if (blocks[write_idx].state == BLOCK_FREED) {
-            blocks[write_idx].state = BLOCK_FREE;
-            blocks[write_idx].allocation_id = 0;
+    for (step = 0; step < budget && shadow.count > 1; step++) {
+        if (coalesce_cursor == NO_SLOT || shadow.next[coalesce_cursor] == NO_SLOT) {
+            coalesce_cursor = shadow.head;
         }
         
-        while (i + 1 < block_count && 
-               blocks[write_idx].state == BLOCK_FREE &&
-               (blocks[i + 1].state == BLOCK_FREE || blocks[i + 1].state == BLOCK_FREED) &&
-               blocks[write_idx].offset + blocks[write_idx].size == blocks[i + 1].offset) {
+        block_info_t* left = &shadow.blocks[coalesce_cursor];
+        block_info_t* right = &shadow.blocks[shadow.next[coalesce_cursor]];
+        
+        if (left->state != BLOCK_ALLOCATED && right->state != BLOCK_ALLOCATED &&
+            left->offset + left->size == right->offset) {
+            // Address-adjacent free blocks are also adjacent in the free list
+            free_block_t* fb = (free_block_t*)(heap_memory + left->offset);
+            fb->size += fb->next->size;
+            fb->next = fb->next->next;
             
-            blocks[write_idx].size += blocks[i + 1].size;
-            blocks[write_idx].state = BLOCK_FREE;
-            blocks[write_idx].allocation_id = 0;
-            i++;
-            coalesce_count++;
-            stats.free_block_count--;  // Decrement for each coalesce
+            merge_shadow_blocks(coalesce_cursor);
+            merged++;
+        } else {
+            coalesce_cursor = shadow.next[coalesce_cursor];
         }
-        write_idx++;
     }
     
-    if (coalesce_count > 0) {
-        block_count = write_idx;
-        add_log("FULL_COALESCE", 0, coalesce_count, 0, 1);
+    common_profile_count(&profile, PROFILE_COALESCE_STEPS, step);
+    common_profile_count(&profile, PROFILE_MERGES, merged);
+    if (merged > 0) {
+        add_log(LOG_COALESCE, 0, merged, shadow.blocks[coalesce_cursor].offset, 1);
     }
+    return merged;
+}
+#else
+// Headless: address-adjacent free blocks are also adjacent in the free list,
+// so the cursor walks the free list instead of the block list
+static int coalesce_steps(int budget) {
+    int merged = 0;
+    int step;
     
-    // Rebuild free list
-    free_list = NULL;
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].state == BLOCK_FREE) {
-            free_block_t* fb = (free_block_t*)(heap_memory + blocks[i].offset);
-            fb->size = blocks[i].size;
-            fb->next = free_list;
-            free_list = fb;
+    for (step = 0; step < budget && free_list && free_list->next; step++) {
+        if (!coalesce_cursor || !coalesce_cursor->next) coalesce_cursor = free_list;
+        
+        free_block_t* left = coalesce_cursor;
+        if ((uint8_t*)left + left->size == (uint8_t*)left->next) {
+            merge_free_blocks(left, left->next);
+            merged++;
+        } else {
+            coalesce_cursor = left->next;
         }
     }
     
-    coalesce_pending = 0;
+    common_profile_count(&profile, PROFILE_COALESCE_STEPS, step);
+    common_profile_count(&profile, PROFILE_MERGES, merged);
+    if (merged > 0) {
+        add_log(LOG_COALESCE, 0, merged, (uint8_t*)coalesce_cursor - heap_memory, 1);
+    }
+    return merged;
 }
 
-void heap_init(size_t size) {
+// Rebuild the block list by walking the heap: every header holds its block's
+// size, and free blocks are the free-list nodes, met in the same order
+static void refresh_snapshot(void) {
+    if (!common_snapshot_begin(&shadow, &snapshot_version, heap_version)) return;
+    
+    const free_block_t* next_free = free_list;
+    size_t offset = 0;
+    while (offset < stats.total_size) {
+        const free_block_t* block = (const free_block_t*)(heap_memory + offset);
+        if (block->size == 0 || block->size > stats.total_size - offset) break;
+        
+        int is_free = block == next_free;
+        if (is_free) next_free = next_free->next;
+        common_snapshot_add(&shadow, 0, offset, block->size, is_free ? BLOCK_FREE : BLOCK_ALLOCATED);
+        offset += block->size;
+    }
+    heap_stats_t* all = &stats;
+    common_snapshot_stats(&block_table, &shadow, heap_version, &all, 1);
+}
+#endif
+
+#ifndef HEAP_HEADLESS
+static inline void refresh_snapshot(void) {}
+#endif
+
+static free_block_t** find_best_fit(size_t total_size) {
+    free_block_t** current = &free_list;
+    free_block_t** best_prev = NULL;
+    uint32_t visited = 0;
+    
+    while (*current) {
+        if ((*current)->size >= total_size) {
+            if (!best_prev || (*current)->size < (*best_prev)->size) {
+                best_prev = current;
+            }
+        }
+        current = &((*current)->next);
+        visited++;
+    }
+    common_profile_count(&profile, PROFILE_VISITED, visited);
+    return best_prev;
+}
+
+// `size` bytes of heap and room for `max_blocks` shadow entries (0 keeps the
+// current capacity)
+void heap_init(size_t size, size_t max_blocks) {
+    heap_version++;
+    
     memset(&stats, 0, sizeof(stats));
-    stats.total_size = size > MAX_HEAP_SIZE ? MAX_HEAP_SIZE : size;
+    stats.total_size = common_align_down(common_arena_reserve(&arena, common_heap_size(size)));
     stats.next_allocation_id = 1;
     stats.min_free_bytes = stats.total_size;
+    heap_memory = arena.base;
     
     free_list = (free_block_t*)heap_memory;
     free_list->size = stats.total_size;
     free_list->next = NULL;
     
-    block_count = 1;
-    blocks[0].offset = 0;
-    blocks[0].size = stats.total_size;
-    blocks[0].state = BLOCK_FREE;
-    blocks[0].allocation_id = 0;
-    blocks[0].timestamp = stats.timestamp_counter++;
-    blocks[0].requested_size = 0;
-    blocks[0].region_id = 0;
-    
-    log_count = 0;
-    coalesce_pending = 0;
-    stats.free_block_count = 1;  // Start with 1 free block
+#ifndef HEAP_HEADLESS
+    common_blocks_init(&shadow, common_block_limit(stats.total_size, max_blocks, shadow.limit));
+    block_info_t whole = {
+        .offset = 0,
+        .size = stats.total_size,
+        .state = BLOCK_FREE,
+        .allocation_id = 0,
+        .timestamp = stats.timestamp_counter++,
+        .requested_size = 0,
+        .region_id = 0
+    };
+    common_blocks_append(&shadow, &whole);
+    coalesce_cursor = shadow.head;
+#else
+    (void)max_blocks;
+    coalesce_cursor = NULL;
+#endif
+    
+    common_stats_reset(&stats, &tracker);
+    common_stats_add_free(&stats, &tracker, stats.total_size);
+    
+    common_log_init(&event_log, stats.total_size);
+    common_profile_clear(&profile);
+    common_lifetime_clear(&lifetimes);
     update_stats();
-    add_log("INIT", 0, size, 0, 1);
+    add_log(LOG_INIT, 0, size, 0, 1);
 }
 
-void* heap_malloc(size_t size) {
-    size_t requested_size = size;
-    size_t aligned_size = (size + 7) & ~7;
-    size_t total_size = aligned_size + sizeof(size_t);
+// heap_init with a coalescing policy; heap_init/heap_reset keep the last one chosen
+void heap_init_coalesce(size_t size, int policy, int budget) {
+    coalesce_policy = (policy >= COALESCE_IMMEDIATE && policy <= COALESCE_MANUAL) ?
+                      (coalesce_policy_t)policy : COALESCE_IMMEDIATE;
+    coalesce_budget = budget > 0 ? budget : DEFAULT_COALESCE_BUDGET;
+    heap_init(size, 0);
+}
+
+// Run up to `budget` deferred coalescing steps now; returns the number of merges
+int heap_coalesce_step(int budget) {
+    heap_version++;
     
+    int merged = coalesce_steps(budget);
     update_stats();
-    if (coalesce_pending && stats.external_fragmentation > FRAGMENTATION_THRESHOLD) {
-        full_coalesce();
-        update_stats();
-    }
+    return merged;
+}
+
+static void* allocate_block(size_t size) {
+    heap_version++;
     
-    free_block_t** current = &free_list;
-    free_block_t* best_fit = NULL;
-    free_block_t** best_prev = NULL;
+    size_t requested_size = size;
+    size_t total_size = common_block_total(size);
     
-    while (*current) {
-        if ((*current)->size >= total_size) {
-            if (!best_fit || (*current)->size < best_fit->size) {
-                best_fit = *current;
-                best_prev = current;
-            }
-        }
-        current = &((*current)->next);
+    // A freed block must be able to hold its free-list node
+    if (total_size < sizeof(free_block_t)) total_size = sizeof(free_block_t);
+    
+    if (coalesce_policy == COALESCE_INCREMENTAL) {
+        coalesce_steps(coalesce_budget);
     }
     
-    if (!best_fit && coalesce_pending) {
-        full_coalesce();
-        
-        current = &free_list;
-        while (*current) {
-            if ((*current)->size >= total_size) {
-                if (!best_fit || (*current)->size < best_fit->size) {
-                    best_fit = *current;
-                    best_prev = current;
-                }
-            }
-            current = &((*current)->next);
-        }
+    free_block_t** best_prev = find_best_fit(total_size);
+    
+    // One more bounded round of merging before giving up
+    if (!best_prev && coalesce_policy == COALESCE_INCREMENTAL && coalesce_steps(coalesce_budget) > 0) {
+        best_prev = find_best_fit(total_size);
     }
     
-    if (!best_fit) {
-        add_log("MALLOC", stats.next_allocation_id, size, 0, 0);
+    if (!best_prev) {
+        update_stats();
+        add_log(LOG_MALLOC, stats.next_allocation_id, size, 0, 0);
         return NULL;
     }
     
+    free_block_t* best_fit = *best_prev;
     *best_prev = best_fit->next;
     
-    *(size_t*)best_fit = aligned_size;
-    void* user_ptr = (uint8_t*)best_fit + sizeof(size_t);
+    // The size word stays in place as the allocated block's header
+    void* user_ptr = common_block_payload(best_fit);
     
     size_t offset = (uint8_t*)best_fit - heap_memory;
     
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].offset == offset && (blocks[i].state == BLOCK_FREE || blocks[i].state == BLOCK_FREED)) {
-            size_t original_block_size = blocks[i].size;
+#ifndef HEAP_HEADLESS
+    int i = common_blocks_find(&shadow, 0, offset);
+    block_info_t* block = i != NO_SLOT ? &shadow.blocks[i] : NULL;
+    if (block && (block->state == BLOCK_FREE || block->state == BLOCK_FREED)) {
+        size_t original_block_size = block->size;
+        common_stats_remove_free(&stats, &tracker, original_block_size);
+        
+        // Only split if remainder is large enough
+        if (common_split_fits(original_block_size, total_size, sizeof(free_block_t))) {
+            block_info_t rest = {
+                .offset = offset + total_size,
+                .size = original_block_size - total_size,
+                .state = block->state,
+                .allocation_id = 0,
+                .timestamp = stats.timestamp_counter,
+                .requested_size = 0,
+                .region_id = 0
+            };
             
-            // Only split if remainder is large enough
-            if (original_block_size > total_size + sizeof(free_block_t) + 16) {
-                if (block_count < MAX_BLOCKS) {
-                    blocks[block_count].offset = offset + total_size;
-                    blocks[block_count].size = original_block_size - total_size;
-                    blocks[block_count].state = blocks[i].state;
-                    blocks[block_count].allocation_id = 0;
-                    blocks[block_count].timestamp = stats.timestamp_counter++;
-                    blocks[block_count].requested_size = 0;
-                    blocks[block_count].region_id = 0;
-                    
-                    free_block_t* remainder = (free_block_t*)(heap_memory + offset + total_size);
-                    remainder->size = blocks[block_count].size;
-                    remainder->next = free_list;
-                    free_list = remainder;
-                    
-                    block_count++;
-                    
-                    // Update current block to exact size when splitting
-                    blocks[i].size = total_size;
-                }
-                // If not splitting, keep the original block size
-            } else {
-                // Consuming entire block
-                stats.free_block_count--;
+            // Inserting may grow the slot pool, so `block` is re-read after it
+            int rest_slot = common_blocks_insert_after(&shadow, i, &rest);
+            block = &shadow.blocks[i];
+            if (rest_slot != NO_SLOT) {
+                stats.timestamp_counter++;
+                
+                // The remainder takes the original block's place in the address-ordered list
+                free_block_t* remainder = (free_block_t*)(heap_memory + rest.offset);
+                remainder->size = rest.size;
+                remainder->next = *best_prev;
+                *best_prev = remainder;
+                best_fit->size = total_size;
+                
+                common_stats_add_free(&stats, &tracker, rest.size);
+                common_profile_count(&profile, PROFILE_SPLITS, 1);
+                
+                // Update current block to exact size when splitting
+                block->size = total_size;
             }
-            
-            // Update block state
-            blocks[i].state = BLOCK_ALLOCATED;
-            blocks[i].allocation_id = stats.next_allocation_id;
-            blocks[i].timestamp = stats.timestamp_counter++;
-            blocks[i].requested_size = requested_size;
-            break;
+            // If not splitting, keep the original block size
         }
+        
+        // Update block state
+        block->state = BLOCK_ALLOCATED;
+        block->allocation_id = stats.next_allocation_id;
+        block->timestamp = stats.timestamp_counter++;
+        block->requested_size = requested_size;
+        common_stats_add_alloc(&stats, &tracker, block->size, requested_size);
+        common_lifetime_alloc(&lifetimes, requested_size, stats.timestamp_counter);
     }
+#else
+    (void)requested_size;
+    common_stats_remove_free(&stats, &tracker, best_fit->size);
     
-    add_log("MALLOC", stats.next_allocation_id, size, offset, 1);
+    // The remainder takes the original block's place in the address-ordered list
+    free_block_t* remainder = NULL;
+    if (common_split_fits(best_fit->size, total_size, sizeof(free_block_t))) {
+        remainder = (free_block_t*)((uint8_t*)best_fit + total_size);
+        remainder->size = best_fit->size - total_size;
+        remainder->next = *best_prev;
+        *best_prev = remainder;
+        best_fit->size = total_size;
+        common_stats_add_free(&stats, &tracker, remainder->size);
+        common_profile_count(&profile, PROFILE_SPLITS, 1);
+    }
+    if (coalesce_cursor == best_fit) coalesce_cursor = remainder;
+    common_stats_add_alloc(&stats, &tracker, best_fit->size, 0);
+#endif
+    
+    add_log(LOG_MALLOC, stats.next_allocation_id, size, offset, 1);
     stats.next_allocation_id++;
     
-    sort_blocks();
     update_stats();
     return user_ptr;
 }
 
-void heap_free(void* ptr) {
+static void release_block(void* ptr) {
+    heap_version++;
+    
     if (!ptr) return;
     
-    size_t* block_start = (size_t*)ptr - 1;
-    size_t user_size = *block_start;
-    size_t total_size = user_size + sizeof(size_t);
+    heap_header_t* block_start = common_block_header(ptr);
     size_t offset = (uint8_t*)block_start - heap_memory;
     
+#ifndef HEAP_HEADLESS
+    // Only blocks handed out by heap_malloc may be linked back in
+    int i = common_blocks_find(&shadow, 0, offset);
+    if (i == NO_SLOT || shadow.blocks[i].state != BLOCK_ALLOCATED) {
+        add_log(LOG_FREE, 0, 0, offset, 0);
+        return;
+    }
+    
+    block_info_t* block = &shadow.blocks[i];
+    common_stats_remove_alloc(&stats, &tracker, block->size, block->requested_size);
+    common_lifetime_free(&lifetimes, block->requested_size, block->timestamp, stats.timestamp_counter);
+    common_stats_add_free(&stats, &tracker, block->size);
+    block->state = BLOCK_FREED;
+    uint32_t alloc_id = block->allocation_id;
+    block->allocation_id = 0;
+    block->requested_size = 0;
+#else
+    // Without the shadow table only the bounds can be checked; like the real
+    // allocator, a double free is not detected
+    if ((uint8_t*)ptr < heap_memory + HEAP_HEADER_SIZE || offset >= stats.total_size) {
+        add_log(LOG_FREE, 0, 0, offset, 0);
+        return;
+    }
+    
+    int i = NO_SLOT;
     uint32_t alloc_id = 0;
+    common_stats_remove_alloc(&stats, &tracker, *block_start, 0);
+    common_stats_add_free(&stats, &tracker, *block_start);
+#endif
+    
+    // The header still holds the full block size, which is the free node's size field
+    insert_block_into_free_list((free_block_t*)block_start, i, coalesce_policy == COALESCE_IMMEDIATE);
+    
+    if (coalesce_policy == COALESCE_INCREMENTAL) {
+        coalesce_steps(coalesce_budget);
+    }
+    
+    add_log(LOG_FREE, alloc_id, 0, offset, 1);
+    update_stats();
+}
+
+// Resize the allocated block at `block_start` (shadow slot `index`) to
+// `total_size` bytes where it is: shrinking splits off the tail, growing
+// absorbs the run of free blocks that follows it. Returns the realloc_kind_t,
+// or -1 if the block has to move.
+static int resize_in_place(heap_header_t* block_start, int index, size_t total_size, size_t requested_size) {
+    size_t current = *block_start;
+    
+#ifndef HEAP_HEADLESS
+    block_info_t* block = &shadow.blocks[index];
+    size_t old_requested = block->requested_size;
+#else
+    (void)index;
+    size_t old_requested = 0;
+    requested_size = 0;
+#endif
     
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].offset == offset && blocks[i].state == BLOCK_ALLOCATED) {
-            blocks[i].state = BLOCK_FREED;
-            alloc_id = blocks[i].allocation_id;
-            blocks[i].allocation_id = 0;
-            blocks[i].requested_size = 0;
-            stats.free_block_count++;  // Increment when freeing
-            break;
+    if (total_size <= current) {
+        int tail_slot = NO_SLOT;
+        int split = common_split_fits(current, total_size, sizeof(free_block_t));
+#ifndef HEAP_HEADLESS
+        if (split) {
+            block_info_t rest = {
+                .offset = (size_t)((uint8_t*)block_start - heap_memory) + total_size,
+                .size = current - total_size,
+                .state = BLOCK_FREED,
+                .allocation_id = 0,
+                .timestamp = stats.timestamp_counter,
+                .requested_size = 0,
+                .region_id = 0
+            };
+            tail_slot = common_blocks_insert_after(&shadow, index, &rest);
+            block = &shadow.blocks[index];
+            split = tail_slot != NO_SLOT;
         }
+        block->requested_size = requested_size;
+        common_lifetime_resize(&lifetimes, old_requested, requested_size, block->timestamp,
+                               stats.timestamp_counter);
+#endif
+        common_stats_remove_alloc(&stats, &tracker, current, old_requested);
+        if (!split) {
+            common_stats_add_alloc(&stats, &tracker, current, requested_size);
+            return REALLOC_SAME;
+        }
+        
+        stats.timestamp_counter++;
+        free_block_t* tail = (free_block_t*)((uint8_t*)block_start + total_size);
+        tail->size = current - total_size;
+        *block_start = total_size;
+#ifndef HEAP_HEADLESS
+        block->size = total_size;
+#endif
+        common_stats_add_alloc(&stats, &tracker, total_size, requested_size);
+        common_stats_add_free(&stats, &tracker, tail->size);
+        common_profile_count(&profile, PROFILE_SPLITS, 1);
+        
+        // The tail is released like a freed block, so it merges with a free right neighbour
+        insert_block_into_free_list(tail, tail_slot, coalesce_policy == COALESCE_IMMEDIATE);
+        return REALLOC_SHRUNK;
     }
     
-    free_block_t* free_block = (free_block_t*)block_start;
-    free_block->size = total_size;
-    free_block->next = free_list;
-    free_list = free_block;
+    // Find the first free block past this one, then check that the contiguous
+    // run starting at its end covers the growth before changing anything
+    uint8_t* end = (uint8_t*)block_start + current;
+    free_block_t** link = &free_list;
+    uint32_t visited = 0;
+    while (*link && (uint8_t*)*link < end) {
+        link = &(*link)->next;
+        visited++;
+    }
+    common_profile_count(&profile, PROFILE_VISITED, visited);
     
-    immediate_neighbor_coalesce(offset);
-    coalesce_pending = 1;
+    size_t available = current;
+    free_block_t* after = *link;
+    while (after && (uint8_t*)after == (uint8_t*)block_start + available && available < total_size) {
+        available += after->size;
+        after = after->next;
+    }
+    if (available < total_size) return -1;
     
-    add_log("FREE", alloc_id, 0, offset, 1);
-    sort_blocks();
-    update_stats();
+    // Absorb the run; `after` is the first free block left behind it
+    int absorbed = 0;
+    for (free_block_t* run = *link; run != after; run = run->next) {
+        common_stats_remove_free(&stats, &tracker, run->size);
+#ifndef HEAP_HEADLESS
+        int right = shadow.next[index];
+        if (coalesce_cursor == right) coalesce_cursor = index;
+        common_blocks_remove(&shadow, right);
+#else
+        if (coalesce_cursor == run) coalesce_cursor = NULL;
+#endif
+        absorbed++;
+    }
+    *link = after;
+    common_profile_count(&profile, PROFILE_MERGES, absorbed);
+    
+    // Give back what the run has beyond the request if it can stand alone
+    size_t final_size = available;
+    if (common_split_fits(available, total_size, sizeof(free_block_t))) {
+        int split = 1;
+#ifndef HEAP_HEADLESS
+        block_info_t rest = {
+            .offset = (size_t)((uint8_t*)block_start - heap_memory) + total_size,
+            .size = available - total_size,
+            .state = BLOCK_FREE,
+            .allocation_id = 0,
+            .timestamp = stats.timestamp_counter,
+            .requested_size = 0,
+            .region_id = 0
+        };
+        split = common_blocks_insert_after(&shadow, index, &rest) != NO_SLOT;
+        block = &shadow.blocks[index];
+#endif
+        if (split) {
+            stats.timestamp_counter++;
+            free_block_t* rest_block = (free_block_t*)((uint8_t*)block_start + total_size);
+            rest_block->size = available - total_size;
+            rest_block->next = after;
+            *link = rest_block;
+            common_stats_add_free(&stats, &tracker, rest_block->size);
+            common_profile_count(&profile, PROFILE_SPLITS, 1);
+            final_size = total_size;
+        }
+    }
+    
+    *block_start = final_size;
+    common_stats_remove_alloc(&stats, &tracker, current, old_requested);
+    common_stats_add_alloc(&stats, &tracker, final_size, requested_size);
+#ifndef HEAP_HEADLESS
+    block->size = final_size;
+    block->requested_size = requested_size;
+    common_lifetime_resize(&lifetimes, old_requested, requested_size, block->timestamp, stats.timestamp_counter);
+#endif
+    return REALLOC_GREW;
+}
+
+static void* reallocate_block(void* ptr, size_t size) {
+    if (!ptr) return allocate_block(size);
+    if (size == 0) {
+        release_block(ptr);
+        return NULL;
+    }
+    
+    heap_version++;
+    
+    heap_header_t* block_start = common_block_header(ptr);
+    size_t offset = (uint8_t*)block_start - heap_memory;
+    
+#ifndef HEAP_HEADLESS
+    int i = common_blocks_find(&shadow, 0, offset);
+    if (i == NO_SLOT || shadow.blocks[i].state != BLOCK_ALLOCATED) {
+        add_log(LOG_REALLOC, 0, size, offset, 0);
+        return NULL;
+    }
+    uint32_t alloc_id = shadow.blocks[i].allocation_id;
+#else
+    if ((uint8_t*)ptr < heap_memory + HEAP_HEADER_SIZE || offset >= stats.total_size) {
+        add_log(LOG_REALLOC, 0, size, offset, 0);
+        return NULL;
+    }
+    int i = NO_SLOT;
+    uint32_t alloc_id = 0;
+#endif
+    
+    size_t total_size = common_block_total(size);
+    if (total_size < sizeof(free_block_t)) total_size = sizeof(free_block_t);
+    
+    int kind = resize_in_place(block_start, i, total_size, size);
+    if (kind >= 0) {
+        common_log_event(&event_log, &stats, LOG_REALLOC, alloc_id, size, offset, 1, 0, (uint8_t)kind);
+        update_stats();
+        return ptr;
+    }
+    
+    // Neither neighbour can give the space: copy into a new block
+    size_t old_usable = *block_start - HEAP_HEADER_SIZE;
+    void* moved = allocate_block(size);
+    if (!moved) {
+        add_log(LOG_REALLOC, alloc_id, size, offset, 0);
+        return NULL;
+    }
+    memcpy(moved, ptr, old_usable < size ? old_usable : size);
+    release_block(ptr);
+    
+    size_t moved_offset = (uint8_t*)moved - HEAP_HEADER_SIZE - heap_memory;
+    common_log_event(&event_log, &stats, LOG_REALLOC, stats.next_allocation_id - 1, size, moved_offset, 1, 0,
+                     REALLOC_MOVED);
+    return moved;
+}
+
+void* heap_malloc(size_t size) {
+    common_profile_begin(&profile, PROFILE_OP_MALLOC);
+    void* ptr = allocate_block(size);
+    common_profile_end(&profile);
+    return ptr;
+}
+
+void heap_free(void* ptr) {
+    common_profile_begin(&profile, PROFILE_OP_FREE);
+    release_block(ptr);
+    common_profile_end(&profile);
+}
+
+// Resize the block at `ptr`, in place when it can be; NULL `ptr` allocates and
+// size 0 frees. Returns NULL (leaving the block alone) if it cannot be resized.
+void* heap_realloc(void* ptr, size_t size) {
+    common_profile_begin(&profile, PROFILE_OP_REALLOC);
+    void* result = reallocate_block(ptr, size);
+    common_profile_end(&profile);
+    return result;
 }
 
 void heap_reset() {
-    heap_init(stats.total_size);
+    heap_init(stats.total_size, 0);
+}
+
+// 0 (the only region) if heap_malloc(size) would find a block now, -1 if not,
+// not counting merges a deferred policy would make first; O(log free blocks),
+// or O(1) from the histogram in headless builds
+int heap_can_allocate(size_t size) {
+    size_t total_size = common_block_total(size);
+    if (total_size < sizeof(free_block_t)) total_size = sizeof(free_block_t);
+    return common_free_fit(&stats, &tracker, total_size) ? 0 : -1;
 }
 
+static void* run_op_malloc(size_t size, uint8_t flags) {
+    (void)flags;
+    return heap_malloc(size);
+}
+
+int heap_run_ops(const op_t* ops, int n, uint32_t* out_ptrs) {
+    return common_run_ops(ops, n, out_ptrs, run_op_malloc, heap_free);
+}
+
+// Fill `ops` with a synthetic workload for heap_run_ops; the heap is not touched
+int heap_generate_ops(const workload_config_t* config, op_t* ops, int capacity) {
+    return common_workload_generate(config, ops, capacity);
+}
+
+// Write a checkpoint of the heap to `buf` (NULL measures); returns its size,
+// and only wrote it if that is <= capacity
+size_t heap_snapshot(void* buf, size_t capacity) {
+    checkpoint_writer_t w;
+    common_checkpoint_begin(&w, buf, capacity, 4);
+    common_checkpoint_put_stats(&w, &stats, &tracker);
+    common_checkpoint_put_log(&w, &event_log);
+#ifndef HEAP_HEADLESS
+    common_checkpoint_put_blocks(&w, &shadow, coalesce_cursor);
+#else
+    uintptr_t cursor = common_checkpoint_offset(coalesce_cursor, heap_memory);
+    common_checkpoint_put_value(&w, cursor);
+#endif
+    
+    uintptr_t head = common_checkpoint_offset(free_list, heap_memory);
+    common_checkpoint_put_value(&w, head);
+    uint8_t* image = common_checkpoint_put(&w, heap_memory, stats.total_size);
+    for (free_block_t* block = image ? free_list : NULL; block; block = block->next) {
+        common_checkpoint_pack(image, (uint8_t*)&block->next - heap_memory, block->next, heap_memory);
+    }
+    return common_checkpoint_end(&w);
+}
+
+// Put the heap back as heap_snapshot() saw it; returns 0, or -1 if `buf` is
+// not a checkpoint of this module (the heap is left alone) or is truncated
+// inside (the heap is re-initialised empty)
+int heap_restore(const void* buf, size_t size) {
+    checkpoint_reader_t r;
+    if (!common_checkpoint_open(&r, buf, size, 4)) return -1;
+    heap_version++;
+    
+    common_checkpoint_get_stats(&r, &stats, &tracker);
+    common_checkpoint_get_log(&r, &event_log);
+#ifndef HEAP_HEADLESS
+    coalesce_cursor = common_checkpoint_get_blocks(&r, &shadow);
+#else
+    uintptr_t cursor = 0;
+    common_checkpoint_get_value(&r, cursor);
+#endif
+    
+    uintptr_t head = 0;
+    common_checkpoint_get_value(&r, head);
+    if (r.ok && common_arena_reserve(&arena, stats.total_size) < stats.total_size) r.ok = 0;
+    heap_memory = arena.base;
+    if (!r.ok || !common_checkpoint_get(&r, heap_memory, stats.total_size)) {
+        heap_init(DEFAULT_HEAP_SIZE, 0);
+        return -1;
+    }
+    
+    free_list = (free_block_t*)common_checkpoint_pointer(head, heap_memory);
+    for (free_block_t* block = free_list; block; block = block->next) {
+        block->next = (free_block_t*)common_checkpoint_pointer((uintptr_t)block->next, heap_memory);
+    }
+#ifdef HEAP_HEADLESS
+    coalesce_cursor = (free_block_t*)common_checkpoint_pointer(cursor, heap_memory);
+#endif
+    update_stats();
+    return 0;
+}
+
+// Headless builds rebuild the block list and stats before they are read
 heap_stats_t* get_heap_stats() {
+    refresh_snapshot();
+    stats.metadata_bytes = common_metadata_bytes(&shadow, &block_table, &event_log, &tracker);
     return &stats;
 }
 
 int get_block_count() {
-    return block_count;
+    refresh_snapshot();
+    return shadow.count;
 }
 
+// Blocks in address order
 block_info_t* get_block_info(int index) {
-    if (index >= 0 && index < block_count) {
-        return &blocks[index];
-    }
-    return NULL;
+    refresh_snapshot();
+    return common_blocks_at(&shadow, index);
+}
+
+// Structure-of-arrays snapshot of the block list for zero-copy reads from JS
+uint32_t* get_block_table_ptr() {
+    refresh_snapshot();
+    return common_block_table_refresh(&block_table, &shadow, heap_version);
+}
+
+int get_block_table_len() {
+    refresh_snapshot();
+    return shadow.count;
+}
+
+// Merges a coalescing pass would still make under a deferred policy
+int get_pending_merges() {
+    const uint32_t* words = get_block_table_ptr();
+    return words ? common_columns_free_pairs(words, 0, (int)words[2]) : 0;
+}
+
+uint32_t get_heap_version() {
+    return heap_version;
 }
 
 int get_log_count() {
-    return log_count;
+    return (int)event_log.count;
 }
 
 log_entry_t* get_log_entry(int index) {
-    if (index >= 0 && index < log_count) {
-        return &logs[index];
-    }
-    return NULL;
+    return common_log_at(&event_log, index);
+}
+
+// Copy events with seq > `seq` into `out`, oldest first; returns the number copied
+int get_log_since(uint32_t seq, log_entry_t* out, int max) {
+    return common_log_since(&event_log, seq, out, max);
+}
+
+// Events overwritten before they could be read
+uint32_t get_log_lost() {
+    return event_log.lost;
 }
 
 void clear_log() {
-    log_count = 0;
+    heap_version++;
+    common_log_clear(&event_log);
+}
+
+// Log2 histogram of `op_kind` latencies in ns (PROFILE_BUCKETS words into
+// `out`); returns the number of calls recorded
+int get_latency_histogram(int op_kind, uint32_t* out) {
+    return common_profile_histogram(&profile, op_kind, PROFILE_NS, out);
+}
+
+// The same for any profile_metric_t, e.g. free-list nodes visited
+int get_op_histogram(int op_kind, int metric, uint32_t* out) {
+    return common_profile_histogram(&profile, op_kind, metric, out);
+}
+
+// Worst case of `metric` over every recorded `op_kind` call
+uint32_t get_op_max(int op_kind, int metric) {
+    return common_profile_max(&profile, op_kind, metric);
+}
+
+void reset_op_profile() {
+    common_profile_clear(&profile);
+}
+
+// Size-class churn, block lifetimes and the live-bytes timeline since heap_init
+lifetime_profile_t* get_lifetime_profile() {
+    return &lifetimes;
 }
\ No newline at end of file
@@ -1,13 +1,32 @@
 #include "heap_common.h"
 #include <stdbool.h>
+#ifdef HEAP_THREAD_SAFE
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+// Thread-safe builds (-DHEAP_THREAD_SAFE) give each region its own mutex, so
+// threads allocating from different regions never wait on each other. A
+// malloc try-locks the regions its flags allow in id order, passes over any
+// another thread holds, and only waits for one if no free region can serve
+// it; a free locks just its block's region. The shadow list, log and profile
+// span every region, so these builds are headless. Region counters change
+// under their own lock and are folded into the global stats when read.
+// Readers, heap_coalesce_step and the deferred coalescing policies (their
+// cursor walks every region) take all the locks. heap_init,
+// heap_define_regions and heap_restore must not run alongside other calls.
+#if defined(HEAP_THREAD_SAFE) && !defined(HEAP_HEADLESS)
+#error "HEAP_THREAD_SAFE builds must be headless (-DHEAP_HEADLESS)"
+#endif
 
 // Configuration flag - set at compile time
 #ifndef USE_PHYSICAL_MEM
 #define USE_PHYSICAL_MEM 0
 #endif
 
-#define MAX_REGIONS 8
-#define FRAGMENTATION_THRESHOLD 30.0f
+#define MAX_REGIONS 8            // region masks are one byte
+#define REGION_NAME_MAX 16
+#define REGION_MIN_SIZE (HEAP_ALIGNMENT > 32 ? HEAP_ALIGNMENT : 32)   // a free-list node, rounded up
 
 // Region flags
 #define REGION_FLAG_FAST     0x01
@@ -15,64 +34,95 @@
 #define REGION_FLAG_UNCACHED 0x04
 #define REGION_FLAG_PINNED   0x08
 
+// What heap_malloc_flags does when no region with the requested flags fits
+typedef enum {
+    REGION_FALLBACK_STRICT = 0,     // fail (the default)
+    REGION_FALLBACK_ANY = 1         // then try every other region
+} region_fallback_t;
+
+// Free block structure. Its region follows from its address
+// (get_region_for_ptr), so the node is no bigger than heap_4's.
+typedef struct free_block {
+    heap_header_t size;
+    struct free_block* next;
+} free_block_t;
+
 // Region structure
 typedef struct {
+#ifdef HEAP_THREAD_SAFE
+    _Alignas(64) pthread_mutex_t lock;  // regions start on their own cache line
+#endif
     uint8_t* start;
     size_t size;
     uint8_t region_id;
     uint8_t flags;
-    const char* name;
-    
-    // Per-region statistics
-    size_t allocated_bytes;
-    size_t free_bytes;
-    uint32_t allocation_count;
-    uint32_t free_block_count;
-    size_t largest_free_block;
-    size_t smallest_free_block;
-    size_t min_free_bytes;
-    float external_fragmentation;
-    float internal_fragmentation;
+    char name[REGION_NAME_MAX];
+    free_block_t* free_list;
+    
+    // Per-region statistics, maintained incrementally
+    heap_stats_t stats;
+    stats_tracker_t tracker;
 } heap_region_t;
 
-// Free block structure
-typedef struct free_block {
+// Region descriptor for heap_define_regions(), in the style of FreeRTOS's
+// HeapRegion_t. Physical builds use `start` and `size` as given; simulated
+// builds ignore `start` and carve the regions from one arena in table order.
+typedef struct {
+    uint8_t* start;
     size_t size;
-    uint8_t region_id;
-    struct free_block* next;
-} free_block_t;
+    uint8_t flags;
+    const char* name;       // copied; NULL names the region after its first flag
+} heap_region_desc_t;
 
 #if USE_PHYSICAL_MEM
-    // External symbols from linker script - generic region naming
-    extern uint8_t __heap_region_0_start[];
-    extern uint8_t __heap_region_0_size[];
-    extern uint8_t __heap_region_1_start[];
-    extern uint8_t __heap_region_1_size[];
-    extern uint8_t __heap_region_2_start[];
-    extern uint8_t __heap_region_2_size[];
-    extern uint32_t __heap_region_count;
+    // Linker-generated table, one entry per bank (see c/heap_regions.ld).
+    // Words are 32 bits, so this is for 32-bit targets.
+    typedef struct {
+        uint32_t start;
+        uint32_t size;
+        uint32_t flags;
+    } heap_region_ld_t;
+    
+    extern const heap_region_ld_t __heap_region_table[];
+    extern const heap_region_ld_t __heap_region_table_end[];
 #else
-    // Separate static arrays for software simulation - generic naming
-    #define REGION_0_SIZE 10240  // 10KB
-    #define REGION_1_SIZE 13312  // 13KB
-    #define REGION_2_SIZE 9216   // 9KB
-    
-    static uint8_t heap_region_0[REGION_0_SIZE];
-    static uint8_t heap_region_1[REGION_1_SIZE];
-    static uint8_t heap_region_2[REGION_2_SIZE];
+    // Software simulation. heap_init(size) scales the layout's sizes to
+    // `size`: the default 32KB heap is split 10KB / 13KB / 9KB and other
+    // sizes keep those ratios.
+    #define REGION_MIN_TOTAL  256
+    
+    static heap_arena_t arena;
 #endif
 
 // Global state
-static block_info_t blocks[MAX_BLOCKS];
-static log_entry_t logs[MAX_LOG_ENTRIES];
+static block_list_t shadow;
+static log_ring_t event_log;
 static heap_stats_t stats;
 static heap_region_t regions[MAX_REGIONS];
-static free_block_t* free_lists[MAX_REGIONS];
+static uint8_t regions_by_address[MAX_REGIONS];  // Region ids sorted by start address
+static uint8_t region_masks[256];                // flags -> bit per region with any of them
+static uint8_t region_fallback[256];             // flags -> region_fallback_t, kept across heap_init
 static int region_count = 0;
-static int block_count = 0;
-static int log_count = 0;
+#ifdef HEAP_THREAD_SAFE
+static atomic_uint heap_version = 0;
+#else
+static uint32_t heap_version = 0;
+#endif
+static block_table_t block_table;
+static op_profile_t profile;
+static lifetime_profile_t lifetimes;
 static bool initialized = false;
-static int coalesce_pending = 0;
+static size_t requested_heap_size = 0;  // Region sizes are rounded; reset splits this again
+static coalesce_policy_t coalesce_policy = COALESCE_IMMEDIATE;
+static int coalesce_budget = DEFAULT_COALESCE_BUDGET;
+#ifndef HEAP_HEADLESS
+static int coalesce_cursor = NO_SLOT;    // Slot the next deferred step starts at
+#else
+static free_block_t* coalesce_cursor = NULL;    // Free block the next deferred step starts at
+static uint32_t snapshot_version = 0;
+static free_block_t** snapshot_free = NULL;    // One region's free list sorted by address
+static int snapshot_free_capacity = 0;
+#endif
 
 // Forward declarations
 static void update_region_stats(uint8_t region_id);
@@ -80,120 +130,212 @@ static void update_global_stats(void);
 static uint8_t get_region_for_ptr(void* ptr);
 static size_t get_offset_in_region(void* ptr, uint8_t region_id);
 static void immediate_neighbor_coalesce(size_t local_offset, uint8_t region_id);
-static void full_coalesce(void);
+static int coalesce_steps(int budget);
 void* heap_malloc_flags(size_t size, uint8_t flags);
 
+// Counters that operations in different regions may bump at the same time
+#ifdef HEAP_THREAD_SAFE
+#define shared_inc(counter) ((void)__atomic_fetch_add(&(counter), 1, __ATOMIC_RELAXED))
+#else
+#define shared_inc(counter) ((void)(counter)++)
+#endif
+
 // Use common utility functions
+#ifndef HEAP_THREAD_SAFE
 #define add_log(action, alloc_id, size, offset, success) \
-    common_add_log_with_region(logs, &log_count, &stats, action, alloc_id, size, offset, success, 0, 0)
+    common_add_log(&event_log, &stats, action, alloc_id, size, offset, success)
 
 #define add_log_with_region(action, alloc_id, size, offset, success, region_id, flags) \
-    common_add_log_with_region(logs, &log_count, &stats, action, alloc_id, size, offset, success, region_id, flags)
+    common_log_event(&event_log, &stats, action, alloc_id, size, offset, success, region_id, flags)
+#else
+// Headless, so only the timestamp advances
+#define add_log(action, alloc_id, size, offset, success) \
+    ((void)(action), (void)(alloc_id), (void)(size), (void)(offset), (void)(success), \
+     shared_inc(stats.timestamp_counter))
+#define add_log_with_region(action, alloc_id, size, offset, success, region_id, flags) \
+    ((void)(region_id), (void)(flags), add_log(action, alloc_id, size, offset, success))
+#endif
 
-#define sort_blocks() common_sort_blocks(blocks, block_count)
+// Per-region stat deltas
+#define region_add_free(rid, size) \
+    common_stats_add_free(&regions[rid].stats, &regions[rid].tracker, size)
+#define region_remove_free(rid, size) \
+    common_stats_remove_free(&regions[rid].stats, &regions[rid].tracker, size)
+#define region_add_alloc(rid, size, requested) \
+    common_stats_add_alloc(&regions[rid].stats, &regions[rid].tracker, size, requested)
+#define region_remove_alloc(rid, size, requested) \
+    common_stats_remove_alloc(&regions[rid].stats, &regions[rid].tracker, size, requested)
 
-// Region configuration - developers customize names and flags
-typedef struct {
-    const char* name;
-    uint8_t flags;
-} region_config_t;
+#ifdef HEAP_THREAD_SAFE
+static pthread_once_t locks_once = PTHREAD_ONCE_INIT;
+
+static void init_locks(void) {
+    for (int r = 0; r < MAX_REGIONS; r++) pthread_mutex_init(&regions[r].lock, NULL);
+}
 
-static const region_config_t region_configs[] = {
-    { "FAST", REGION_FLAG_FAST },
-    { "DMA", REGION_FLAG_DMA },
-    { "UNCACHED", REGION_FLAG_UNCACHED }
+// Every region lock, in id order, for calls that read or change all regions
+static void lock_all(void) {
+    pthread_once(&locks_once, init_locks);
+    for (int r = 0; r < MAX_REGIONS; r++) pthread_mutex_lock(&regions[r].lock);
+}
+
+static void unlock_all(void) {
+    for (int r = MAX_REGIONS - 1; r >= 0; r--) pthread_mutex_unlock(&regions[r].lock);
+}
+
+// The deferred policies move one cursor across every region, so under them an
+// operation holds all the locks. Returns whether it does.
+static bool lock_op(void) {
+    if (coalesce_policy == COALESCE_IMMEDIATE) return false;
+    lock_all();
+    return true;
+}
+
+#define lock_region(rid, exclusive) ((exclusive) ? (void)0 : (void)pthread_mutex_lock(&regions[rid].lock))
+#define unlock_region(rid, exclusive) ((exclusive) ? unlock_all() : (void)pthread_mutex_unlock(&regions[rid].lock))
+#define unlock_op(exclusive) ((exclusive) ? unlock_all() : (void)0)
+
+// Region stats are finished when get_heap_stats() folds them together
+#define stats_changed() ((void)0)
+#else
+#define lock_all() ((void)0)
+#define unlock_all() ((void)0)
+#define lock_op() false
+#define lock_region(rid, exclusive) ((void)(exclusive))
+#define unlock_region(rid, exclusive) ((void)0)
+#define unlock_op(exclusive) ((void)0)
+#define stats_changed() update_global_stats()
+#endif
+
+// Layout used until heap_define_regions() replaces it - developers customize
+// names and flags here
+static const heap_region_desc_t default_layout[] = {
+    { NULL, 10240, REGION_FLAG_FAST, "FAST" },
+    { NULL, 13312, REGION_FLAG_DMA, "DMA" },
+    { NULL, 9216, REGION_FLAG_UNCACHED, "UNCACHED" }
 };
 
-// Initialize regions based on compilation mode
-static bool heap_define_regions(void) {
+static heap_region_desc_t layout[MAX_REGIONS];
+static char layout_names[MAX_REGIONS][REGION_NAME_MAX];
+static int layout_count = 0;            // 0 = default_layout, or the linker table
+
+static void set_region_name(heap_region_t* region, const char* name) {
+    static const char* const flag_names[] = { "FAST", "DMA", "UNCACHED", "PINNED" };
+    
+    if (!name) {
+        name = "REGION";
+        for (int b = 0; b < 4; b++) {
+            if (region->flags & (1u << b)) {
+                name = flag_names[b];
+                break;
+            }
+        }
+    }
+    strncpy(region->name, name, REGION_NAME_MAX - 1);
+    region->name[REGION_NAME_MAX - 1] = '\0';
+}
+
+// Lay the regions out from the current descriptor table. `size` is the
+// simulated heap size; physical builds take their sizes from the table.
+static bool build_regions(size_t size) {
 #if USE_PHYSICAL_MEM
-    // Use linker script symbols for physical memory
-    region_count = (int)&__heap_region_count;
-    if (region_count > MAX_REGIONS) region_count = MAX_REGIONS;
-    if (region_count > 3) region_count = 3; // We only have 3 configs
-    
-    // Region 0
-    if (region_count > 0) {
-        regions[0].start = __heap_region_0_start;
-        regions[0].size = (size_t)__heap_region_0_size;
-        regions[0].region_id = 0;
-        regions[0].flags = region_configs[0].flags;
-        regions[0].name = region_configs[0].name;
-    }
-    
-    // Region 1
-    if (region_count > 1) {
-        regions[1].start = __heap_region_1_start;
-        regions[1].size = (size_t)__heap_region_1_size;
-        regions[1].region_id = 1;
-        regions[1].flags = region_configs[1].flags;
-        regions[1].name = region_configs[1].name;
-    }
-    
-    // Region 2
-    if (region_count > 2) {
-        regions[2].start = __heap_region_2_start;
-        regions[2].size = (size_t)__heap_region_2_size;
-        regions[2].region_id = 2;
-        regions[2].flags = region_configs[2].flags;
-        regions[2].name = region_configs[2].name;
+    (void)size;
+    if (layout_count > 0) {
+        region_count = layout_count;
+        for (int i = 0; i < region_count; i++) {
+            regions[i].start = layout[i].start;
+            regions[i].size = common_align_down(layout[i].size);
+            regions[i].flags = layout[i].flags;
+            set_region_name(&regions[i], layout[i].name);
+        }
+    } else {
+        region_count = (int)(__heap_region_table_end - __heap_region_table);
+        if (region_count > MAX_REGIONS) region_count = MAX_REGIONS;
+        for (int i = 0; i < region_count; i++) {
+            const heap_region_ld_t* entry = &__heap_region_table[i];
+            regions[i].start = (uint8_t*)(uintptr_t)entry->start;
+            regions[i].size = common_align_down((size_t)entry->size);
+            regions[i].flags = (uint8_t)entry->flags;
+            set_region_name(&regions[i], NULL);
+        }
+    }
+    for (int i = 0; i < region_count; i++) {
+        regions[i].region_id = i;
     }
-    
 #else
-    // Use separate static arrays for software simulation
-    region_count = 3;
-    
-    // Region 0
-    regions[0].start = heap_region_0;
-    regions[0].size = REGION_0_SIZE;
-    regions[0].region_id = 0;
-    regions[0].flags = region_configs[0].flags;
-    regions[0].name = region_configs[0].name;
-    
-    // Region 1
-    regions[1].start = heap_region_1;
-    regions[1].size = REGION_1_SIZE;
-    regions[1].region_id = 1;
-    regions[1].flags = region_configs[1].flags;
-    regions[1].name = region_configs[1].name;
-    
-    // Region 2
-    regions[2].start = heap_region_2;
-    regions[2].size = REGION_2_SIZE;
-    regions[2].region_id = 2;
-    regions[2].flags = region_configs[2].flags;
-    regions[2].name = region_configs[2].name;
+    const heap_region_desc_t* table = layout_count > 0 ? layout : default_layout;
+    region_count = layout_count > 0 ? layout_count : (int)(sizeof(default_layout) / sizeof(default_layout[0]));
+    
+    uint64_t weight = 0;
+    for (int i = 0; i < region_count; i++) weight += table[i].size;
+    
+    // Every region must hold at least one free-list node; the slack lets a
+    // tiny share be raised to that without overrunning the arena
+    if (size < REGION_MIN_TOTAL) size = REGION_MIN_TOTAL;
+    size_t slack = (size_t)region_count * REGION_MIN_SIZE;
+    size_t reserved = common_arena_reserve(&arena, size + slack);
+    if (reserved < size + slack) size = reserved - slack;
+    
+    uint8_t* start = arena.base;
+    for (int i = 0; i < region_count; i++) {
+        size_t share = weight > 0 ? (size_t)((uint64_t)size * table[i].size / weight) : size / (size_t)region_count;
+        regions[i].start = start;
+        regions[i].size = common_align_down(share);
+        if (regions[i].size < REGION_MIN_SIZE) regions[i].size = REGION_MIN_SIZE;
+        regions[i].region_id = i;
+        regions[i].flags = table[i].flags;
+        set_region_name(&regions[i], table[i].name);
+        start += regions[i].size;
+    }
 #endif
     
     // Initialize per-region state and free lists
     for (int i = 0; i < region_count; i++) {
         // Initialize region stats
-        regions[i].allocated_bytes = 0;
-        regions[i].free_bytes = regions[i].size;
-        regions[i].allocation_count = 0;
-        regions[i].free_block_count = 1;
-        regions[i].largest_free_block = regions[i].size;
-        regions[i].smallest_free_block = regions[i].size;
-        regions[i].min_free_bytes = regions[i].size;
-        regions[i].external_fragmentation = 0.0f;
-        regions[i].internal_fragmentation = 0.0f;
+        memset(&regions[i].stats, 0, sizeof(heap_stats_t));
+        regions[i].stats.total_size = regions[i].size;
+        regions[i].stats.min_free_bytes = regions[i].size;
+        common_stats_reset(&regions[i].stats, &regions[i].tracker);
+        region_add_free(i, regions[i].size);
+        common_stats_finish(&regions[i].stats, &regions[i].tracker);
         
         // Initialize free list
-        free_lists[i] = (free_block_t*)regions[i].start;
-        free_lists[i]->size = regions[i].size;
-        free_lists[i]->region_id = i;
-        free_lists[i]->next = NULL;
+        regions[i].free_list = (free_block_t*)regions[i].start;
+        regions[i].free_list->size = regions[i].size;
+        regions[i].free_list->next = NULL;
         
+#ifndef HEAP_HEADLESS
         // Add block for visualization - use region-local offset
-        if (block_count < MAX_BLOCKS) {
-            blocks[block_count].offset = 0; // Region-local offset
-            blocks[block_count].size = regions[i].size;
-            blocks[block_count].state = BLOCK_FREE;
-            blocks[block_count].allocation_id = 0;
-            blocks[block_count].timestamp = stats.timestamp_counter++;
-            blocks[block_count].requested_size = 0;
-            blocks[block_count].region_id = i;
-            block_count++;
+        if (shadow.count < shadow.limit) {
+            block_info_t whole = {
+                .offset = 0, // Region-local offset
+                .size = regions[i].size,
+                .state = BLOCK_FREE,
+                .allocation_id = 0,
+                .timestamp = stats.timestamp_counter++,
+                .requested_size = 0,
+                .region_id = i
+            };
+            common_blocks_append(&shadow, &whole);
+        }
+#endif
+    }
+    
+    // Order regions by address so pointer lookup is a binary search
+    for (int i = 0; i < region_count; i++) {
+        int j = i;
+        while (j > 0 && regions[regions_by_address[j - 1]].start > regions[i].start) {
+            regions_by_address[j] = regions_by_address[j - 1];
+            j--;
+        }
+        regions_by_address[j] = (uint8_t)i;
+    }
+    
+    // Every flags value maps straight to the regions it may use
+    for (int f = 0; f < 256; f++) {
+        region_masks[f] = 0;
+        for (int i = 0; i < region_count; i++) {
+            if (f == 0 || (regions[i].flags & f)) region_masks[f] |= (uint8_t)(1u << i);
         }
     }
     
@@ -202,10 +344,19 @@ static bool heap_define_regions(void) {
 
 static uint8_t get_region_for_ptr(void* ptr) {
     uint8_t* byte_ptr = (uint8_t*)ptr;
-    for (int i = 0; i < region_count; i++) {
-        if (byte_ptr >= regions[i].start && 
-            byte_ptr < regions[i].start + regions[i].size) {
-            return regions[i].region_id;
+    int lo = 0;
+    int hi = region_count - 1;
+    
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        const heap_region_t* region = &regions[regions_by_address[mid]];
+        
+        if (byte_ptr < region->start) {
+            hi = mid - 1;
+        } else if (byte_ptr >= region->start + region->size) {
+            lo = mid + 1;
+        } else {
+            return region->region_id;
         }
     }
     return 0;
@@ -220,70 +371,11 @@ static size_t get_offset_in_region(void* ptr, uint8_t region_id) {
 static void update_region_stats(uint8_t region_id) {
     if (region_id >= region_count) return;
     
-    heap_region_t* region = &regions[region_id];
-    
-    // Reset stats
-    region->allocated_bytes = 0;
-    region->free_bytes = 0;
-    region->allocation_count = 0;
-    region->free_block_count = 0;
-    region->largest_free_block = 0;
-    region->smallest_free_block = region->size;
-    
-    size_t total_requested = 0;
-    size_t total_allocated = 0;
-    int has_free_blocks = 0;
-    
-    // Calculate from blocks
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].region_id != region_id) continue;
-        
-        if (blocks[i].state == BLOCK_ALLOCATED) {
-            region->allocated_bytes += blocks[i].size;
-            region->allocation_count++;
-            
-            if (blocks[i].requested_size > 0) {
-                total_requested += blocks[i].requested_size;
-                total_allocated += blocks[i].size;
-            }
-        } else if (blocks[i].state == BLOCK_FREE || blocks[i].state == BLOCK_FREED) {
-            region->free_bytes += blocks[i].size;
-            region->free_block_count++;
-            has_free_blocks = 1;
-            
-            if (blocks[i].size > region->largest_free_block) {
-                region->largest_free_block = blocks[i].size;
-            }
-            if (blocks[i].size < region->smallest_free_block) {
-                region->smallest_free_block = blocks[i].size;
-            }
-        }
-    }
-    
-    // Calculate external fragmentation
-    if (region->free_bytes > 0 && region->largest_free_block > 0) {
-        region->external_fragmentation = (1.0f - (float)region->largest_free_block / (float)region->free_bytes) * 100.0f;
-    } else {
-        region->external_fragmentation = 0.0f;
-    }
-    
-    // Calculate internal fragmentation
-    if (total_allocated > 0 && total_requested > 0) {
-        region->internal_fragmentation = ((float)(total_allocated - total_requested) / (float)total_allocated) * 100.0f;
-    } else {
-        region->internal_fragmentation = 0.0f;
-    }
-    
-    if (!has_free_blocks) {
-        region->smallest_free_block = 0;
-    }
-    
-    // Update minimum free bytes
-    if (region->min_free_bytes == 0 || region->free_bytes < region->min_free_bytes) {
-        region->min_free_bytes = region->free_bytes;
-    }
+    common_stats_finish(&regions[region_id].stats, &regions[region_id].tracker);
+    COMMON_VERIFY_STATS(&shadow, region_id, &regions[region_id].stats, "heap_5");
 }
 
+// O(region_count): regions carry their own running totals
 static void update_global_stats(void) {
     // Update per-region stats first
     for (int i = 0; i < region_count; i++) {
@@ -297,27 +389,33 @@ static void update_global_stats(void) {
     stats.free_block_count = 0;
     stats.largest_free_block = 0;
     stats.smallest_free_block = stats.total_size;
+    memset(stats.free_size_histogram, 0, sizeof(stats.free_size_histogram));
     
     float total_external_frag = 0;
     float total_internal_frag = 0;
     int regions_contributing = 0;
     
     for (int i = 0; i < region_count; i++) {
-        stats.allocated_bytes += regions[i].allocated_bytes;
-        stats.free_bytes += regions[i].free_bytes;
-        stats.allocation_count += regions[i].allocation_count;
-        stats.free_block_count += regions[i].free_block_count;
+        const heap_stats_t* rs = &regions[i].stats;
+        
+        stats.allocated_bytes += rs->allocated_bytes;
+        stats.free_bytes += rs->free_bytes;
+        stats.allocation_count += rs->allocation_count;
+        stats.free_block_count += rs->free_block_count;
+        for (int b = 0; b < FREE_SIZE_BUCKETS; b++) {
+            stats.free_size_histogram[b] += rs->free_size_histogram[b];
+        }
         
-        if (regions[i].largest_free_block > stats.largest_free_block) {
-            stats.largest_free_block = regions[i].largest_free_block;
+        if (rs->largest_free_block > stats.largest_free_block) {
+            stats.largest_free_block = rs->largest_free_block;
         }
-        if (regions[i].smallest_free_block < stats.smallest_free_block && regions[i].free_block_count > 0) {
-            stats.smallest_free_block = regions[i].smallest_free_block;
+        if (rs->smallest_free_block < stats.smallest_free_block && rs->free_block_count > 0) {
+            stats.smallest_free_block = rs->smallest_free_block;
         }
         
-        if (regions[i].free_bytes > 0) {
-            total_external_frag += regions[i].external_fragmentation;
-            total_internal_frag += regions[i].internal_fragmentation;
+        if (rs->free_bytes > 0) {
+            total_external_frag += rs->external_fragmentation;
+            total_internal_frag += rs->internal_fragmentation;
             regions_contributing++;
         }
     }
@@ -341,126 +439,284 @@ static void update_global_stats(void) {
     }
 }
 
-static void immediate_neighbor_coalesce(size_t local_offset, uint8_t region_id) {
-    sort_blocks();
-    
-    int freed_idx = -1;
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].offset == local_offset && blocks[i].region_id == region_id) {
-            freed_idx = i;
+// Remove a block that is being absorbed by a neighbour from its region's free list
+static void unlink_free_block(uint8_t region_id, free_block_t* target) {
+    free_block_t** current = &regions[region_id].free_list;
+    uint32_t visited = 0;
+    while (*current) {
+        visited++;
+        if (*current == target) {
+            *current = target->next;
             break;
         }
+        current = &(*current)->next;
     }
-    
-    if (freed_idx == -1) return;
+    common_profile_count(&profile, PROFILE_VISITED, visited);
+}
+
+// Cut `block` down to `total_size` and put the rest on its region's free list
+static void split_free_block(free_block_t* block, size_t total_size, uint8_t region_id) {
+    free_block_t* remainder = (free_block_t*)((uint8_t*)block + total_size);
+    remainder->size = block->size - total_size;
+    remainder->next = regions[region_id].free_list;
+    regions[region_id].free_list = remainder;
+    block->size = total_size;
+    
+    region_add_free(region_id, remainder->size);
+    common_profile_count(&profile, PROFILE_SPLITS, 1);
+}
+
+#ifndef HEAP_HEADLESS
+// Free slot `left` and the entry after it are address neighbours in one
+// region: fold the right one into the left, in both the real free list and
+// the block list
+static void merge_with_next(int left) {
+    block_info_t* block = &shadow.blocks[left];
+    int right = shadow.next[left];
+    uint8_t region_id = block->region_id;
+    
+    region_remove_free(region_id, block->size);
+    region_remove_free(region_id, shadow.blocks[right].size);
+    block->size += shadow.blocks[right].size;
+    block->state = BLOCK_FREE;
+    region_add_free(region_id, block->size);
+    
+    unlink_free_block(region_id, (free_block_t*)(regions[region_id].start + shadow.blocks[right].offset));
+    ((free_block_t*)(regions[region_id].start + block->offset))->size = block->size;
+    
+    if (coalesce_cursor == right) coalesce_cursor = left;
+    common_blocks_remove(&shadow, right);
+    common_profile_count(&profile, PROFILE_MERGES, 1);
+}
+
+static bool can_merge_with_next(int left) {
+    if (left == NO_SLOT || shadow.next[left] == NO_SLOT) return false;
+    
+    const block_info_t* a = &shadow.blocks[left];
+    const block_info_t* b = &shadow.blocks[shadow.next[left]];
+    return a->region_id == b->region_id &&
+           a->state != BLOCK_ALLOCATED &&
+           b->state != BLOCK_ALLOCATED &&
+           a->offset + a->size == b->offset;
+}
+
+static void immediate_neighbor_coalesce(size_t local_offset, uint8_t region_id) {
+    // The list is ordered by (region, offset), so neighbours are one link away
+    int freed_idx = common_blocks_find(&shadow, region_id, local_offset);
+    if (freed_idx == NO_SLOT) return;
     
     int coalesced = 0;
     
     // Check left neighbor (same region only)
-    if (freed_idx > 0 && 
-        blocks[freed_idx - 1].region_id == region_id &&
-        (blocks[freed_idx - 1].state == BLOCK_FREE || blocks[freed_idx - 1].state == BLOCK_FREED) &&
-        blocks[freed_idx - 1].offset + blocks[freed_idx - 1].size == blocks[freed_idx].offset) {
-        
-        blocks[freed_idx - 1].size += blocks[freed_idx].size;
-        blocks[freed_idx - 1].state = BLOCK_FREE;
-        
-        for (int i = freed_idx; i < block_count - 1; i++) {
-            blocks[i] = blocks[i + 1];
-        }
-        block_count--;
-        freed_idx--;
+    int left = shadow.prev[freed_idx];
+    if (can_merge_with_next(left)) {
+        merge_with_next(left);
+        freed_idx = left;
         coalesced = 1;
     }
     
     // Check right neighbor (same region only)
-    if (freed_idx >= 0 && freed_idx < block_count - 1 &&
-        blocks[freed_idx + 1].region_id == region_id &&
-        (blocks[freed_idx + 1].state == BLOCK_FREE || blocks[freed_idx + 1].state == BLOCK_FREED) &&
-        blocks[freed_idx].offset + blocks[freed_idx].size == blocks[freed_idx + 1].offset) {
-        
-        blocks[freed_idx].size += blocks[freed_idx + 1].size;
-        blocks[freed_idx].state = BLOCK_FREE;
-        
-        for (int i = freed_idx + 1; i < block_count - 1; i++) {
-            blocks[i] = blocks[i + 1];
-        }
-        block_count--;
+    if (can_merge_with_next(freed_idx)) {
+        merge_with_next(freed_idx);
         coalesced = 1;
     }
     
     if (coalesced) {
-        add_log("COALESCE", 0, 0, local_offset, 1);
+        add_log(LOG_COALESCE, 0, 0, local_offset, 1);
     }
 }
 
-static void full_coalesce(void) {
-    sort_blocks();
+// Examine at most `budget` adjacent pairs of shadow entries, starting where
+// the previous call stopped, and merge the free ones. Returns the merge count.
+static int coalesce_steps(int budget) {
+    int merged = 0;
+    int step;
+    
+    for (step = 0; step < budget && shadow.count > 1; step++) {
+        if (coalesce_cursor == NO_SLOT || shadow.next[coalesce_cursor] == NO_SLOT) {
+            coalesce_cursor = shadow.head;
+        }
+        
+        if (can_merge_with_next(coalesce_cursor)) {
+            merge_with_next(coalesce_cursor);
+            merged++;
+        } else {
+            coalesce_cursor = shadow.next[coalesce_cursor];
+        }
+    }
     
-    int write_idx = 0;
-    int coalesce_count = 0;
+    common_profile_count(&profile, PROFILE_COALESCE_STEPS, step);
+    if (merged > 0) {
+        add_log_with_region(LOG_COALESCE, 0, merged, shadow.blocks[coalesce_cursor].offset, 1,
+                            shadow.blocks[coalesce_cursor].region_id, 0);
+    }
+    return merged;
+}
+
+static inline void refresh_snapshot(void) {}
+#else
+// Headless: a free block's address neighbours are found by walking its
+// region's free list, the same O(free blocks) walk as the best-fit search
+
+// Free block of `region_id` that starts at `address`, or NULL
+static free_block_t* find_free_at(const uint8_t* address, uint8_t region_id) {
+    uint32_t visited = 0;
+    free_block_t* node = regions[region_id].free_list;
+    for (; node && (uint8_t*)node != address; node = node->next) visited++;
+    common_profile_count(&profile, PROFILE_VISITED, visited + (node != NULL));
+    return node;
+}
+
+// Free block of `region_id` that starts where `block` ends, or NULL
+static free_block_t* find_free_successor(const free_block_t* block, uint8_t region_id) {
+    return find_free_at((const uint8_t*)block + block->size, region_id);
+}
+
+// Fold free block `right` into its address neighbour `left`
+static void merge_free_blocks(free_block_t* left, free_block_t* right, uint8_t region_id) {
+    unlink_free_block(region_id, right);
+    region_remove_free(region_id, left->size);
+    region_remove_free(region_id, right->size);
+    left->size += right->size;
+    region_add_free(region_id, left->size);
+    common_profile_count(&profile, PROFILE_MERGES, 1);
+    
+    if (coalesce_cursor == right) coalesce_cursor = left;
+}
+
+static void immediate_neighbor_coalesce(size_t local_offset, uint8_t region_id) {
+    free_block_t* block = (free_block_t*)(regions[region_id].start + local_offset);
+    int coalesced = 0;
     
-    for (int i = 0; i < block_count; i++) {
-        blocks[write_idx] = blocks[i];
-        
-        if (blocks[write_idx].state == BLOCK_FREED) {
-            blocks[write_idx].state = BLOCK_FREE;
-            blocks[write_idx].allocation_id = 0;
+    free_block_t* right = find_free_successor(block, region_id);
+    if (right) {
+        merge_free_blocks(block, right, region_id);
+        coalesced = 1;
+    }
+    
+    uint32_t visited = 0;
+    for (free_block_t* node = regions[region_id].free_list; node; node = node->next) {
+        visited++;
+        if ((uint8_t*)node + node->size == (uint8_t*)block) {
+            merge_free_blocks(node, block, region_id);
+            coalesced = 1;
+            break;
         }
+    }
+    common_profile_count(&profile, PROFILE_VISITED, visited);
+    
+    if (coalesced) {
+        add_log(LOG_COALESCE, 0, 0, local_offset, 1);
+    }
+}
+
+// Next free block after `block` across the regions' lists, wrapping around
+static free_block_t* next_free_block(free_block_t* block) {
+    int r = 0;
+    if (block) {
+        if (block->next) return block->next;
+        r = get_region_for_ptr(block) + 1;
+    }
+    for (int n = 0; n < region_count; n++, r++) {
+        if (r >= region_count) r = 0;
+        if (regions[r].free_list) return regions[r].free_list;
+    }
+    return NULL;
+}
+
+// Examine at most `budget` free blocks, starting where the previous call
+// stopped, and merge each with a free successor. Returns the merge count.
+static int coalesce_steps(int budget) {
+    int merged = 0;
+    int step;
+    
+    for (step = 0; step < budget; step++) {
+        if (!coalesce_cursor) coalesce_cursor = next_free_block(NULL);
+        if (!coalesce_cursor) break;
         
-        // Coalesce only within the same region
-        while (i + 1 < block_count && 
-               blocks[write_idx].state == BLOCK_FREE &&
-               (blocks[i + 1].state == BLOCK_FREE || blocks[i + 1].state == BLOCK_FREED) &&
-               blocks[write_idx].region_id == blocks[i + 1].region_id &&
-               blocks[write_idx].offset + blocks[write_idx].size == blocks[i + 1].offset) {
-            
-            blocks[write_idx].size += blocks[i + 1].size;
-            blocks[write_idx].state = BLOCK_FREE;
-            blocks[write_idx].allocation_id = 0;
-            i++;
-            coalesce_count++;
+        uint8_t region_id = get_region_for_ptr(coalesce_cursor);
+        free_block_t* right = find_free_successor(coalesce_cursor, region_id);
+        if (right) {
+            merge_free_blocks(coalesce_cursor, right, region_id);
+            merged++;
+        } else {
+            coalesce_cursor = next_free_block(coalesce_cursor);
         }
-        write_idx++;
     }
     
-    if (coalesce_count > 0) {
-        block_count = write_idx;
-        add_log("FULL_COALESCE", 0, coalesce_count, 0, 1);
+    common_profile_count(&profile, PROFILE_COALESCE_STEPS, step);
+    if (merged > 0) {
+        uint8_t region_id = get_region_for_ptr(coalesce_cursor);
+        add_log_with_region(LOG_COALESCE, 0, merged, get_offset_in_region(coalesce_cursor, region_id), 1,
+                            region_id, 0);
     }
+    return merged;
+}
+
+// Rebuild the block list region by region. Free blocks are matched against
+// the sorted free list; every other header holds its block's payload size.
+static void refresh_snapshot(void) {
+    if (!common_snapshot_begin(&shadow, &snapshot_version, heap_version)) return;
     
-    // Rebuild free lists
     for (int r = 0; r < region_count; r++) {
-        free_lists[r] = NULL;
-    }
-    
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].state == BLOCK_FREE) {
-            uint8_t rid = blocks[i].region_id;
-            size_t local_offset = blocks[i].offset;
+        int free_count = 0;
+        for (free_block_t* node = regions[r].free_list; node; node = node->next) {
+            if (!common_grow((void**)&snapshot_free, &snapshot_free_capacity, free_count + 1,
+                             sizeof(free_block_t*))) {
+                break;
+            }
+            snapshot_free[free_count++] = node;
+        }
+        if (free_count > 1) qsort(snapshot_free, (size_t)free_count, sizeof(free_block_t*), common_ptr_compare);
+        
+        int next_free = 0;
+        size_t offset = 0;
+        while (offset < regions[r].size) {
+            free_block_t* block = (free_block_t*)(regions[r].start + offset);
+            int is_free = next_free < free_count && snapshot_free[next_free] == block;
+            size_t size = is_free ? block->size : block->size + HEAP_HEADER_SIZE;
+            if (size == 0 || size > regions[r].size - offset) break;
             
-            free_block_t* fb = (free_block_t*)(regions[rid].start + local_offset);
-            fb->size = blocks[i].size;
-            fb->region_id = rid;
-            fb->next = free_lists[rid];
-            free_lists[rid] = fb;
+            next_free += is_free;
+            common_snapshot_add(&shadow, (uint8_t)r, offset, size, is_free ? BLOCK_FREE : BLOCK_ALLOCATED);
+            offset += size;
         }
     }
     
-    coalesce_pending = 0;
+    heap_stats_t* region_stats[MAX_REGIONS];
+    for (int r = 0; r < region_count; r++) region_stats[r] = &regions[r].stats;
+    common_snapshot_stats(&block_table, &shadow, heap_version, region_stats, region_count);
 }
+#endif
 
-void heap_init(size_t size) {
+// `size` bytes split across the regions and room for `max_blocks` shadow
+// entries (0 keeps the current capacity)
+void heap_init(size_t size, size_t max_blocks) {
+    heap_version++;
+    
     memset(&stats, 0, sizeof(stats));
     
-    block_count = 0;
-    log_count = 0;
-    coalesce_pending = 0;
+#ifndef HEAP_HEADLESS
+    common_blocks_init(&shadow, common_block_limit(common_heap_size(size), max_blocks, shadow.limit));
+#else
+    (void)max_blocks;
+#endif
+    common_log_init(&event_log, common_heap_size(size));
+    common_profile_clear(&profile);
+    common_lifetime_clear(&lifetimes);
     
-    if (!initialized) {
-        heap_define_regions();
-        initialized = true;
-    }
+    // Always rebuild regions: the block list and the per-region stats were just cleared
+#ifdef HEAP_THREAD_SAFE
+    pthread_once(&locks_once, init_locks);
+#endif
+    requested_heap_size = common_heap_size(size);
+    build_regions(requested_heap_size);
+    initialized = true;
+#ifndef HEAP_HEADLESS
+    coalesce_cursor = shadow.head;
+#else
+    coalesce_cursor = NULL;
+#endif
     
     // Calculate total size from all regions
     stats.total_size = 0;
@@ -472,144 +728,709 @@ void heap_init(size_t size) {
     stats.min_free_bytes = stats.total_size;
     
     update_global_stats();
-    add_log("INIT", 0, stats.total_size, 0, 1);
+    add_log(LOG_INIT, 0, stats.total_size, 0, 1);
 }
 
-void* heap_malloc_flags(size_t size, uint8_t flags) {
-    if (!initialized) return NULL;
+// heap_init with a coalescing policy; heap_init/heap_reset keep the last one chosen
+void heap_init_coalesce(size_t size, int policy, int budget) {
+    coalesce_policy = (policy >= COALESCE_IMMEDIATE && policy <= COALESCE_MANUAL) ?
+                      (coalesce_policy_t)policy : COALESCE_IMMEDIATE;
+    coalesce_budget = budget > 0 ? budget : DEFAULT_COALESCE_BUDGET;
+    heap_init(size, 0);
+}
+
+// Replace the region layout, as vPortDefineHeapRegions() does, and
+// reinitialise the heap with it. The `count` descriptors (at most
+// MAX_REGIONS) give region ids in table order. Simulated builds get exactly
+// the sizes given; later heap_init calls scale them to the new heap size.
+// count 0 goes back to the default layout. Returns the region count, or 0
+// if the table is rejected: a region too small for a free-list node, or,
+// in physical builds, overlapping ranges.
+int heap_define_regions(const heap_region_desc_t* descs, int count) {
+    if (count < 0 || count > MAX_REGIONS || (count > 0 && !descs)) return 0;
+    
+    for (int i = 0; i < count; i++) {
+        if (descs[i].size < REGION_MIN_SIZE) return 0;
+#if USE_PHYSICAL_MEM
+        for (int j = 0; j < i; j++) {
+            if (descs[i].start < descs[j].start + descs[j].size &&
+                descs[j].start < descs[i].start + descs[i].size) return 0;
+        }
+#endif
+    }
     
-    size_t requested_size = size;
-    size_t aligned_size = (size + 7) & ~7;
-    size_t total_size = aligned_size + sizeof(size_t);
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        layout[i] = descs[i];
+        if (descs[i].name) {
+            strncpy(layout_names[i], descs[i].name, REGION_NAME_MAX - 1);
+            layout_names[i][REGION_NAME_MAX - 1] = '\0';
+            layout[i].name = layout_names[i];
+        }
+        total += descs[i].size;
+    }
+    layout_count = count;
     
-    // Find best region based on flags
-    free_block_t* best_fit = NULL;
+    if (count == 0) {
+        for (size_t i = 0; i < sizeof(default_layout) / sizeof(default_layout[0]); i++) {
+            total += default_layout[i].size;
+        }
+    }
+    heap_init(total, 0);
+    return region_count;
+}
+
+// Choose what heap_malloc_flags(size, flags) does when no region with those
+// flags fits, e.g. (REGION_FLAG_FAST, REGION_FALLBACK_ANY) for "FAST, then
+// anywhere"; every flags value starts out strict. Kept across heap_init.
+void heap_set_region_fallback(uint8_t flags, int policy) {
+    region_fallback[flags] = policy == REGION_FALLBACK_ANY ? REGION_FALLBACK_ANY : REGION_FALLBACK_STRICT;
+}
+
+// Run up to `budget` deferred coalescing steps now; returns the number of merges
+int heap_coalesce_step(int budget) {
+    heap_version++;
+    
+    if (!initialized) return 0;
+    
+    lock_all();
+    int merged = coalesce_steps(budget);
+    update_global_stats();
+    unlock_all();
+    return merged;
+}
+
+// Regions to try if none of region_masks[flags] can serve a request
+static uint8_t fallback_mask(uint8_t flags) {
+    if (region_fallback[flags] != REGION_FALLBACK_ANY) return 0;
+    return region_masks[0] & (uint8_t)~region_masks[flags];
+}
+
+// Best fit across the regions in `mask`; returns the link to the block. A
+// region whose largest free block is too small is skipped without a walk.
+static free_block_t** find_best_fit(size_t total_size, uint8_t mask, uint8_t* best_region) {
     free_block_t** best_prev = NULL;
-    uint8_t best_region = 0;
+    uint32_t visited = 0;
     
-    for (int r = 0; r < region_count; r++) {
-        // Skip regions that don't match required flags
-        if (flags && !(regions[r].flags & flags)) continue;
+    for (uint32_t m = mask; m; m &= m - 1) {
+        int r = __builtin_ctz(m);
+        if (common_free_largest(&regions[r].tracker) < total_size) continue;
         
-        free_block_t** current = &free_lists[r];
+        free_block_t** current = &regions[r].free_list;
         while (*current) {
             if ((*current)->size >= total_size) {
-                if (!best_fit || (*current)->size < best_fit->size) {
-                    best_fit = *current;
+                if (!best_prev || (*current)->size < (*best_prev)->size) {
                     best_prev = current;
-                    best_region = r;
+                    *best_region = r;
                 }
             }
             current = &((*current)->next);
+            visited++;
+        }
+    }
+    common_profile_count(&profile, PROFILE_VISITED, visited);
+    return best_prev;
+}
+
+#ifdef HEAP_THREAD_SAFE
+// Best fit in the first region of `mask` that can serve the request, which
+// is left locked. Regions held by other threads are passed over at first and
+// only waited for once every free one has turned out too small. When the
+// caller already holds every lock, this is the best fit across `mask`.
+static free_block_t** lock_best_fit(size_t total_size, uint8_t mask, uint8_t* best_region, bool exclusive) {
+    if (exclusive) return find_best_fit(total_size, mask, best_region);
+    
+    uint8_t contended = 0;
+    for (uint32_t m = mask; m; m &= m - 1) {
+        int r = __builtin_ctz(m);
+        if (pthread_mutex_trylock(&regions[r].lock) != 0) {
+            contended |= (uint8_t)(1u << r);
+            continue;
         }
+        free_block_t** best_prev = find_best_fit(total_size, (uint8_t)(1u << r), best_region);
+        if (best_prev) return best_prev;
+        pthread_mutex_unlock(&regions[r].lock);
+    }
+    
+    for (uint32_t m = contended; m; m &= m - 1) {
+        int r = __builtin_ctz(m);
+        pthread_mutex_lock(&regions[r].lock);
+        free_block_t** best_prev = find_best_fit(total_size, (uint8_t)(1u << r), best_region);
+        if (best_prev) return best_prev;
+        pthread_mutex_unlock(&regions[r].lock);
+    }
+    return NULL;
+}
+#else
+#define lock_best_fit(total_size, mask, best_region, exclusive) \
+    ((void)(exclusive), find_best_fit(total_size, mask, best_region))
+#endif
+
+// The matching regions first, then the fallback ones
+static free_block_t** find_region_fit(size_t total_size, uint8_t flags, uint8_t* best_region, bool exclusive) {
+    free_block_t** best_prev = lock_best_fit(total_size, region_masks[flags], best_region, exclusive);
+    uint8_t fallback = fallback_mask(flags);
+    if (!best_prev && fallback) best_prev = lock_best_fit(total_size, fallback, best_region, exclusive);
+    return best_prev;
+}
+
+static void* allocate_block(size_t size, uint8_t flags) {
+    heap_version++;
+    
+    if (!initialized) return NULL;
+    
+    size_t requested_size = size;
+    size_t total_size = common_block_total(size);
+    
+    // A freed block must be able to hold its free-list node
+    if (total_size < sizeof(free_block_t)) total_size = sizeof(free_block_t);
+    
+    bool exclusive = lock_op();
+    if (coalesce_policy == COALESCE_INCREMENTAL) {
+        coalesce_steps(coalesce_budget);
     }
     
-    if (!best_fit) {
-        add_log_with_region("MALLOC", stats.next_allocation_id, size, 0, 0, 0xFF, flags);
+    // Find best region based on flags; thread-safe builds return it locked
+    uint8_t best_region = 0;
+    free_block_t** best_prev = find_region_fit(total_size, flags, &best_region, exclusive);
+    
+    // One more bounded round of merging before giving up
+    if (!best_prev && coalesce_policy == COALESCE_INCREMENTAL && coalesce_steps(coalesce_budget) > 0) {
+        best_prev = find_region_fit(total_size, flags, &best_region, exclusive);
+    }
+    
+    if (!best_prev) {
+        stats_changed();
+        add_log_with_region(LOG_MALLOC, stats.next_allocation_id, size, 0, 0, 0xFF, flags);
+        unlock_op(exclusive);
         return NULL;
     }
     
+    free_block_t* best_fit = *best_prev;
+    
     // Remove from free list
     *best_prev = best_fit->next;
     
-    *(size_t*)best_fit = aligned_size;
-    void* user_ptr = (uint8_t*)best_fit + sizeof(size_t);
-    
+    void* user_ptr = common_block_payload(best_fit);
     size_t local_offset = get_offset_in_region(best_fit, best_region);
     
+#ifndef HEAP_HEADLESS
     // Update block tracking
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].region_id == best_region && blocks[i].offset == local_offset &&
-            (blocks[i].state == BLOCK_FREE || blocks[i].state == BLOCK_FREED)) {
-            
-            size_t original_size = blocks[i].size;
+    int i = common_blocks_find(&shadow, best_region, local_offset);
+    block_info_t* block = i != NO_SLOT ? &shadow.blocks[i] : NULL;
+    if (block && (block->state == BLOCK_FREE || block->state == BLOCK_FREED)) {
+        size_t original_size = block->size;
+        region_remove_free(best_region, original_size);
+        
+        // Split if remainder is large enough
+        if (common_split_fits(original_size, total_size, sizeof(free_block_t))) {
+            block_info_t rest = {
+                .offset = local_offset + total_size,
+                .size = original_size - total_size,
+                .state = block->state,
+                .allocation_id = 0,
+                .timestamp = stats.timestamp_counter,
+                .requested_size = 0,
+                .region_id = best_region
+            };
             
-            // Split if remainder is large enough
-            if (original_size > total_size + sizeof(free_block_t) + 16) {
-                if (block_count < MAX_BLOCKS) {
-                    blocks[block_count].offset = local_offset + total_size;
-                    blocks[block_count].size = original_size - total_size;
-                    blocks[block_count].state = blocks[i].state;
-                    blocks[block_count].allocation_id = 0;
-                    blocks[block_count].timestamp = stats.timestamp_counter++;
-                    blocks[block_count].requested_size = 0;
-                    blocks[block_count].region_id = best_region;
-                    
-                    free_block_t* remainder = (free_block_t*)((uint8_t*)best_fit + total_size);
-                    remainder->size = blocks[block_count].size;
-                    remainder->region_id = best_region;
-                    remainder->next = free_lists[best_region];
-                    free_lists[best_region] = remainder;
-                    
-                    block_count++;
-                    blocks[i].size = total_size;
-                }
+            // Inserting may grow the slot pool, so `block` is re-read after it
+            int rest_slot = common_blocks_insert_after(&shadow, i, &rest);
+            block = &shadow.blocks[i];
+            if (rest_slot != NO_SLOT) {
+                stats.timestamp_counter++;
+                split_free_block(best_fit, total_size, best_region);
+                block->size = total_size;
             }
-            
-            blocks[i].state = BLOCK_ALLOCATED;
-            blocks[i].allocation_id = stats.next_allocation_id;
-            blocks[i].timestamp = stats.timestamp_counter++;
-            blocks[i].requested_size = requested_size;
-            break;
         }
+        
+        block->state = BLOCK_ALLOCATED;
+        block->allocation_id = stats.next_allocation_id;
+        block->timestamp = stats.timestamp_counter++;
+        block->requested_size = requested_size;
+        region_add_alloc(best_region, block->size, requested_size);
+        common_lifetime_alloc(&lifetimes, requested_size, stats.timestamp_counter);
     }
+#else
+    (void)requested_size;
+    region_remove_free(best_region, best_fit->size);
+    if (common_split_fits(best_fit->size, total_size, sizeof(free_block_t))) {
+        split_free_block(best_fit, total_size, best_region);
+    }
+    if (coalesce_cursor == best_fit) coalesce_cursor = NULL;
+    region_add_alloc(best_region, best_fit->size, 0);
+#endif
     
-    add_log_with_region("MALLOC", stats.next_allocation_id, size, local_offset, 1, best_region, flags);
-    stats.next_allocation_id++;
+    // The header records everything the block spans, so an unsplit block is
+    // returned whole when it is freed
+    best_fit->size -= HEAP_HEADER_SIZE;
     
-    sort_blocks();
-    update_global_stats();
+    add_log_with_region(LOG_MALLOC, stats.next_allocation_id, size, local_offset, 1, best_region, flags);
+    shared_inc(stats.next_allocation_id);
+    
+    stats_changed();
+    unlock_region(best_region, exclusive);
     return user_ptr;
 }
 
+void* heap_malloc_flags(size_t size, uint8_t flags) {
+    common_profile_begin(&profile, PROFILE_OP_MALLOC_FLAGS);
+    void* ptr = allocate_block(size, flags);
+    common_profile_end(&profile);
+    return ptr;
+}
+
 void* heap_malloc(size_t size) {
-    return heap_malloc_flags(size, 0);
+    common_profile_begin(&profile, PROFILE_OP_MALLOC);
+    void* ptr = allocate_block(size, 0);
+    common_profile_end(&profile);
+    return ptr;
 }
 
-void heap_free(void* ptr) {
+static void release_block(void* ptr) {
+    heap_version++;
+    
     if (!ptr || !initialized) return;
     
-    size_t* block_start = (size_t*)ptr - 1;
-    size_t user_size = *block_start;
-    size_t total_size = user_size + sizeof(size_t);
+    heap_header_t* block_start = common_block_header(ptr);
     
     // Find region
     uint8_t region_id = get_region_for_ptr(block_start);
     size_t local_offset = get_offset_in_region(block_start, region_id);
     
+    bool exclusive = lock_op();
+    lock_region(region_id, exclusive);
     uint32_t alloc_id = 0;
     
-    // Update block tracking
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].offset == local_offset && 
-            blocks[i].region_id == region_id && 
-            blocks[i].state == BLOCK_ALLOCATED) {
-            blocks[i].state = BLOCK_FREED;
-            alloc_id = blocks[i].allocation_id;
-            blocks[i].allocation_id = 0;
-            blocks[i].requested_size = 0;
-            break;
-        }
+#ifndef HEAP_HEADLESS
+    // Only blocks handed out by heap_malloc may be linked back in
+    int i = common_blocks_find(&shadow, region_id, local_offset);
+    if (i == NO_SLOT || shadow.blocks[i].state != BLOCK_ALLOCATED) {
+        add_log_with_region(LOG_FREE, 0, 0, local_offset, 0, region_id, 0);
+        unlock_region(region_id, exclusive);
+        return;
     }
     
+    block_info_t* block = &shadow.blocks[i];
+    region_remove_alloc(region_id, block->size, block->requested_size);
+    common_lifetime_free(&lifetimes, block->requested_size, block->timestamp, stats.timestamp_counter);
+    region_add_free(region_id, block->size);
+    block->state = BLOCK_FREED;
+    alloc_id = block->allocation_id;
+    block->allocation_id = 0;
+    block->requested_size = 0;
+    
+    // An unsplit allocation owns the whole tracked block, not just its header size
+    size_t total_size = block->size;
+#else
+    size_t total_size = *block_start + HEAP_HEADER_SIZE;
+    region_remove_alloc(region_id, total_size, 0);
+    region_add_free(region_id, total_size);
+#endif
+    
     // Add to region's free list
     free_block_t* free_block = (free_block_t*)block_start;
     free_block->size = total_size;
-    free_block->region_id = region_id;
-    free_block->next = free_lists[region_id];
-    free_lists[region_id] = free_block;
+    free_block->next = regions[region_id].free_list;
+    regions[region_id].free_list = free_block;
     
-    immediate_neighbor_coalesce(local_offset, region_id);
-    coalesce_pending = 1;
+    if (coalesce_policy == COALESCE_IMMEDIATE) {
+        immediate_neighbor_coalesce(local_offset, region_id);
+    } else if (coalesce_policy == COALESCE_INCREMENTAL) {
+        coalesce_steps(coalesce_budget);
+    }
     
-    add_log_with_region("FREE", alloc_id, 0, local_offset, 1, region_id, 0);
-    sort_blocks();
-    update_global_stats();
+    add_log_with_region(LOG_FREE, alloc_id, 0, local_offset, 1, region_id, 0);
+    stats_changed();
+    unlock_region(region_id, exclusive);
+}
+
+void heap_free(void* ptr) {
+    common_profile_begin(&profile, PROFILE_OP_FREE);
+    release_block(ptr);
+    common_profile_end(&profile);
+}
+
+// Resize the allocated block at `block_start` (shadow slot `index`) to
+// `total_size` bytes where it is: shrinking splits off the tail, growing
+// absorbs the free blocks that follow it in its region. Returns the
+// realloc_kind_t, or -1 if the block has to move.
+static int resize_in_place(heap_header_t* block_start, int index, uint8_t region_id, size_t total_size,
+                           size_t requested_size) {
+    size_t current = *block_start + HEAP_HEADER_SIZE;
+    size_t local_offset = get_offset_in_region(block_start, region_id);
+    
+#ifndef HEAP_HEADLESS
+    block_info_t* block = &shadow.blocks[index];
+    size_t old_requested = block->requested_size;
+    current = block->size;
+#else
+    (void)index;
+    size_t old_requested = 0;
+    requested_size = 0;
+#endif
+    
+    if (total_size <= current) {
+        int split = common_split_fits(current, total_size, sizeof(free_block_t));
+#ifndef HEAP_HEADLESS
+        if (split) {
+            block_info_t rest = {
+                .offset = local_offset + total_size,
+                .size = current - total_size,
+                .state = BLOCK_FREED,
+                .allocation_id = 0,
+                .timestamp = stats.timestamp_counter,
+                .requested_size = 0,
+                .region_id = region_id
+            };
+            split = common_blocks_insert_after(&shadow, index, &rest) != NO_SLOT;
+            block = &shadow.blocks[index];
+        }
+        block->requested_size = requested_size;
+        common_lifetime_resize(&lifetimes, old_requested, requested_size, block->timestamp,
+                               stats.timestamp_counter);
+#endif
+        region_remove_alloc(region_id, current, old_requested);
+        if (!split) {
+            region_add_alloc(region_id, current, requested_size);
+            return REALLOC_SAME;
+        }
+        
+        // The tail goes on the free list like a freed block
+        shared_inc(stats.timestamp_counter);
+        free_block_t* head = (free_block_t*)block_start;
+        head->size = current;
+        split_free_block(head, total_size, region_id);
+        *block_start = total_size - HEAP_HEADER_SIZE;
+#ifndef HEAP_HEADLESS
+        block->size = total_size;
+#endif
+        region_add_alloc(region_id, total_size, requested_size);
+        
+        if (coalesce_policy == COALESCE_IMMEDIATE) {
+            immediate_neighbor_coalesce(local_offset + total_size, region_id);
+        } else if (coalesce_policy == COALESCE_INCREMENTAL) {
+            coalesce_steps(coalesce_budget);
+        }
+        return REALLOC_SHRUNK;
+    }
+    
+    // Check that the contiguous free run after the block covers the growth
+    // before changing anything
+    size_t available = current;
+#ifndef HEAP_HEADLESS
+    for (int j = shadow.next[index]; available < total_size && j != NO_SLOT; j = shadow.next[j]) {
+        const block_info_t* right = &shadow.blocks[j];
+        if (right->region_id != region_id || right->state == BLOCK_ALLOCATED ||
+            right->offset != local_offset + available) {
+            break;
+        }
+        available += right->size;
+    }
+#else
+    for (free_block_t* right; available < total_size; available += right->size) {
+        right = find_free_at((uint8_t*)block_start + available, region_id);
+        if (!right) break;
+    }
+#endif
+    if (available < total_size) return -1;
+    
+    // Absorb the run
+    int absorbed = 0;
+    for (size_t end = current; end < available; absorbed++) {
+#ifndef HEAP_HEADLESS
+        int right = shadow.next[index];
+        free_block_t* node = (free_block_t*)(regions[region_id].start + shadow.blocks[right].offset);
+        if (coalesce_cursor == right) coalesce_cursor = index;
+        common_blocks_remove(&shadow, right);
+        unlink_free_block(region_id, node);
+#else
+        free_block_t* node = find_free_at((uint8_t*)block_start + end, region_id);
+        unlink_free_block(region_id, node);
+        if (coalesce_cursor == node) coalesce_cursor = NULL;
+#endif
+        region_remove_free(region_id, node->size);
+        end += node->size;
+    }
+    common_profile_count(&profile, PROFILE_MERGES, absorbed);
+    
+    // Give back what the run has beyond the request if it can stand alone
+    free_block_t* grown = (free_block_t*)block_start;
+    grown->size = available;
+    if (common_split_fits(available, total_size, sizeof(free_block_t))) {
+        int split = 1;
+#ifndef HEAP_HEADLESS
+        block_info_t rest = {
+            .offset = local_offset + total_size,
+            .size = available - total_size,
+            .state = BLOCK_FREE,
+            .allocation_id = 0,
+            .timestamp = stats.timestamp_counter,
+            .requested_size = 0,
+            .region_id = region_id
+        };
+        split = common_blocks_insert_after(&shadow, index, &rest) != NO_SLOT;
+        block = &shadow.blocks[index];
+#endif
+        if (split) {
+            shared_inc(stats.timestamp_counter);
+            split_free_block(grown, total_size, region_id);
+        }
+    }
+    
+    size_t final_size = grown->size;
+    *block_start = final_size - HEAP_HEADER_SIZE;
+    region_remove_alloc(region_id, current, old_requested);
+    region_add_alloc(region_id, final_size, requested_size);
+#ifndef HEAP_HEADLESS
+    block->size = final_size;
+    block->requested_size = requested_size;
+    common_lifetime_resize(&lifetimes, old_requested, requested_size, block->timestamp, stats.timestamp_counter);
+#endif
+    return REALLOC_GREW;
+}
+
+static void* reallocate_block(void* ptr, size_t size) {
+    if (!ptr) return allocate_block(size, 0);
+    if (size == 0) {
+        release_block(ptr);
+        return NULL;
+    }
+    
+    heap_version++;
+    
+    if (!initialized) return NULL;
+    
+    heap_header_t* block_start = common_block_header(ptr);
+    uint8_t region_id = get_region_for_ptr(block_start);
+    size_t local_offset = get_offset_in_region(block_start, region_id);
+    
+#ifndef HEAP_HEADLESS
+    int i = common_blocks_find(&shadow, region_id, local_offset);
+    if (i == NO_SLOT || shadow.blocks[i].state != BLOCK_ALLOCATED) {
+        add_log_with_region(LOG_REALLOC, 0, size, local_offset, 0, region_id, 0);
+        return NULL;
+    }
+    uint32_t alloc_id = shadow.blocks[i].allocation_id;
+#else
+    // Only the bounds can be checked without the shadow table
+    if ((uint8_t*)block_start < regions[region_id].start ||
+        local_offset + sizeof(free_block_t) > regions[region_id].size) {
+        add_log_with_region(LOG_REALLOC, 0, size, local_offset, 0, region_id, 0);
+        return NULL;
+    }
+    int i = NO_SLOT;
+    uint32_t alloc_id = 0;
+#endif
+    
+    size_t total_size = common_block_total(size);
+    if (total_size < sizeof(free_block_t)) total_size = sizeof(free_block_t);
+    
+    bool exclusive = lock_op();
+    lock_region(region_id, exclusive);
+    int kind = resize_in_place(block_start, i, region_id, total_size, size);
+    if (kind >= 0) {
+        add_log_with_region(LOG_REALLOC, alloc_id, size, local_offset, 1, region_id, (uint8_t)kind);
+        stats_changed();
+        unlock_region(region_id, exclusive);
+        return ptr;
+    }
+    unlock_region(region_id, exclusive);
+    
+    // Nothing free after it: copy into a new block with the old region's
+    // flags, so DMA memory stays DMA memory
+    size_t old_usable = *block_start;
+    void* moved = allocate_block(size, regions[region_id].flags);
+    if (!moved) {
+        add_log_with_region(LOG_REALLOC, alloc_id, size, local_offset, 0, region_id, 0);
+        return NULL;
+    }
+    memcpy(moved, ptr, old_usable < size ? old_usable : size);
+    release_block(ptr);
+    
+    uint8_t moved_region = get_region_for_ptr(common_block_header(moved));
+    add_log_with_region(LOG_REALLOC, stats.next_allocation_id - 1, size,
+                        get_offset_in_region(common_block_header(moved), moved_region), 1, moved_region, REALLOC_MOVED);
+    return moved;
+}
+
+// Resize the block at `ptr`, in place when it can be; NULL `ptr` allocates and
+// size 0 frees. Returns NULL (leaving the block alone) if it cannot be resized.
+void* heap_realloc(void* ptr, size_t size) {
+    common_profile_begin(&profile, PROFILE_OP_REALLOC);
+    void* result = reallocate_block(ptr, size);
+    common_profile_end(&profile);
+    return result;
 }
 
 void heap_reset() {
     initialized = false;
-    heap_init(stats.total_size);
+    heap_init(requested_heap_size, 0);
+}
+
+static int best_region_fit(size_t total_size, uint8_t mask) {
+    int best_region = -1;
+    size_t best_size = 0;
+    for (uint32_t m = mask; m; m &= m - 1) {
+        int r = __builtin_ctz(m);
+        size_t fit = common_free_fit(&regions[r].stats, &regions[r].tracker, total_size);
+        if (fit && (best_region < 0 || fit < best_size)) {
+            best_region = r;
+            best_size = fit;
+        }
+    }
+    return best_region;
+}
+
+// Region heap_malloc_flags(size, flags) would allocate from now, fallback
+// included, or -1 if it would fail (before any merges a deferred policy makes
+// first). Each region's size index gives its smallest fitting block without
+// walking the free list. Headless builds go by the histograms (see
+// common_free_fit()), so the region named can serve the request but may not
+// be the one best fit would pick.
+int heap_can_allocate_flags(size_t size, uint8_t flags) {
+    if (!initialized) return -1;
+    
+    size_t total_size = common_block_total(size);
+    if (total_size < sizeof(free_block_t)) total_size = sizeof(free_block_t);
+    
+    lock_all();
+    int region = best_region_fit(total_size, region_masks[flags]);
+    if (region < 0 && fallback_mask(flags)) region = best_region_fit(total_size, fallback_mask(flags));
+    unlock_all();
+    return region;
+}
+
+int heap_can_allocate(size_t size) {
+    return heap_can_allocate_flags(size, 0);
+}
+
+// Ops without flags are profiled as plain heap_malloc calls
+static void* run_op_malloc(size_t size, uint8_t flags) {
+    return flags ? heap_malloc_flags(size, flags) : heap_malloc(size);
+}
+
+int heap_run_ops(const op_t* ops, int n, uint32_t* out_ptrs) {
+    return common_run_ops(ops, n, out_ptrs, run_op_malloc, heap_free);
+}
+
+// Fill `ops` with a synthetic workload for heap_run_ops; the heap is not touched
+int heap_generate_ops(const workload_config_t* config, op_t* ops, int capacity) {
+    return common_workload_generate(config, ops, capacity);
+}
+
+// Write a checkpoint of the heap to `buf` (NULL measures); returns its size,
+// and only wrote it if that is <= capacity. Each region is saved with its own
+// stats, free list and bytes; free-list links are stored relative to the
+// region's start.
+size_t heap_snapshot(void* buf, size_t capacity) {
+    checkpoint_writer_t w;
+    lock_all();
+    common_checkpoint_begin(&w, buf, capacity, 5);
+    common_checkpoint_put_value(&w, requested_heap_size);
+    common_checkpoint_put_value(&w, region_count);
+    for (int i = 0; i < region_count; i++) {
+        common_checkpoint_put_value(&w, regions[i].size);
+        common_checkpoint_put_value(&w, regions[i].flags);
+    }
+    
+    common_checkpoint_put_value(&w, stats);
+    common_checkpoint_put_value(&w, initialized);
+    common_checkpoint_put_log(&w, &event_log);
+#ifndef HEAP_HEADLESS
+    common_checkpoint_put_blocks(&w, &shadow, coalesce_cursor);
+#else
+    uint8_t cursor_region = coalesce_cursor ? get_region_for_ptr(coalesce_cursor) : 0;
+    uintptr_t cursor = common_checkpoint_offset(coalesce_cursor, regions[cursor_region].start);
+    common_checkpoint_put_value(&w, cursor_region);
+    common_checkpoint_put_value(&w, cursor);
+#endif
+    
+    for (int i = 0; i < region_count; i++) {
+        uint8_t* start = regions[i].start;
+        uintptr_t head = common_checkpoint_offset(regions[i].free_list, start);
+        common_checkpoint_put_stats(&w, &regions[i].stats, &regions[i].tracker);
+        common_checkpoint_put_value(&w, head);
+        
+        uint8_t* image = common_checkpoint_put(&w, start, regions[i].size);
+        for (free_block_t* block = image ? regions[i].free_list : NULL; block; block = block->next) {
+            common_checkpoint_pack(image, (uint8_t*)&block->next - start, block->next, start);
+        }
+    }
+    unlock_all();
+    return common_checkpoint_end(&w);
+}
+
+// Does the checkpoint's region table match the current regions?
+static bool checkpoint_layout_matches(checkpoint_reader_t* r) {
+    int count = -1;
+    common_checkpoint_get_value(r, count);
+    if (count != region_count) return false;
+    
+    for (int i = 0; i < region_count; i++) {
+        size_t region_size = 0;
+        uint8_t flags = 0;
+        common_checkpoint_get_value(r, region_size);
+        common_checkpoint_get_value(r, flags);
+        if (region_size != regions[i].size || flags != regions[i].flags) return false;
+    }
+    return r->ok;
+}
+
+// Put the heap back as heap_snapshot() saw it. A checkpoint taken at another
+// heap size first re-initialises the heap at that size. Returns 0, or -1 if
+// `buf` is not a checkpoint of this module (the heap is left alone), was
+// taken with another region table (heap_define_regions) or is truncated
+// inside (the heap is then re-initialised empty).
+int heap_restore(const void* buf, size_t size) {
+    checkpoint_reader_t r;
+    size_t heap_size = 0;
+    if (!common_checkpoint_open(&r, buf, size, 5) || !common_checkpoint_get_value(&r, heap_size)) return -1;
+    
+    size_t layout_pos = r.pos;
+    if (!checkpoint_layout_matches(&r)) {
+        heap_init(heap_size, 0);
+        r.ok = 1;
+        r.pos = layout_pos;
+        if (!checkpoint_layout_matches(&r)) return -1;
+    }
+    heap_version++;
+    
+    common_checkpoint_get_value(&r, stats);
+    common_checkpoint_get_value(&r, initialized);
+    common_checkpoint_get_log(&r, &event_log);
+#ifndef HEAP_HEADLESS
+    coalesce_cursor = common_checkpoint_get_blocks(&r, &shadow);
+#else
+    uint8_t cursor_region = 0;
+    uintptr_t cursor = 0;
+    common_checkpoint_get_value(&r, cursor_region);
+    common_checkpoint_get_value(&r, cursor);
+    if (cursor_region >= region_count) cursor = 0;
+#endif
+    
+    for (int i = 0; i < region_count && r.ok; i++) {
+        uint8_t* start = regions[i].start;
+        uintptr_t head = 0;
+        common_checkpoint_get_stats(&r, &regions[i].stats, &regions[i].tracker);
+        common_checkpoint_get_value(&r, head);
+        if (!common_checkpoint_get(&r, start, regions[i].size)) break;
+        
+        regions[i].free_list = (free_block_t*)common_checkpoint_pointer(head, start);
+        for (free_block_t* block = regions[i].free_list; block; block = block->next) {
+            block->next = (free_block_t*)common_checkpoint_pointer((uintptr_t)block->next, start);
+        }
+    }
+    if (!r.ok) {
+        heap_init(requested_heap_size, 0);
+        return -1;
+    }
+    
+#ifdef HEAP_HEADLESS
+    coalesce_cursor = cursor ? (free_block_t*)common_checkpoint_pointer(cursor, regions[cursor_region].start) : NULL;
+#endif
+    update_global_stats();
+    return 0;
 }
 
 // Get region-specific stats
@@ -618,29 +1439,29 @@ heap_stats_t* get_region_stats(uint8_t region_id) {
     
     if (region_id >= region_count) return NULL;
     
+    lock_all();
+    refresh_snapshot();
     update_region_stats(region_id);
     
-    heap_region_t* region = &regions[region_id];
-    
-    memset(&region_stats, 0, sizeof(heap_stats_t));
-    region_stats.total_size = region->size;
-    region_stats.allocated_bytes = region->allocated_bytes;
-    region_stats.free_bytes = region->free_bytes;
-    region_stats.allocation_count = region->allocation_count;
-    region_stats.free_block_count = region->free_block_count;
-    region_stats.largest_free_block = region->largest_free_block;
-    region_stats.smallest_free_block = region->smallest_free_block;
-    region_stats.external_fragmentation = region->external_fragmentation;
-    region_stats.internal_fragmentation = region->internal_fragmentation;
+    region_stats = regions[region_id].stats;
     region_stats.next_allocation_id = stats.next_allocation_id;
     region_stats.timestamp_counter = stats.timestamp_counter;
-    region_stats.min_free_bytes = region->min_free_bytes;
+    unlock_all();
     
     return &region_stats;
 }
 
+// Headless builds rebuild the block list and stats before they are read;
+// thread-safe ones fold the region counters together only here
 heap_stats_t* get_heap_stats() {
+    lock_all();
+    refresh_snapshot();
     update_global_stats();
+    stats.metadata_bytes = common_metadata_bytes(&shadow, &block_table, &event_log, NULL);
+    for (int i = 0; i < region_count; i++) {
+        stats.metadata_bytes += common_tracker_bytes(&regions[i].tracker);
+    }
+    unlock_all();
     return &stats;
 }
 
@@ -660,31 +1481,97 @@ size_t get_region_size(uint8_t region_id) {
 }
 
 int get_block_count() {
-    return block_count;
+    lock_all();
+    refresh_snapshot();
+    int count = shadow.count;
+    unlock_all();
+    return count;
 }
 
+// Blocks in (region, offset) order
 block_info_t* get_block_info(int index) {
-    if (index >= 0 && index < block_count) {
-        return &blocks[index];
-    }
-    return NULL;
+    lock_all();
+    refresh_snapshot();
+    block_info_t* block = common_blocks_at(&shadow, index);
+    unlock_all();
+    return block;
+}
+
+// Structure-of-arrays snapshot of the block list for zero-copy reads from JS
+uint32_t* get_block_table_ptr() {
+    lock_all();
+    refresh_snapshot();
+    uint32_t* words = common_block_table_refresh(&block_table, &shadow, heap_version);
+    unlock_all();
+    return words;
+}
+
+int get_block_table_len() {
+    lock_all();
+    refresh_snapshot();
+    int count = shadow.count;
+    unlock_all();
+    return count;
+}
+
+// Merges a coalescing pass would still make under a deferred policy
+int get_pending_merges() {
+    const uint32_t* words = get_block_table_ptr();
+    return words ? common_columns_free_pairs(words, 0, (int)words[2]) : 0;
+}
+
+uint32_t get_heap_version() {
+    return heap_version;
 }
 
 int get_log_count() {
-    return log_count;
+    return (int)event_log.count;
 }
 
 log_entry_t* get_log_entry(int index) {
-    if (index >= 0 && index < log_count) {
-        return &logs[index];
-    }
-    return NULL;
+    return common_log_at(&event_log, index);
+}
+
+// Copy events with seq > `seq` into `out`, oldest first; returns the number copied
+int get_log_since(uint32_t seq, log_entry_t* out, int max) {
+    return common_log_since(&event_log, seq, out, max);
+}
+
+// Events overwritten before they could be read
+uint32_t get_log_lost() {
+    return event_log.lost;
 }
 
 void clear_log() {
-    log_count = 0;
+    heap_version++;
+    common_log_clear(&event_log);
 }
 
 int get_region_count() {
     return region_count;
+}
+
+// Log2 histogram of `op_kind` latencies in ns (PROFILE_BUCKETS words into
+// `out`); returns the number of calls recorded
+int get_latency_histogram(int op_kind, uint32_t* out) {
+    return common_profile_histogram(&profile, op_kind, PROFILE_NS, out);
+}
+
+// The same for any profile_metric_t, e.g. free-list nodes visited
+int get_op_histogram(int op_kind, int metric, uint32_t* out) {
+    return common_profile_histogram(&profile, op_kind, metric, out);
+}
+
+// Worst case of `metric` over every recorded `op_kind` call
+uint32_t get_op_max(int op_kind, int metric) {
+    return common_profile_max(&profile, op_kind, metric);
+}
+
+void reset_op_profile() {
+    common_profile_clear(&profile);
+}
+
+// Size-class churn, block lifetimes and the live-bytes timeline since heap_init
+lifetime_profile_t* get_lifetime_profile() {
+    return &lifetimes;
 }
\ No newline at end of file
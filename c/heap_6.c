@@ -0,0 +1,775 @@
+#include "heap_common.h"
+
+// Two-level segregated fit (TLSF) allocator.
+//
+// Free blocks are binned by size into FL (power of two) x SL (linear
+// subdivision) classes. A bitmap per level records which bins are non-empty,
+// so finding a fitting bin is two find-first-set operations and malloc/free
+// never walk a list. Free blocks carry a footer (boundary tag) and every
+// header records whether its physical predecessor is free, so both
+// neighbours can be merged in constant time on free.
+
+#define TLSF_SL_LOG2     4
+#define TLSF_SL_COUNT    (1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT    (TLSF_SL_LOG2 + 3)            // Below 128 bytes, classes are linear, 8 bytes apart
+#define TLSF_SMALL_BLOCK (1 << TLSF_FL_SHIFT)
+#define TLSF_FL_MAX      31                            // Covers block sizes up to HEAP_SIZE_LIMIT (2^30)
+#define TLSF_FL_COUNT    (TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+
+// Low bits of the size word (sizes are multiples of 8)
+#define TLSF_FREE_BIT      ((size_t)1)
+#define TLSF_PREV_FREE_BIT ((size_t)2)
+#define TLSF_FLAG_MASK     ((size_t)7)
+
+// Block header. Allocated blocks only use `size`; the user pointer follows it.
+// Free blocks also link into their size class and end with a footer holding
+// their size, which the next block reads when it coalesces backwards.
+typedef struct tlsf_block {
+    size_t size;
+    struct tlsf_block* next_free;
+    struct tlsf_block* prev_free;
+} tlsf_block_t;
+
+#define MIN_BLOCK_SIZE ((sizeof(tlsf_block_t) + sizeof(size_t) + 7) & ~(size_t)7)
+
+// Global state
+static heap_arena_t arena;
+static uint8_t* heap_memory = NULL;
+static block_list_t shadow;
+static log_ring_t event_log;
+static heap_stats_t stats;
+static stats_tracker_t tracker;
+static uint32_t fl_bitmap = 0;
+static uint32_t sl_bitmap[TLSF_FL_COUNT];
+static tlsf_block_t* free_heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+static uint32_t heap_version = 0;
+static block_table_t block_table;
+static op_profile_t profile;
+static lifetime_profile_t lifetimes;
+#ifdef HEAP_HEADLESS
+static uint32_t snapshot_version = 0;
+#endif
+
+// Use common utility functions
+#define add_log(action, alloc_id, size, offset, success) \
+    common_add_log(&event_log, &stats, action, alloc_id, size, offset, success)
+
+// Stats are maintained incrementally; this only derives the O(1) summary fields
+static void update_stats(void) {
+    common_stats_finish(&stats, &tracker);
+    COMMON_VERIFY_STATS(&shadow, -1, &stats, "heap_6");
+}
+
+static inline int tlsf_ffs(uint32_t word) {
+    return __builtin_ctz(word);
+}
+
+static inline int tlsf_fls(size_t size) {
+    return 31 - __builtin_clz((uint32_t)size);
+}
+
+static inline size_t block_size(const tlsf_block_t* block) {
+    return block->size & ~TLSF_FLAG_MASK;
+}
+
+static inline size_t block_offset(const tlsf_block_t* block) {
+    return (size_t)((const uint8_t*)block - heap_memory);
+}
+
+static inline tlsf_block_t* block_next(const tlsf_block_t* block) {
+    size_t next_offset = block_offset(block) + block_size(block);
+    return next_offset < stats.total_size ? (tlsf_block_t*)(heap_memory + next_offset) : NULL;
+}
+
+static inline tlsf_block_t* block_prev(const tlsf_block_t* block) {
+    size_t prev_size = *((const size_t*)block - 1);
+    return (tlsf_block_t*)((uint8_t*)block - prev_size);
+}
+
+// Write the footer of a free block and flag it in its successor's header
+static inline void block_mark_free(tlsf_block_t* block) {
+    size_t size = block_size(block);
+    block->size = size | TLSF_FREE_BIT | (block->size & TLSF_PREV_FREE_BIT);
+    *(size_t*)((uint8_t*)block + size - sizeof(size_t)) = size;
+
+    tlsf_block_t* next = block_next(block);
+    if (next) next->size |= TLSF_PREV_FREE_BIT;
+}
+
+static inline void block_mark_used(tlsf_block_t* block) {
+    block->size &= ~TLSF_FREE_BIT;
+
+    tlsf_block_t* next = block_next(block);
+    if (next) next->size &= ~TLSF_PREV_FREE_BIT;
+}
+
+// Size class of a block of exactly `size` bytes
+static void mapping_insert(size_t size, int* fl, int* sl) {
+    if (size < TLSF_SMALL_BLOCK) {
+        *fl = 0;
+        *sl = (int)(size / (TLSF_SMALL_BLOCK / TLSF_SL_COUNT));
+    } else {
+        int f = tlsf_fls(size);
+        *sl = (int)(size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+        *fl = f - TLSF_FL_SHIFT + 1;
+    }
+}
+
+// Size class whose every block is guaranteed to fit `size` bytes
+static void mapping_search(size_t size, int* fl, int* sl) {
+    if (size >= TLSF_SMALL_BLOCK) {
+        size += ((size_t)1 << (tlsf_fls(size) - TLSF_SL_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static void insert_free_block(tlsf_block_t* block) {
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+
+    block->prev_free = NULL;
+    block->next_free = free_heads[fl][sl];
+    if (block->next_free) block->next_free->prev_free = block;
+    free_heads[fl][sl] = block;
+
+    fl_bitmap |= 1u << fl;
+    sl_bitmap[fl] |= 1u << sl;
+}
+
+static void remove_free_block(tlsf_block_t* block) {
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+
+    if (block->prev_free) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        free_heads[fl][sl] = block->next_free;
+    }
+    if (block->next_free) block->next_free->prev_free = block->prev_free;
+
+    if (!free_heads[fl][sl]) {
+        sl_bitmap[fl] &= ~(1u << sl);
+        if (!sl_bitmap[fl]) fl_bitmap &= ~(1u << fl);
+    }
+}
+
+static tlsf_block_t* find_suitable_block(size_t size) {
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+    if (fl >= TLSF_FL_COUNT) return NULL;
+
+    uint32_t sl_map = sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint32_t fl_map = fl_bitmap & (~0u << (fl + 1));
+        if (!fl_map) return NULL;
+
+        fl = tlsf_ffs(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    sl = tlsf_ffs(sl_map);
+
+    // The bin's head fits whatever it holds, so one node is all a search visits
+    common_profile_count(&profile, PROFILE_VISITED, 1);
+    return free_heads[fl][sl];
+}
+
+#ifndef HEAP_HEADLESS
+// Merge the entry after slot `left` into it in the visualization table
+static void merge_shadow_blocks(int left) {
+    block_info_t* block = &shadow.blocks[left];
+    int right = shadow.next[left];
+
+    common_stats_remove_free(&stats, &tracker, block->size);
+    common_stats_remove_free(&stats, &tracker, shadow.blocks[right].size);
+    block->size += shadow.blocks[right].size;
+    block->state = BLOCK_FREE;  // Coalesced blocks become FREE
+    common_stats_add_free(&stats, &tracker, block->size);
+
+    common_blocks_remove(&shadow, right);
+}
+
+static inline void refresh_snapshot(void) {}
+#else
+// Headless: account for two free blocks of these sizes becoming one
+static void merge_free_stats(size_t left, size_t right) {
+    common_stats_remove_free(&stats, &tracker, left);
+    common_stats_remove_free(&stats, &tracker, right);
+    common_stats_add_free(&stats, &tracker, left + right);
+}
+
+// Headless: rebuild the block list from the physical headers
+static void refresh_snapshot(void) {
+    if (!common_snapshot_begin(&shadow, &snapshot_version, heap_version)) return;
+    
+    for (size_t offset = 0; offset < stats.total_size;) {
+        const tlsf_block_t* block = (const tlsf_block_t*)(heap_memory + offset);
+        size_t size = block_size(block);
+        if (size == 0 || size > stats.total_size - offset) break;
+        
+        common_snapshot_add(&shadow, 0, offset, size,
+                            (block->size & TLSF_FREE_BIT) ? BLOCK_FREE : BLOCK_ALLOCATED);
+        offset += size;
+    }
+    heap_stats_t* all = &stats;
+    common_snapshot_stats(&block_table, &shadow, heap_version, &all, 1);
+}
+#endif
+
+// `size` bytes of heap and room for `max_blocks` shadow entries (0 keeps the
+// current capacity)
+void heap_init(size_t size, size_t max_blocks) {
+    heap_version++;
+    
+    memset(&stats, 0, sizeof(stats));
+    stats.total_size = common_arena_reserve(&arena, common_heap_size(size)) & ~(size_t)7;
+    stats.next_allocation_id = 1;
+    stats.min_free_bytes = stats.total_size;
+    heap_memory = arena.base;
+
+    fl_bitmap = 0;
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    memset(free_heads, 0, sizeof(free_heads));
+
+    common_stats_reset(&stats, &tracker);
+#ifndef HEAP_HEADLESS
+    common_blocks_init(&shadow, common_block_limit(stats.total_size, max_blocks, shadow.limit));
+#else
+    (void)max_blocks;
+#endif
+
+    if (stats.total_size >= MIN_BLOCK_SIZE) {
+        tlsf_block_t* block = (tlsf_block_t*)heap_memory;
+        block->size = stats.total_size;
+        block_mark_free(block);
+        insert_free_block(block);
+
+#ifndef HEAP_HEADLESS
+        block_info_t whole = {
+            .offset = 0,
+            .size = stats.total_size,
+            .state = BLOCK_FREE,
+            .allocation_id = 0,
+            .timestamp = stats.timestamp_counter++,
+            .requested_size = 0,
+            .region_id = 0
+        };
+        common_blocks_append(&shadow, &whole);
+#endif
+
+        common_stats_add_free(&stats, &tracker, stats.total_size);
+    }
+
+    common_log_init(&event_log, stats.total_size);
+    common_profile_clear(&profile);
+    common_lifetime_clear(&lifetimes);
+    update_stats();
+    add_log(LOG_INIT, 0, size, 0, 1);
+}
+
+static void* allocate_block(size_t size) {
+    heap_version++;
+    
+    size_t requested_size = size;
+    size_t aligned_size = (size + 7) & ~7;
+    size_t total_size = aligned_size + sizeof(size_t);
+
+    // A freed block must be able to hold its links and footer
+    if (total_size < MIN_BLOCK_SIZE) total_size = MIN_BLOCK_SIZE;
+    total_size = (total_size + 7) & ~(size_t)7;
+
+    tlsf_block_t* block = total_size <= stats.total_size ? find_suitable_block(total_size) : NULL;
+    if (!block) {
+        add_log(LOG_MALLOC, stats.next_allocation_id, size, 0, 0);
+        return NULL;
+    }
+
+    remove_free_block(block);
+
+    size_t offset = block_offset(block);
+    size_t original_block_size = block_size(block);
+
+#ifndef HEAP_HEADLESS
+    int i = common_blocks_find(&shadow, 0, offset);
+    if (i != NO_SLOT) {
+        common_stats_remove_free(&stats, &tracker, shadow.blocks[i].size);
+    }
+    int can_track = shadow.count < shadow.limit;
+#else
+    (void)requested_size;
+    common_stats_remove_free(&stats, &tracker, original_block_size);
+    int can_track = 1;
+#endif
+
+    // Split off the tail if it can stand on its own as a free block
+    if (original_block_size - total_size >= MIN_BLOCK_SIZE && can_track) {
+        tlsf_block_t* remainder = (tlsf_block_t*)((uint8_t*)block + total_size);
+        remainder->size = original_block_size - total_size;
+        block->size = total_size | (block->size & TLSF_FLAG_MASK);
+        block_mark_free(remainder);
+        insert_free_block(remainder);
+
+#ifndef HEAP_HEADLESS
+        block_info_t rest = {
+            .offset = offset + total_size,
+            .size = block_size(remainder),
+            .state = i != NO_SLOT ? shadow.blocks[i].state : BLOCK_FREE,
+            .allocation_id = 0,
+            .timestamp = stats.timestamp_counter++,
+            .requested_size = 0,
+            .region_id = 0
+        };
+        if (i != NO_SLOT) {
+            common_blocks_insert_after(&shadow, i, &rest);
+            shadow.blocks[i].size = total_size;
+        }
+#endif
+        common_stats_add_free(&stats, &tracker, block_size(remainder));
+        common_profile_count(&profile, PROFILE_SPLITS, 1);
+    }
+
+    block_mark_used(block);
+
+#ifndef HEAP_HEADLESS
+    if (i != NO_SLOT) {
+        block_info_t* info = &shadow.blocks[i];
+        info->state = BLOCK_ALLOCATED;
+        info->allocation_id = stats.next_allocation_id;
+        info->timestamp = stats.timestamp_counter++;
+        info->requested_size = requested_size;
+        common_stats_add_alloc(&stats, &tracker, info->size, requested_size);
+        common_lifetime_alloc(&lifetimes, requested_size, stats.timestamp_counter);
+    }
+#else
+    common_stats_add_alloc(&stats, &tracker, block_size(block), 0);
+#endif
+
+    add_log(LOG_MALLOC, stats.next_allocation_id, size, offset, 1);
+    stats.next_allocation_id++;
+
+    update_stats();
+    return (uint8_t*)block + sizeof(size_t);
+}
+
+static void release_block(void* ptr) {
+    heap_version++;
+    
+    if (!ptr) return;
+
+    tlsf_block_t* block = (tlsf_block_t*)((uint8_t*)ptr - sizeof(size_t));
+    size_t offset = block_offset(block);
+
+    // Reject pointers outside the heap and double frees
+    if ((uint8_t*)ptr < heap_memory + sizeof(size_t) || offset >= stats.total_size ||
+        (block->size & TLSF_FREE_BIT)) {
+        add_log(LOG_FREE, 0, 0, offset, 0);
+        return;
+    }
+
+    uint32_t alloc_id = 0;
+
+#ifndef HEAP_HEADLESS
+    int i = common_blocks_find(&shadow, 0, offset);
+    if (i != NO_SLOT && shadow.blocks[i].state == BLOCK_ALLOCATED) {
+        block_info_t* info = &shadow.blocks[i];
+        common_stats_remove_alloc(&stats, &tracker, info->size, info->requested_size);
+        common_lifetime_free(&lifetimes, info->requested_size, info->timestamp, stats.timestamp_counter);
+        common_stats_add_free(&stats, &tracker, info->size);
+        info->state = BLOCK_FREED;
+        alloc_id = info->allocation_id;
+        info->allocation_id = 0;
+        info->requested_size = 0;
+    }
+#else
+    common_stats_remove_alloc(&stats, &tracker, block_size(block), 0);
+    common_stats_add_free(&stats, &tracker, block_size(block));
+#endif
+
+    int coalesced = 0;
+
+    // Merge with the previous physical block through its footer
+    if (block->size & TLSF_PREV_FREE_BIT) {
+        tlsf_block_t* prev = block_prev(block);
+        remove_free_block(prev);
+#ifndef HEAP_HEADLESS
+        prev->size += block_size(block);
+
+        int left = i != NO_SLOT ? shadow.prev[i] : NO_SLOT;
+        if (left != NO_SLOT && shadow.blocks[left].offset == block_offset(prev)) {
+            merge_shadow_blocks(left);
+            i = left;
+        }
+#else
+        merge_free_stats(block_size(prev), block_size(block));
+        prev->size += block_size(block);
+#endif
+        block = prev;
+        coalesced++;
+    }
+
+    // Merge with the next physical block
+    tlsf_block_t* next = block_next(block);
+    if (next && (next->size & TLSF_FREE_BIT)) {
+        remove_free_block(next);
+#ifndef HEAP_HEADLESS
+        block->size += block_size(next);
+
+        int right = i != NO_SLOT ? shadow.next[i] : NO_SLOT;
+        if (right != NO_SLOT && shadow.blocks[right].offset == block_offset(next)) {
+            merge_shadow_blocks(i);
+        }
+#else
+        merge_free_stats(block_size(block), block_size(next));
+        block->size += block_size(next);
+#endif
+        coalesced++;
+    }
+
+    block_mark_free(block);
+    insert_free_block(block);
+
+    if (coalesced) {
+        common_profile_count(&profile, PROFILE_MERGES, coalesced);
+        add_log(LOG_COALESCE, 0, 0, offset, 1);
+    }
+
+    add_log(LOG_FREE, alloc_id, 0, offset, 1);
+    update_stats();
+}
+
+#ifndef HEAP_HEADLESS
+// Replace the shadow entry after slot `index`, if any, with one for the free
+// block `tail` (or just drop it when `tail` is NULL)
+static void replace_shadow_tail(int index, int drop_next, const tlsf_block_t* tail) {
+    if (drop_next) common_blocks_remove(&shadow, shadow.next[index]);
+    if (!tail) return;
+
+    block_info_t rest = {
+        .offset = block_offset(tail),
+        .size = block_size(tail),
+        .state = drop_next ? BLOCK_FREE : BLOCK_FREED,
+        .allocation_id = 0,
+        .timestamp = stats.timestamp_counter++,
+        .requested_size = 0,
+        .region_id = 0
+    };
+    common_blocks_insert_after(&shadow, index, &rest);
+}
+#endif
+
+// Resize in place against the next physical block: the size change moves the
+// boundary between them when that block is free, a shrink splits off a new
+// free tail otherwise, and only a grow past a used neighbour has to move
+static void* reallocate_block(void* ptr, size_t size) {
+    if (!ptr) return allocate_block(size);
+    if (size == 0) {
+        release_block(ptr);
+        return NULL;
+    }
+
+    heap_version++;
+
+    tlsf_block_t* block = (tlsf_block_t*)((uint8_t*)ptr - sizeof(size_t));
+    size_t offset = block_offset(block);
+    if ((uint8_t*)ptr < heap_memory + sizeof(size_t) || offset >= stats.total_size ||
+        (block->size & TLSF_FREE_BIT)) {
+        add_log(LOG_REALLOC, 0, size, offset, 0);
+        return NULL;
+    }
+
+    uint32_t alloc_id = 0;
+    size_t old_requested = 0;
+#ifndef HEAP_HEADLESS
+    int i = common_blocks_find(&shadow, 0, offset);
+    if (i == NO_SLOT || shadow.blocks[i].state != BLOCK_ALLOCATED) {
+        add_log(LOG_REALLOC, 0, size, offset, 0);
+        return NULL;
+    }
+    alloc_id = shadow.blocks[i].allocation_id;
+    old_requested = shadow.blocks[i].requested_size;
+    int can_track = shadow.count < shadow.limit;
+    size_t requested_size = size;
+#else
+    int can_track = 1;
+    size_t requested_size = 0;
+#endif
+
+    size_t total_size = ((size + 7) & ~7) + sizeof(size_t);
+    if (total_size < MIN_BLOCK_SIZE) total_size = MIN_BLOCK_SIZE;
+    total_size = (total_size + 7) & ~(size_t)7;
+
+    size_t current = block_size(block);
+    tlsf_block_t* next = block_next(block);
+    size_t next_free = next && (next->size & TLSF_FREE_BIT) ? block_size(next) : 0;
+
+    if (total_size > current + next_free) {
+        // Move: copy into a fresh block and free this one
+        void* moved = allocate_block(size);
+        if (!moved) {
+            add_log(LOG_REALLOC, alloc_id, size, offset, 0);
+            return NULL;
+        }
+        memcpy(moved, ptr, current - sizeof(size_t));
+        release_block(ptr);
+
+        common_log_event(&event_log, &stats, LOG_REALLOC, stats.next_allocation_id - 1, size,
+                         block_offset((tlsf_block_t*)((uint8_t*)moved - sizeof(size_t))), 1, 0, REALLOC_MOVED);
+        return moved;
+    }
+#ifndef HEAP_HEADLESS
+    common_lifetime_resize(&lifetimes, old_requested, requested_size, shadow.blocks[i].timestamp,
+                           stats.timestamp_counter);
+#endif
+
+    // Everything from the block's start to the end of its free neighbour is
+    // split between the block and a free tail, if the tail can stand alone
+    size_t span = current + next_free;
+    size_t tail_size = span - total_size;
+    if (tail_size < MIN_BLOCK_SIZE || (!next_free && !can_track)) tail_size = 0;
+    size_t final_size = span - tail_size;
+
+    int kind = final_size > current ? REALLOC_GREW : final_size < current ? REALLOC_SHRUNK : REALLOC_SAME;
+    if (kind == REALLOC_SAME) {
+        common_stats_remove_alloc(&stats, &tracker, current, old_requested);
+        common_stats_add_alloc(&stats, &tracker, current, requested_size);
+#ifndef HEAP_HEADLESS
+        shadow.blocks[i].requested_size = requested_size;
+#endif
+        common_log_event(&event_log, &stats, LOG_REALLOC, alloc_id, size, offset, 1, 0, REALLOC_SAME);
+        update_stats();
+        return ptr;
+    }
+
+    if (next_free) {
+        remove_free_block(next);
+        common_stats_remove_free(&stats, &tracker, next_free);
+    }
+    common_stats_remove_alloc(&stats, &tracker, current, old_requested);
+    common_stats_add_alloc(&stats, &tracker, final_size, requested_size);
+
+    block->size = final_size | (block->size & TLSF_FLAG_MASK);
+    tlsf_block_t* tail = NULL;
+    if (tail_size) {
+        tail = (tlsf_block_t*)((uint8_t*)block + final_size);
+        tail->size = tail_size;
+        block_mark_free(tail);
+        insert_free_block(tail);
+        common_stats_add_free(&stats, &tracker, tail_size);
+        if (!next_free) common_profile_count(&profile, PROFILE_SPLITS, 1);
+    }
+    block_mark_used(block);
+    if (kind == REALLOC_GREW) common_profile_count(&profile, PROFILE_MERGES, 1);
+
+#ifndef HEAP_HEADLESS
+    replace_shadow_tail(i, next_free != 0, tail);
+    shadow.blocks[i].size = final_size;
+    shadow.blocks[i].requested_size = requested_size;
+#endif
+
+    common_log_event(&event_log, &stats, LOG_REALLOC, alloc_id, size, offset, 1, 0, (uint8_t)kind);
+    update_stats();
+    return ptr;
+}
+
+void* heap_malloc(size_t size) {
+    common_profile_begin(&profile, PROFILE_OP_MALLOC);
+    void* ptr = allocate_block(size);
+    common_profile_end(&profile);
+    return ptr;
+}
+
+void heap_free(void* ptr) {
+    common_profile_begin(&profile, PROFILE_OP_FREE);
+    release_block(ptr);
+    common_profile_end(&profile);
+}
+
+// Resize the block at `ptr`, in place when it can be; NULL `ptr` allocates and
+// size 0 frees. Returns NULL (leaving the block alone) if it cannot be resized.
+void* heap_realloc(void* ptr, size_t size) {
+    common_profile_begin(&profile, PROFILE_OP_REALLOC);
+    void* result = reallocate_block(ptr, size);
+    common_profile_end(&profile);
+    return result;
+}
+
+void heap_reset() {
+    heap_init(stats.total_size, 0);
+}
+
+// 0 (the only region) if heap_malloc(size) would succeed now, -1 if not. This
+// is the same bitmap search, so a block that fits but sits in a bin with
+// smaller ones is passed over here exactly as heap_malloc passes it over.
+int heap_can_allocate(size_t size) {
+    size_t total_size = ((size + 7) & ~7) + sizeof(size_t);
+    if (total_size < MIN_BLOCK_SIZE) total_size = MIN_BLOCK_SIZE;
+    total_size = (total_size + 7) & ~(size_t)7;
+    return total_size <= stats.total_size && find_suitable_block(total_size) ? 0 : -1;
+}
+
+static void* run_op_malloc(size_t size, uint8_t flags) {
+    (void)flags;
+    return heap_malloc(size);
+}
+
+int heap_run_ops(const op_t* ops, int n, uint32_t* out_ptrs) {
+    return common_run_ops(ops, n, out_ptrs, run_op_malloc, heap_free);
+}
+
+// Fill `ops` with a synthetic workload for heap_run_ops; the heap is not touched
+int heap_generate_ops(const workload_config_t* config, op_t* ops, int capacity) {
+    return common_workload_generate(config, ops, capacity);
+}
+
+// Write a checkpoint of the heap to `buf` (NULL measures); returns its size,
+// and only wrote it if that is <= capacity
+size_t heap_snapshot(void* buf, size_t capacity) {
+    checkpoint_writer_t w;
+    common_checkpoint_begin(&w, buf, capacity, 6);
+    common_checkpoint_put_stats(&w, &stats, &tracker);
+    common_checkpoint_put_log(&w, &event_log);
+#ifndef HEAP_HEADLESS
+    common_checkpoint_put_blocks(&w, &shadow, NO_SLOT);
+#endif
+
+    common_checkpoint_put_value(&w, fl_bitmap);
+    common_checkpoint_put_value(&w, sl_bitmap);
+    for (int fl = 0; fl < TLSF_FL_COUNT; fl++) {
+        for (int sl = 0; sl < TLSF_SL_COUNT; sl++) {
+            uintptr_t head = common_checkpoint_offset(free_heads[fl][sl], heap_memory);
+            common_checkpoint_put_value(&w, head);
+        }
+    }
+
+    // Bin links in the copy become offsets
+    uint8_t* image = common_checkpoint_put(&w, heap_memory, stats.total_size);
+    for (int fl = 0; image && fl < TLSF_FL_COUNT; fl++) {
+        for (int sl = 0; sl < TLSF_SL_COUNT; sl++) {
+            for (tlsf_block_t* block = free_heads[fl][sl]; block; block = block->next_free) {
+                size_t at = block_offset(block);
+                common_checkpoint_pack(image, at + offsetof(tlsf_block_t, next_free), block->next_free, heap_memory);
+                common_checkpoint_pack(image, at + offsetof(tlsf_block_t, prev_free), block->prev_free, heap_memory);
+            }
+        }
+    }
+    return common_checkpoint_end(&w);
+}
+
+// Put the heap back as heap_snapshot() saw it; returns 0, or -1 if `buf` is
+// not a checkpoint of this module (the heap is left alone) or is truncated
+// inside (the heap is re-initialised empty)
+int heap_restore(const void* buf, size_t size) {
+    checkpoint_reader_t r;
+    if (!common_checkpoint_open(&r, buf, size, 6)) return -1;
+    heap_version++;
+
+    common_checkpoint_get_stats(&r, &stats, &tracker);
+    common_checkpoint_get_log(&r, &event_log);
+#ifndef HEAP_HEADLESS
+    common_checkpoint_get_blocks(&r, &shadow);
+#endif
+
+    uintptr_t heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    common_checkpoint_get_value(&r, fl_bitmap);
+    common_checkpoint_get_value(&r, sl_bitmap);
+    common_checkpoint_get_value(&r, heads);
+    if (r.ok && common_arena_reserve(&arena, stats.total_size) < stats.total_size) r.ok = 0;
+    heap_memory = arena.base;
+    if (!r.ok || !common_checkpoint_get(&r, heap_memory, stats.total_size)) {
+        heap_init(DEFAULT_HEAP_SIZE, 0);
+        return -1;
+    }
+
+    for (int fl = 0; fl < TLSF_FL_COUNT; fl++) {
+        for (int sl = 0; sl < TLSF_SL_COUNT; sl++) {
+            free_heads[fl][sl] = (tlsf_block_t*)common_checkpoint_pointer(heads[fl][sl], heap_memory);
+            for (tlsf_block_t* block = free_heads[fl][sl]; block; block = block->next_free) {
+                block->next_free = (tlsf_block_t*)common_checkpoint_pointer((uintptr_t)block->next_free, heap_memory);
+                block->prev_free = (tlsf_block_t*)common_checkpoint_pointer((uintptr_t)block->prev_free, heap_memory);
+            }
+        }
+    }
+    update_stats();
+    return 0;
+}
+
+// Headless builds rebuild the block list and stats before they are read
+heap_stats_t* get_heap_stats() {
+    refresh_snapshot();
+    stats.metadata_bytes = common_metadata_bytes(&shadow, &block_table, &event_log, &tracker) +
+                           sizeof(sl_bitmap) + sizeof(free_heads);
+    return &stats;
+}
+
+int get_block_count() {
+    refresh_snapshot();
+    return shadow.count;
+}
+
+// Blocks in address order
+block_info_t* get_block_info(int index) {
+    refresh_snapshot();
+    return common_blocks_at(&shadow, index);
+}
+
+// Structure-of-arrays snapshot of the block list for zero-copy reads from JS
+uint32_t* get_block_table_ptr() {
+    refresh_snapshot();
+    return common_block_table_refresh(&block_table, &shadow, heap_version);
+}
+
+int get_block_table_len() {
+    refresh_snapshot();
+    return shadow.count;
+}
+
+uint32_t get_heap_version() {
+    return heap_version;
+}
+
+int get_log_count() {
+    return (int)event_log.count;
+}
+
+log_entry_t* get_log_entry(int index) {
+    return common_log_at(&event_log, index);
+}
+
+// Copy events with seq > `seq` into `out`, oldest first; returns the number copied
+int get_log_since(uint32_t seq, log_entry_t* out, int max) {
+    return common_log_since(&event_log, seq, out, max);
+}
+
+// Events overwritten before they could be read
+uint32_t get_log_lost() {
+    return event_log.lost;
+}
+
+void clear_log() {
+    heap_version++;
+    common_log_clear(&event_log);
+}
+
+// Log2 histogram of `op_kind` latencies in ns (PROFILE_BUCKETS words into
+// `out`); returns the number of calls recorded
+int get_latency_histogram(int op_kind, uint32_t* out) {
+    return common_profile_histogram(&profile, op_kind, PROFILE_NS, out);
+}
+
+// The same for any profile_metric_t, e.g. free-list nodes visited
+int get_op_histogram(int op_kind, int metric, uint32_t* out) {
+    return common_profile_histogram(&profile, op_kind, metric, out);
+}
+
+// Worst case of `metric` over every recorded `op_kind` call
+uint32_t get_op_max(int op_kind, int metric) {
+    return common_profile_max(&profile, op_kind, metric);
+}
+
+void reset_op_profile() {
+    common_profile_clear(&profile);
+}
+
+// Size-class churn, block lifetimes and the live-bytes timeline since heap_init
+lifetime_profile_t* get_lifetime_profile() {
+    return &lifetimes;
+}
\ No newline at end of file
@@ -4,10 +4,26 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "heap_limits.h"
 
-#define MAX_HEAP_SIZE 65536
-#define MAX_BLOCKS 1000
-#define MAX_LOG_ENTRIES 1000
+#ifdef HEAP_NAMESPACE
+#include "heap_namespace.h"
+#endif
+
+// Headless builds (-DHEAP_HEADLESS) measure the allocator alone: the shadow
+// block list, the free-size index and the event log are compiled out of
+// malloc/free, and stats keep only running byte and block counters. Query
+// functions rebuild the block list from the heap's own headers when they are
+// called, without ids, timestamps or requested sizes. Operation profiling is
+// compiled out as well.
+#if defined(HEAP_HEADLESS) && !defined(HEAP_NO_LOG)
+#define HEAP_NO_LOG 1
+#endif
+#if defined(HEAP_HEADLESS) && !defined(HEAP_NO_PROFILE)
+#define HEAP_NO_PROFILE 1
+#endif
 
 typedef enum {
     BLOCK_FREE = 0,
@@ -25,17 +41,52 @@ typedef struct {
     uint8_t region_id;  // For heap_5
 } block_info_t;
 
+typedef enum {
+    LOG_INIT = 0,
+    LOG_MALLOC = 1,
+    LOG_FREE = 2,
+    LOG_COALESCE = 3,
+    LOG_REALLOC = 4,        // flags holds a realloc_kind_t
+    LOG_RELEASE = 5         // heap_1 scope released: `size` bytes from `offset`
+} log_action_t;
+
+// How heap_realloc resized a block. A moved block also logs the MALLOC of its
+// new place and the FREE of the old one before the REALLOC entry.
+typedef enum {
+    REALLOC_SAME = 0,       // already the right size, nothing split off
+    REALLOC_SHRUNK = 1,     // tail split off in place
+    REALLOC_GREW = 2,       // grew in place into the free space after it
+    REALLOC_MOVED = 3       // copied to a new block and the old one freed
+} realloc_kind_t;
+
+// Packed 24-byte event record
 typedef struct {
-    char action[32];
+    uint32_t seq;           // 1-based, never reused
     uint32_t allocation_id;
-    size_t size;
-    size_t offset;
+    uint32_t size;
+    uint32_t offset;
     uint32_t timestamp;
-    int success;
-    uint8_t region_id;  // Add region ID to log entries
-    uint8_t flags;      // Add flags for heap_5
+    uint8_t action;         // log_action_t
+    uint8_t success;
+    uint8_t region_id;      // For heap_5, 0xFF if no region
+    uint8_t flags;          // Allocation flags for heap_5
 } log_entry_t;
 
+// Ring of events, sized by heap_init. Once full, the oldest entry is
+// overwritten and counted in `lost`; sequence numbers keep increasing across
+// clears.
+typedef struct {
+    log_entry_t* entries;
+    uint32_t capacity;
+    uint32_t head;          // Index of the oldest entry
+    uint32_t count;
+    uint32_t next_seq;
+    uint32_t lost;
+} log_ring_t;
+
+// Free blocks of [2^b, 2^(b+1)) bytes are counted in bucket b
+#define FREE_SIZE_BUCKETS 32
+
 typedef struct {
     size_t total_size;
     size_t allocated_bytes;
@@ -49,79 +100,576 @@ typedef struct {
     size_t min_free_bytes;
     float external_fragmentation;
     float internal_fragmentation;
+    size_t metadata_bytes;          // allocator bookkeeping kept outside the heap
+    uint32_t free_size_histogram[FREE_SIZE_BUCKETS];
 } heap_stats_t;
 
-// Common utility functions
-// Update the common_add_log function signature
-static inline void common_add_log_with_region(log_entry_t* logs, int* log_count, heap_stats_t* stats,
-                                  const char* action, uint32_t alloc_id, size_t size, 
-                                  size_t offset, int success, uint8_t region_id, uint8_t flags) {
-    if (*log_count >= MAX_LOG_ENTRIES) return;
+static inline int common_size_bucket(size_t size) {
+    int bucket = size ? 63 - __builtin_clzll((unsigned long long)size) : 0;
+    return bucket < FREE_SIZE_BUCKETS ? bucket : FREE_SIZE_BUCKETS - 1;
+}
+
+// Event log
+//
+// Benchmark builds can compile logging out with -DHEAP_NO_LOG; the timestamp
+// still advances so block timestamps match a logging build.
+
+static inline void common_log_clear(log_ring_t* log) {
+    log->head = 0;
+    log->count = 0;
+    if (log->next_seq == 0) log->next_seq = 1;
+}
+
+// Resize the ring to `capacity` entries, dropping what it holds if that
+// changes; returns 0 (and keeps the old ring) if it could not be allocated
+static inline int common_log_reserve(log_ring_t* log, uint32_t capacity) {
+    if (capacity == log->capacity) return 1;
     
-    log_entry_t* entry = &logs[(*log_count)++];
-    strncpy(entry->action, action, sizeof(entry->action) - 1);
-    entry->action[sizeof(entry->action) - 1] = '\0';
+    log_entry_t* entries = NULL;
+    if (capacity > 0) {
+        entries = (log_entry_t*)realloc(log->entries, (size_t)capacity * sizeof(log_entry_t));
+        if (!entries) return 0;
+    } else {
+        free(log->entries);
+    }
+    log->entries = entries;
+    log->capacity = capacity;
+    log->head = 0;
+    log->count = 0;
+    return 1;
+}
+
+// Ring size for a heap of `heap_size` bytes; none when logging is compiled out
+static inline uint32_t common_log_capacity(size_t heap_size) {
+#if defined(HEAP_NO_LOG)
+    (void)heap_size;
+    return 0;
+#elif defined(HEAP_BUDGET)
+    size_t entries = heap_size / BUDGET_LOG_BYTES;
+    if (entries < BUDGET_MIN_ENTRIES) entries = BUDGET_MIN_ENTRIES;
+    return entries < MAX_LOG_ENTRIES ? (uint32_t)entries : MAX_LOG_ENTRIES;
+#else
+    (void)heap_size;
+    return MAX_LOG_ENTRIES;
+#endif
+}
+
+// heap_init's ring: sized for the new heap and emptied
+static inline void common_log_init(log_ring_t* log, size_t heap_size) {
+    common_log_reserve(log, common_log_capacity(heap_size));
+    common_log_clear(log);
+}
+
+static inline log_entry_t* common_log_at(log_ring_t* log, int index) {
+    if (index < 0 || (uint32_t)index >= log->count) return NULL;
+    return &log->entries[(log->head + (uint32_t)index) % log->capacity];
+}
+
+// Copy up to `max` entries with seq > `since` into `out`, oldest first
+static inline int common_log_since(const log_ring_t* log, uint32_t since, log_entry_t* out, int max) {
+    if (log->count == 0 || max <= 0) return 0;
+    
+    // Entries are contiguous in seq, so the first one to copy is found directly
+    uint32_t first_seq = log->entries[log->head].seq;
+    uint32_t skip = since >= first_seq ? since - first_seq + 1 : 0;
+    if (skip >= log->count) return 0;
+    
+    int copied = 0;
+    for (uint32_t i = skip; i < log->count && copied < max; i++) {
+        out[copied++] = log->entries[(log->head + i) % log->capacity];
+    }
+    return copied;
+}
+
+#ifndef HEAP_NO_LOG
+static inline void common_log_event(log_ring_t* log, heap_stats_t* stats, log_action_t action,
+                                    uint32_t alloc_id, size_t size, size_t offset, int success,
+                                    uint8_t region_id, uint8_t flags) {
+    if (log->next_seq == 0) log->next_seq = 1;
+    if (log->capacity == 0) {
+        // No ring (heap_init could not allocate one): the event is lost
+        log->next_seq++;
+        log->lost++;
+        stats->timestamp_counter++;
+        return;
+    }
+    
+    uint32_t slot;
+    if (log->count < log->capacity) {
+        slot = (log->head + log->count) % log->capacity;
+        log->count++;
+    } else {
+        slot = log->head;
+        log->head = (log->head + 1) % log->capacity;
+        log->lost++;
+    }
+    
+    log_entry_t* entry = &log->entries[slot];
+    entry->seq = log->next_seq++;
     entry->allocation_id = alloc_id;
-    entry->size = size;
-    entry->offset = offset;
-    entry->success = success;
+    entry->size = (uint32_t)size;
+    entry->offset = (uint32_t)offset;
     entry->timestamp = stats->timestamp_counter++;
+    entry->action = (uint8_t)action;
+    entry->success = success ? 1 : 0;
     entry->region_id = region_id;
     entry->flags = flags;
 }
+#else
+// Same signature, so callers' event arguments still count as used
+static inline void common_log_event(log_ring_t* log, heap_stats_t* stats, log_action_t action,
+                                    uint32_t alloc_id, size_t size, size_t offset, int success,
+                                    uint8_t region_id, uint8_t flags) {
+    (void)log;
+    (void)action;
+    (void)alloc_id;
+    (void)size;
+    (void)offset;
+    (void)success;
+    (void)region_id;
+    (void)flags;
+    stats->timestamp_counter++;
+}
+#endif
+
+#define common_add_log(log, stats, action, alloc_id, size, offset, success) \
+    common_log_event(log, stats, action, alloc_id, size, offset, success, 0, 0)
+
+// Coalescing policy for allocators that merge free neighbours (heap_4, heap_5).
+// With the deferred policies heap_free only links the block back in, and a
+// cursor over the block list merges adjacent free pairs a bounded number of steps
+// at a time, resuming where the previous step stopped.
+typedef enum {
+    COALESCE_IMMEDIATE = 0,     // Merge neighbours inside heap_free
+    COALESCE_INCREMENTAL = 1,   // Each malloc/free runs at most `budget` steps
+    COALESCE_MANUAL = 2         // Merging only happens in heap_coalesce_step()
+} coalesce_policy_t;
 
-static inline void common_add_log(log_entry_t* logs, int* log_count, heap_stats_t* stats,
-                                  const char* action, uint32_t alloc_id, size_t size, 
-                                  size_t offset, int success) {
-    common_add_log_with_region(logs, log_count, stats, action, alloc_id, size, offset, success, 0, 0);
+#define DEFAULT_COALESCE_BUDGET 4
+
+// Runtime capacity
+//
+// heap_init(size, max_blocks) takes both limits at runtime. Heap memory and
+// metadata live in buffers sized from them instead of static arrays; under
+// wasm, ALLOW_MEMORY_GROWTH lets these grow past the initial memory.
+
+static inline size_t common_heap_size(size_t size) {
+    return size > HEAP_SIZE_LIMIT ? HEAP_SIZE_LIMIT : size;
 }
 
-static inline void common_sort_blocks(block_info_t* blocks, int block_count) {
-    for (int i = 0; i < block_count - 1; i++) {
-        for (int j = i + 1; j < block_count; j++) {
-            if (blocks[i].offset > blocks[j].offset) {
-                block_info_t temp = blocks[i];
-                blocks[i] = blocks[j];
-                blocks[j] = temp;
-            }
+// Block capacity for heap_init's max_blocks; 0 keeps `current`, or in budget
+// builds follows the heap size
+static inline int common_block_limit(size_t heap_size, size_t max_blocks, int current) {
+#ifdef HEAP_BUDGET
+    (void)current;
+    if (max_blocks == 0) {
+        max_blocks = heap_size / BUDGET_BLOCK_BYTES;
+        if (max_blocks < BUDGET_MIN_ENTRIES) max_blocks = BUDGET_MIN_ENTRIES;
+    }
+#else
+    (void)heap_size;
+    if (max_blocks == 0) return current > 0 ? current : DEFAULT_MAX_BLOCKS;
+#endif
+    return max_blocks > BLOCK_LIMIT ? BLOCK_LIMIT : (int)max_blocks;
+}
+
+// Block layout
+//
+// heap_2, heap_4 and heap_5 put a size header in front of every block and
+// round payloads to a fixed alignment. The layout is fixed at compile time;
+// the Makefile's LAYOUT variants set these:
+//   HEAP_ALIGNMENT      payload sizes round up to this power of two
+//   HEAP_HEADER_BYTES   4 for a 32-bit size header (default: size_t)
+//   HEAP_HEADER_SIZE    bytes the header takes in front of the payload; set it
+//                       to HEAP_ALIGNMENT for payload addresses aligned to it
+//   HEAP_SPLIT_SLACK    bytes a remainder needs beyond a free-list node before
+//                       a block is split rather than handed out whole
+#ifndef HEAP_ALIGNMENT
+#define HEAP_ALIGNMENT 8
+#endif
+#if HEAP_ALIGNMENT < 4 || (HEAP_ALIGNMENT & (HEAP_ALIGNMENT - 1))
+#error "HEAP_ALIGNMENT must be a power of two of at least 4"
+#endif
+
+#if defined(HEAP_HEADER_BYTES) && HEAP_HEADER_BYTES == 4
+typedef uint32_t heap_header_t;     // enough for HEAP_SIZE_LIMIT
+#else
+typedef size_t heap_header_t;
+#endif
+
+#ifndef HEAP_HEADER_SIZE
+#define HEAP_HEADER_SIZE sizeof(heap_header_t)
+#endif
+
+#ifndef HEAP_SPLIT_SLACK
+#define HEAP_SPLIT_SLACK 16
+#endif
+
+// Blocks are laid end to end and a free one keeps its free-list node at its
+// start, so block spans also round to pointer alignment. Only the mcu layout
+// on a 64-bit host differs: payloads stay 4-byte aligned, nodes 8.
+#define HEAP_BLOCK_ALIGNMENT (HEAP_ALIGNMENT > _Alignof(void*) ? (size_t)HEAP_ALIGNMENT : _Alignof(void*))
+
+static inline size_t common_align_size(size_t size) {
+    return (size + (HEAP_ALIGNMENT - 1)) & ~(size_t)(HEAP_ALIGNMENT - 1);
+}
+
+// Largest span of whole blocks in `size` bytes (heap and region sizes)
+static inline size_t common_align_down(size_t size) {
+    return size & ~(HEAP_BLOCK_ALIGNMENT - 1);
+}
+
+// Bytes a block spans to hand out `size`: the rounded payload and its header
+static inline size_t common_block_total(size_t size) {
+    size_t total = common_align_size(size) + HEAP_HEADER_SIZE;
+    return (total + (HEAP_BLOCK_ALIGNMENT - 1)) & ~(HEAP_BLOCK_ALIGNMENT - 1);
+}
+
+static inline heap_header_t* common_block_header(void* ptr) {
+    return (heap_header_t*)((uint8_t*)ptr - HEAP_HEADER_SIZE);
+}
+
+static inline void* common_block_payload(void* block) {
+    return (uint8_t*)block + HEAP_HEADER_SIZE;
+}
+
+// Whether giving `total_size` of a `block_size` block leaves a remainder
+// worth a free-list node of `node_size`
+static inline int common_split_fits(size_t block_size, size_t total_size, size_t node_size) {
+    return block_size > total_size + node_size + HEAP_SPLIT_SLACK;
+}
+
+// Backing store for a heap's memory
+typedef struct {
+    uint8_t* base;
+    size_t capacity;
+} heap_arena_t;
+
+#define ARENA_MIN_SIZE 256     // room for free-block headers even in a tiny heap
+
+// The arena starts on a HEAP_ALIGNMENT boundary so aligned layouts hold from
+// the first block; malloc already guarantees 8
+static inline uint8_t* common_arena_alloc(size_t size) {
+#if HEAP_ALIGNMENT > 8
+    return (uint8_t*)aligned_alloc(HEAP_ALIGNMENT, common_align_size(size));
+#else
+    return (uint8_t*)malloc(size);
+#endif
+}
+
+// Make the arena hold at least `size` bytes; contents are not kept. Returns
+// the usable size, which is less than `size` only if growing failed.
+static inline size_t common_arena_reserve(heap_arena_t* arena, size_t size) {
+    if (arena->base && size <= arena->capacity) return size;
+    
+    size_t capacity = size > ARENA_MIN_SIZE ? size : ARENA_MIN_SIZE;
+    uint8_t* base = common_arena_alloc(capacity);
+    if (!base) {
+        // Keep the previous buffer, or settle for the minimum on first use
+        if (!arena->base && (arena->base = common_arena_alloc(ARENA_MIN_SIZE))) {
+            arena->capacity = ARENA_MIN_SIZE;
         }
+        return arena->capacity;
     }
+    
+    free(arena->base);
+    arena->base = base;
+    arena->capacity = capacity;
+    return size;
 }
 
-static inline void common_update_stats(block_info_t* blocks, int block_count, heap_stats_t* stats) {
-    stats->allocated_bytes = 0;
-    stats->free_bytes = 0;
-    stats->allocation_count = 0;
-    stats->free_block_count = 0;
-    stats->largest_free_block = 0;
-    stats->smallest_free_block = stats->total_size;
+// Grow *array to at least `needed` elements, doubling; contents are kept.
+// Returns 0, leaving the array as it was, if the allocation fails.
+static inline int common_grow(void** array, int* capacity, int needed, size_t elem_size) {
+    if (needed <= *capacity) return 1;
     
-    size_t total_requested = 0;
-    size_t total_allocated = 0;
-    int has_free_blocks = 0;
+    int grown = *capacity > 0 ? *capacity : 64;
+    while (grown < needed) grown *= 2;
     
-    for (int i = 0; i < block_count; i++) {
-        if (blocks[i].state == BLOCK_ALLOCATED) {
-            stats->allocated_bytes += blocks[i].size;
-            stats->allocation_count++;
-            
-            if (blocks[i].requested_size > 0) {
-                total_requested += blocks[i].requested_size;
-                total_allocated += blocks[i].size;
-            }
-        } else if (blocks[i].state == BLOCK_FREE || blocks[i].state == BLOCK_FREED) {
-            stats->free_bytes += blocks[i].size;
-            stats->free_block_count++;
-            has_free_blocks = 1;
-            
-            if (blocks[i].size > stats->largest_free_block) {
-                stats->largest_free_block = blocks[i].size;
-            }
-            if (blocks[i].size < stats->smallest_free_block) {
-                stats->smallest_free_block = blocks[i].size;
-            }
+    void* resized = realloc(*array, (size_t)grown * elem_size);
+    if (!resized) return 0;
+    *array = resized;
+    *capacity = grown;
+    return 1;
+}
+
+// Block list
+//
+// Shadow entries sit in stable slots and are chained in (region_id, offset)
+// order through next/prev, so a block's address neighbours are one link away
+// and splits and merges never move other entries. A hash on (region_id,
+// offset) maps pointers to slots. Every operation is O(1) however many
+// blocks are tracked; an entry's region_id and offset must not change while
+// it is linked. Slots grow by doubling up to `limit`.
+
+#define NO_SLOT (-1)
+
+typedef struct {
+    block_info_t* blocks;       // Indexed by slot
+    int32_t* next;              // Address order; unused slots chain through next
+    int32_t* prev;
+    int32_t* buckets;           // Slot per hash bucket, NO_SLOT if empty
+    uint32_t bucket_mask;
+    int capacity;               // Slots allocated
+    int used;                   // Slots handed out since init
+    int count;                  // Linked blocks
+    int limit;
+    int32_t head;
+    int32_t tail;
+    int32_t free_slots;
+    int cursor_index;           // Ordinal of cursor_slot, -1 if unknown
+    int32_t cursor_slot;
+} block_list_t;
+
+static inline uint32_t common_block_hash(uint8_t region_id, size_t offset) {
+    uint64_t key = ((uint64_t)region_id << 32) | (uint32_t)offset;
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+static inline void common_blocks_hash_insert(block_list_t* list, int32_t slot) {
+    const block_info_t* block = &list->blocks[slot];
+    uint32_t b = common_block_hash(block->region_id, block->offset) & list->bucket_mask;
+    while (list->buckets[b] != NO_SLOT) b = (b + 1) & list->bucket_mask;
+    list->buckets[b] = slot;
+}
+
+static inline void common_blocks_hash_remove(block_list_t* list, int32_t slot) {
+    const block_info_t* block = &list->blocks[slot];
+    uint32_t mask = list->bucket_mask;
+    uint32_t hole = common_block_hash(block->region_id, block->offset) & mask;
+    while (list->buckets[hole] != slot) hole = (hole + 1) & mask;
+    
+    // Shift later entries of the probe run back into the hole
+    for (uint32_t b = (hole + 1) & mask; list->buckets[b] != NO_SLOT; b = (b + 1) & mask) {
+        const block_info_t* moved = &list->blocks[list->buckets[b]];
+        uint32_t home = common_block_hash(moved->region_id, moved->offset) & mask;
+        if (((b - home) & mask) >= ((b - hole) & mask)) {
+            list->buckets[hole] = list->buckets[b];
+            hole = b;
         }
     }
+    list->buckets[hole] = NO_SLOT;
+}
+
+// Double the slot arrays (up to limit) and rebuild the hash at load <= 1/2
+static inline int common_blocks_grow(block_list_t* list) {
+    if (list->capacity >= list->limit) return 0;
+    
+    int capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+    if (capacity > list->limit) capacity = list->limit;
+    
+    block_info_t* blocks = (block_info_t*)realloc(list->blocks, (size_t)capacity * sizeof(block_info_t));
+    if (!blocks) return 0;
+    list->blocks = blocks;
+    int32_t* next = (int32_t*)realloc(list->next, (size_t)capacity * sizeof(int32_t));
+    if (!next) return 0;
+    list->next = next;
+    int32_t* prev = (int32_t*)realloc(list->prev, (size_t)capacity * sizeof(int32_t));
+    if (!prev) return 0;
+    list->prev = prev;
+    
+    uint32_t bucket_count = 1;
+    while (bucket_count < (uint32_t)capacity * 2) bucket_count <<= 1;
+    int32_t* buckets = (int32_t*)realloc(list->buckets, bucket_count * sizeof(int32_t));
+    if (!buckets) return 0;
+    list->buckets = buckets;
+    list->bucket_mask = bucket_count - 1;
+    list->capacity = capacity;
+    
+    memset(list->buckets, 0xFF, bucket_count * sizeof(int32_t));
+    for (int32_t slot = list->head; slot != NO_SLOT; slot = list->next[slot]) {
+        common_blocks_hash_insert(list, slot);
+    }
+    return 1;
+}
+
+// Empty the list and set how many blocks it may hold. Storage is kept for
+// the next heap unless the new limit is smaller than what is allocated.
+static inline void common_blocks_init(block_list_t* list, int limit) {
+    if (list->capacity > limit) {
+        free(list->blocks);
+        free(list->next);
+        free(list->prev);
+        free(list->buckets);
+        list->blocks = NULL;
+        list->next = NULL;
+        list->prev = NULL;
+        list->buckets = NULL;
+        list->bucket_mask = 0;
+        list->capacity = 0;
+    }
+    if (list->buckets) {
+        memset(list->buckets, 0xFF, (size_t)(list->bucket_mask + 1) * sizeof(int32_t));
+    }
+    
+    list->limit = limit;
+    list->used = 0;
+    list->count = 0;
+    list->head = NO_SLOT;
+    list->tail = NO_SLOT;
+    list->free_slots = NO_SLOT;
+    list->cursor_index = -1;
+}
+
+// Slot of the block starting at (region_id, offset), or NO_SLOT
+static inline int common_blocks_find(const block_list_t* list, uint8_t region_id, size_t offset) {
+    if (list->count == 0) return NO_SLOT;
+    
+    uint32_t b = common_block_hash(region_id, offset) & list->bucket_mask;
+    for (int32_t slot = list->buckets[b]; slot != NO_SLOT; slot = list->buckets[b]) {
+        const block_info_t* block = &list->blocks[slot];
+        if (block->offset == offset && block->region_id == region_id) return slot;
+        b = (b + 1) & list->bucket_mask;
+    }
+    return NO_SLOT;
+}
+
+// Link a copy of `block` in after slot `after` (NO_SLOT: at the head); the
+// caller keeps address order. Returns the new slot, or NO_SLOT when full.
+static inline int common_blocks_insert_after(block_list_t* list, int after, const block_info_t* block) {
+    if (list->count >= list->limit) return NO_SLOT;
+    
+    int32_t slot = list->free_slots;
+    if (slot != NO_SLOT) {
+        list->free_slots = list->next[slot];
+    } else {
+        if (list->used == list->capacity && !common_blocks_grow(list)) return NO_SLOT;
+        slot = list->used++;
+    }
+    
+    int32_t before = after == NO_SLOT ? list->head : list->next[after];
+    list->blocks[slot] = *block;
+    list->prev[slot] = after;
+    list->next[slot] = before;
+    if (after == NO_SLOT) {
+        list->head = slot;
+    } else {
+        list->next[after] = slot;
+    }
+    if (before == NO_SLOT) {
+        list->tail = slot;
+    } else {
+        list->prev[before] = slot;
+    }
+    
+    common_blocks_hash_insert(list, slot);
+    list->count++;
+    list->cursor_index = -1;
+    return slot;
+}
+
+static inline int common_blocks_append(block_list_t* list, const block_info_t* block) {
+    return common_blocks_insert_after(list, list->tail, block);
+}
+
+static inline void common_blocks_remove(block_list_t* list, int slot) {
+    if (slot < 0 || slot >= list->used) return;
+    
+    common_blocks_hash_remove(list, slot);
+    
+    int32_t prev = list->prev[slot];
+    int32_t next = list->next[slot];
+    if (prev == NO_SLOT) {
+        list->head = next;
+    } else {
+        list->next[prev] = next;
+    }
+    if (next == NO_SLOT) {
+        list->tail = prev;
+    } else {
+        list->prev[next] = prev;
+    }
+    
+    list->next[slot] = list->free_slots;
+    list->free_slots = slot;
+    list->count--;
+    list->cursor_index = -1;
+}
+
+// Block at position `index` in address order. The walk starts from the head,
+// the tail or the previous position, so reading 0..count-1 in turn (as
+// get_block_info callers do) is O(1) per call.
+static inline block_info_t* common_blocks_at(block_list_t* list, int index) {
+    if (index < 0 || index >= list->count) return NULL;
+    
+    int pos = list->cursor_index;
+    int32_t slot = list->cursor_slot;
+    int from_cursor = pos < 0 ? list->count : (index > pos ? index - pos : pos - index);
+    int from_tail = list->count - 1 - index;
+    
+    if (index <= from_cursor && index <= from_tail) {
+        pos = 0;
+        slot = list->head;
+    } else if (from_tail < from_cursor) {
+        pos = list->count - 1;
+        slot = list->tail;
+    }
+    
+    while (pos < index) {
+        slot = list->next[slot];
+        pos++;
+    }
+    while (pos > index) {
+        slot = list->prev[slot];
+        pos--;
+    }
+    
+    list->cursor_index = index;
+    list->cursor_slot = slot;
+    return &list->blocks[slot];
+}
+
+// Block totals
+//
+// What a full pass over the blocks adds up before it becomes heap_stats_t.
+// The list walk below and the column kernels further down both fill one.
+
+typedef struct {
+    size_t allocated_bytes;
+    size_t free_bytes;
+    size_t requested_bytes;         // Over allocations that recorded a request
+    size_t requested_allocated;
+    size_t largest_free;
+    size_t smallest_free;           // SIZE_MAX while there is no free block
+    uint32_t allocation_count;
+    uint32_t free_block_count;
+    uint32_t free_size_histogram[FREE_SIZE_BUCKETS];
+} block_totals_t;
+
+static inline void common_totals_clear(block_totals_t* totals) {
+    memset(totals, 0, sizeof(*totals));
+    totals->smallest_free = SIZE_MAX;
+}
+
+static inline void common_totals_add(block_totals_t* totals, size_t size, uint32_t state, size_t requested) {
+    if (state == BLOCK_ALLOCATED) {
+        totals->allocated_bytes += size;
+        totals->allocation_count++;
+        
+        if (requested > 0) {
+            totals->requested_bytes += requested;
+            totals->requested_allocated += size;
+        }
+    } else if (state == BLOCK_FREE || state == BLOCK_FREED) {
+        totals->free_bytes += size;
+        totals->free_block_count++;
+        totals->free_size_histogram[common_size_bucket(size)]++;
+        if (size > totals->largest_free) totals->largest_free = size;
+        if (size < totals->smallest_free) totals->smallest_free = size;
+    }
+}
+
+// Replace the block-derived fields of `stats` with `totals`
+static inline void common_stats_from_totals(heap_stats_t* stats, const block_totals_t* totals) {
+    stats->allocated_bytes = totals->allocated_bytes;
+    stats->free_bytes = totals->free_bytes;
+    stats->allocation_count = totals->allocation_count;
+    stats->free_block_count = totals->free_block_count;
+    stats->largest_free_block = totals->largest_free;
+    memcpy(stats->free_size_histogram, totals->free_size_histogram, sizeof(stats->free_size_histogram));
+    
+    // If no free blocks, reset smallest
+    stats->smallest_free_block = totals->free_block_count > 0 ? totals->smallest_free : 0;
     
     // Calculate external fragmentation
     if (stats->free_bytes > 0 && stats->largest_free_block > 0) {
@@ -131,8 +679,9 @@ static inline void common_update_stats(block_info_t* blocks, int block_count, he
     }
     
     // Calculate internal fragmentation
-    if (total_allocated > 0 && total_requested > 0) {
-        stats->internal_fragmentation = ((float)(total_allocated - total_requested) / (float)total_allocated) * 100.0f;
+    if (totals->requested_allocated > 0 && totals->requested_bytes > 0) {
+        stats->internal_fragmentation = ((float)(totals->requested_allocated - totals->requested_bytes) /
+                                         (float)totals->requested_allocated) * 100.0f;
     } else {
         stats->internal_fragmentation = 0.0f;
     }
@@ -141,11 +690,1359 @@ static inline void common_update_stats(block_info_t* blocks, int block_count, he
     if (stats->min_free_bytes == 0 || stats->free_bytes < stats->min_free_bytes) {
         stats->min_free_bytes = stats->free_bytes;
     }
+}
+
+// Full recompute of block-derived stats. region_id < 0 scans every block,
+// otherwise only blocks belonging to that region (heap_5).
+static inline void common_scan_stats(const block_list_t* list, int region_id, heap_stats_t* stats) {
+    block_totals_t totals;
+    common_totals_clear(&totals);
     
-    // If no free blocks, reset smallest
-    if (!has_free_blocks) {
+    for (int32_t slot = list->head; slot != NO_SLOT; slot = list->next[slot]) {
+        const block_info_t* block = &list->blocks[slot];
+        if (region_id >= 0 && block->region_id != region_id) continue;
+        common_totals_add(&totals, block->size, block->state, block->requested_size);
+    }
+    common_stats_from_totals(stats, &totals);
+}
+
+static inline void common_update_stats(const block_list_t* list, heap_stats_t* stats) {
+    common_scan_stats(list, -1, stats);
+}
+
+// Incremental statistics
+//
+// Instead of rescanning the block list after every operation, allocators
+// report each state change (split, allocate, free, coalesce) as a delta. Free
+// block sizes are kept in a sorted multiset so the largest/smallest free
+// block stay exact. The multiset is a sequence of sorted chunks, so an insert
+// or remove moves at most one chunk's entries whatever the free block count.
+// The log2 size histogram in heap_stats_t is kept by the same deltas, in
+// headless builds too.
+
+#define SIZE_CHUNK_ENTRIES 256
+
+typedef struct {
+    size_t sizes[SIZE_CHUNK_ENTRIES];   // Ascending
+    int count;
+} size_chunk_t;
+
+typedef struct {
+    size_chunk_t** chunks;      // Ascending, none empty
+    int chunk_count;
+    int chunk_capacity;
+    int count;
+} free_size_index_t;
+
+typedef struct {
+    free_size_index_t free_sizes;
+    size_t requested_bytes;     // Sum of requested_size over allocated blocks that recorded one
+    size_t requested_block_bytes; // Block bytes backing those requests
+    uint32_t free_size_mask;    // Bit b set while free_size_histogram[b] is non-zero
+} stats_tracker_t;
+
+static inline int common_size_chunk_lower_bound(const size_chunk_t* chunk, size_t size) {
+    int lo = 0;
+    int hi = chunk->count;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (chunk->sizes[mid] < size) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// First chunk whose largest entry is >= size, or the last chunk
+static inline int common_size_index_find_chunk(const free_size_index_t* index, size_t size) {
+    int lo = 0;
+    int hi = index->chunk_count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        const size_chunk_t* chunk = index->chunks[mid];
+        if (chunk->sizes[chunk->count - 1] < size) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Put a new empty chunk at position `at`
+static inline size_chunk_t* common_size_index_add_chunk(free_size_index_t* index, int at) {
+    if (!common_grow((void**)&index->chunks, &index->chunk_capacity, index->chunk_count + 1,
+                     sizeof(size_chunk_t*))) {
+        return NULL;
+    }
+    size_chunk_t* chunk = (size_chunk_t*)malloc(sizeof(size_chunk_t));
+    if (!chunk) return NULL;
+    
+    memmove(&index->chunks[at + 1], &index->chunks[at],
+            (size_t)(index->chunk_count - at) * sizeof(size_chunk_t*));
+    index->chunks[at] = chunk;
+    index->chunk_count++;
+    chunk->count = 0;
+    return chunk;
+}
+
+static inline void common_size_index_clear(free_size_index_t* index) {
+    for (int c = 0; c < index->chunk_count; c++) free(index->chunks[c]);
+    index->chunk_count = 0;
+    index->count = 0;
+}
+
+static inline void common_size_index_insert(free_size_index_t* index, size_t size) {
+    if (index->chunk_count == 0 && !common_size_index_add_chunk(index, 0)) return;
+    
+    int c = common_size_index_find_chunk(index, size);
+    size_chunk_t* chunk = index->chunks[c];
+    
+    // Split a full chunk in half and insert into whichever half `size` sorts into
+    if (chunk->count == SIZE_CHUNK_ENTRIES) {
+        size_chunk_t* upper = common_size_index_add_chunk(index, c + 1);
+        if (!upper) return;
+        
+        int half = SIZE_CHUNK_ENTRIES / 2;
+        memcpy(upper->sizes, &chunk->sizes[half], (size_t)(SIZE_CHUNK_ENTRIES - half) * sizeof(size_t));
+        upper->count = SIZE_CHUNK_ENTRIES - half;
+        chunk->count = half;
+        if (size > chunk->sizes[half - 1]) chunk = upper;
+    }
+    
+    int pos = common_size_chunk_lower_bound(chunk, size);
+    memmove(&chunk->sizes[pos + 1], &chunk->sizes[pos], (size_t)(chunk->count - pos) * sizeof(size_t));
+    chunk->sizes[pos] = size;
+    chunk->count++;
+    index->count++;
+}
+
+static inline void common_size_index_remove(free_size_index_t* index, size_t size) {
+    if (index->chunk_count == 0) return;
+    
+    int c = common_size_index_find_chunk(index, size);
+    size_chunk_t* chunk = index->chunks[c];
+    int pos = common_size_chunk_lower_bound(chunk, size);
+    if (pos >= chunk->count || chunk->sizes[pos] != size) return;
+    
+    memmove(&chunk->sizes[pos], &chunk->sizes[pos + 1], (size_t)(chunk->count - pos - 1) * sizeof(size_t));
+    chunk->count--;
+    index->count--;
+    
+    if (chunk->count == 0) {
+        free(chunk);
+        memmove(&index->chunks[c], &index->chunks[c + 1],
+                (size_t)(index->chunk_count - c - 1) * sizeof(size_chunk_t*));
+        index->chunk_count--;
+    }
+}
+
+// Smallest entry >= size, or 0 if there is none
+static inline size_t common_size_index_lower_bound(const free_size_index_t* index, size_t size) {
+    if (index->chunk_count == 0) return 0;
+    
+    const size_chunk_t* chunk = index->chunks[common_size_index_find_chunk(index, size)];
+    int pos = common_size_chunk_lower_bound(chunk, size);
+    return pos < chunk->count ? chunk->sizes[pos] : 0;
+}
+
+// Clear the block-derived counters; total_size, ids and min_free_bytes are kept
+static inline void common_stats_reset(heap_stats_t* stats, stats_tracker_t* tracker) {
+    stats->allocated_bytes = 0;
+    stats->free_bytes = 0;
+    stats->allocation_count = 0;
+    stats->free_block_count = 0;
+    memset(stats->free_size_histogram, 0, sizeof(stats->free_size_histogram));
+    common_size_index_clear(&tracker->free_sizes);
+    tracker->free_size_mask = 0;
+    tracker->requested_bytes = 0;
+    tracker->requested_block_bytes = 0;
+}
+
+static inline void common_stats_add_free(heap_stats_t* stats, stats_tracker_t* tracker, size_t size) {
+    stats->free_bytes += size;
+    stats->free_block_count++;
+    int bucket = common_size_bucket(size);
+    stats->free_size_histogram[bucket]++;
+    tracker->free_size_mask |= 1u << bucket;
+#ifndef HEAP_HEADLESS
+    common_size_index_insert(&tracker->free_sizes, size);
+#endif
+}
+
+static inline void common_stats_remove_free(heap_stats_t* stats, stats_tracker_t* tracker, size_t size) {
+    stats->free_bytes -= size;
+    stats->free_block_count--;
+    int bucket = common_size_bucket(size);
+    if (--stats->free_size_histogram[bucket] == 0) tracker->free_size_mask &= ~(1u << bucket);
+#ifndef HEAP_HEADLESS
+    common_size_index_remove(&tracker->free_sizes, size);
+#endif
+}
+
+static inline void common_stats_add_alloc(heap_stats_t* stats, stats_tracker_t* tracker,
+                                          size_t size, size_t requested_size) {
+    stats->allocated_bytes += size;
+    stats->allocation_count++;
+    if (requested_size > 0) {
+        tracker->requested_bytes += requested_size;
+        tracker->requested_block_bytes += size;
+    }
+}
+
+static inline void common_stats_remove_alloc(heap_stats_t* stats, stats_tracker_t* tracker,
+                                             size_t size, size_t requested_size) {
+    stats->allocated_bytes -= size;
+    stats->allocation_count--;
+    if (requested_size > 0) {
+        tracker->requested_bytes -= requested_size;
+        tracker->requested_block_bytes -= size;
+    }
+}
+
+// Derive extremes and fragmentation from the running totals - O(1). Headless
+// builds have no size index and only track the low-water mark here; the
+// other fields are filled in when a snapshot is taken.
+static inline void common_stats_finish(heap_stats_t* stats, const stats_tracker_t* tracker) {
+#ifndef HEAP_HEADLESS
+    const free_size_index_t* index = &tracker->free_sizes;
+    
+    if (index->count > 0) {
+        const size_chunk_t* last = index->chunks[index->chunk_count - 1];
+        stats->largest_free_block = last->sizes[last->count - 1];
+        stats->smallest_free_block = index->chunks[0]->sizes[0];
+    } else {
+        stats->largest_free_block = 0;
         stats->smallest_free_block = 0;
     }
+    
+    if (stats->free_bytes > 0 && stats->largest_free_block > 0) {
+        stats->external_fragmentation = (1.0f - (float)stats->largest_free_block / (float)stats->free_bytes) * 100.0f;
+    } else {
+        stats->external_fragmentation = 0.0f;
+    }
+    
+    if (tracker->requested_block_bytes > 0 && tracker->requested_bytes > 0) {
+        stats->internal_fragmentation = ((float)(tracker->requested_block_bytes - tracker->requested_bytes) /
+                                         (float)tracker->requested_block_bytes) * 100.0f;
+    } else {
+        stats->internal_fragmentation = 0.0f;
+    }
+#else
+    (void)tracker;
+#endif
+    
+    if (stats->min_free_bytes == 0 || stats->free_bytes < stats->min_free_bytes) {
+        stats->min_free_bytes = stats->free_bytes;
+    }
+}
+
+// Smallest free block that can hold a `size` byte block, 0 if none does - the
+// answer to "would a best-fit search succeed" without walking a free list.
+// Headless builds only have the histogram: the result is the lower bound of
+// the first bucket whose every block fits, so a fitting block that shares
+// `size`'s own bucket is missed unless `size` is a power of two.
+static inline size_t common_free_fit(const heap_stats_t* stats, const stats_tracker_t* tracker, size_t size) {
+#ifndef HEAP_HEADLESS
+    (void)stats;
+    return common_size_index_lower_bound(&tracker->free_sizes, size);
+#else
+    (void)tracker;
+    if (size == 0) size = 1;
+    int bucket = common_size_bucket(size);
+    if (((size_t)1 << bucket) < size) bucket++;
+    for (; bucket < FREE_SIZE_BUCKETS; bucket++) {
+        if (stats->free_size_histogram[bucket]) return (size_t)1 << bucket;
+    }
+    return 0;
+#endif
+}
+
+// Upper bound on the largest free block in O(1): exact from the size index,
+// or the top of the highest non-empty bucket in headless builds. A request
+// above it cannot be served.
+static inline size_t common_free_largest(const stats_tracker_t* tracker) {
+#ifndef HEAP_HEADLESS
+    const free_size_index_t* index = &tracker->free_sizes;
+    if (index->count == 0) return 0;
+    const size_chunk_t* last = index->chunks[index->chunk_count - 1];
+    return last->sizes[last->count - 1];
+#else
+    if (!tracker->free_size_mask) return 0;
+    int top = 31 - __builtin_clz(tracker->free_size_mask);
+    return ((size_t)2 << top) - 1;
+#endif
 }
 
+// Batched operations
+//
+// heap_run_ops() runs a whole op tape natively instead of crossing from JS
+// once per malloc/free. The layout is fixed (4 x u32) so JS can fill it
+// directly. out_ptrs receives the pointer of every successful allocation in
+// order, and OP_FREE's ptr_index refers to an entry of that list, the same
+// way simulation steps index allocatedPointers. out_ptrs needs room for n.
+
+typedef enum {
+    OP_MALLOC = 0,
+    OP_FREE = 1,
+    OP_SKIP = 2,
+    OP_FREE_ADDR = 3        // free a pointer from an earlier batch, held in `size`
+} op_kind_t;
+
+// OP_MALLOC flag: keep a slot in out_ptrs (0) even if the allocation fails, so
+// ptr_index can count every malloc op rather than only successful ones
+#define OP_FLAG_KEEP_SLOT 0x100
+
+typedef struct {
+    uint32_t kind;          // op_kind_t
+    uint32_t size;          // OP_MALLOC: bytes requested; OP_FREE_ADDR: wasm32 pointer
+    int32_t ptr_index;      // OP_FREE: index into out_ptrs
+    uint32_t flags;         // OP_MALLOC: region flags (heap_5) in the low byte, OP_FLAG_*
+} op_t;
+
+typedef void* (*common_op_malloc_fn)(size_t size, uint8_t flags);
+typedef void (*common_op_free_fn)(void* ptr);
+
+// Returns the number of pointers written to out_ptrs
+static inline int common_run_ops(const op_t* ops, int n, uint32_t* out_ptrs,
+                                 common_op_malloc_fn malloc_fn, common_op_free_fn free_fn) {
+    int ptr_count = 0;
+    
+    for (int i = 0; i < n; i++) {
+        const op_t* op = &ops[i];
+        
+        if (op->kind == OP_MALLOC) {
+            void* ptr = malloc_fn(op->size, (uint8_t)op->flags);
+            if (ptr || (op->flags & OP_FLAG_KEEP_SLOT)) out_ptrs[ptr_count++] = (uint32_t)(uintptr_t)ptr;
+        } else if (op->kind == OP_FREE) {
+            if (op->ptr_index >= 0 && op->ptr_index < ptr_count && out_ptrs[op->ptr_index]) {
+                free_fn((void*)(uintptr_t)out_ptrs[op->ptr_index]);
+            }
+        } else if (op->kind == OP_FREE_ADDR) {
+            if (op->size) free_fn((void*)(uintptr_t)op->size);
+        }
+    }
+    return ptr_count;
+}
+
+// Synthetic workloads
+//
+// A seeded generator for op tapes far larger and less regular than the
+// hand-written simulations. The same config always gives the same tape on
+// every platform, so native and wasm runs, and every heap in a comparison,
+// see identical ops. Every malloc carries OP_FLAG_KEEP_SLOT, so OP_FREE's
+// ptr_index is the allocation ordinal whether or not allocations succeed.
+// Zero config fields pick the defaults noted below.
+
+typedef enum {
+    WORKLOAD_SIZE_UNIFORM = 0,
+    WORKLOAD_SIZE_POWER_LAW = 1,    // bounded Pareto, tail index shape/100 (default 1.2)
+    WORKLOAD_SIZE_BIMODAL = 2,      // shape% near min_size, the rest near max_size (default 80)
+    WORKLOAD_SIZE_CLASSES = 3       // one of classes[] (default: the powers of two in range)
+} workload_size_dist_t;
+
+typedef enum {
+    WORKLOAD_LIFO = 0,              // free the newest live allocation
+    WORKLOAD_FIFO = 1,              // free the oldest
+    WORKLOAD_RANDOM = 2,
+    WORKLOAD_LONG_LIVED = 3         // long_lived_percent are never freed, the rest churn randomly
+} workload_lifetime_t;
+
+#define WORKLOAD_CLASSES 8
+#define WORKLOAD_FLAGS   4
+
+// All u32 so JS can fill it directly
+typedef struct {
+    uint32_t seed;
+    uint32_t op_count;
+    uint32_t size_dist;             // workload_size_dist_t
+    uint32_t min_size;              // default 8
+    uint32_t max_size;              // default 1024
+    uint32_t shape;                 // see workload_size_dist_t
+    uint32_t lifetime;              // workload_lifetime_t
+    uint32_t max_live;              // live allocations that may be freed, default 256
+    uint32_t alloc_percent;         // chance an op allocates below max_live, default 55
+    uint32_t long_lived_percent;    // WORKLOAD_LONG_LIVED, default 10
+    uint32_t flag_percent[WORKLOAD_FLAGS];  // % of mallocs asking for region flag 1 << i (heap_5), summing to <= 100
+    uint32_t classes[WORKLOAD_CLASSES];     // WORKLOAD_SIZE_CLASSES sizes, 0-terminated
+} workload_config_t;
+
+// xorshift32 on a scrambled seed; rand() differs between libcs
+static inline uint32_t common_workload_rand(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Uniform in [lo, hi]
+static inline uint32_t common_workload_range(uint32_t* state, uint32_t lo, uint32_t hi) {
+    if (hi <= lo) return lo;
+    return lo + (uint32_t)(((uint64_t)common_workload_rand(state) * ((uint64_t)hi - lo + 1)) >> 32);
+}
+
+static inline uint32_t common_workload_size(const workload_config_t* config, uint32_t* state,
+                                            uint32_t lo, uint32_t hi) {
+    switch (config->size_dist) {
+    case WORKLOAD_SIZE_POWER_LAW: {
+        // Inverse CDF of a Pareto truncated to [lo, hi]; most requests are small
+        float a = (config->shape ? config->shape : 120) / 100.0f;
+        float u = ((common_workload_rand(state) >> 8) + 1) * (1.0f / 16777216.0f);
+        float tail = 1.0f - powf((float)lo / (float)hi, a);
+        uint32_t size = (uint32_t)((float)lo * powf(1.0f - u * tail, -1.0f / a));
+        return size < lo ? lo : size > hi ? hi : size;
+    }
+    case WORKLOAD_SIZE_BIMODAL: {
+        uint32_t spread = (hi - lo) / 8;
+        uint32_t small = config->shape ? config->shape : 80;
+        return common_workload_range(state, 0, 99) < small ? common_workload_range(state, lo, lo + spread)
+                                                           : common_workload_range(state, hi - spread, hi);
+    }
+    case WORKLOAD_SIZE_CLASSES: {
+        int count = 0;
+        while (count < WORKLOAD_CLASSES && config->classes[count]) count++;
+        if (count > 0) return config->classes[common_workload_range(state, 0, (uint32_t)count - 1)];
+        
+        uint32_t first = 1;
+        while (first < lo) first <<= 1;
+        if (first > hi) return lo;
+        int steps = 0;
+        while (((uint64_t)first << (steps + 1)) <= hi) steps++;
+        return first << common_workload_range(state, 0, (uint32_t)steps);
+    }
+    default:
+        return common_workload_range(state, lo, hi);
+    }
+}
+
+// Write up to `capacity` ops of `config` to `ops` (config->op_count at
+// most); returns how many, or -1 if the live set could not be allocated
+static inline int common_workload_generate(const workload_config_t* config, op_t* ops, int capacity) {
+    uint32_t lo = config->min_size ? config->min_size : 8;
+    uint32_t hi = config->max_size ? config->max_size : 1024;
+    if (hi < lo) hi = lo;
+    int max_live = config->max_live ? (int)config->max_live : 256;
+    uint32_t alloc_percent = config->alloc_percent ? config->alloc_percent : 55;
+    uint32_t long_percent = config->long_lived_percent ? config->long_lived_percent : 10;
+    uint32_t flag_total = 0;
+    for (int f = 0; f < WORKLOAD_FLAGS; f++) flag_total += config->flag_percent[f];
+    int n = config->op_count < (uint32_t)capacity ? (int)config->op_count : capacity;
+    
+    // Live ordinals in allocation order, as a ring so FIFO pops from the front
+    int32_t* live = (int32_t*)malloc((size_t)max_live * sizeof(int32_t));
+    if (!live) return -1;
+    int head = 0;
+    int live_count = 0;
+    int long_lived = 0;
+    int32_t next_ordinal = 0;
+    uint32_t state = config->seed * 0x9E3779B9u + 0x7F4A7C15u;
+    if (state == 0) state = 1;
+    
+    for (int i = 0; i < n; i++) {
+        op_t* op = &ops[i];
+        int allocate = live_count == 0 ||
+                       (live_count < max_live && common_workload_range(&state, 0, 99) < alloc_percent);
+        if (allocate) {
+            uint32_t flags = 0;
+            if (flag_total > 0) {
+                uint32_t roll = common_workload_range(&state, 0, 99);
+                uint32_t upto = 0;
+                for (int f = 0; f < WORKLOAD_FLAGS && !flags; f++) {
+                    upto += config->flag_percent[f];
+                    if (roll < upto) flags = 1u << f;
+                }
+            }
+            op->kind = OP_MALLOC;
+            op->size = common_workload_size(config, &state, lo, hi);
+            op->ptr_index = -1;
+            op->flags = flags | OP_FLAG_KEEP_SLOT;
+            
+            int keep = config->lifetime == WORKLOAD_LONG_LIVED && long_lived < max_live &&
+                       common_workload_range(&state, 0, 99) < long_percent;
+            if (keep) {
+                long_lived++;
+            } else {
+                live[(head + live_count++) % max_live] = next_ordinal;
+            }
+            next_ordinal++;
+            continue;
+        }
+        
+        int pick;
+        if (config->lifetime == WORKLOAD_FIFO) {
+            pick = head;
+            head = (head + 1) % max_live;
+        } else {
+            int k = config->lifetime == WORKLOAD_LIFO ? live_count - 1
+                                                      : (int)common_workload_range(&state, 0, (uint32_t)live_count - 1);
+            // Swap the pick with the newest entry, which then leaves the ring
+            int back = (head + live_count - 1) % max_live;
+            pick = (head + k) % max_live;
+            int32_t ordinal = live[pick];
+            live[pick] = live[back];
+            live[back] = ordinal;
+            pick = back;
+        }
+        live_count--;
+        op->kind = OP_FREE;
+        op->size = 0;
+        op->ptr_index = live[pick];
+        op->flags = 0;
+    }
+    
+    free(live);
+    return n;
+}
+
+// Block table snapshot
+//
+// A packed structure-of-arrays copy of the block table that JS can wrap in a
+// single Uint32Array. Layout (all u32):
+//   [0] column count  [1] capacity  [2] length  [3] heap_version at fill
+//   [4] heap_version of the fill the dirty span is relative to
+//   [5] [6] first dirty (region_id, offset)  [7] [8] last dirty (region_id, end)
+//   then BLOCK_TABLE_COLUMNS columns of `capacity` entries each.
+// Modules bump heap_version on every call that can change blocks, stats or
+// the log; the snapshot is only rebuilt when the version has moved.
+//
+// The dirty span is the smallest (region_id, offset) range, compared region
+// first, that covers every row added, changed or dropped since the previous
+// fill, so a renderer only has to redraw that much. [5] is DIRTY_NONE when
+// nothing changed; a first fill is dirty from (0, 0) to (DIRTY_NONE, DIRTY_NONE).
+
+enum {
+    BLOCK_COL_OFFSET = 0,
+    BLOCK_COL_SIZE,
+    BLOCK_COL_STATE,
+    BLOCK_COL_ALLOCATION_ID,
+    BLOCK_COL_TIMESTAMP,
+    BLOCK_COL_REQUESTED_SIZE,
+    BLOCK_COL_REGION_ID,
+    BLOCK_TABLE_COLUMNS
+};
+
+#define BLOCK_TABLE_HEADER 9
+#define DIRTY_NONE 0xFFFFFFFFu
+#define BLOCK_TABLE_WORDS(capacity) (BLOCK_TABLE_HEADER + BLOCK_TABLE_COLUMNS * (size_t)(capacity))
+
+// The snapshot buffers grow with the heap's block capacity. Each fill goes
+// into the spare buffer and the two are swapped, so the previous fill is
+// still there to diff against. The address changes on every refresh, so JS
+// re-reads get_block_table_ptr() every time.
+typedef struct {
+    uint32_t* words;
+    int capacity;
+    uint32_t* spare;            // Previous fill
+    int spare_capacity;
+} block_table_t;
+
+// Size the table for `length` rows and write the header; returns the number
+// of rows that fit (0 if the table could not be allocated). The rows must be
+// followed by common_block_table_end().
+static inline int common_block_table_begin(block_table_t* table, int length, int capacity_hint,
+                                           uint32_t version) {
+    if (!table->spare || table->spare_capacity < length) {
+        int capacity = capacity_hint > length ? capacity_hint : length;
+        if (capacity < 1) capacity = 1;
+        
+        uint32_t* words = (uint32_t*)realloc(table->spare, BLOCK_TABLE_WORDS(capacity) * sizeof(uint32_t));
+        if (words) {
+            table->spare = words;
+            table->spare_capacity = capacity;
+        }
+        if (!table->spare) return 0;
+    }
+    
+    uint32_t* previous = table->words;
+    int previous_capacity = table->capacity;
+    table->words = table->spare;
+    table->capacity = table->spare_capacity;
+    table->spare = previous;
+    table->spare_capacity = previous_capacity;
+    
+    if (length > table->capacity) length = table->capacity;
+    table->words[0] = BLOCK_TABLE_COLUMNS;
+    table->words[1] = (uint32_t)table->capacity;
+    table->words[2] = (uint32_t)length;
+    table->words[3] = version;
+    return length;
+}
+
+static inline void common_block_table_set(block_table_t* table, int row, const block_info_t* block) {
+    uint32_t* columns = table->words + BLOCK_TABLE_HEADER;
+    size_t capacity = (size_t)table->capacity;
+    
+    columns[BLOCK_COL_OFFSET * capacity + row] = (uint32_t)block->offset;
+    columns[BLOCK_COL_SIZE * capacity + row] = (uint32_t)block->size;
+    columns[BLOCK_COL_STATE * capacity + row] = (uint32_t)block->state;
+    columns[BLOCK_COL_ALLOCATION_ID * capacity + row] = block->allocation_id;
+    columns[BLOCK_COL_TIMESTAMP * capacity + row] = block->timestamp;
+    columns[BLOCK_COL_REQUESTED_SIZE * capacity + row] = (uint32_t)block->requested_size;
+    columns[BLOCK_COL_REGION_ID * capacity + row] = block->region_id;
+}
+
+static inline int common_block_table_current(const block_table_t* table, uint32_t version) {
+    return table->words && table->words[0] == BLOCK_TABLE_COLUMNS && table->words[3] == version;
+}
+
+// (region_id, offset) of a row as one value that sorts region first
+static inline uint64_t common_block_row_key(const uint32_t* words, int row) {
+    const uint32_t* columns = words + BLOCK_TABLE_HEADER;
+    size_t capacity = words[1];
+    return ((uint64_t)columns[BLOCK_COL_REGION_ID * capacity + row] << 32) |
+           columns[BLOCK_COL_OFFSET * capacity + row];
+}
+
+static inline int common_block_rows_equal(const uint32_t* a, int row_a, const uint32_t* b, int row_b) {
+    const uint32_t* columns_a = a + BLOCK_TABLE_HEADER;
+    const uint32_t* columns_b = b + BLOCK_TABLE_HEADER;
+    size_t capacity_a = a[1];
+    size_t capacity_b = b[1];
+    for (int c = 0; c < BLOCK_TABLE_COLUMNS; c++) {
+        if (columns_a[c * capacity_a + row_a] != columns_b[c * capacity_b + row_b]) return 0;
+    }
+    return 1;
+}
+
+static inline void common_block_row_dirty(const uint32_t* words, int row, uint64_t* lo, uint64_t* hi) {
+    uint64_t key = common_block_row_key(words, row);
+    uint64_t end = key + words[BLOCK_TABLE_HEADER + BLOCK_COL_SIZE * (size_t)words[1] + row];
+    if (key < *lo) *lo = key;
+    if (end > *hi) *hi = end;
+}
+
+// Diff the new fill against the previous one and write the dirty span. Both
+// are walked together in row order; rows that don't match are dirty on either
+// side, and the side with the lower key moves on, so rows that only moved in
+// the table (after a split, say) line up again at the next equal pair.
+static inline void common_block_table_end(block_table_t* table) {
+    uint32_t* words = table->words;
+    const uint32_t* previous = table->spare;
+    uint64_t lo = UINT64_MAX;
+    uint64_t hi = 0;
+    
+    if (!previous || previous[0] != BLOCK_TABLE_COLUMNS) {
+        words[4] = 0;
+        lo = 0;
+        hi = UINT64_MAX;
+    } else {
+        int length = (int)words[2];
+        int previous_length = (int)previous[2];
+        int i = 0;
+        int j = 0;
+        
+        words[4] = previous[3];
+        while (i < length && j < previous_length) {
+            if (common_block_rows_equal(words, i, previous, j)) {
+                i++;
+                j++;
+                continue;
+            }
+            
+            uint64_t key = common_block_row_key(words, i);
+            uint64_t previous_key = common_block_row_key(previous, j);
+            if (key <= previous_key) common_block_row_dirty(words, i++, &lo, &hi);
+            if (previous_key <= key) common_block_row_dirty(previous, j++, &lo, &hi);
+        }
+        while (i < length) common_block_row_dirty(words, i++, &lo, &hi);
+        while (j < previous_length) common_block_row_dirty(previous, j++, &lo, &hi);
+    }
+    
+    words[5] = lo == UINT64_MAX ? DIRTY_NONE : (uint32_t)(lo >> 32);
+    words[6] = (uint32_t)lo;
+    words[7] = (uint32_t)(hi >> 32);
+    words[8] = (uint32_t)hi;
+}
+
+static inline uint32_t* common_block_table_refresh(block_table_t* table, const block_list_t* list,
+                                                   uint32_t version) {
+    if (common_block_table_current(table, version)) return table->words;
+    
+    int length = common_block_table_begin(table, list->count, list->capacity, version);
+    int row = 0;
+    for (int32_t slot = list->head; slot != NO_SLOT && row < length; slot = list->next[slot]) {
+        common_block_table_set(table, row++, &list->blocks[slot]);
+    }
+    if (common_block_table_current(table, version)) common_block_table_end(table);
+    return table->words;
+}
+
+// Column kernels
+//
+// Passes over a block table snapshot that has already been filled for a
+// query (headless stats, pending merges), reading only the columns they need.
+
+static inline const uint32_t* common_column(const uint32_t* words, int column) {
+    return words + BLOCK_TABLE_HEADER + (size_t)column * words[1];
+}
+
+// Add rows [begin, end) to `totals`
+static inline void common_columns_totals(const uint32_t* words, int begin, int end, block_totals_t* totals) {
+    const uint32_t* size = common_column(words, BLOCK_COL_SIZE);
+    const uint32_t* state = common_column(words, BLOCK_COL_STATE);
+    const uint32_t* requested = common_column(words, BLOCK_COL_REQUESTED_SIZE);
+    for (int row = begin; row < end; row++) {
+        common_totals_add(totals, size[row], state[row], requested[row]);
+    }
+}
+
+// First row after `begin` whose region differs from row `begin`'s, or the
+// table length. A region's blocks are contiguous in address order, so this
+// partitions the table by region.
+static inline int common_columns_region_end(const uint32_t* words, int begin) {
+    const uint32_t* region = common_column(words, BLOCK_COL_REGION_ID);
+    int length = (int)words[2];
+    if (begin >= length) return length;
+    
+    uint32_t id = region[begin];
+    int row = begin + 1;
+    while (row < length && region[row] == id) row++;
+    return row;
+}
+
+// Totals per region: rows go to totals[region_id] (ignored past `count`), or
+// all to totals[0] when count is 1
+static inline void common_columns_partition(const uint32_t* words, block_totals_t* totals, int count) {
+    const uint32_t* region = common_column(words, BLOCK_COL_REGION_ID);
+    int length = (int)words[2];
+    
+    for (int r = 0; r < count; r++) common_totals_clear(&totals[r]);
+    for (int row = 0; row < length;) {
+        int end = common_columns_region_end(words, row);
+        int r = count == 1 ? 0 : (int)region[row];
+        if (r < count) common_columns_totals(words, row, end, &totals[r]);
+        row = end;
+    }
+}
+
+// Adjacent free pairs in rows [begin, end): each is a merge a coalescing pass
+// still has to make
+static inline int common_columns_free_pairs(const uint32_t* words, int begin, int end) {
+    const uint32_t* offset = common_column(words, BLOCK_COL_OFFSET);
+    const uint32_t* size = common_column(words, BLOCK_COL_SIZE);
+    const uint32_t* state = common_column(words, BLOCK_COL_STATE);
+    const uint32_t* region = common_column(words, BLOCK_COL_REGION_ID);
+    int pairs = 0;
+    
+    // Row i pairs with row i + 1
+    for (int row = begin; row + 1 < end; row++) {
+        int free_left = state[row] == BLOCK_FREE || state[row] == BLOCK_FREED;
+        int free_right = state[row + 1] == BLOCK_FREE || state[row + 1] == BLOCK_FREED;
+        if (free_left && free_right && region[row] == region[row + 1] &&
+            offset[row] + size[row] == offset[row + 1]) {
+            pairs++;
+        }
+    }
+    return pairs;
+}
+
+// Headless snapshots
+//
+// A headless module fills the block list from its real heap only when a
+// query asks for it, at most once per heap_version, and derives the full
+// stats from that list with common_snapshot_stats(), which goes through the
+// block table columns. The table is needed for the query anyway.
+
+#define MAX_SNAPSHOT_REGIONS 8
+
+// Returns 1 if the list must be rebuilt, having emptied it
+static inline int common_snapshot_begin(block_list_t* list, uint32_t* snapshot_version, uint32_t version) {
+    if (*snapshot_version == version && list->limit > 0) return 0;
+    
+    *snapshot_version = version;
+    common_blocks_init(list, BLOCK_LIMIT);
+    return 1;
+}
+
+static inline void common_snapshot_add(block_list_t* list, uint8_t region_id, size_t offset,
+                                       size_t size, block_state_t state) {
+    block_info_t block = {
+        .offset = offset,
+        .size = size,
+        .state = state,
+        .allocation_id = 0,
+        .timestamp = 0,
+        .requested_size = 0,
+        .region_id = region_id
+    };
+    common_blocks_append(list, &block);
+}
+
+// Stats per region from the freshly built list and its block table (stats[0]
+// only when count is 1). Walks the list instead if the table is short.
+static inline void common_snapshot_stats(block_table_t* table, const block_list_t* list, uint32_t version,
+                                         heap_stats_t* const* stats, int count) {
+    const uint32_t* words = common_block_table_refresh(table, list, version);
+    if (!words || (int)words[2] != list->count) {
+        for (int r = 0; r < count; r++) common_scan_stats(list, count == 1 ? -1 : r, stats[r]);
+        return;
+    }
+    
+    block_totals_t totals[MAX_SNAPSHOT_REGIONS];
+    if (count > MAX_SNAPSHOT_REGIONS) count = MAX_SNAPSHOT_REGIONS;
+    common_columns_partition(words, totals, count);
+    for (int r = 0; r < count; r++) common_stats_from_totals(stats[r], &totals[r]);
+}
+
+// qsort comparator for free-list nodes, so unordered free lists can be
+// matched against a walk of the heap in address order
+static inline int common_ptr_compare(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)*(void* const*)a;
+    uintptr_t y = (uintptr_t)*(void* const*)b;
+    return x < y ? -1 : x > y;
+}
+
+// State checkpoints
+//
+// heap_snapshot() serializes a module's state - heap bytes, free lists, block
+// list, stats and log - so heap_restore() can rewind to it without replaying
+// the operations in between. Pointers into the heap are stored as offsets
+// (+1, so 0 stays NULL), which lets a checkpoint restore into an arena at
+// another address. Configuration (coalescing policy, region fallback) and the
+// op profile are not part of it. Block lists are written in address order and
+// relinked by appending, so after a restore the slot of the k-th block is k.
+// Only the header is validated: a checkpoint is trusted to come from
+// heap_snapshot() of the same module and build.
+
+#define CHECKPOINT_MAGIC  0x4b504843u   // "CHPK"
+#define CHECKPOINT_FORMAT 1
+#ifndef HEAP_HEADLESS
+#define CHECKPOINT_BUILD  0
+#else
+#define CHECKPOINT_BUILD  0x100         // headless layouts differ
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t heap_id;           // module number | CHECKPOINT_BUILD
+    uint32_t reserved;
+    uint64_t size;              // whole checkpoint, this header included
+} checkpoint_header_t;
+
+// Writes go to `data` while they fit; `pos` keeps counting past `capacity`,
+// so a NULL buffer measures how big the checkpoint is
+typedef struct {
+    uint8_t* data;
+    size_t capacity;
+    size_t pos;
+} checkpoint_writer_t;
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    int ok;                     // cleared by any read past the end
+} checkpoint_reader_t;
+
+// Append `size` bytes; returns where they were written, NULL if they didn't fit
+static inline uint8_t* common_checkpoint_put(checkpoint_writer_t* w, const void* src, size_t size) {
+    uint8_t* dst = NULL;
+    if (w->data && w->pos + size <= w->capacity) {
+        dst = w->data + w->pos;
+        memcpy(dst, src, size);
+    }
+    w->pos += size;
+    return dst;
+}
+
+static inline const uint8_t* common_checkpoint_get(checkpoint_reader_t* r, void* dst, size_t size) {
+    if (!r->ok || r->pos + size > r->size) {
+        r->ok = 0;
+        return NULL;
+    }
+    const uint8_t* src = r->data + r->pos;
+    if (dst) memcpy(dst, src, size);
+    r->pos += size;
+    return src;
+}
+
+#define common_checkpoint_put_value(w, value) common_checkpoint_put(w, &(value), sizeof(value))
+#define common_checkpoint_get_value(r, value) common_checkpoint_get(r, &(value), sizeof(value))
+
+static inline uintptr_t common_checkpoint_offset(const void* ptr, const uint8_t* base) {
+    return ptr ? (uintptr_t)((const uint8_t*)ptr - base) + 1 : 0;
+}
+
+static inline void* common_checkpoint_pointer(uintptr_t offset, uint8_t* base) {
+    return offset ? base + (offset - 1) : NULL;
+}
+
+// Overwrite the pointer field at image + at (a copy of the heap, possibly
+// unaligned) with the offset of `ptr`
+static inline void common_checkpoint_pack(uint8_t* image, size_t at, const void* ptr, const uint8_t* base) {
+    uintptr_t offset = common_checkpoint_offset(ptr, base);
+    memcpy(image + at, &offset, sizeof(offset));
+}
+
+static inline void common_checkpoint_begin(checkpoint_writer_t* w, void* buf, size_t capacity, uint32_t heap_id) {
+    w->data = (uint8_t*)buf;
+    w->capacity = capacity;
+    w->pos = 0;
+    checkpoint_header_t header = { CHECKPOINT_MAGIC, CHECKPOINT_FORMAT, heap_id | CHECKPOINT_BUILD, 0, 0 };
+    common_checkpoint_put_value(w, header);
+}
+
+// Returns the checkpoint's size; it is complete only if that is <= capacity
+static inline size_t common_checkpoint_end(checkpoint_writer_t* w) {
+    if (w->data && w->pos <= w->capacity) {
+        ((checkpoint_header_t*)w->data)->size = w->pos;
+    }
+    return w->pos;
+}
+
+// Returns 1 if `buf` holds a whole checkpoint of this module and build
+static inline int common_checkpoint_open(checkpoint_reader_t* r, const void* buf, size_t size, uint32_t heap_id) {
+    checkpoint_header_t header;
+    r->data = (const uint8_t*)buf;
+    r->size = size;
+    r->pos = 0;
+    r->ok = buf != NULL;
+    if (!common_checkpoint_get_value(r, header)) return 0;
+    
+    r->ok = header.magic == CHECKPOINT_MAGIC && header.format == CHECKPOINT_FORMAT &&
+            header.heap_id == (heap_id | CHECKPOINT_BUILD) && header.size == size;
+    return r->ok;
+}
+
+// The log is written oldest first, so a restored ring starts at 0
+static inline void common_checkpoint_put_log(checkpoint_writer_t* w, const log_ring_t* log) {
+    common_checkpoint_put_value(w, log->count);
+    common_checkpoint_put_value(w, log->next_seq);
+    common_checkpoint_put_value(w, log->lost);
+    for (uint32_t i = 0; i < log->count; i++) {
+        common_checkpoint_put_value(w, log->entries[(log->head + i) % log->capacity]);
+    }
+}
+
+static inline void common_checkpoint_get_log(checkpoint_reader_t* r, log_ring_t* log) {
+    uint32_t count = 0;
+    common_checkpoint_get_value(r, count);
+    if (count > log->capacity && !common_log_reserve(log, count)) r->ok = 0;
+    if (!r->ok) return;
+    
+    log->head = 0;
+    log->count = count;
+    common_checkpoint_get_value(r, log->next_seq);
+    common_checkpoint_get_value(r, log->lost);
+    common_checkpoint_get(r, log->entries, count * sizeof(log_entry_t));
+}
+
+// Stats and their tracker; the size index is written as its sorted sizes
+static inline void common_checkpoint_put_stats(checkpoint_writer_t* w, const heap_stats_t* stats,
+                                               const stats_tracker_t* tracker) {
+    const free_size_index_t* index = &tracker->free_sizes;
+    common_checkpoint_put(w, stats, sizeof(*stats));
+    common_checkpoint_put_value(w, tracker->requested_bytes);
+    common_checkpoint_put_value(w, tracker->requested_block_bytes);
+    common_checkpoint_put_value(w, tracker->free_size_mask);
+    common_checkpoint_put_value(w, index->count);
+    for (int c = 0; c < index->chunk_count; c++) {
+        common_checkpoint_put(w, index->chunks[c]->sizes, (size_t)index->chunks[c]->count * sizeof(size_t));
+    }
+}
+
+static inline void common_checkpoint_get_stats(checkpoint_reader_t* r, heap_stats_t* stats,
+                                               stats_tracker_t* tracker) {
+    int count = 0;
+    common_checkpoint_get(r, stats, sizeof(*stats));
+    common_checkpoint_get_value(r, tracker->requested_bytes);
+    common_checkpoint_get_value(r, tracker->requested_block_bytes);
+    common_checkpoint_get_value(r, tracker->free_size_mask);
+    common_checkpoint_get_value(r, count);
+    
+    common_size_index_clear(&tracker->free_sizes);
+    const uint8_t* sizes = common_checkpoint_get(r, NULL, (size_t)(count > 0 ? count : 0) * sizeof(size_t));
+    for (int i = 0; sizes && i < count; i++) {
+        size_t size;
+        memcpy(&size, sizes + (size_t)i * sizeof(size_t), sizeof(size));
+        common_size_index_insert(&tracker->free_sizes, size);
+    }
+}
+
+// Blocks in address order; `cursor` is a slot to carry over as its ordinal
+static inline void common_checkpoint_put_blocks(checkpoint_writer_t* w, const block_list_t* list, int cursor) {
+    int ordinal = -1;
+    int k = 0;
+    common_checkpoint_put_value(w, list->limit);
+    common_checkpoint_put_value(w, list->count);
+    for (int32_t slot = list->head; slot != NO_SLOT; slot = list->next[slot], k++) {
+        if (slot == cursor) ordinal = k;
+        common_checkpoint_put_value(w, list->blocks[slot]);
+    }
+    common_checkpoint_put_value(w, ordinal);
+}
+
+// Relink the list; returns the carried-over cursor slot (NO_SLOT if none)
+static inline int common_checkpoint_get_blocks(checkpoint_reader_t* r, block_list_t* list) {
+    int limit = 0;
+    int count = 0;
+    int ordinal = -1;
+    common_checkpoint_get_value(r, limit);
+    common_checkpoint_get_value(r, count);
+    if (count < 0 || count > limit || limit > BLOCK_LIMIT) r->ok = 0;
+    if (!r->ok) return NO_SLOT;
+    
+    common_blocks_init(list, limit);
+    for (int i = 0; i < count && r->ok; i++) {
+        block_info_t block;
+        if (common_checkpoint_get_value(r, block) && common_blocks_append(list, &block) == NO_SLOT) r->ok = 0;
+    }
+    common_checkpoint_get_value(r, ordinal);
+    return ordinal >= 0 && ordinal < count ? ordinal : NO_SLOT;
+}
+
+// Operation profiling
+//
+// heap_malloc, heap_malloc_flags and heap_free time themselves and count the
+// work they did. Each figure of a finished call goes into a log2 histogram
+// for its operation kind, next to the worst case seen, so bounds such as the
+// longest free-list walk can be read off after a workload. Nested calls
+// (heap_malloc forwarding to heap_malloc_flags) are recorded once, under the
+// outer kind. The histograms live in the module; with -DHEAP_NO_PROFILE the
+// hooks compile to nothing and every histogram stays empty.
+
+typedef enum {
+    PROFILE_OP_MALLOC = 0,
+    PROFILE_OP_FREE = 1,
+    PROFILE_OP_MALLOC_FLAGS = 2,
+    PROFILE_OP_REALLOC = 3,
+    PROFILE_OP_KINDS
+} profile_op_t;
+
+typedef enum {
+    PROFILE_NS = 0,             // wall time of the call
+    PROFILE_VISITED,            // free-list nodes or blocks examined
+    PROFILE_SPLITS,
+    PROFILE_MERGES,
+    PROFILE_COALESCE_STEPS,     // deferred coalesce steps run inside the call
+    PROFILE_METRICS
+} profile_metric_t;
+
+// Bucket 0 counts zeros; bucket b counts values in [2^(b-1), 2^b)
+#define PROFILE_BUCKETS 33
+
+typedef struct {
+    uint32_t count;
+    uint32_t max;
+    uint32_t buckets[PROFILE_BUCKETS];
+} profile_histogram_t;
+
+typedef struct {
+    profile_histogram_t histograms[PROFILE_OP_KINDS][PROFILE_METRICS];
+    uint32_t work[PROFILE_METRICS];     // counts of the call in flight
+    uint64_t start_ticks;
+    int depth;
+    int kind;
+} op_profile_t;
+
+static inline void common_histogram_add(profile_histogram_t* histogram, uint32_t value) {
+    int bucket = value ? 32 - __builtin_clz(value) : 0;
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    if (value > histogram->max) histogram->max = value;
+}
+
+// Copy the buckets of one histogram into `out` (PROFILE_BUCKETS words);
+// returns the number of calls recorded
+static inline int common_profile_histogram(const op_profile_t* profile, int kind, int metric, uint32_t* out) {
+    if (kind < 0 || kind >= PROFILE_OP_KINDS || metric < 0 || metric >= PROFILE_METRICS) return 0;
+    
+    const profile_histogram_t* histogram = &profile->histograms[kind][metric];
+    if (out) memcpy(out, histogram->buckets, sizeof(histogram->buckets));
+    return (int)histogram->count;
+}
+
+static inline uint32_t common_profile_max(const op_profile_t* profile, int kind, int metric) {
+    if (kind < 0 || kind >= PROFILE_OP_KINDS || metric < 0 || metric >= PROFILE_METRICS) return 0;
+    return profile->histograms[kind][metric].max;
+}
+
+#ifndef HEAP_NO_PROFILE
+// Timestamps are raw ticks of the cheapest clock at hand: performance.now()
+// under wasm, the TSC on x86 and CLOCK_MONOTONIC elsewhere. TSC ticks are
+// converted with a rate measured against CLOCK_MONOTONIC the first time a
+// profile is cleared (heap_init), which costs about a millisecond once.
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+
+static inline uint64_t common_ticks(void) {
+    return (uint64_t)(emscripten_get_now() * 1e6);
+}
+
+static inline void common_ticks_calibrate(void) {}
+
+static inline uint64_t common_ticks_to_ns(uint64_t ticks) {
+    return ticks;
+}
+#else
+#include <time.h>
+
+static inline uint64_t common_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static double tsc_ns_per_tick = 0.0;
+
+static inline uint64_t common_ticks(void) {
+    return __rdtsc();
+}
+
+static inline void common_ticks_calibrate(void) {
+    if (tsc_ns_per_tick > 0.0) return;
+    
+    uint64_t ns_start = common_clock_ns();
+    uint64_t tsc_start = __rdtsc();
+    uint64_t ns_elapsed;
+    while ((ns_elapsed = common_clock_ns() - ns_start) < 1000000) {}
+    uint64_t tsc_elapsed = __rdtsc() - tsc_start;
+    tsc_ns_per_tick = tsc_elapsed ? (double)ns_elapsed / (double)tsc_elapsed : 1.0;
+}
+
+static inline uint64_t common_ticks_to_ns(uint64_t ticks) {
+    return (uint64_t)((double)ticks * tsc_ns_per_tick);
+}
+#else
+static inline uint64_t common_ticks(void) {
+    return common_clock_ns();
+}
+
+static inline void common_ticks_calibrate(void) {}
+
+static inline uint64_t common_ticks_to_ns(uint64_t ticks) {
+    return ticks;
+}
+#endif
+#endif
+
+static inline void common_profile_begin(op_profile_t* profile, int kind) {
+    if (profile->depth++ > 0) return;
+    
+    profile->kind = kind;
+    memset(profile->work, 0, sizeof(profile->work));
+    profile->start_ticks = common_ticks();
+}
+
+static inline void common_profile_end(op_profile_t* profile) {
+    if (--profile->depth > 0) return;
+    
+    uint64_t elapsed = common_ticks_to_ns(common_ticks() - profile->start_ticks);
+    profile->work[PROFILE_NS] = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+    for (int m = 0; m < PROFILE_METRICS; m++) {
+        common_histogram_add(&profile->histograms[profile->kind][m], profile->work[m]);
+    }
+}
+
+#define common_profile_count(profile, metric, n) ((profile)->work[metric] += (uint32_t)(n))
+#else
+#define common_ticks_calibrate() ((void)0)
+#define common_profile_begin(profile, kind) ((void)0)
+#define common_profile_end(profile) ((void)0)
+#define common_profile_count(profile, metric, n) ((void)0)
+#endif
+
+static inline void common_profile_clear(op_profile_t* profile) {
+    common_ticks_calibrate();
+    memset(profile->histograms, 0, sizeof(profile->histograms));
+}
+
+// Fold `src` into `dst` and empty it (heap_3's per-thread profiles)
+static inline void common_profile_merge(op_profile_t* dst, op_profile_t* src) {
+    for (int k = 0; k < PROFILE_OP_KINDS; k++) {
+        for (int m = 0; m < PROFILE_METRICS; m++) {
+            profile_histogram_t* to = &dst->histograms[k][m];
+            const profile_histogram_t* from = &src->histograms[k][m];
+            if (from->count == 0) continue;
+            
+            for (int b = 0; b < PROFILE_BUCKETS; b++) to->buckets[b] += from->buckets[b];
+            to->count += from->count;
+            if (from->max > to->max) to->max = from->max;
+        }
+    }
+    common_profile_clear(src);
+}
+
+// Allocation lifetimes
+//
+// Every malloc and free a module puts in its shadow list is also counted
+// here, at a fixed cost per call: per size-class counts, a log2 histogram per
+// class of how many logical-clock ticks (stats.timestamp_counter) each block
+// lived, and a timeline of the live requested bytes. The timeline keeps
+// LIFETIME_WINDOWS high-water marks; when the clock runs past the last window,
+// neighbouring pairs are folded and the window width doubles, so it always
+// spans the whole run. Compiled out with -DHEAP_NO_PROFILE like the hooks above.
+
+// Requested sizes of [2^c, 2^(c+1)) bytes are class c, as common_size_bucket
+#define LIFETIME_CLASSES 32
+#define LIFETIME_WINDOWS 64
+
+typedef struct {
+    uint32_t live_bytes;            // requested bytes of the live allocations
+    uint32_t peak_live_bytes;
+    uint32_t window_ticks;          // clock ticks per timeline entry
+    uint32_t window_count;          // timeline entries in use
+    uint32_t allocs[LIFETIME_CLASSES];
+    uint32_t frees[LIFETIME_CLASSES];
+    uint32_t timeline[LIFETIME_WINDOWS];                // peak live bytes per window
+    profile_histogram_t lifetimes[LIFETIME_CLASSES];    // ticks from malloc to free
+} lifetime_profile_t;
+
+static inline void common_lifetime_clear(lifetime_profile_t* profile) {
+    memset(profile, 0, sizeof(*profile));
+    profile->window_ticks = 1;
+}
+
+#ifndef HEAP_NO_PROFILE
+// Window of `now`, folding the timeline until it fits. Windows skipped since
+// the last call held the live bytes from before it.
+static inline uint32_t common_lifetime_window(lifetime_profile_t* profile, uint32_t now) {
+    uint32_t window = now / profile->window_ticks;
+    while (window >= LIFETIME_WINDOWS) {
+        for (int i = 0; i < LIFETIME_WINDOWS / 2; i++) {
+            uint32_t a = profile->timeline[2 * i];
+            uint32_t b = profile->timeline[2 * i + 1];
+            profile->timeline[i] = a > b ? a : b;
+        }
+        memset(&profile->timeline[LIFETIME_WINDOWS / 2], 0, sizeof(profile->timeline) / 2);
+        profile->window_count = (profile->window_count + 1) / 2;
+        profile->window_ticks *= 2;
+        window = now / profile->window_ticks;
+    }
+    
+    for (uint32_t i = profile->window_count; i < window; i++) profile->timeline[i] = profile->live_bytes;
+    if (window >= profile->window_count) profile->window_count = window + 1;
+    return window;
+}
+
+static inline void common_lifetime_peak(lifetime_profile_t* profile, uint32_t window) {
+    if (profile->live_bytes > profile->timeline[window]) profile->timeline[window] = profile->live_bytes;
+    if (profile->live_bytes > profile->peak_live_bytes) profile->peak_live_bytes = profile->live_bytes;
+}
+
+static inline void common_lifetime_alloc(lifetime_profile_t* profile, size_t requested_size, uint32_t now) {
+    uint32_t window = common_lifetime_window(profile, now);
+    profile->allocs[common_size_bucket(requested_size)]++;
+    profile->live_bytes += (uint32_t)requested_size;
+    common_lifetime_peak(profile, window);
+}
+
+static inline void common_lifetime_free(lifetime_profile_t* profile, size_t requested_size,
+                                        uint32_t born, uint32_t now) {
+    uint32_t window = common_lifetime_window(profile, now);
+    int size_class = common_size_bucket(requested_size);
+    profile->frees[size_class]++;
+    common_histogram_add(&profile->lifetimes[size_class], now - born);
+    profile->live_bytes -= profile->live_bytes < requested_size ? profile->live_bytes : (uint32_t)requested_size;
+    common_lifetime_peak(profile, window);
+}
+
+// An in-place realloc counts as freeing the old size and allocating the new
+// one, so live bytes and the per-class churn follow the block
+static inline void common_lifetime_resize(lifetime_profile_t* profile, size_t old_size, size_t new_size,
+                                          uint32_t born, uint32_t now) {
+    if (old_size == new_size) return;
+    common_lifetime_free(profile, old_size, born, now);
+    common_lifetime_alloc(profile, new_size, now);
+}
+
+// heap_1 drops a whole scope at once; the live bytes go back to the mark's
+static inline void common_lifetime_rollback(lifetime_profile_t* profile, uint32_t live_bytes, uint32_t now) {
+    common_lifetime_window(profile, now);
+    profile->live_bytes = live_bytes;
+}
+#else
+#define common_lifetime_alloc(profile, requested_size, now) ((void)0)
+#define common_lifetime_free(profile, requested_size, born, now) ((void)0)
+#define common_lifetime_resize(profile, old_size, new_size, born, now) ((void)0)
+#define common_lifetime_rollback(profile, live_bytes, now) ((void)0)
+#endif
+
+// Metadata
+//
+// heap_stats_t.metadata_bytes is what a module keeps outside its heap: the
+// shadow list, the snapshot buffers, the event ring, the free-size index and
+// the profiles. Modules set it when the stats are read and add their own
+// tables on top.
+
+static inline size_t common_blocks_bytes(const block_list_t* list) {
+    size_t bytes = (size_t)list->capacity * (sizeof(block_info_t) + 2 * sizeof(int32_t));
+    if (list->buckets) bytes += (size_t)(list->bucket_mask + 1) * sizeof(int32_t);
+    return bytes;
+}
+
+static inline size_t common_block_table_bytes(const block_table_t* table) {
+    size_t words = 0;
+    if (table->words) words += BLOCK_TABLE_WORDS(table->capacity);
+    if (table->spare) words += BLOCK_TABLE_WORDS(table->spare_capacity);
+    return words * sizeof(uint32_t);
+}
+
+static inline size_t common_tracker_bytes(const stats_tracker_t* tracker) {
+    const free_size_index_t* index = &tracker->free_sizes;
+    return (size_t)index->chunk_capacity * sizeof(size_chunk_t*) +
+           (size_t)index->chunk_count * sizeof(size_chunk_t);
+}
+
+// `shadow` and `tracker` may be NULL for modules without them
+static inline size_t common_metadata_bytes(const block_list_t* shadow, const block_table_t* table,
+                                           const log_ring_t* log, const stats_tracker_t* tracker) {
+    size_t bytes = sizeof(op_profile_t) + sizeof(lifetime_profile_t);
+    bytes += common_block_table_bytes(table);
+    bytes += (size_t)log->capacity * sizeof(log_entry_t);
+    if (shadow) bytes += common_blocks_bytes(shadow);
+    if (tracker) bytes += common_tracker_bytes(tracker);
+    return bytes;
+}
+
+// Debug builds (-DHEAP_DEBUG_STATS) cross-check the deltas against a full rescan
+// of the shadow list, which headless builds do not maintain
+#if defined(HEAP_DEBUG_STATS) && !defined(HEAP_HEADLESS)
+#include <stdio.h>
+
+static inline int common_float_differs(float a, float b) {
+    float d = a - b;
+    return d > 0.01f || d < -0.01f;
+}
+
+static inline void common_verify_stats(const block_list_t* list, int region_id,
+                                       const heap_stats_t* stats, const char* where) {
+    heap_stats_t expected = *stats;
+    common_scan_stats(list, region_id, &expected);
+    
+    if (expected.allocated_bytes != stats->allocated_bytes ||
+        expected.free_bytes != stats->free_bytes ||
+        expected.allocation_count != stats->allocation_count ||
+        expected.free_block_count != stats->free_block_count ||
+        expected.largest_free_block != stats->largest_free_block ||
+        expected.smallest_free_block != stats->smallest_free_block ||
+        common_float_differs(expected.external_fragmentation, stats->external_fragmentation) ||
+        common_float_differs(expected.internal_fragmentation, stats->internal_fragmentation) ||
+        memcmp(expected.free_size_histogram, stats->free_size_histogram, sizeof(stats->free_size_histogram))) {
+        fprintf(stderr, "heap stats mismatch after %s (region %d): "
+                "alloc %zu/%zu free %zu/%zu count %u/%u free_blocks %u/%u largest %zu/%zu smallest %zu/%zu\n",
+                where, region_id,
+                stats->allocated_bytes, expected.allocated_bytes,
+                stats->free_bytes, expected.free_bytes,
+                stats->allocation_count, expected.allocation_count,
+                stats->free_block_count, expected.free_block_count,
+                stats->largest_free_block, expected.largest_free_block,
+                stats->smallest_free_block, expected.smallest_free_block);
+        abort();
+    }
+}
+
+#define COMMON_VERIFY_STATS(list, region_id, stats, where) \
+    common_verify_stats(list, region_id, stats, where)
+#else
+#define COMMON_VERIFY_STATS(list, region_id, stats, where) ((void)0)
+#endif
+
 #endif // HEAP_COMMON_H
\ No newline at end of file
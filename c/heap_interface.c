@@ -14,6 +14,29 @@ static log_entry_t log_entries[MAX_LOG_ENTRIES];
 static heap_type_t current_heap_type = HEAP_1;
 static int log_count = 0;
 
+// Trace recorder state
+#define TRACE_BUFFER_RECORDS 256
+static heap_trace_sink_t trace_sink = NULL;
+static void* trace_ctx = NULL;
+static uint8_t trace_buffer[TRACE_HEADER_SIZE + TRACE_BUFFER_RECORDS * TRACE_RECORD_SIZE];
+static size_t trace_used = 0;
+static uint32_t trace_next_id = 0;
+static uint16_t trace_thread = 0;
+static trace_map_t trace_live;  // heap offset -> trace id
+
+static void trace_flush(void) {
+    if (trace_sink && trace_used > 0) trace_sink(trace_buffer, trace_used, trace_ctx);
+    trace_used = 0;
+}
+
+static void trace_record(uint8_t kind, uint8_t flags, uint32_t size, uint32_t id) {
+    if (trace_used + TRACE_RECORD_SIZE > sizeof(trace_buffer)) trace_flush();
+    
+    trace_record_t rec = { kind, flags, trace_thread, size, id };
+    trace_encode(trace_buffer + trace_used, &rec);
+    trace_used += TRACE_RECORD_SIZE;
+}
+
 static void add_log_entry(const char* action, uint32_t alloc_id, size_t size, size_t offset, int success) {
     if (log_count >= MAX_LOG_ENTRIES) return;
     
@@ -71,9 +94,20 @@ void heap_init(heap_type_t type, size_t size) {
     
     update_stats();
     add_log_entry("INIT", 0, size, 0, 1);
+    
+    if (trace_sink) {
+        trace_map_clear(&trace_live);
+        trace_record(TRACE_RESET, 0, (uint32_t)stats.total_size, 0);
+    }
 }
 
 void* heap_malloc(size_t size) {
+    return heap_malloc_flags(size, 0);
+}
+
+// Region flags only steer heap_5; the other heaps ignore them, but they are
+// traced either way so a replay makes the same requests
+void* heap_malloc_flags(size_t size, uint8_t flags) {
     void* ptr = NULL;
     
     switch (current_heap_type) {
@@ -81,12 +115,18 @@ void* heap_malloc(size_t size) {
         case HEAP_2: ptr = heap2_malloc(size); break;
         case HEAP_3: ptr = heap3_malloc(size); break;
         case HEAP_4: ptr = heap4_malloc(size); break;
-        case HEAP_5: ptr = heap5_malloc(size); break;
+        case HEAP_5: ptr = flags ? heap5_malloc_flags(size, flags) : heap5_malloc(size); break;
     }
     
     size_t offset = ptr ? (size_t)((uint8_t*)ptr - heap_memory) : 0;
     add_log_entry("MALLOC", stats.next_allocation_id, size, offset, ptr != NULL);
     
+    if (trace_sink) {
+        uint32_t id = trace_next_id++;
+        if (ptr) trace_map_put(&trace_live, (uint32_t)offset, id);
+        trace_record(TRACE_MALLOC, flags, (uint32_t)size, id);
+    }
+    
     if (ptr) {
         stats.next_allocation_id++;
     }
@@ -118,6 +158,12 @@ void heap_free(void* ptr) {
     }
     
     add_log_entry("FREE", alloc_id, 0, offset, 1);
+    
+    // Frees of blocks allocated before tracing started are not recorded
+    uintptr_t trace_id;
+    if (trace_sink && trace_map_take(&trace_live, (uint32_t)offset, &trace_id)) {
+        trace_record(TRACE_FREE, 0, 0, (uint32_t)trace_id);
+    }
     update_stats();
 }
 
@@ -153,4 +199,25 @@ log_entry_t* get_log_entry(int index) {
 
 void clear_log(void) {
     log_count = 0;
+}
+
+void heap_trace_start(heap_trace_sink_t sink, void* ctx) {
+    trace_flush();
+    trace_sink = sink;
+    trace_ctx = ctx;
+    trace_next_id = 0;
+    trace_map_clear(&trace_live);
+    
+    trace_write_header(trace_buffer, (uint32_t)stats.total_size);
+    trace_used = TRACE_HEADER_SIZE;
+}
+
+void heap_trace_stop(void) {
+    trace_flush();
+    trace_sink = NULL;
+    trace_ctx = NULL;
+}
+
+void heap_trace_set_thread(uint16_t thread_id) {
+    trace_thread = thread_id;
 }
\ No newline at end of file
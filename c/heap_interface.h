@@ -3,10 +3,11 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "heap_trace.h"
+#include "heap_limits.h"
 
-#define MAX_HEAP_SIZE 65536
-#define MAX_ALLOCATIONS 1000
-#define MAX_LOG_ENTRIES 10000
+#define MAX_HEAP_SIZE DEFAULT_HEAP_SIZE
+#define MAX_ALLOCATIONS DEFAULT_MAX_BLOCKS
 
 typedef enum {
     HEAP_1 = 1,
@@ -65,6 +66,7 @@ extern int block_count;
 // Interface functions
 void heap_init(heap_type_t type, size_t size);
 void* heap_malloc(size_t size);
+void* heap_malloc_flags(size_t size, uint8_t flags);
 void heap_free(void* ptr);
 void heap_reset(void);
 
@@ -76,6 +78,12 @@ int get_log_count(void);
 log_entry_t* get_log_entry(int index);
 void clear_log(void);
 
+// Trace recorder: records are buffered and handed to `sink` in chunks
+typedef void (*heap_trace_sink_t)(const uint8_t* data, size_t len, void* ctx);
+void heap_trace_start(heap_trace_sink_t sink, void* ctx);
+void heap_trace_stop(void);
+void heap_trace_set_thread(uint16_t thread_id);
+
 // Heap-specific implementations
 void* heap1_malloc(size_t size);
 void heap1_free(void* ptr);
@@ -94,6 +102,7 @@ void heap4_free(void* ptr);
 void heap4_init(size_t size);
 
 void* heap5_malloc(size_t size);
+void* heap5_malloc_flags(size_t size, uint8_t flags);
 void heap5_free(void* ptr);
 void heap5_init(size_t size);
 
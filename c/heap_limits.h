@@ -0,0 +1,24 @@
+#ifndef HEAP_LIMITS_H
+#define HEAP_LIMITS_H
+
+// Capacity limits shared by the heap modules and heap_interface.
+//
+// Heap size and block-table capacity are runtime arguments of heap_init();
+// these are the defaults and the ceilings the arguments are clamped to.
+// Offsets and sizes reach JS as u32, which bounds HEAP_SIZE_LIMIT.
+
+#define DEFAULT_HEAP_SIZE   65536
+#define DEFAULT_MAX_BLOCKS  1000            // used until heap_init asks for another capacity
+#define HEAP_SIZE_LIMIT     ((size_t)1 << 30)
+#define BLOCK_LIMIT         (1 << 22)
+#define MAX_LOG_ENTRIES     1000            // event ring size
+
+// Memory-budget builds (-DHEAP_BUDGET, make BUDGET=1) size the side tables
+// from the heap_init size instead: max_blocks 0 allows one block per
+// BUDGET_BLOCK_BYTES of heap, and the ring holds one event per
+// BUDGET_LOG_BYTES, within [BUDGET_MIN_ENTRIES, MAX_LOG_ENTRIES]
+#define BUDGET_BLOCK_BYTES  16
+#define BUDGET_LOG_BYTES    256
+#define BUDGET_MIN_ENTRIES  64
+
+#endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef HEAP_NAMESPACE_H
+#define HEAP_NAMESPACE_H
+
+// Native static-library builds compile each heap with -DHEAP_NAMESPACE=heapN,
+// which prefixes every exported function (heap_malloc -> heapN_heap_malloc) so
+// all heaps can be linked into one binary. WASM builds leave names unchanged.
+
+#define HEAP_NS_CAT(ns, name) ns##_##name
+#define HEAP_NS_EXPAND(ns, name) HEAP_NS_CAT(ns, name)
+#define HEAP_NS(name) HEAP_NS_EXPAND(HEAP_NAMESPACE, name)
+
+#define heap_init               HEAP_NS(heap_init)
+#define heap_init_coalesce      HEAP_NS(heap_init_coalesce)
+#define heap_malloc             HEAP_NS(heap_malloc)
+#define heap_malloc_flags       HEAP_NS(heap_malloc_flags)
+#define heap_free               HEAP_NS(heap_free)
+#define heap_realloc            HEAP_NS(heap_realloc)
+#define heap_mark               HEAP_NS(heap_mark)
+#define heap_release            HEAP_NS(heap_release)
+#define heap_flush_thread       HEAP_NS(heap_flush_thread)
+#define heap_reset              HEAP_NS(heap_reset)
+#define heap_run_ops            HEAP_NS(heap_run_ops)
+#define heap_generate_ops       HEAP_NS(heap_generate_ops)
+#define heap_snapshot           HEAP_NS(heap_snapshot)
+#define heap_restore            HEAP_NS(heap_restore)
+#define heap_coalesce_step      HEAP_NS(heap_coalesce_step)
+#define heap_set_region_fallback HEAP_NS(heap_set_region_fallback)
+#define heap_define_regions     HEAP_NS(heap_define_regions)
+#define heap_can_allocate       HEAP_NS(heap_can_allocate)
+#define heap_can_allocate_flags HEAP_NS(heap_can_allocate_flags)
+#define get_heap_stats          HEAP_NS(get_heap_stats)
+#define get_region_stats        HEAP_NS(get_region_stats)
+#define get_region_count        HEAP_NS(get_region_count)
+#define get_region_name         HEAP_NS(get_region_name)
+#define get_region_flags        HEAP_NS(get_region_flags)
+#define get_region_size         HEAP_NS(get_region_size)
+#define get_block_count         HEAP_NS(get_block_count)
+#define get_block_info          HEAP_NS(get_block_info)
+#define get_allocation_count    HEAP_NS(get_allocation_count)
+#define get_allocation_info     HEAP_NS(get_allocation_info)
+#define get_block_table_ptr     HEAP_NS(get_block_table_ptr)
+#define get_block_table_len     HEAP_NS(get_block_table_len)
+#define get_pending_merges      HEAP_NS(get_pending_merges)
+#define get_heap_version        HEAP_NS(get_heap_version)
+#define get_heap_offset         HEAP_NS(get_heap_offset)
+#define get_log_count           HEAP_NS(get_log_count)
+#define get_log_entry           HEAP_NS(get_log_entry)
+#define get_log_since           HEAP_NS(get_log_since)
+#define get_log_lost            HEAP_NS(get_log_lost)
+#define clear_log               HEAP_NS(clear_log)
+#define get_latency_histogram   HEAP_NS(get_latency_histogram)
+#define get_op_histogram        HEAP_NS(get_op_histogram)
+#define get_op_max              HEAP_NS(get_op_max)
+#define reset_op_profile        HEAP_NS(reset_op_profile)
+#define get_lifetime_profile    HEAP_NS(get_lifetime_profile)
+
+#endif // HEAP_NAMESPACE_H
\ No newline at end of file
@@ -0,0 +1,205 @@
+#ifndef HEAP_TRACE_H
+#define HEAP_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Binary allocation trace
+//
+// A 16-byte header followed by fixed-size 12-byte records, little endian.
+// Fixed records mean a reader can cut the stream at any record boundary, so
+// traces are replayed chunk by chunk (mmap natively, ReadableStream in the
+// browser) without ever being loaded whole.
+//
+//   header: u32 magic "HTRC" | u16 version | u16 record size | u32 heap size | u32 reserved
+//   record: u8 kind | u8 flags | u16 thread id | u32 size | u32 id
+//
+// `id` is the allocation ordinal: every malloc record takes the next id,
+// including ones that failed when recorded, and a free record names the id
+// it releases. A replayer only has to remember ids that are still live, and
+// forgets all of them on TRACE_RESET.
+
+#define TRACE_MAGIC        0x43525448u  // "HTRC"
+#define TRACE_VERSION      1
+#define TRACE_HEADER_SIZE  16
+#define TRACE_RECORD_SIZE  12
+
+typedef enum {
+    TRACE_MALLOC = 0,   // same values as op_kind_t
+    TRACE_FREE = 1,
+    TRACE_RESET = 2     // heap re-initialised; size holds the new heap size
+} trace_kind_t;
+
+typedef struct {
+    uint8_t kind;       // trace_kind_t
+    uint8_t flags;      // TRACE_MALLOC: region flags (heap_5), 0 otherwise
+    uint16_t thread_id;
+    uint32_t size;      // TRACE_MALLOC: bytes requested
+    uint32_t id;
+} trace_record_t;
+
+static inline void trace_put_u16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void trace_put_u32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint16_t trace_get_u16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t trace_get_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void trace_write_header(uint8_t* out, uint32_t heap_size) {
+    trace_put_u32(out, TRACE_MAGIC);
+    trace_put_u16(out + 4, TRACE_VERSION);
+    trace_put_u16(out + 6, TRACE_RECORD_SIZE);
+    trace_put_u32(out + 8, heap_size);
+    trace_put_u32(out + 12, 0);
+}
+
+// Returns 1 if `in` starts with a header this reader understands
+static inline int trace_read_header(const uint8_t* in, size_t len, uint32_t* heap_size) {
+    if (len < TRACE_HEADER_SIZE) return 0;
+    if (trace_get_u32(in) != TRACE_MAGIC) return 0;
+    if (trace_get_u16(in + 4) != TRACE_VERSION) return 0;
+    if (trace_get_u16(in + 6) != TRACE_RECORD_SIZE) return 0;
+    if (heap_size) *heap_size = trace_get_u32(in + 8);
+    return 1;
+}
+
+static inline void trace_encode(uint8_t* out, const trace_record_t* rec) {
+    out[0] = rec->kind;
+    out[1] = rec->flags;
+    trace_put_u16(out + 2, rec->thread_id);
+    trace_put_u32(out + 4, rec->size);
+    trace_put_u32(out + 8, rec->id);
+}
+
+static inline void trace_decode(const uint8_t* in, trace_record_t* rec) {
+    rec->kind = in[0];
+    rec->flags = in[1];
+    rec->thread_id = trace_get_u16(in + 2);
+    rec->size = trace_get_u32(in + 4);
+    rec->id = trace_get_u32(in + 8);
+}
+
+// Live-id map
+//
+// Open addressing with linear probing and backward-shift deletion. Sized for
+// the live set, not the trace: the recorder keys it by heap offset, the
+// replayer by trace id. The table doubles at 3/4 load, so it keeps up with
+// however many blocks the heap was initialised to hold.
+
+#define TRACE_MAP_MIN_CAPACITY 4096     // power of two
+
+typedef struct {
+    uint32_t* keys;             // key + 1, 0 = empty slot
+    uintptr_t* values;
+    uint32_t capacity;          // 0 until the first put
+    uint32_t count;
+} trace_map_t;
+
+static inline uint32_t trace_map_slot(const trace_map_t* map, uint32_t key) {
+    return (key * 2654435761u) & (map->capacity - 1);
+}
+
+static inline void trace_map_clear(trace_map_t* map) {
+    if (map->keys) memset(map->keys, 0, map->capacity * sizeof(uint32_t));
+    map->count = 0;
+}
+
+static inline void trace_map_free(trace_map_t* map) {
+    free(map->keys);
+    free(map->values);
+    memset(map, 0, sizeof(*map));
+}
+
+// Rehash into a table of `capacity` slots; returns 0 if it can't be allocated
+static inline int trace_map_resize(trace_map_t* map, uint32_t capacity) {
+    uint32_t* keys = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    uintptr_t* values = (uintptr_t*)malloc(capacity * sizeof(uintptr_t));
+    if (!keys || !values) {
+        free(keys);
+        free(values);
+        return 0;
+    }
+    
+    trace_map_t grown = { keys, values, capacity, map->count };
+    for (uint32_t i = 0; i < map->capacity; i++) {
+        if (map->keys[i] == 0) continue;
+        uint32_t slot = trace_map_slot(&grown, map->keys[i] - 1);
+        while (keys[slot] != 0) slot = (slot + 1) & (capacity - 1);
+        keys[slot] = map->keys[i];
+        values[slot] = map->values[i];
+    }
+    
+    free(map->keys);
+    free(map->values);
+    *map = grown;
+    return 1;
+}
+
+// Returns 0 if the map could not grow
+static inline int trace_map_put(trace_map_t* map, uint32_t key, uintptr_t value) {
+    if ((map->count + 1) * 4 > map->capacity * 3 &&
+        !trace_map_resize(map, map->capacity ? map->capacity * 2 : TRACE_MAP_MIN_CAPACITY)) {
+        return 0;
+    }
+    
+    uint32_t slot = trace_map_slot(map, key);
+    while (map->keys[slot] != 0) {
+        if (map->keys[slot] == key + 1) {
+            map->values[slot] = value;
+            return 1;
+        }
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    
+    map->keys[slot] = key + 1;
+    map->values[slot] = value;
+    map->count++;
+    return 1;
+}
+
+// Look up and remove `key`; returns 0 if it was not present
+static inline int trace_map_take(trace_map_t* map, uint32_t key, uintptr_t* value) {
+    if (map->count == 0) return 0;
+    
+    uint32_t mask = map->capacity - 1;
+    uint32_t slot = trace_map_slot(map, key);
+    
+    while (map->keys[slot] != key + 1) {
+        if (map->keys[slot] == 0) return 0;
+        slot = (slot + 1) & mask;
+    }
+    if (value) *value = map->values[slot];
+    
+    // Shift later entries of the probe run back into the hole
+    uint32_t hole = slot;
+    uint32_t next = (slot + 1) & mask;
+    while (map->keys[next] != 0) {
+        uint32_t home = trace_map_slot(map, map->keys[next] - 1);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            map->keys[hole] = map->keys[next];
+            map->values[hole] = map->values[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    map->keys[hole] = 0;
+    map->count--;
+    return 1;
+}
+
+#endif
\ No newline at end of file
@@ -2,12 +2,16 @@ import React, { useState, useEffect, useRef, useCallback } from 'react';
 import { Box, Grid, Paper, Typography, Alert, Fade } from '@mui/material';
 import { Code as CodeIcon } from '@mui/icons-material';
 import Statistics from './components/Statistics';
-import MemoryLayout from './components/MemoryLayout';
+import MemoryLayout, { SVG_BLOCK_LIMIT } from './components/MemoryLayout';
 import Log from './components/Log';
+import Comparison from './components/Comparison';
 import HeapModule from './js/heap_module';
 import { getSimulations } from './utils/simulations';
 
 const HEAP_SIZE = 32768;
+// Steps between heap checkpoints when stepping backward; a step back replays
+// at most this many steps from the nearest one
+const CHECKPOINT_INTERVAL = 64;
 
 const paperStyles = {
     p: 1.5,
@@ -28,6 +32,7 @@ function App() {
     const [availableHeaps, setAvailableHeaps] = useState([]);
     const [stats, setStats] = useState({});
     const [blocks, setBlocks] = useState([]);
+    const [blockColumns, setBlockColumns] = useState(null);
     const [logs, setLogs] = useState([]);
     const [activeBlock, setActiveBlock] = useState(null);
     const [resetZoom, setResetZoom] = useState(false);
@@ -42,17 +47,35 @@ function App() {
     
     const playbackTimer = useRef(null);
     const stepRef = useRef(0);
+    const lastVersion = useRef(null);
+    // Heap snapshots along the current simulation, ascending by step:
+    // { step, state, pointers } with pointers the allocations made so far
+    const checkpoints = useRef([]);
+
+    // Large heaps are drawn straight from the block table columns; block
+    // objects are only built while the SVG layout is in use
+    const refreshBlocks = useCallback(() => {
+        const columns = heapModule.getBlockColumns();
+        setBlockColumns(columns);
+        setBlocks(columns.length > SVG_BLOCK_LIMIT ? [] : heapModule.getBlocks() || []);
+    }, [heapModule]);
 
     const refreshData = useCallback(() => {
         if (!heapModule || !heapModule.initialized) return;
         try {
+            // Nothing to re-read if the current heap hasn't changed since last time
+            const version = heapModule.getVersion();
+            const versionKey = `${heapModule.currentHeap}:${version}`;
+            if (version !== null && versionKey === lastVersion.current) return;
+            lastVersion.current = versionKey;
+            
             setStats(heapModule.getStats() || {});
-            setBlocks(heapModule.getBlocks() || []);
+            refreshBlocks();
             setLogs(heapModule.getLogs() || []);
         } catch (error) {
             console.error('Failed to refresh data:', error);
         }
-    }, [heapModule]);
+    }, [heapModule, refreshBlocks]);
 
     useEffect(() => {
         const initModule = async () => {
@@ -60,12 +83,13 @@ function App() {
                 await heapModule.init();
                 const heaps = heapModule.getAvailableHeaps();
                 setAvailableHeaps(heaps);
-                heapModule.switchHeap(1);
+                await heapModule.switchHeap(1);
                 heapModule.initHeap(HEAP_SIZE);
                 setStats(heapModule.getStats() || {});
-                setBlocks(heapModule.getBlocks() || []);
+                refreshBlocks();
                 setLogs(heapModule.getLogs() || []);
                 setInitialized(true);
+                heapModule.prefetch();
             } catch (error) {
                 console.error('Failed to initialize heap module:', error);
                 setInitError(error.message);
@@ -83,11 +107,16 @@ function App() {
         }
     }, [resetZoom]);
 
-    const handleHeapChange = (newHeap) => {
+    const handleHeapChange = async (newHeap) => {
         if (newHeap === currentHeap) return;
         resetPlayback();
+        try {
+            await heapModule.switchHeap(newHeap);
+        } catch (error) {
+            console.error(`Failed to load heap ${newHeap}:`, error);
+            return;
+        }
         setCurrentHeap(newHeap);
-        heapModule.switchHeap(newHeap);
         heapModule.initHeap(HEAP_SIZE);
         setAllocatedPointers([]);
         setPointerBlockMap(new Map());
@@ -168,6 +197,7 @@ function App() {
         setIsPlaying(false);
         setCurrentStep(0);
         stepRef.current = 0;
+        checkpoints.current = [];
         if (playbackTimer.current) { clearTimeout(playbackTimer.current); playbackTimer.current = null; }
     }, []);
 
@@ -238,27 +268,53 @@ function App() {
         }
     };
 
+    // Replay steps [from, to) on top of `pointers`. Free steps are rewritten so
+    // ptrIndex counts from the batch start, or names a pointer from before it.
+    // Each CHECKPOINT_INTERVAL boundary crossed is saved as a checkpoint.
+    const replaySteps = (from, to, pointers) => {
+        let all = pointers;
+        for (let start = from; start < to; ) {
+            const end = Math.min(to, (Math.floor(start / CHECKPOINT_INTERVAL) + 1) * CHECKPOINT_INTERVAL);
+            const base = all;
+            const batch = simulationSteps.slice(start, end).map(step => {
+                if (step.action !== 'free' || step.ptrIndex === undefined) return step;
+                return step.ptrIndex < base.length
+                    ? { action: 'free', ptr: base[step.ptrIndex] || 0 }
+                    : { ...step, ptrIndex: step.ptrIndex - base.length };
+            });
+            all = [...base, ...heapModule.runBatch(batch)];
+            start = end;
+            
+            if (end % CHECKPOINT_INTERVAL === 0 && !checkpoints.current.some(c => c.step === end)) {
+                const state = heapModule.snapshot();
+                if (state) {
+                    checkpoints.current.push({ step: end, state, pointers: all });
+                    checkpoints.current.sort((a, b) => a.step - b.step);
+                }
+            }
+        }
+        return all;
+    };
+
+    // Rewind by restoring the nearest checkpoint at or before the target step
+    // and replaying the rest; heaps without snapshots replay from the start
     const handleStepBackward = () => {
         if (currentStep > 0) {
-            heapModule.reset();
-            setAllocatedPointers([]);
+            const target = currentStep - 1;
+            const checkpoint = checkpoints.current.filter(c => c.step <= target).pop();
+            let from = 0;
+            let pointers = [];
+            if (checkpoint && heapModule.restore(checkpoint.state)) {
+                from = checkpoint.step;
+                pointers = checkpoint.pointers;
+            } else {
+                heapModule.reset();
+            }
             setPointerBlockMap(new Map());
             setActiveBlock(null);
             
-            const newPointers = [];
-            for (let i = 0; i < currentStep - 1; i++) {
-                const step = simulationSteps[i];
-                if (step.action === 'allocate') {
-                    const ptr = step.flags !== undefined && currentHeap === 5
-                        ? heapModule.mallocFlags(step.size, step.flags)
-                        : heapModule.malloc(step.size);
-                    if (ptr) newPointers.push(ptr);
-                } else if (step.action === 'free' && step.ptrIndex !== undefined) {
-                    if (step.ptrIndex < newPointers.length) heapModule.free(newPointers[step.ptrIndex]);
-                }
-            }
-            setAllocatedPointers(newPointers);
-            setCurrentStep(prev => prev - 1);
+            setAllocatedPointers(replaySteps(from, target, pointers));
+            setCurrentStep(target);
             refreshData();
         }
     };
@@ -338,6 +394,7 @@ function App() {
                         <Paper elevation={0} sx={{ ...paperStyles, minHeight: currentHeap === 5 ? 620 : 350 }}>
                             <MemoryLayout
                                 blocks={blocks}
+                                blockColumns={blockColumns}
                                 totalSize={stats.totalSize || HEAP_SIZE}
                                 heapOffset={heapModule.getHeapOffset ? heapModule.getHeapOffset() : 0}
                                 activeBlock={activeBlock}
@@ -364,6 +421,13 @@ function App() {
                         </Paper>
                     </Grid>
 
+                    {/* Comparison */}
+                    <Grid item xs={12}>
+                        <Paper elevation={0} sx={paperStyles}>
+                            <Comparison steps={simulationSteps} heapSize={HEAP_SIZE} simulation={simulation} />
+                        </Paper>
+                    </Grid>
+
                     {/* Log */}
                     <Grid item xs={12}>
                         <Paper elevation={0} sx={{ ...paperStyles, height: 180 }}>
@@ -0,0 +1,216 @@
+import React, { useState, useRef, useEffect } from 'react';
+import {
+    Box,
+    Typography,
+    Button,
+    LinearProgress,
+    Table,
+    TableHead,
+    TableBody,
+    TableRow,
+    TableCell,
+    Tooltip,
+    FormControl,
+    InputLabel,
+    Select,
+    MenuItem
+} from '@mui/material';
+import { CompareArrows as CompareIcon, UploadFile as UploadIcon, AutoAwesome as GenerateIcon } from '@mui/icons-material';
+import { compareHeaps, COMPARE_HEAPS } from '../utils/compare';
+import { traceToSteps } from '../utils/traceReplay';
+import { getWorkloads, WORKLOAD_OP_COUNTS } from '../utils/workloads';
+
+const WORKLOADS = getWorkloads();
+const WORKLOAD_SEED = 1;
+
+// Same colours as the block states in MemoryLayout
+const STATE_COLORS = ['#4CAF50', '#f44336', '#FF9800'];
+
+const formatNs = (ns) => {
+    if (ns === undefined) return '-';
+    if (ns >= 1e6) return `${(ns / 1e6).toFixed(1)}ms`;
+    if (ns >= 1e3) return `${(ns / 1e3).toFixed(1)}µs`;
+    return `${ns}ns`;
+};
+
+// The final layout of one heap as a strip of blocks in address order
+const BlockStrip = ({ blocks }) => {
+    const total = blocks.reduce((sum, b) => sum + b.size, 0) || 1;
+    let x = 0;
+    return (
+        <svg width="100%" height="10" viewBox="0 0 1000 10" preserveAspectRatio="none">
+            {blocks.map((b, i) => {
+                const width = (b.size / total) * 1000;
+                const rect = <rect key={i} x={x} y={0} width={width} height={10} fill={STATE_COLORS[b.state] || '#9ca3af'} />;
+                x += width;
+                return rect;
+            })}
+        </svg>
+    );
+};
+
+// Replay one workload (the selected simulation, a recorded trace or a
+// generated one) against every heap at once, one worker each, and tabulate
+// the results
+const Comparison = ({ steps, heapSize, simulation }) => {
+    const [progress, setProgress] = useState({});
+    const [results, setResults] = useState(null);
+    const [blocks, setBlocks] = useState({});
+    const [running, setRunning] = useState(false);
+    const [source, setSource] = useState('');
+    const [workload, setWorkload] = useState('churn');
+    const [workloadOps, setWorkloadOps] = useState(WORKLOAD_OP_COUNTS[0]);
+    const run = useRef(null);
+    const fileInput = useRef(null);
+
+    useEffect(() => () => { if (run.current) run.current.stop(); }, []);
+
+    // `generated` is a workload config the workers expand themselves;
+    // otherwise the steps are packed and sent
+    const start = async (tapeSteps, size, label, generated) => {
+        if (run.current) run.current.stop();
+        setRunning(true);
+        setResults(null);
+        setBlocks({});
+        setProgress({});
+        const opCount = generated ? generated.ops : tapeSteps.length;
+        setSource(`${label} (${opCount.toLocaleString()} ops)`);
+
+        const handle = compareHeaps(tapeSteps, {
+            heapSize: size,
+            workload: generated,
+            onProgress: (heapType, done, total) => setProgress(prev => ({ ...prev, [heapType]: (done / total) * 100 }))
+        });
+        run.current = handle;
+        const finished = await handle.done;
+        if (run.current === handle) {
+            setResults(finished);
+            setRunning(false);
+        }
+    };
+
+    const handleTrace = async (event) => {
+        const file = event.target.files[0];
+        event.target.value = '';
+        if (!file) return;
+        try {
+            const trace = traceToSteps(await file.arrayBuffer());
+            start(trace.steps, trace.heapSize || heapSize, file.name);
+        } catch (error) {
+            setSource(`${file.name}: ${error.message}`);
+        }
+    };
+
+    const showBlocks = async (heapType) => {
+        if (!run.current) return;
+        const heapBlocks = await run.current.blocks(heapType);
+        setBlocks(prev => ({ ...prev, [heapType]: heapBlocks }));
+    };
+
+    const slowest = results
+        ? Math.max(...Object.values(results).map(r => r.ms || 0))
+        : 0;
+
+    return (
+        <Box sx={{ display: 'flex', flexDirection: 'column', gap: 1, minHeight: 0 }}>
+            <Box sx={{ display: 'flex', alignItems: 'center', gap: 1, flexWrap: 'wrap' }}>
+                <Typography variant="subtitle2" sx={{ fontWeight: 600, fontSize: '0.8rem' }}>Compare Heaps</Typography>
+                <Button size="small" variant="outlined" startIcon={<CompareIcon />}
+                    disabled={running || !steps.length}
+                    onClick={() => start(steps, heapSize, simulation || 'simulation')}>
+                    Simulation
+                </Button>
+                <Button size="small" variant="outlined" startIcon={<UploadIcon />}
+                    disabled={running} onClick={() => fileInput.current && fileInput.current.click()}>
+                    Trace
+                </Button>
+                <input ref={fileInput} type="file" hidden onChange={handleTrace} />
+                <FormControl size="small" sx={{ minWidth: 150 }}>
+                    <InputLabel>Workload</InputLabel>
+                    <Select value={workload} onChange={(e) => setWorkload(e.target.value)} label="Workload" disabled={running}>
+                        {Object.entries(WORKLOADS).map(([key, w]) => (
+                            <MenuItem key={key} value={key}>
+                                <Tooltip title={w.description} placement="right"><span>{w.name}</span></Tooltip>
+                            </MenuItem>
+                        ))}
+                    </Select>
+                </FormControl>
+                <FormControl size="small" sx={{ minWidth: 90 }}>
+                    <InputLabel>Ops</InputLabel>
+                    <Select value={workloadOps} onChange={(e) => setWorkloadOps(e.target.value)} label="Ops" disabled={running}>
+                        {WORKLOAD_OP_COUNTS.map(count => (
+                            <MenuItem key={count} value={count}>{count.toLocaleString()}</MenuItem>
+                        ))}
+                    </Select>
+                </FormControl>
+                <Button size="small" variant="outlined" startIcon={<GenerateIcon />}
+                    disabled={running}
+                    onClick={() => start(null, heapSize, `${WORKLOADS[workload].name}, seed ${WORKLOAD_SEED}`,
+                        { ...WORKLOADS[workload].config, ops: workloadOps, seed: WORKLOAD_SEED })}>
+                    Generate
+                </Button>
+                {source && <Typography variant="caption" sx={{ color: 'text.secondary' }}>{source}</Typography>}
+            </Box>
+
+            {(running || results) && (
+                <Table size="small" sx={{ '& td, & th': { py: 0.25, fontSize: '0.75rem' } }}>
+                    <TableHead>
+                        <TableRow>
+                            <TableCell>Heap</TableCell>
+                            <TableCell align="right">Time</TableCell>
+                            <TableCell align="right">Ops/s</TableCell>
+                            <TableCell align="right">malloc p50 / p99 / max</TableCell>
+                            <TableCell align="right">free p99</TableCell>
+                            <TableCell align="right">Frag %</TableCell>
+                            <TableCell sx={{ width: '25%' }}>Layout</TableCell>
+                        </TableRow>
+                    </TableHead>
+                    <TableBody>
+                        {COMPARE_HEAPS.map(heapType => {
+                            const r = results && results[heapType];
+                            if (!r) {
+                                return (
+                                    <TableRow key={heapType}>
+                                        <TableCell>Heap {heapType}</TableCell>
+                                        <TableCell colSpan={6}>
+                                            <LinearProgress variant="determinate" value={progress[heapType] || 0} />
+                                        </TableCell>
+                                    </TableRow>
+                                );
+                            }
+                            if (r.error) {
+                                return (
+                                    <TableRow key={heapType}>
+                                        <TableCell>Heap {heapType}</TableCell>
+                                        <TableCell colSpan={6} sx={{ color: 'error.main' }}>{r.error}</TableCell>
+                                    </TableRow>
+                                );
+                            }
+                            const malloc = r.latency && r.latency.malloc;
+                            const free = r.latency && r.latency.free;
+                            return (
+                                <TableRow key={heapType}>
+                                    <TableCell><Tooltip title={r.name}><span>Heap {heapType}</span></Tooltip></TableCell>
+                                    <TableCell align="right" sx={{ fontWeight: r.ms === slowest ? 600 : 400 }}>{r.ms.toFixed(1)}ms</TableCell>
+                                    <TableCell align="right">{Math.round(r.opsPerSecond).toLocaleString()}</TableCell>
+                                    <TableCell align="right">
+                                        {malloc ? `${formatNs(malloc.p50)} / ${formatNs(malloc.p99)} / ${formatNs(malloc.max)}` : '-'}
+                                    </TableCell>
+                                    <TableCell align="right">{free ? formatNs(free.p99) : '-'}</TableCell>
+                                    <TableCell align="right">{(r.stats.externalFragmentation || 0).toFixed(1)}</TableCell>
+                                    <TableCell>
+                                        {blocks[heapType]
+                                            ? <BlockStrip blocks={blocks[heapType]} />
+                                            : <Button size="small" sx={{ py: 0, minWidth: 0 }} onClick={() => showBlocks(heapType)}>Blocks</Button>}
+                                    </TableCell>
+                                </TableRow>
+                            );
+                        })}
+                    </TableBody>
+                </Table>
+            )}
+        </Box>
+    );
+};
+
+export default Comparison;
@@ -16,6 +16,8 @@ const Log = ({ logs, currentHeap }) => {
             case 'INIT': return 'info';
             case 'MALLOC': return 'success';
             case 'FREE': return 'warning';
+            case 'REALLOC': return 'primary';
+            case 'RELEASE': return 'warning';
             case 'COALESCE': return 'secondary';
             case 'FULL_COALESCE': return 'secondary';
             default: return 'default';
@@ -32,6 +34,9 @@ const Log = ({ logs, currentHeap }) => {
         return regionStyles[regionId] || { borderColor: 'grey', backgroundColor: 'rgba(128,128,128,0.1)', color: 'grey' };
     };
 
+    // realloc_kind_t in a REALLOC entry's flags
+    const REALLOC_KINDS = ['same size', 'shrunk in place', 'grew in place', 'moved'];
+
     const formatLogEntry = (log) => {
         let details = [];
         
@@ -39,7 +44,10 @@ const Log = ({ logs, currentHeap }) => {
             details.push(`Size: ${log.size}B`);
         }
         
-        if (log.offset > 0) {
+        if (log.action === 'RELEASE' && log.success) {
+            // The whole scope, from its mark to the old bump pointer
+            details.push(`Range: 0x${log.offset.toString(16).padStart(4, '0')}-0x${(log.offset + log.size).toString(16).padStart(4, '0')}`);
+        } else if (log.offset > 0) {
             details.push(`Addr: 0x${log.offset.toString(16).padStart(4, '0')}`);
         }
         
@@ -47,6 +55,10 @@ const Log = ({ logs, currentHeap }) => {
             details.push(`ID: ${log.allocationId}`);
         }
         
+        if (log.action === 'REALLOC' && log.success && REALLOC_KINDS[log.flags]) {
+            details.push(REALLOC_KINDS[log.flags]);
+        }
+        
         if (currentHeap === 5 && log.action === 'MALLOC' && log.flags) {
             const flagNames = [];
             if (log.flags & 0x01) flagNames.push('FAST');
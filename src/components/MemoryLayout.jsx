@@ -1,4 +1,4 @@
-import React, { useEffect, useRef, useState } from 'react';
+import React, { useEffect, useMemo, useRef, useState } from 'react';
 import { 
     Box, 
     Typography, 
@@ -16,6 +16,9 @@ const BLOCK_STATES = {
     2: { name: 'Freed', color: '#FF9800', label: 'Freed Block' }
 };
 
+// Above this many blocks the layout is drawn on a canvas instead of as SVG
+export const SVG_BLOCK_LIMIT = 2000;
+
 // Region colors using a distinct purple/magenta/cyan theme to avoid conflict with block state colors
 const REGION_COLORS = {
     0: { border: '#8b5cf6', bg: 'rgba(139,92,246,0.08)', name: 'FAST', description: 'High-speed cache-friendly memory for frequently accessed data' },
@@ -24,11 +27,14 @@ const REGION_COLORS = {
     // Reserved for future region additions
     3: { border: '#f97316', bg: 'rgba(249,115,22,0.08)', name: 'REGION3', description: 'Reserved region 3' },
     4: { border: '#14b8a6', bg: 'rgba(20,184,166,0.08)', name: 'REGION4', description: 'Reserved region 4' },
-    5: { border: '#a855f7', bg: 'rgba(168,85,247,0.08)', name: 'REGION5', description: 'Reserved region 5' }
+    5: { border: '#a855f7', bg: 'rgba(168,85,247,0.08)', name: 'REGION5', description: 'Reserved region 5' },
+    6: { border: '#eab308', bg: 'rgba(234,179,8,0.08)', name: 'REGION6', description: 'Reserved region 6' },
+    7: { border: '#64748b', bg: 'rgba(100,116,139,0.08)', name: 'REGION7', description: 'Reserved region 7' }
 };
 
 const MemoryLayout = ({ 
     blocks, 
+    blockColumns,
     totalSize, 
     heapOffset, 
     activeBlock, 
@@ -60,6 +66,7 @@ const MemoryLayout = ({
 
     // Use currentHeap prop to determine if it's heap 5, not block data
     const isHeap5 = currentHeap === 5;
+    const rasterize = !!blockColumns && blockColumns.length > SVG_BLOCK_LIMIT;
     
     const blocksByRegion = isHeap5 ? blocks.reduce((acc, block) => {
         const regionId = block.regionId !== undefined ? block.regionId : 0;
@@ -68,8 +75,13 @@ const MemoryLayout = ({
         return acc;
     }, {}) : { 0: blocks };
 
-    // For heap 5, always show all 3 regions
-    const regionIds = isHeap5 ? [0, 1, 2] : [0];
+    // Every heap 5 region starts out as one free block, so the blocks name
+    // them all; the default layout has three
+    const regionIds = useMemo(() => {
+        if (!isHeap5) return [0];
+        if (rasterize) return [...new Set(blockColumns.regionId)].sort((a, b) => a - b);
+        return blocks.length > 0 ? Object.keys(blocksByRegion).map(Number).sort((a, b) => a - b) : [0, 1, 2];
+    }, [isHeap5, rasterize, blockColumns, blocks]);
 
     useEffect(() => {
         const handleResize = () => {
@@ -97,18 +109,20 @@ const MemoryLayout = ({
 
     useEffect(() => {
         if (selectedBlock) {
-            const stillExists = blocks.some(b => 
-                b.offset === selectedBlock.offset && 
-                b.allocationId === selectedBlock.allocationId &&
-                b.regionId === selectedBlock.regionId
-            );
+            const matches = (offset, allocationId, regionId) =>
+                offset === selectedBlock.offset &&
+                allocationId === selectedBlock.allocationId &&
+                regionId === selectedBlock.regionId;
+            const stillExists = rasterize
+                ? blockColumns.offset.some((offset, i) => matches(offset, blockColumns.allocationId[i], blockColumns.regionId[i]))
+                : blocks.some(b => matches(b.offset, b.allocationId, b.regionId));
             if (!stillExists) {
                 setSelectedBlock(null);
                 onBlockClick(null);
                 if (tooltipRef.current) { tooltipRef.current.remove(); tooltipRef.current = null; }
             }
         }
-    }, [blocks, selectedBlock, onBlockClick]);
+    }, [blocks, blockColumns, rasterize, selectedBlock, onBlockClick]);
 
     const formatBytes = (bytes) => {
         if (bytes < 1024) return `${bytes}B`;
@@ -167,7 +181,21 @@ const MemoryLayout = ({
 
             {/* Graph Area */}
             <Box sx={{ flex: 1, minHeight: 0, display: 'flex', flexDirection: 'column', overflow: 'hidden' }}>
-                {isHeap5 ? (
+                {rasterize ? (
+                    <CanvasLayout
+                        key={currentHeap}
+                        columns={blockColumns}
+                        regionIds={regionIds}
+                        totalSize={totalSize}
+                        isHeap5={isHeap5}
+                        dimensions={dimensions}
+                        selectedBlock={selectedBlock}
+                        onBlockClick={handleBlockClick}
+                        resetZoom={resetZoom}
+                        onFreeBlock={onFreeBlock}
+                        formatBytes={formatBytes}
+                    />
+                ) : isHeap5 ? (
                     <Heap5Layout
                         blocksByRegion={blocksByRegion}
                         regionIds={regionIds}
@@ -206,7 +234,7 @@ const MemoryLayout = ({
                     <>
                         <Box sx={{ width: '1px', height: '18px', bgcolor: 'rgba(0,0,0,0.2)', mx: 0.5 }} />
                         {regionIds.map((id) => {
-                            const region = REGION_COLORS[id];
+                            const region = REGION_COLORS[id] || REGION_COLORS[0];
                             return (
                                 <Tooltip key={id} title={region.description} placement="top" arrow>
                                     <Chip label={region.name} size="small" sx={{ borderColor: region.border, backgroundColor: region.bg, color: region.border, fontWeight: 'bold', cursor: 'help', fontSize: '0.65rem', '&:hover': { backgroundColor: `${region.border}22` } }} variant="outlined" icon={<Info sx={{ fontSize: '10px !important', color: `${region.border} !important`, ml: 0.5 }} />} />
@@ -227,9 +255,9 @@ const Heap5Layout = ({ blocksByRegion, regionIds, dimensions, selectedBlock, onB
     const lastZoomLevelRef = useRef({});
     const lastDimensionsRef = useRef({});
 
-    const regionNames = ['FAST', 'DMA', 'UNCACHED'];
+    const regionNames = Object.fromEntries(regionIds.map(id => [id, (REGION_COLORS[id] || REGION_COLORS[0]).name]));
     const totalRegionHeight = dimensions.height - 30;
-    const regionHeight = Math.floor((totalRegionHeight - 16) / 3);
+    const regionHeight = Math.floor((totalRegionHeight - 16) / regionIds.length);
     const borderWidth = 2;
 
     useEffect(() => {
@@ -913,4 +941,408 @@ const SingleHeapLayout = ({ blocks, totalSize, heapOffset, dimensions, selectedB
     );
 };
 
+// Rasterized layout for heaps with more blocks than the SVG view can handle.
+// It reads the copied block table columns (HeapWrapper.getBlockColumns())
+// instead of block objects. When zoomed out, each pixel column shows how many
+// of its bytes are allocated, freed or free; once few enough blocks are in
+// view they are drawn one by one. Hit-testing is a binary search on offsets,
+// and after a heap change only the dirty span reported by the C side is
+// redrawn.
+const CANVAS_MARGIN = { top: 12, right: 15, bottom: 30, left: 45 };
+const CANVAS_MIN_SPAN = 64;         // Bytes across the lane at the deepest zoom
+const CANVAS_BLOCK_PX = 4;          // Draw blocks one by one once they average this wide
+
+// Rows of each lane (a heap 5 region, or the whole heap) in offset order
+const buildLanes = (columns, regionIds, isHeap5, totalSize) => {
+    const rowsByLane = Object.fromEntries(regionIds.map(id => [id, []]));
+    for (let i = 0; i < columns.length; i++) {
+        const id = isHeap5 ? columns.regionId[i] : 0;
+        if (!rowsByLane[id]) rowsByLane[id] = [];
+        rowsByLane[id].push(i);
+    }
+
+    return Object.keys(rowsByLane).map(Number).sort((a, b) => a - b).map(id => {
+        const rows = Uint32Array.from(rowsByLane[id]);
+        let sorted = true;
+        let size = 0;
+        for (let k = 0; k < rows.length; k++) {
+            if (k > 0 && columns.offset[rows[k]] < columns.offset[rows[k - 1]]) sorted = false;
+            size = Math.max(size, columns.offset[rows[k]] + columns.size[rows[k]]);
+        }
+        if (!sorted) rows.sort((a, b) => columns.offset[a] - columns.offset[b]);
+        return { id, rows, size: isHeap5 ? size || 1 : totalSize };
+    });
+};
+
+// Position in lane.rows of the first block ending after byte `at`
+const firstBlockAfter = (lane, columns, at) => {
+    const { rows } = lane;
+    let lo = 0;
+    let hi = rows.length;
+    while (lo < hi) {
+        const mid = (lo + hi) >> 1;
+        if (columns.offset[rows[mid]] <= at) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo > 0 && columns.offset[rows[lo - 1]] + columns.size[rows[lo - 1]] > at) lo--;
+    return lo;
+};
+
+// Table row of the block holding byte `at`, or -1
+const blockAt = (lane, columns, at) => {
+    const k = firstBlockAfter(lane, columns, at);
+    if (k >= lane.rows.length) return -1;
+    const row = lane.rows[k];
+    return columns.offset[row] <= at ? row : -1;
+};
+
+const blockFromRow = (columns, row) => ({
+    offset: columns.offset[row],
+    size: columns.size[row],
+    state: columns.state[row],
+    allocationId: columns.allocationId[row],
+    timestamp: columns.timestamp[row],
+    requestedSize: columns.requestedSize[row],
+    regionId: columns.regionId[row]
+});
+
+// Pixel columns [px0, px1) of the lane's block area
+const drawLaneSpan = (ctx, lane, columns, view, width, height, px0, px1, detailed) => {
+    const bpp = (view.d1 - view.d0) / width;
+    const b0 = view.d0 + px0 * bpp;
+    const b1 = view.d0 + px1 * bpp;
+    const inset = 1;
+    const h = height - inset * 2;
+
+    ctx.save();
+    ctx.beginPath();
+    ctx.rect(px0, 0, px1 - px0, height);
+    ctx.clip();
+    ctx.clearRect(px0, 0, px1 - px0, height);
+    ctx.fillStyle = 'rgba(245,245,245,0.5)';
+    ctx.fillRect(px0, 0, px1 - px0, height);
+
+    let k = firstBlockAfter(lane, columns, b0);
+    if (detailed) {
+        ctx.font = 'bold 10px sans-serif';
+        ctx.textAlign = 'center';
+        ctx.textBaseline = 'middle';
+        for (; k < lane.rows.length; k++) {
+            const row = lane.rows[k];
+            const start = columns.offset[row];
+            if (start >= b1) break;
+            const state = columns.state[row];
+            const x = (start - view.d0) / bpp;
+            const w = Math.max(1, columns.size[row] / bpp);
+
+            ctx.globalAlpha = state === 0 ? 0.5 : 1;
+            ctx.fillStyle = BLOCK_STATES[state]?.color || '#999';
+            ctx.fillRect(x, inset, w, h);
+            ctx.globalAlpha = 1;
+            ctx.strokeStyle = 'rgba(255,255,255,0.3)';
+            ctx.strokeRect(x + 0.5, inset + 0.5, w - 1, h - 1);
+
+            const label = state === 1 && columns.allocationId[row] > 0 ? `#${columns.allocationId[row]}` : state === 2 ? 'FREED' : '';
+            if (label && w > 30) {
+                ctx.fillStyle = 'white';
+                ctx.fillText(label, x + w / 2, height / 2);
+            }
+        }
+    } else {
+        // Bytes of each state under every pixel column
+        const n = px1 - px0;
+        const bytes = new Float64Array(n * 3);
+        for (; k < lane.rows.length; k++) {
+            const row = lane.rows[k];
+            const start = columns.offset[row];
+            if (start >= b1) break;
+            const end = start + columns.size[row];
+            const state = Math.min(columns.state[row], 2);
+            const first = Math.max(px0, Math.floor((start - view.d0) / bpp));
+            const last = Math.min(px1 - 1, Math.floor((end - view.d0) / bpp));
+            for (let p = first; p <= last; p++) {
+                const colStart = view.d0 + p * bpp;
+                const overlap = Math.min(end, colStart + bpp) - Math.max(start, colStart);
+                if (overlap > 0) bytes[(p - px0) * 3 + state] += overlap;
+            }
+        }
+
+        // Stack allocated, freed, then free from the bottom of each column
+        for (let p = 0; p < n; p++) {
+            let y = inset + h;
+            for (const state of [1, 2, 0]) {
+                const fill = (bytes[p * 3 + state] / bpp) * h;
+                if (fill <= 0) continue;
+                ctx.globalAlpha = state === 0 ? 0.5 : 1;
+                ctx.fillStyle = BLOCK_STATES[state].color;
+                ctx.fillRect(px0 + p, y - fill, 1, fill);
+                y -= fill;
+            }
+        }
+        ctx.globalAlpha = 1;
+    }
+    ctx.restore();
+};
+
+const drawLaneAxis = (ctx, view, width, height) => {
+    ctx.save();
+    ctx.clearRect(-CANVAS_MARGIN.left, height, width + CANVAS_MARGIN.left + CANVAS_MARGIN.right, CANVAS_MARGIN.bottom);
+    ctx.strokeStyle = '#000';
+    ctx.fillStyle = '#000';
+    ctx.font = '9px sans-serif';
+    ctx.textAlign = 'center';
+    ctx.textBaseline = 'top';
+
+    const span = view.d1 - view.d0;
+    for (let t = 0; t <= 6; t++) {
+        const x = (t / 6) * width;
+        const at = Math.round(view.d0 + (t / 6) * span);
+        ctx.beginPath();
+        ctx.moveTo(x + 0.5, height + 4);
+        ctx.lineTo(x + 0.5, height + 10);
+        ctx.stroke();
+        ctx.fillText(`0x${at.toString(16).padStart(4, '0')}`, x, height + 12);
+    }
+    ctx.restore();
+};
+
+const CanvasLayout = ({ columns, regionIds, totalSize, isHeap5, dimensions, selectedBlock, onBlockClick, resetZoom, onFreeBlock, formatBytes }) => {
+    const canvasRefs = useRef({});
+    const overlayRefs = useRef({});
+    const views = useRef({});       // Lane id -> { d0, d1 } in bytes
+    const drawn = useRef({});       // Lane id -> what the base canvas shows
+    const drag = useRef(null);
+    const [hover, setHover] = useState(null);
+
+    const lanes = useMemo(
+        () => buildLanes(columns, regionIds, isHeap5, totalSize),
+        [columns, regionIds, isHeap5, totalSize]
+    );
+
+    const laneHeight = isHeap5
+        ? Math.floor((dimensions.height - 46) / Math.max(1, lanes.length))
+        : dimensions.height;
+    const innerWidth = Math.max(1, dimensions.width - CANVAS_MARGIN.left - CANVAS_MARGIN.right);
+    const innerHeight = Math.max(1, laneHeight - CANVAS_MARGIN.top - CANVAS_MARGIN.bottom);
+
+    const viewOf = (lane) => {
+        let view = views.current[lane.id];
+        if (!view || (view.size !== lane.size && view.d0 === 0 && view.d1 === view.size)) {
+            view = { d0: 0, d1: lane.size, size: lane.size };
+        }
+        if (view.d1 > lane.size) view = { d0: Math.max(0, lane.size - (view.d1 - view.d0)), d1: lane.size };
+        view.size = lane.size;
+        views.current[lane.id] = view;
+        return view;
+    };
+
+    const isDetailed = (lane, view) => {
+        const first = firstBlockAfter(lane, columns, view.d0);
+        const last = firstBlockAfter(lane, columns, view.d1);
+        return (last - first) * CANVAS_BLOCK_PX <= innerWidth;
+    };
+
+    const context = (canvas) => {
+        const ctx = canvas.getContext('2d');
+        const dpr = window.devicePixelRatio || 1;
+        ctx.setTransform(dpr, 0, 0, dpr, CANVAS_MARGIN.left * dpr, CANVAS_MARGIN.top * dpr);
+        return ctx;
+    };
+
+    // Redraw a lane's blocks: everything if the view or the data it was drawn
+    // from moved, otherwise just the pixels under the dirty span
+    const drawLane = (lane, force) => {
+        const canvas = canvasRefs.current[lane.id];
+        if (!canvas) return;
+        const view = viewOf(lane);
+        const detailed = isDetailed(lane, view);
+        const last = drawn.current[lane.id];
+        const ctx = context(canvas);
+
+        const stale = columns.version === null || (last && last.version !== columns.version && last.version !== columns.since);
+        const full = force || !last || stale ||
+            last.d0 !== view.d0 || last.d1 !== view.d1 || last.width !== innerWidth ||
+            last.height !== innerHeight || last.detailed !== detailed;
+
+        if (full) {
+            drawLaneSpan(ctx, lane, columns, view, innerWidth, innerHeight, 0, innerWidth, detailed);
+            drawLaneAxis(ctx, view, innerWidth, innerHeight);
+        } else if (columns.dirty && columns.version !== last.version) {
+            const { loRegion, loOffset, hiRegion, hiEnd } = columns.dirty;
+            const id = isHeap5 ? lane.id : 0;
+            if (id >= loRegion && id <= hiRegion) {
+                const lo = id === loRegion ? loOffset : 0;
+                const hi = id === hiRegion ? hiEnd : lane.size;
+                const bpp = (view.d1 - view.d0) / innerWidth;
+                const px0 = Math.max(0, Math.floor((lo - view.d0) / bpp) - 1);
+                const px1 = Math.min(innerWidth, Math.ceil((hi - view.d0) / bpp) + 1);
+                if (px1 > px0) drawLaneSpan(ctx, lane, columns, view, innerWidth, innerHeight, px0, px1, detailed);
+            }
+        }
+
+        drawn.current[lane.id] = { version: columns.version, d0: view.d0, d1: view.d1, width: innerWidth, height: innerHeight, detailed };
+    };
+
+    // Hover and selection outlines live on their own canvas so they never
+    // force a redraw of the blocks
+    const drawOverlay = (lane) => {
+        const canvas = overlayRefs.current[lane.id];
+        if (!canvas) return;
+        const ctx = context(canvas);
+        ctx.clearRect(-CANVAS_MARGIN.left, -CANVAS_MARGIN.top, dimensions.width, laneHeight);
+
+        const view = viewOf(lane);
+        const bpp = (view.d1 - view.d0) / innerWidth;
+        const outline = (row, lineWidth) => {
+            const x = (columns.offset[row] - view.d0) / bpp;
+            const w = Math.max(1, columns.size[row] / bpp);
+            ctx.lineWidth = lineWidth;
+            ctx.strokeStyle = '#000';
+            ctx.strokeRect(x, 1, w, innerHeight - 2);
+        };
+
+        if (hover && hover.lane === lane.id) outline(hover.row, 2);
+        if (selectedBlock && (!isHeap5 || selectedBlock.regionId === lane.id)) {
+            const row = blockAt(lane, columns, selectedBlock.offset);
+            if (row >= 0 && columns.offset[row] === selectedBlock.offset) outline(row, 3);
+        }
+
+        ctx.lineWidth = 2;
+        ctx.strokeStyle = isHeap5 ? (REGION_COLORS[lane.id] || REGION_COLORS[0]).border : '#333';
+        ctx.strokeRect(0, 0, innerWidth, innerHeight);
+    };
+
+    useEffect(() => {
+        lanes.forEach(lane => drawLane(lane, false));
+    }, [lanes, columns, innerWidth, innerHeight]);
+
+    useEffect(() => {
+        lanes.forEach(lane => drawOverlay(lane));
+    }, [lanes, columns, hover, selectedBlock, innerWidth, innerHeight]);
+
+    useEffect(() => {
+        if (!resetZoom) return;
+        views.current = {};
+        lanes.forEach(lane => { drawLane(lane, true); drawOverlay(lane); });
+    }, [resetZoom]);
+
+    const byteAt = (lane, event) => {
+        const rect = canvasRefs.current[lane.id].getBoundingClientRect();
+        const x = event.clientX - rect.left - CANVAS_MARGIN.left;
+        const view = viewOf(lane);
+        return { x, at: view.d0 + (x / innerWidth) * (view.d1 - view.d0) };
+    };
+
+    const setView = (lane, d0, d1) => {
+        const span = Math.min(lane.size, Math.max(CANVAS_MIN_SPAN, d1 - d0));
+        const start = Math.max(0, Math.min(lane.size - span, d0));
+        views.current[lane.id] = { d0: start, d1: start + span, size: lane.size };
+        drawLane(lane, false);
+        drawOverlay(lane);
+    };
+
+    // React registers wheel listeners as passive, so they can't stop the page scrolling
+    useEffect(() => {
+        const cleanups = lanes.map(lane => {
+            const canvas = overlayRefs.current[lane.id];
+            if (!canvas) return null;
+            const onWheel = (event) => {
+                event.preventDefault();
+                const view = viewOf(lane);
+                const { x, at } = byteAt(lane, event);
+                const span = (view.d1 - view.d0) * Math.pow(2, event.deltaY * 0.002);
+                const clamped = Math.min(lane.size, Math.max(CANVAS_MIN_SPAN, span));
+                const d0 = at - (Math.max(0, x) / innerWidth) * clamped;
+                setView(lane, d0, d0 + clamped);
+            };
+            canvas.addEventListener('wheel', onWheel, { passive: false });
+            return () => canvas.removeEventListener('wheel', onWheel);
+        });
+        return () => cleanups.forEach(cleanup => cleanup && cleanup());
+    }, [lanes, columns, innerWidth]);
+
+    const handlePointerDown = (lane, event) => {
+        const view = viewOf(lane);
+        drag.current = { lane: lane.id, x: event.clientX, d0: view.d0, d1: view.d1, moved: false };
+    };
+
+    const handlePointerMove = (lane, event) => {
+        const d = drag.current;
+        if (d && d.lane === lane.id && event.buttons) {
+            const dx = event.clientX - d.x;
+            if (Math.abs(dx) > 2) d.moved = true;
+            const shift = (dx / innerWidth) * (d.d1 - d.d0);
+            setView(lane, d.d0 - shift, d.d1 - shift);
+            return;
+        }
+
+        const { at } = byteAt(lane, event);
+        const row = blockAt(lane, columns, at);
+        if (row < 0) {
+            if (hover) setHover(null);
+        } else if (!hover || hover.row !== row || hover.lane !== lane.id || hover.clientX !== event.clientX) {
+            setHover({ lane: lane.id, row, clientX: event.clientX, clientY: event.clientY });
+        }
+    };
+
+    const handleClick = (lane, event) => {
+        const d = drag.current;
+        drag.current = null;
+        if (d && d.moved) return;
+        const row = blockAt(lane, columns, byteAt(lane, event).at);
+        onBlockClick(row >= 0 ? blockFromRow(columns, row) : null);
+    };
+
+    const dpr = window.devicePixelRatio || 1;
+    const hovered = hover && hover.row < columns.length ? blockFromRow(columns, hover.row) : null;
+
+    return (
+        <Box sx={{ flex: 1, display: 'flex', flexDirection: 'column', minHeight: 0, overflow: 'hidden', position: 'relative' }}>
+            {lanes.map((lane, idx) => {
+                const regionColor = REGION_COLORS[lane.id] || REGION_COLORS[0];
+                const canvasStyle = { position: 'absolute', left: 0, top: 0, width: dimensions.width, height: laneHeight };
+                return (
+                    <Box key={lane.id} mb={idx < lanes.length - 1 ? 0.75 : 0} sx={{ flexShrink: 0 }}>
+                        {isHeap5 && (
+                            <Typography variant="caption" sx={{ fontWeight: 600, color: regionColor.border, mb: 0.25, display: 'block', fontSize: '0.7rem' }}>
+                                Region {lane.id}: {regionColor.name}
+                            </Typography>
+                        )}
+                        <Box sx={{ position: 'relative', width: dimensions.width, height: laneHeight, background: isHeap5 ? regionColor.bg : 'transparent', borderRadius: '4px' }}>
+                            <canvas ref={el => canvasRefs.current[lane.id] = el} style={canvasStyle}
+                                width={dimensions.width * dpr} height={laneHeight * dpr} />
+                            <canvas ref={el => overlayRefs.current[lane.id] = el} style={{ ...canvasStyle, cursor: 'pointer' }}
+                                width={dimensions.width * dpr} height={laneHeight * dpr}
+                                onPointerDown={(e) => handlePointerDown(lane, e)}
+                                onPointerMove={(e) => handlePointerMove(lane, e)}
+                                onPointerLeave={() => setHover(null)}
+                                onClick={(e) => handleClick(lane, e)} />
+                        </Box>
+                    </Box>
+                );
+            })}
+
+            {hovered && (
+                <Box sx={{ position: 'fixed', left: hover.clientX + 15, top: hover.clientY - 15, bgcolor: 'rgba(0,0,0,0.9)', color: 'white', p: 1.25, borderRadius: 1.5, fontSize: '12px', pointerEvents: 'none', zIndex: 9999 }}>
+                    {isHeap5 && <div style={{ fontWeight: 'bold', marginBottom: 4, color: '#60a5fa' }}>Region: {(REGION_COLORS[hovered.regionId] || REGION_COLORS[0]).name}</div>}
+                    <div><strong>ID:</strong> {hovered.allocationId > 0 ? `#${hovered.allocationId}` : (hovered.state === 0 ? 'Free Block' : 'Freed Block')}</div>
+                    <div><strong>State:</strong> {BLOCK_STATES[hovered.state]?.name || 'Unknown'}</div>
+                    <div><strong>Size:</strong> {formatBytes(hovered.size)}</div>
+                    <div><strong>Offset:</strong> 0x{hovered.offset.toString(16).padStart(4, '0')}</div>
+                </Box>
+            )}
+
+            {selectedBlock && selectedBlock.state === 1 && onFreeBlock && (
+                <Box sx={{ position: 'absolute', right: 8, top: 4, display: 'flex', alignItems: 'center', gap: 1, bgcolor: 'rgba(0,0,0,0.85)', color: 'white', px: 1, py: 0.5, borderRadius: 1, fontSize: '12px' }}>
+                    <span>#{selectedBlock.allocationId} · {formatBytes(selectedBlock.size)} at 0x{selectedBlock.offset.toString(16).padStart(4, '0')}</span>
+                    <Box component="span" sx={{ bgcolor: '#ef4444', px: 1, borderRadius: 0.5, cursor: 'pointer', fontWeight: 'bold', '&:hover': { bgcolor: '#dc2626' } }}
+                        onClick={() => { onFreeBlock(selectedBlock); onBlockClick(null); }}>
+                        Free Block
+                    </Box>
+                </Box>
+            )}
+        </Box>
+    );
+};
+
 export default MemoryLayout;
@@ -15,7 +15,9 @@ import {
     Storage as StorageIcon,
     BrokenImage as FragmentIcon,
     Layers as LayersIcon,
-    HelpOutline as HelpIcon
+    HelpOutline as HelpIcon,
+    Timer as TimerIcon,
+    HourglassBottom as LifetimeIcon
 } from '@mui/icons-material';
 
 // Heap implementation descriptions for tooltips
@@ -73,12 +75,26 @@ const HEAP_INFO = {
 • Can fall back to other regions if preferred region is full
 • Best for: embedded systems with heterogeneous memory types
 • Use cases: Cache-friendly hot data, DMA buffers, bulk storage`
+    },
+    6: {
+        label: 'TLSF',
+        description: `Heap 6 (Two-Level Segregated Fit):
+• Free blocks are binned into power-of-two classes, each split into 16 linear sub-classes
+• Bitmaps over both levels find a fitting class with two find-first-set operations
+• O(1) allocation and free - no free list walk regardless of fragmentation
+• Boundary tags (footers) merge both neighbors immediately on free
+• Good-fit rather than best-fit: sizes round up to the next sub-class
+• Best for: real-time and firmware code that needs a bounded worst case
+• Trade-off: slightly more internal fragmentation than best fit`
     }
 };
 
 const Statistics = ({ stats, currentHeap, blocks, heapModule }) => {
     const [selectedRegion, setSelectedRegion] = useState('all');
     const [displayStats, setDisplayStats] = useState(stats);
+    const [profile, setProfile] = useState(null);
+    const [pendingMerges, setPendingMerges] = useState(null);
+    const [lifetimes, setLifetimes] = useState(null);
 
     const externalFragTooltip = "External fragmentation: free memory scattered in small non-contiguous blocks.";
     const internalFragTooltip = "Internal fragmentation: wasted space within allocated blocks due to alignment.";
@@ -96,6 +112,13 @@ const Statistics = ({ stats, currentHeap, blocks, heapModule }) => {
         }
     }, [selectedRegion, stats, currentHeap, heapModule]);
 
+    // Stats change with every operation, so the profile is re-read with them
+    useEffect(() => {
+        setProfile(heapModule && heapModule.initialized ? heapModule.getOpProfile() : null);
+        setPendingMerges(heapModule && heapModule.initialized ? heapModule.getPendingMerges() : null);
+        setLifetimes(heapModule && heapModule.initialized ? heapModule.getLifetimeProfile() : null);
+    }, [stats, currentHeap, heapModule]);
+
     const {
         totalSize = 0,
         allocatedBytes = 0,
@@ -105,7 +128,8 @@ const Statistics = ({ stats, currentHeap, blocks, heapModule }) => {
         largestFreeBlock = 0,
         minFreeBytes = 0,
         externalFragmentation = 0,
-        internalFragmentation = 0
+        internalFragmentation = 0,
+        metadataBytes = 0
     } = displayStats;
 
     const allocatedPercent = totalSize > 0 ? (allocatedBytes / totalSize) * 100 : 0;
@@ -118,13 +142,83 @@ const Statistics = ({ stats, currentHeap, blocks, heapModule }) => {
         return `${(bytes / (1024 * 1024)).toFixed(2)}MB`;
     };
 
+    // Free blocks per log2 size bucket, kept by the allocator as blocks split and merge
+    const freeSizeRows = (displayStats.freeSizeHistogram || [])
+        .map((count, b) => count > 0 ? `${formatBytes(2 ** b)}-${formatBytes(2 ** (b + 1))}: ${count}` : null)
+        .filter(Boolean);
+    // Adjacent free blocks a deferred-coalescing heap has yet to merge
+    const mergeRows = pendingMerges ? ['', `Pending merges: ${pendingMerges}`] : [];
+    const externalFragTitle = [
+        externalFragTooltip,
+        ...(freeSizeRows.length > 0 ? ['', 'Free blocks by size:', ...freeSizeRows] : []),
+        ...mergeRows
+    ].join('\n');
+
     const getFragColor = (v) => v < 10 ? '#10b981' : v < 30 ? '#f59e0b' : '#ef4444';
-    const showFragmentation = currentHeap === 2 || currentHeap === 4 || currentHeap === 5;
+    const showFragmentation = currentHeap === 2 || currentHeap === 4 || currentHeap === 5 || currentHeap === 6;
     const showRegionSelector = currentHeap === 5;
     const showMinHistoric = currentHeap !== 1 && selectedRegion === 'all';
 
     const heapInfo = HEAP_INFO[currentHeap] || { label: `Heap ${currentHeap}`, description: 'No description available.' };
 
+    const formatNs = (ns) => ns < 1000 ? `${ns}ns` : ns < 1000000 ? `${(ns / 1000).toFixed(1)}µs` : `${(ns / 1000000).toFixed(2)}ms`;
+
+    // Worst case per op over every call since heap_init; heap_malloc_flags
+    // counts as malloc here
+    const worstCase = (ops, metric) => Math.max(0, ...ops.map(op => profile[op][metric].max));
+    const mallocOps = ['malloc', 'mallocFlags'];
+    const hasProfile = profile && (profile.malloc.ns.count + profile.mallocFlags.ns.count + profile.free.ns.count) > 0;
+
+    // Tooltip rows: the log2 latency buckets that saw any calls
+    const latencyRows = (ops) => {
+        if (!profile) return [];
+        const rows = [];
+        for (let b = 0; b < profile.malloc.ns.buckets.length; b++) {
+            const count = ops.reduce((sum, op) => sum + profile[op].ns.buckets[b], 0);
+            if (count > 0) rows.push(`< ${formatNs(2 ** b)}: ${count}`);
+        }
+        return rows;
+    };
+    const profileTooltip = hasProfile ? [
+        'Worst case since init (free-list nodes visited, blocks split/merged, deferred coalesce steps)',
+        `malloc: ${formatNs(worstCase(mallocOps, 'ns'))}, ${worstCase(mallocOps, 'visited')} visited, ` +
+            `${worstCase(mallocOps, 'merges')} merged, ${worstCase(mallocOps, 'coalesceSteps')} coalesce steps`,
+        `free: ${formatNs(worstCase(['free'], 'ns'))}, ${worstCase(['free'], 'visited')} visited, ` +
+            `${worstCase(['free'], 'merges')} merged, ${worstCase(['free'], 'coalesceSteps')} coalesce steps`,
+        '',
+        'malloc latency:', ...latencyRows(mallocOps),
+        '',
+        'free latency:', ...latencyRows(['free'])
+    ].join('\n') : '';
+
+    // Size classes by churn (mallocs plus frees), with the log2 bucket that
+    // holds the median lifetime, and the live-bytes timeline as a sparkline
+    const hasLifetimes = lifetimes && lifetimes.classes.length > 0;
+    const hotClasses = hasLifetimes
+        ? [...lifetimes.classes].sort((a, b) => (b.allocs + b.frees) - (a.allocs + a.frees))
+        : [];
+    const medianLifetime = ({ count, buckets }) => {
+        let seen = 0;
+        for (let b = 0; b < buckets.length; b++) {
+            seen += buckets[b];
+            if (seen * 2 >= count) return b === 0 ? '0' : `< ${2 ** b}`;
+        }
+        return '0';
+    };
+    const sparkline = (values) => {
+        const peak = Math.max(1, ...values);
+        return values.map(v => '▁▂▃▄▅▆▇█'[Math.min(7, Math.floor((v / peak) * 8))]).join('');
+    };
+    const sizeClassLabel = (c) => `${formatBytes(c.minSize)}-${formatBytes(c.maxSize)}`;
+    const lifetimeTooltip = hasLifetimes ? [
+        `Live bytes requested, peak ${formatBytes(lifetimes.peakLiveBytes)} (${lifetimes.windowTicks} ticks per step):`,
+        sparkline(lifetimes.timeline),
+        '',
+        'Size classes by churn (median / longest lifetime in ticks):',
+        ...hotClasses.slice(0, 8).map(c => `${sizeClassLabel(c)}: ${c.allocs} malloc, ${c.frees} free` +
+            (c.lifetime.count > 0 ? `, ${medianLifetime(c.lifetime)} / ${c.lifetime.max}` : ''))
+    ].join('\n') : '';
+
     return (
         <Box sx={{ 
             display: 'flex', 
@@ -206,14 +300,49 @@ const Statistics = ({ stats, currentHeap, blocks, heapModule }) => {
                         Min: <strong>{formatBytes(minFreeBytes)}</strong>
                     </Typography>
                 )}
+                {metadataBytes > 0 && selectedRegion === 'all' && (
+                    <Typography variant="body2" color="text.secondary" sx={{ fontSize: '0.8rem', whiteSpace: 'nowrap' }}>
+                        Metadata: <strong>{formatBytes(metadataBytes)}</strong>
+                    </Typography>
+                )}
             </Box>
 
+            {/* Worst-case latency and traversal */}
+            {hasProfile && (
+                <Tooltip title={<Box sx={{ whiteSpace: 'pre-line', maxWidth: 380, fontSize: '0.8rem' }}>{profileTooltip}</Box>} placement="bottom" arrow>
+                    <Box sx={{ display: 'flex', alignItems: 'center', gap: 1, cursor: 'help' }}>
+                        <TimerIcon sx={{ fontSize: 20, color: 'primary.main' }} />
+                        <Typography variant="body2" color="text.secondary" sx={{ fontSize: '0.8rem', whiteSpace: 'nowrap' }}>
+                            Worst malloc: <strong>{formatNs(worstCase(mallocOps, 'ns'))}</strong> / <strong>{worstCase(mallocOps, 'visited')}</strong> visited
+                        </Typography>
+                        <Typography variant="body2" color="text.secondary" sx={{ fontSize: '0.8rem', whiteSpace: 'nowrap' }}>
+                            free: <strong>{formatNs(worstCase(['free'], 'ns'))}</strong> / <strong>{worstCase(['free'], 'visited')}</strong>
+                        </Typography>
+                    </Box>
+                </Tooltip>
+            )}
+
+            {/* Allocation churn and lifetimes */}
+            {hasLifetimes && (
+                <Tooltip title={<Box sx={{ whiteSpace: 'pre-line', maxWidth: 420, fontSize: '0.8rem' }}>{lifetimeTooltip}</Box>} placement="bottom" arrow>
+                    <Box sx={{ display: 'flex', alignItems: 'center', gap: 1, cursor: 'help' }}>
+                        <LifetimeIcon sx={{ fontSize: 20, color: 'primary.main' }} />
+                        <Typography variant="body2" color="text.secondary" sx={{ fontSize: '0.8rem', whiteSpace: 'nowrap' }}>
+                            Hot: <strong>{sizeClassLabel(hotClasses[0])}</strong>
+                        </Typography>
+                        <Typography variant="body2" color="text.secondary" sx={{ fontSize: '0.8rem', whiteSpace: 'nowrap' }}>
+                            Peak live: <strong>{formatBytes(lifetimes.peakLiveBytes)}</strong>
+                        </Typography>
+                    </Box>
+                </Tooltip>
+            )}
+
             {/* Fragmentation */}
             {showFragmentation && (
                 <Box sx={{ display: 'flex', alignItems: 'center', gap: 1.5 }}>
                     <FragmentIcon sx={{ fontSize: 20, color: 'primary.main' }} />
                     <Box sx={{ display: 'flex', alignItems: 'center', gap: 0.5 }}>
-                        <Tooltip title={externalFragTooltip} placement="top" arrow>
+                        <Tooltip title={<Box sx={{ whiteSpace: 'pre-line' }}>{externalFragTitle}</Box>} placement="top" arrow>
                             <IconButton size="small" sx={{ p: 0.25 }}><HelpIcon sx={{ fontSize: 14, color: 'text.secondary' }} /></IconButton>
                         </Tooltip>
                         <Typography variant="body2" color="text.secondary" sx={{ fontSize: '0.75rem' }}>Ext:</Typography>
@@ -0,0 +1,77 @@
+// src/js/compare.worker.js
+// One heap of a comparison run (see utils/compare.js). The worker loads its
+// heap module, replays the op tape it is sent, or generates from a workload
+// config, with HeapWrapper.runTape() and posts back stats and latency
+// summaries. The heap is kept until the worker is terminated, so its blocks
+// can still be asked for afterwards.
+/* eslint-disable no-restricted-globals */
+
+import HeapWrapper from './heap_module';
+
+let heap = null;
+let heapType = 0;
+
+// Percentile of a log2 histogram, as the upper bound of the bucket it falls in
+const percentile = (buckets, count, p) => {
+    const rank = Math.ceil(count * p);
+    let seen = 0;
+    for (let b = 0; b < buckets.length; b++) {
+        seen += buckets[b];
+        if (seen >= rank) return b === 0 ? 0 : 2 ** b;
+    }
+    return 0;
+};
+
+const summarizeProfile = (profile) => {
+    if (!profile) return null;
+    const summary = {};
+    for (const [op, metrics] of Object.entries(profile)) {
+        const ns = metrics.ns;
+        if (!ns || ns.count === 0) continue;
+        summary[op] = {
+            count: ns.count,
+            p50: percentile(ns.buckets, ns.count, 0.5),
+            p99: percentile(ns.buckets, ns.count, 0.99),
+            max: ns.max,
+            maxVisited: metrics.visited ? metrics.visited.max : 0
+        };
+    }
+    return summary;
+};
+
+const run = async ({ heapType: type, tape: sent, workload, heapSize, maxBlocks = 0 }) => {
+    heapType = type;
+    heap = new HeapWrapper();
+    await heap.init(type);
+    heap.initHeap(heapSize, maxBlocks);
+    
+    const tape = sent || heap.generateTape(workload);
+    const total = tape.length / 4;
+    const { ms, allocations } = heap.runTape(tape, {
+        onProgress: (done) => self.postMessage({ type: 'progress', heapType, done, total })
+    });
+    
+    self.postMessage({
+        type: 'result',
+        heapType,
+        name: heap.getCurrentHeapInfo().name,
+        ops: total,
+        ms,
+        opsPerSecond: ms > 0 ? total / (ms / 1000) : 0,
+        allocations,
+        stats: heap.getStats(),
+        latency: summarizeProfile(heap.getOpProfile())
+    });
+};
+
+self.onmessage = async ({ data }) => {
+    try {
+        if (data.type === 'run') {
+            await run(data);
+        } else if (data.type === 'blocks') {
+            self.postMessage({ type: 'blocks', heapType, blocks: heap ? heap.getBlocks() : [] });
+        }
+    } catch (error) {
+        self.postMessage({ type: 'error', heapType: data.heapType || heapType, message: error.message });
+    }
+};
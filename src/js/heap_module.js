@@ -1,51 +1,351 @@
-import Heap1Module from './heap1.js';
-import Heap2Module from './heap2.js';
-import Heap3Module from './heap3.js';
-import Heap4Module from './heap4.js';
-import Heap5Module from './heap5.js';
-
-const HEAP_MODULES = {
-    1: { module: Heap1Module, name: 'Heap 1 - Bump Allocator', hasOffset: true },
-    2: { module: Heap2Module, name: 'Heap 2 - Best Fit', hasOffset: false },
-    3: { module: Heap3Module, name: 'Heap 3 - Thread Safe', hasOffset: false },
-    4: { module: Heap4Module, name: 'Heap 4 - Coalescing', hasOffset: false },
-    5: { module: Heap5Module, name: 'Heap 5 - Multi-Region', hasOffset: false }
+// op_t kinds, see heap_common.h
+const OP_MALLOC = 0;
+const OP_FREE = 1;
+const OP_SKIP = 2;
+const OP_FREE_ADDR = 3;
+const OP_FLAG_KEEP_SLOT = 0x100;
+const OP_WORDS = 4;
+const TAPE_CHUNK = 65536;       // ops per heap_run_ops call in runTape()
+
+// workload_config_t, see heap_common.h
+export const WORKLOAD_SIZES = ['uniform', 'powerLaw', 'bimodal', 'classes'];
+export const WORKLOAD_LIFETIMES = ['lifo', 'fifo', 'random', 'longLived'];
+export const WORKLOAD_FLAG_NAMES = ['fast', 'dma', 'uncached', 'pinned'];   // region flag 1 << i
+const WORKLOAD_CLASSES = 8;
+const WORKLOAD_WORDS = 14 + WORKLOAD_CLASSES;
+
+// Block table snapshot layout, see heap_common.h
+const BLOCK_TABLE_HEADER = 9;
+const DIRTY_NONE = 0xFFFFFFFF;
+const BLOCK_COLUMNS = ['offset', 'size', 'state', 'allocationId', 'timestamp', 'requestedSize', 'regionId'];
+
+// Packed log_entry_t, see heap_common.h
+const LOG_ENTRY_SIZE = 24;
+const LOG_ACTIONS = ['INIT', 'MALLOC', 'FREE', 'COALESCE', 'REALLOC', 'RELEASE'];
+
+// op_profile_t kinds and metrics, see heap_common.h
+const PROFILE_OPS = ['malloc', 'free', 'mallocFlags', 'realloc'];
+const PROFILE_METRICS = ['ns', 'visited', 'splits', 'merges', 'coalesceSteps'];
+const PROFILE_BUCKETS = 33;
+
+// lifetime_profile_t: four counters, allocs and frees per size class, the
+// timeline, then a profile_histogram_t (count, max, buckets) per size class
+const LIFETIME_CLASSES = 32;
+const LIFETIME_WINDOWS = 64;
+const LIFETIME_HISTOGRAM_WORDS = 2 + PROFILE_BUCKETS;
+
+// heap_stats_t.free_size_histogram: bucket b counts free blocks of [2^b, 2^(b+1)) bytes
+const FREE_SIZE_BUCKETS = 32;
+const STATS_HISTOGRAM_WORD = 13;
+
+// The glue checked in under src/js predates the Makefile's current exports
+// (it is the SINGLE_FILE build with the original heap_stats_t), so every call
+// below checks for its export and falls back to the original ones. Modules
+// rebuilt with `make` export get_lifetime_profile, and only they have the
+// longer heap_stats_t.
+const hasCurrentLayout = mod => !!mod._get_lifetime_profile;
+
+// Each heap's Emscripten glue is a separate chunk, imported the first time
+// the heap is needed; its .wasm is served from public/wasm (see the Makefile).
+// heap_6 has no glue checked in yet, so it is listed without a loader and
+// shown as unavailable; once `make heap6` output is committed its load is
+// () => import('./heap6.js') like the others.
+export const HEAP_MODULES = {
+    1: { load: () => import('./heap1.js'), wasm: 'heap1.wasm', name: 'Heap 1 - Bump Allocator', hasOffset: true },
+    2: { load: () => import('./heap2.js'), wasm: 'heap2.wasm', name: 'Heap 2 - Best Fit', hasOffset: false },
+    3: { load: () => import('./heap3.js'), wasm: 'heap3.wasm', name: 'Heap 3 - Thread Safe', hasOffset: false },
+    4: { load: () => import('./heap4.js'), wasm: 'heap4.wasm', name: 'Heap 4 - Coalescing', hasOffset: false },
+    5: { load: () => import('./heap5.js'), wasm: 'heap5.wasm', name: 'Heap 5 - Multi-Region', hasOffset: false },
+    6: { load: null, wasm: 'heap6.wasm', name: 'Heap 6 - TLSF', hasOffset: false }
+};
+
+const WASM_BASE = `${process.env.PUBLIC_URL || ''}/wasm`;
+
+// Compiled modules by file name, shared by loads and prefetches. A compiled
+// module owns no memory, so prefetching a heap that is never opened only
+// costs the compile. Streaming compilation runs off the main thread as the
+// bytes arrive, and lets the engine keep the machine code in its cache for
+// the next visit.
+const compiledModules = {};
+
+function compileWasm(file) {
+    if (!compiledModules[file]) {
+        const url = `${WASM_BASE}/${file}`;
+        compiledModules[file] = (async () => {
+            const response = await fetch(url, { credentials: 'same-origin' });
+            if (!response.ok) throw new Error(`${url}: ${response.status}`);
+            
+            // compileStreaming insists on the application/wasm MIME type
+            if (WebAssembly.compileStreaming && response.headers.get('Content-Type') === 'application/wasm') {
+                return WebAssembly.compileStreaming(response);
+            }
+            return WebAssembly.compile(await response.arrayBuffer());
+        })();
+        compiledModules[file].catch(() => { delete compiledModules[file]; });
+    }
+    return compiledModules[file];
+}
+
+// Pack simulation steps into op_t words as heap_run_ops reads them. Allocate
+// flags are kept for every heap; only heap_5 looks at their low byte.
+export function encodeOps(steps, useFlags = true) {
+    const words = new Uint32Array(steps.length * OP_WORDS);
+    steps.forEach((step, i) => {
+        const idx = i * OP_WORDS;
+        if (step.action === 'allocate') {
+            words[idx] = OP_MALLOC;
+            words[idx + 1] = step.size;
+            words[idx + 2] = -1;
+            words[idx + 3] = (useFlags && step.flags !== undefined ? step.flags : 0) |
+                (step.keepSlot ? OP_FLAG_KEEP_SLOT : 0);
+        } else if (step.action === 'free' && step.ptr !== undefined) {
+            words[idx] = OP_FREE_ADDR;
+            words[idx + 1] = step.ptr;
+            words[idx + 2] = -1;
+        } else if (step.action === 'free' && step.ptrIndex !== undefined) {
+            words[idx] = OP_FREE;
+            words[idx + 2] = step.ptrIndex;
+        } else {
+            words[idx] = OP_SKIP;
+        }
+    });
+    return words;
+}
+
+// Pack a workload config (see utils/workloads.js) into workload_config_t words;
+// fields left out take the generator's defaults
+export function encodeWorkload(config) {
+    const words = new Uint32Array(WORKLOAD_WORDS);
+    words[0] = config.seed || 0;
+    words[1] = config.ops || 0;
+    words[2] = Math.max(0, WORKLOAD_SIZES.indexOf(config.sizes));
+    words[3] = config.minSize || 0;
+    words[4] = config.maxSize || 0;
+    words[5] = config.shape || 0;
+    words[6] = Math.max(0, WORKLOAD_LIFETIMES.indexOf(config.lifetime));
+    words[7] = config.maxLive || 0;
+    words[8] = config.allocPercent || 0;
+    words[9] = config.longLivedPercent || 0;
+    WORKLOAD_FLAG_NAMES.forEach((name, i) => {
+        words[10 + i] = (config.flags && config.flags[name]) || 0;
+    });
+    (config.classes || []).slice(0, WORKLOAD_CLASSES).forEach((size, i) => {
+        words[14 + i] = size;
+    });
+    return words;
+}
+
+// xorshift32 and the uniform [lo, hi] pick of common_workload_range; the
+// 32x32-bit product is split so it stays exact in doubles
+const workloadRand = (rng) => {
+    let x = rng.state;
+    x = (x ^ (x << 13)) >>> 0;
+    x = (x ^ (x >>> 17)) >>> 0;
+    x = (x ^ (x << 5)) >>> 0;
+    rng.state = x;
+    return x;
+};
+
+const workloadRange = (rng, lo, hi) => {
+    if (hi <= lo) return lo;
+    const r = workloadRand(rng);
+    const span = hi - lo + 1;
+    const high = Math.floor(r / 65536) * span;
+    const low = (r % 65536) * span;
+    return lo + Math.floor((high + Math.floor(low / 65536)) / 65536);
+};
+
+const workloadSize = (words, rng, lo, hi) => {
+    const f = Math.fround;
+    switch (words[2]) {
+    case 1: {
+        const a = f((words[5] || 120) / 100);
+        const u = f(((workloadRand(rng) >>> 8) + 1) * f(1 / 16777216));
+        const tail = f(1 - f(Math.pow(f(lo / hi), a)));
+        const size = Math.trunc(f(lo * f(Math.pow(f(1 - f(u * tail)), f(-1 / a)))));
+        return size < lo ? lo : size > hi ? hi : size;
+    }
+    case 2: {
+        const spread = Math.floor((hi - lo) / 8);
+        const small = words[5] || 80;
+        return workloadRange(rng, 0, 99) < small ? workloadRange(rng, lo, lo + spread)
+                                                 : workloadRange(rng, hi - spread, hi);
+    }
+    case 3: {
+        let count = 0;
+        while (count < WORKLOAD_CLASSES && words[14 + count]) count++;
+        if (count > 0) return words[14 + workloadRange(rng, 0, count - 1)];
+        
+        let first = 1;
+        while (first < lo) first *= 2;
+        if (first > hi) return lo;
+        let steps = 0;
+        while (first * 2 ** (steps + 1) <= hi) steps++;
+        return first * 2 ** workloadRange(rng, 0, steps);
+    }
+    default:
+        return workloadRange(rng, lo, hi);
+    }
 };
 
+// common_workload_generate in JS, for modules without heap_generate_ops:
+// the same config gives the same op tape
+export function generateWorkloadOps(config) {
+    const words = encodeWorkload(config);
+    const lo = words[3] || 8;
+    const hi = Math.max(lo, words[4] || 1024);
+    const maxLive = words[7] || 256;
+    const allocPercent = words[8] || 55;
+    const longPercent = words[9] || 10;
+    const lifetime = words[6];
+    let flagTotal = 0;
+    for (let f = 0; f < WORKLOAD_FLAG_NAMES.length; f++) flagTotal += words[10 + f];
+    
+    const n = words[1];
+    const ops = new Uint32Array(n * OP_WORDS);
+    const live = new Int32Array(maxLive);
+    let head = 0;
+    let liveCount = 0;
+    let longLived = 0;
+    let nextOrdinal = 0;
+    const rng = { state: (Math.imul(words[0], 0x9E3779B9) + 0x7F4A7C15) >>> 0 };
+    if (rng.state === 0) rng.state = 1;
+    
+    for (let i = 0; i < n; i++) {
+        const idx = i * OP_WORDS;
+        const allocate = liveCount === 0 ||
+            (liveCount < maxLive && workloadRange(rng, 0, 99) < allocPercent);
+        if (allocate) {
+            let flags = 0;
+            if (flagTotal > 0) {
+                const roll = workloadRange(rng, 0, 99);
+                let upto = 0;
+                for (let f = 0; f < WORKLOAD_FLAG_NAMES.length && !flags; f++) {
+                    upto += words[10 + f];
+                    if (roll < upto) flags = 1 << f;
+                }
+            }
+            ops[idx] = OP_MALLOC;
+            ops[idx + 1] = workloadSize(words, rng, lo, hi);
+            ops[idx + 2] = -1;
+            ops[idx + 3] = flags | OP_FLAG_KEEP_SLOT;
+            
+            const keep = lifetime === 3 && longLived < maxLive && workloadRange(rng, 0, 99) < longPercent;
+            if (keep) {
+                longLived++;
+            } else {
+                live[(head + liveCount++) % maxLive] = nextOrdinal;
+            }
+            nextOrdinal++;
+            continue;
+        }
+        
+        let pick;
+        if (lifetime === 1) {
+            pick = head;
+            head = (head + 1) % maxLive;
+        } else {
+            const k = lifetime === 0 ? liveCount - 1 : workloadRange(rng, 0, liveCount - 1);
+            // Swap the pick with the newest entry, which then leaves the ring
+            const back = (head + liveCount - 1) % maxLive;
+            pick = (head + k) % maxLive;
+            const ordinal = live[pick];
+            live[pick] = live[back];
+            live[back] = ordinal;
+            pick = back;
+        }
+        liveCount--;
+        ops[idx] = OP_FREE;
+        ops[idx + 2] = live[pick];
+    }
+    return ops;
+}
+
+const whenIdle = typeof window !== 'undefined' && window.requestIdleCallback
+    ? callback => window.requestIdleCallback(callback)
+    : callback => setTimeout(callback, 200);
+
 class HeapWrapper {
     constructor() {
         this.modules = {};
         this.currentHeap = 1;
         this.currentModule = null;
         this.initialized = false;
+        this.logCache = {};
+        this.loading = {};
     }
 
-    async init() {
+    // Only the current heap is loaded up front; the others load on their
+    // first switchHeap, or earlier through prefetch()
+    async init(heapType = this.currentHeap) {
         try {
-            console.log('Initializing all heap modules...');
-            
-            // Initialize all available heap modules
-            for (const [heapType, config] of Object.entries(HEAP_MODULES)) {
-                console.log(`Loading ${config.name}...`);
-                this.modules[heapType] = await config.module();
-                console.log(`${config.name} loaded successfully`);
-            }
-            
-            this.currentModule = this.modules[this.currentHeap];
+            this.currentHeap = heapType;
+            this.currentModule = await this.loadHeap(this.currentHeap);
             this.initialized = true;
-            console.log('All heap modules initialized successfully');
         } catch (error) {
             console.error('Failed to initialize heap modules:', error);
             throw error;
         }
     }
 
-    switchHeap(heapType) {
+    // Instantiate a heap's module once; concurrent callers share the promise
+    loadHeap(heapType) {
+        const config = HEAP_MODULES[heapType];
+        if (!config) return Promise.reject(new Error(`Heap ${heapType} not available`));
+        if (!config.load) return Promise.reject(new Error(`${config.name} is not built (make heap${heapType})`));
+        
+        if (!this.loading[heapType]) {
+            this.loading[heapType] = (async () => {
+                console.log(`Loading ${config.name}...`);
+                const [{ default: factory }, compiled] = await Promise.all([
+                    config.load(),
+                    compileWasm(config.wasm).catch(() => null)
+                ]);
+                
+                // Modules built with the binary inlined (SINGLE_FILE) have no
+                // .wasm to fetch and instantiate themselves
+                const options = { locateFile: path => `${WASM_BASE}/${path}` };
+                if (compiled) {
+                    options.instantiateWasm = (imports, receiveInstance) => {
+                        WebAssembly.instantiate(compiled, imports)
+                            .then(instance => receiveInstance(instance, compiled))
+                            .catch(error => console.error(`Failed to instantiate ${config.name}:`, error));
+                        return {};
+                    };
+                }
+                
+                const module = await factory(options);
+                this.modules[heapType] = module;
+                console.log(`${config.name} loaded successfully`);
+                return module;
+            })();
+            this.loading[heapType].catch(() => { delete this.loading[heapType]; });
+        }
+        return this.loading[heapType];
+    }
+
+    // Fetch and compile the heaps not loaded yet, one at a time while the page
+    // is idle, so a later switchHeap only has to instantiate
+    prefetch() {
+        const pending = Object.keys(HEAP_MODULES).filter(type => HEAP_MODULES[type].load && !this.loading[type]);
+        const next = () => {
+            const type = pending.shift();
+            if (type === undefined) return;
+            
+            const config = HEAP_MODULES[type];
+            Promise.all([config.load(), compileWasm(config.wasm)])
+                .catch(() => {})
+                .then(() => whenIdle(next));
+        };
+        whenIdle(next);
+    }
+
+    async switchHeap(heapType) {
         if (!this.initialized) throw new Error('Module not initialized');
-        if (!this.modules[heapType]) throw new Error(`Heap ${heapType} not available`);
         
+        const module = await this.loadHeap(heapType);
         this.currentHeap = heapType;
-        this.currentModule = this.modules[heapType];
+        this.currentModule = module;
         console.log(`Switched to ${HEAP_MODULES[heapType].name}`);
     }
 
@@ -57,14 +357,39 @@ class HeapWrapper {
         return Object.entries(HEAP_MODULES).map(([type, config]) => ({
             type: parseInt(type),
             name: config.name,
-            available: !!this.modules[type]
+            available: !!config.load,
+            loaded: !!this.modules[type]
         }));
     }
 
-    initHeap(size) {
+    // maxBlocks sizes the block table; 0 keeps the module's current capacity
+    initHeap(size, maxBlocks = 0) {
         if (!this.initialized) throw new Error('Module not initialized');
         console.log(`Initializing ${HEAP_MODULES[this.currentHeap].name} with size: ${size}`);
-        this.currentModule._heap_init(size);
+        this.currentModule._heap_init(size, maxBlocks);
+    }
+
+    // Coalescing policy for heap 4/5: 0 = immediate, 1 = incremental, 2 = manual
+    initHeapWithPolicy(size, policy, budget = 0) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        if (!this.currentModule._heap_init_coalesce) {
+            return this.initHeap(size);
+        }
+        console.log(`Initializing ${HEAP_MODULES[this.currentHeap].name} with size: ${size}, coalesce policy: ${policy}`);
+        this.currentModule._heap_init_coalesce(size, policy, budget);
+    }
+
+    coalesceStep(budget) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        if (!this.currentModule._heap_coalesce_step) return 0;
+        return this.currentModule._heap_coalesce_step(budget);
+    }
+
+    // Heap 5: what mallocFlags(size, flags) does when no region with those
+    // flags fits: 0 = fail, 1 = try every other region. Kept across init.
+    setRegionFallback(flags, policy) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        if (this.currentModule._heap_set_region_fallback) this.currentModule._heap_set_region_fallback(flags, policy);
     }
 
     malloc(size) {
@@ -97,6 +422,212 @@ class HeapWrapper {
         this.currentModule._heap_free(ptr);
     }
 
+    // Resize in place where the heap can, else move; 0 on failure (the block
+    // is left alone). Modules without heap_realloc get null.
+    realloc(ptr, size) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        if (!this.currentModule._heap_realloc) return null;
+        const result = this.currentModule._heap_realloc(ptr, size);
+        console.log(`realloc(${ptr}, ${size}) = ${result}`);
+        return result;
+    }
+
+    // Heap 1: open a nested scope and return its mark (0 if too deeply
+    // nested), or null for heaps without scopes
+    mark() {
+        if (!this.initialized) throw new Error('Module not initialized');
+        return this.currentModule._heap_mark ? this.currentModule._heap_mark() : null;
+    }
+
+    // Heap 1: free everything allocated since mark() returned `mark`, closing
+    // the scopes inside it too. Returns false if `mark` is not open.
+    release(mark) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        if (!this.currentModule._heap_release) return false;
+        console.log(`release(${mark})`);
+        return this.currentModule._heap_release(mark) === 0;
+    }
+
+    // Copy of the whole heap state (Uint8Array), or null for heaps without
+    // checkpoints (heap 3) and modules built before heap_snapshot
+    snapshot() {
+        if (!this.initialized) throw new Error('Module not initialized');
+        const mod = this.currentModule;
+        if (!mod._heap_snapshot || !mod._malloc) return null;
+        
+        const size = mod._heap_snapshot(0, 0);
+        if (size === 0) return null;
+        const ptr = mod._malloc(size);
+        try {
+            if (mod._heap_snapshot(ptr, size) !== size) return null;
+            return mod.HEAPU8.slice(ptr, ptr + size);
+        } finally {
+            mod._free(ptr);
+        }
+    }
+
+    // Put back a snapshot() of the current heap; returns false if the module
+    // rejected it. The log rewinds too, so the cached entries are dropped.
+    restore(state) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        const mod = this.currentModule;
+        if (!state || !mod._heap_restore || !mod._malloc) return false;
+        
+        const ptr = mod._malloc(state.length);
+        try {
+            mod.HEAPU8.set(state, ptr);
+            const ok = mod._heap_restore(ptr, state.length) === 0;
+            this.logCache[this.currentHeap] = { entries: [], lastSeq: 0 };
+            return ok;
+        } finally {
+            mod._free(ptr);
+        }
+    }
+
+    // Run simulation steps in a single call into WASM. Returns the pointers of
+    // the successful allocations in order, which is what free steps' ptrIndex
+    // refers to. Allocate steps with keepSlot also record failures (as 0), and
+    // free steps may name a pointer from an earlier batch with `ptr`.
+    runBatch(steps) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        const mod = this.currentModule;
+        const useFlags = this.currentHeap === 5;
+        
+        if (!mod._heap_run_ops || !mod._malloc) {
+            // Module built without the batch export
+            const pointers = [];
+            for (const step of steps) {
+                if (step.action === 'allocate') {
+                    const ptr = step.flags !== undefined && useFlags
+                        ? this.mallocFlags(step.size, step.flags)
+                        : this.malloc(step.size);
+                    if (ptr || step.keepSlot) pointers.push(ptr || 0);
+                } else if (step.action === 'free' && step.ptr !== undefined) {
+                    if (step.ptr) this.free(step.ptr);
+                } else if (step.action === 'free' && step.ptrIndex !== undefined) {
+                    if (pointers[step.ptrIndex]) this.free(pointers[step.ptrIndex]);
+                }
+            }
+            return pointers;
+        }
+        
+        const n = steps.length;
+        if (n === 0) return [];
+        
+        const words = encodeOps(steps, useFlags);
+        const opsPtr = mod._malloc(n * OP_WORDS * 4);
+        const outPtr = mod._malloc(n * 4);
+        try {
+            // Views are re-read after _malloc in case memory grew
+            mod.HEAPU32.set(words, opsPtr >> 2);
+            const count = mod._heap_run_ops(opsPtr, n, outPtr);
+            console.log(`runBatch(${n} ops) = ${count} allocations`);
+            return Array.from(mod.HEAPU32.subarray(outPtr >> 2, (outPtr >> 2) + count));
+        } finally {
+            mod._free(opsPtr);
+            mod._free(outPtr);
+        }
+    }
+
+    // Run a packed op tape (see encodeOps) in chunks of heap_run_ops calls,
+    // without per-op logging. ptrIndex counts allocations over the whole
+    // tape; frees of allocations from earlier chunks are passed by address.
+    // Returns the time spent inside the module and the allocation count;
+    // onProgress(done, total) is called after every chunk.
+    runTape(tape, { chunk = TAPE_CHUNK, onProgress } = {}) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        const mod = this.currentModule;
+        if (!mod._heap_run_ops || !mod._malloc) return this.runTapeCalls(tape, onProgress);
+        
+        const total = tape.length / OP_WORDS;
+        const pointers = [];
+        const opsPtr = mod._malloc(chunk * OP_WORDS * 4);
+        const outPtr = mod._malloc(chunk * 4);
+        let ms = 0;
+        try {
+            for (let start = 0; start < total; start += chunk) {
+                const count = Math.min(chunk, total - start);
+                const words = tape.slice(start * OP_WORDS, (start + count) * OP_WORDS);
+                const base = pointers.length;
+                for (let idx = 0; idx < words.length; idx += OP_WORDS) {
+                    if (words[idx] !== OP_FREE) continue;
+                    const ptrIndex = words[idx + 2] | 0;
+                    if (ptrIndex < base) {
+                        words[idx] = OP_FREE_ADDR;
+                        words[idx + 1] = ptrIndex >= 0 ? pointers[ptrIndex] : 0;
+                        words[idx + 2] = -1;
+                    } else {
+                        words[idx + 2] = ptrIndex - base;
+                    }
+                }
+                
+                mod.HEAPU32.set(words, opsPtr >> 2);
+                const t0 = performance.now();
+                const made = mod._heap_run_ops(opsPtr, count, outPtr);
+                ms += performance.now() - t0;
+                
+                const out = mod.HEAPU32.subarray(outPtr >> 2, (outPtr >> 2) + made);
+                for (let i = 0; i < made; i++) pointers.push(out[i]);
+                if (onProgress) onProgress(start + count, total);
+            }
+        } finally {
+            mod._free(opsPtr);
+            mod._free(outPtr);
+        }
+        return { ms, allocations: pointers.length };
+    }
+
+    // runTape() for modules without heap_run_ops: the same ops, one export
+    // call each, as common_run_ops runs them
+    runTapeCalls(tape, onProgress) {
+        const mod = this.currentModule;
+        const useFlags = this.currentHeap === 5 && !!mod._heap_malloc_flags;
+        const total = tape.length / OP_WORDS;
+        const pointers = [];
+        const t0 = performance.now();
+        for (let idx = 0; idx < tape.length; idx += OP_WORDS) {
+            const kind = tape[idx];
+            if (kind === OP_MALLOC) {
+                const flags = tape[idx + 3] & 0xFF;
+                const ptr = useFlags && flags ? mod._heap_malloc_flags(tape[idx + 1], flags) : mod._heap_malloc(tape[idx + 1]);
+                if (ptr || (tape[idx + 3] & OP_FLAG_KEEP_SLOT)) pointers.push(ptr);
+            } else if (kind === OP_FREE) {
+                const ptrIndex = tape[idx + 2] | 0;
+                if (ptrIndex >= 0 && pointers[ptrIndex]) mod._heap_free(pointers[ptrIndex]);
+            } else if (kind === OP_FREE_ADDR) {
+                if (tape[idx + 1]) mod._heap_free(tape[idx + 1]);
+            }
+        }
+        const ms = performance.now() - t0;
+        if (onProgress) onProgress(total, total);
+        return { ms, allocations: pointers.length };
+    }
+
+    // Expand a workload config into an op tape for runTape(). The generator
+    // runs in the module, so a million-op tape is never built as step objects;
+    // the heap itself is not touched. Modules without heap_generate_ops get
+    // the same tape from generateWorkloadOps().
+    generateTape(config) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        const mod = this.currentModule;
+        if (!mod._heap_generate_ops || !mod._malloc) return generateWorkloadOps(config);
+        
+        const words = encodeWorkload(config);
+        const capacity = words[1];
+        const configPtr = mod._malloc(WORKLOAD_WORDS * 4);
+        const opsPtr = mod._malloc(Math.max(1, capacity) * OP_WORDS * 4);
+        try {
+            if (!configPtr || !opsPtr) throw new Error('Out of memory for the workload');
+            mod.HEAPU32.set(words, configPtr >> 2);
+            const count = mod._heap_generate_ops(configPtr, opsPtr, capacity);
+            if (count < 0) throw new Error('Out of memory for the workload');
+            return mod.HEAPU32.slice(opsPtr >> 2, (opsPtr >> 2) + count * OP_WORDS);
+        } finally {
+            if (configPtr) mod._free(configPtr);
+            if (opsPtr) mod._free(opsPtr);
+        }
+    }
+
     reset() {
         if (!this.initialized) throw new Error('Module not initialized');
         console.log('Resetting heap');
@@ -128,6 +659,8 @@ class HeapWrapper {
             //     size_t min_free_bytes;          // idx + 9
             //     float external_fragmentation;   // idx + 10
             //     float internal_fragmentation;   // idx + 11
+            //     size_t metadata_bytes;          // idx + 12
+            //     uint32_t free_size_histogram[32]; // idx + 13
             // } heap_stats_t;
             
             const stats = {
@@ -142,7 +675,10 @@ class HeapWrapper {
                 smallestFreeBlock: HEAPU32[idx + 8],
                 minFreeBytes: HEAPU32[idx + 9],
                 externalFragmentation: HEAPF32[idx + 10],
-                internalFragmentation: HEAPF32[idx + 11]
+                internalFragmentation: HEAPF32[idx + 11],
+                // Past the end of the original struct
+                metadataBytes: hasCurrentLayout(this.currentModule) ? HEAPU32[idx + 12] : 0,
+                freeSizeHistogram: this.readFreeSizeHistogram(idx)
             };
             
             console.log('Stats read from heap:', stats);
@@ -153,9 +689,186 @@ class HeapWrapper {
         }
     }
 
+    // Per-call latency and work histograms for each op kind, or null if the
+    // module predates them. buckets[0] counts zeros and buckets[b] values in
+    // [2^(b-1), 2^b); max is the worst case seen since heap_init.
+    getOpProfile() {
+        if (!this.initialized) throw new Error('Module not initialized');
+        const mod = this.currentModule;
+        if (!mod._get_op_histogram || !mod._malloc) return null;
+        
+        const outPtr = mod._malloc(PROFILE_BUCKETS * 4);
+        try {
+            const profile = {};
+            PROFILE_OPS.forEach((op, kind) => {
+                profile[op] = {};
+                PROFILE_METRICS.forEach((metric, m) => {
+                    const count = mod._get_op_histogram(kind, m, outPtr);
+                    const start = outPtr >> 2;
+                    profile[op][metric] = {
+                        count,
+                        max: mod._get_op_max(kind, m) >>> 0,
+                        buckets: Array.from(mod.HEAPU32.subarray(start, start + PROFILE_BUCKETS))
+                    };
+                });
+            });
+            return profile;
+        } finally {
+            mod._free(outPtr);
+        }
+    }
+
+    resetOpProfile() {
+        if (!this.initialized) throw new Error('Module not initialized');
+        if (this.currentModule._reset_op_profile) this.currentModule._reset_op_profile();
+    }
+
+    // Churn per log2 size class since heap_init, how many logical-clock ticks
+    // each class lived (same buckets as getOpProfile), and the high-water mark
+    // of live requested bytes per timeline window of windowTicks ticks. Null if
+    // the module predates it; classes that never saw a call are left out.
+    getLifetimeProfile() {
+        if (!this.initialized) throw new Error('Module not initialized');
+        const mod = this.currentModule;
+        if (!mod._get_lifetime_profile) return null;
+        
+        const words = mod.HEAPU32;
+        const base = mod._get_lifetime_profile() >> 2;
+        const allocs = base + 4;
+        const frees = allocs + LIFETIME_CLASSES;
+        const timeline = frees + LIFETIME_CLASSES;
+        const lifetimes = timeline + LIFETIME_WINDOWS;
+        
+        const classes = [];
+        for (let c = 0; c < LIFETIME_CLASSES; c++) {
+            if (words[allocs + c] === 0 && words[frees + c] === 0) continue;
+            const histogram = lifetimes + c * LIFETIME_HISTOGRAM_WORDS;
+            classes.push({
+                minSize: c === 0 ? 0 : 2 ** c,
+                maxSize: 2 ** (c + 1) - 1,
+                allocs: words[allocs + c],
+                frees: words[frees + c],
+                lifetime: {
+                    count: words[histogram],
+                    max: words[histogram + 1],
+                    buckets: Array.from(words.subarray(histogram + 2, histogram + 2 + PROFILE_BUCKETS))
+                }
+            });
+        }
+        
+        return {
+            liveBytes: words[base],
+            peakLiveBytes: words[base + 1],
+            windowTicks: words[base + 2],
+            timeline: Array.from(words.subarray(timeline, timeline + words[base + 3])),
+            classes
+        };
+    }
+
+    // Free-block counts per log2 size bucket of the heap_stats_t at word `idx`,
+    // or null for modules with the original struct
+    readFreeSizeHistogram(idx) {
+        if (!hasCurrentLayout(this.currentModule)) return null;
+        const start = idx + STATS_HISTOGRAM_WORD;
+        return Array.from(this.currentModule.HEAPU32.subarray(start, start + FREE_SIZE_BUCKETS));
+    }
+
+    // Region an allocation of `size` bytes would come from right now, -1 if it
+    // would fail, or null if the module can't tell. Nothing is allocated.
+    canAllocate(size, flags = 0) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        const mod = this.currentModule;
+        if (flags && mod._heap_can_allocate_flags) return mod._heap_can_allocate_flags(size, flags);
+        return mod._heap_can_allocate ? mod._heap_can_allocate(size) : null;
+    }
+
+    // Monotonic counter bumped by every C call that changes blocks, stats or the log
+    getVersion() {
+        if (!this.initialized) throw new Error('Module not initialized');
+        return this.currentModule._get_heap_version ? this.currentModule._get_heap_version() : null;
+    }
+
+    // Zero-copy column views over the C block table snapshot, or null if the
+    // module doesn't export it. Views are only valid until the next heap call.
+    getBlockTable() {
+        if (!this.initialized) throw new Error('Module not initialized');
+        const mod = this.currentModule;
+        if (!mod._get_block_table_ptr) return null;
+        
+        const base = mod._get_block_table_ptr() >> 2;
+        const HEAPU32 = mod.HEAPU32;
+        const columnCount = HEAPU32[base];
+        const capacity = HEAPU32[base + 1];
+        const length = HEAPU32[base + 2];
+        
+        // dirty: the (region, offset) range that changed since the fill at
+        // version `since`, or null if nothing did
+        const table = {
+            length,
+            version: HEAPU32[base + 3],
+            since: HEAPU32[base + 4],
+            dirty: HEAPU32[base + 5] === DIRTY_NONE ? null : {
+                loRegion: HEAPU32[base + 5],
+                loOffset: HEAPU32[base + 6],
+                hiRegion: HEAPU32[base + 7],
+                hiEnd: HEAPU32[base + 8]
+            }
+        };
+        BLOCK_COLUMNS.slice(0, columnCount).forEach((name, c) => {
+            const start = base + BLOCK_TABLE_HEADER + c * capacity;
+            table[name] = HEAPU32.subarray(start, start + length);
+        });
+        return table;
+    }
+
+    // Merges a deferred-coalescing heap still has to make, or null for heaps
+    // that coalesce as they go
+    getPendingMerges() {
+        if (!this.initialized) throw new Error('Module not initialized');
+        return this.currentModule._get_pending_merges ? this.currentModule._get_pending_merges() : null;
+    }
+
+    // Copy of the block table columns that stays valid across heap calls, for
+    // renderers that keep it between frames. Without the C table the columns
+    // are built from getBlocks() and the whole heap is reported dirty.
+    getBlockColumns() {
+        const table = this.getBlockTable();
+        if (table) {
+            const columns = { length: table.length, version: table.version, since: table.since, dirty: table.dirty };
+            BLOCK_COLUMNS.forEach(name => { columns[name] = table[name].slice(); });
+            return columns;
+        }
+        
+        const blocks = this.getBlocks();
+        const columns = { length: blocks.length, version: null, since: null, dirty: null };
+        BLOCK_COLUMNS.forEach(name => {
+            const column = new Uint32Array(blocks.length);
+            blocks.forEach((block, i) => { column[i] = block[name] || 0; });
+            columns[name] = column;
+        });
+        return columns;
+    }
+
     getBlocks() {
         if (!this.initialized) throw new Error('Module not initialized');
         
+        const table = this.getBlockTable();
+        if (table) {
+            const blocks = new Array(table.length);
+            for (let i = 0; i < table.length; i++) {
+                blocks[i] = {
+                    offset: table.offset[i],
+                    size: table.size[i],
+                    state: table.state[i],
+                    allocationId: table.allocationId[i],
+                    timestamp: table.timestamp[i],
+                    requestedSize: table.requestedSize[i],
+                    regionId: table.regionId[i]
+                };
+            }
+            return blocks;
+        }
+        
         try {
             let count, getBlockInfo;
             
@@ -232,7 +945,8 @@ class HeapWrapper {
                     smallestFreeBlock: HEAPU32[idx + 8],
                     minFreeBytes: HEAPU32[idx + 9],
                     externalFragmentation: HEAPF32[idx + 10],
-                    internalFragmentation: HEAPF32[idx + 11]
+                    internalFragmentation: HEAPF32[idx + 11],
+                    freeSizeHistogram: this.readFreeSizeHistogram(idx)
                 };
                 
                 return stats;
@@ -275,6 +989,47 @@ class HeapWrapper {
         return null;
     }
 
+    // Name heap 5 gave region `regionId`, falling back to its number
+    regionName(regionId) {
+        const mod = this.currentModule;
+        if (mod._get_region_name && mod._get_region_count && regionId < mod._get_region_count()) {
+            return mod.UTF8ToString(mod._get_region_name(regionId));
+        }
+        return `Region ${regionId}`;
+    }
+
+    // Heap 5: replace the region layout and reinitialise with it, e.g.
+    // [{ size: 8192, flags: 0x01, name: 'TCM' }, ...] (up to 8 regions).
+    // Sizes are exact now and scale with later initHeap sizes. Returns the
+    // region count, 0 if the layout was rejected, or null if unsupported.
+    defineRegions(descs) {
+        if (!this.initialized) throw new Error('Module not initialized');
+        const mod = this.currentModule;
+        if (!mod._heap_define_regions || !mod._malloc) return null;
+        
+        // heap_region_desc_t on wasm32: start, size, flags (padded), name
+        const DESC_BYTES = 16;
+        const NAME_BYTES = 16;
+        const ptr = mod._malloc(descs.length * (DESC_BYTES + NAME_BYTES) || 1);
+        try {
+            descs.forEach((desc, i) => {
+                const base = ptr + i * DESC_BYTES;
+                const namePtr = ptr + descs.length * DESC_BYTES + i * NAME_BYTES;
+                const name = (desc.name || '').slice(0, NAME_BYTES - 1);
+                for (let c = 0; c < name.length; c++) mod.HEAPU8[namePtr + c] = name.charCodeAt(c) & 0x7F;
+                mod.HEAPU8[namePtr + name.length] = 0;
+                
+                mod.HEAPU32[base >> 2] = 0;
+                mod.HEAPU32[(base >> 2) + 1] = desc.size;
+                mod.HEAPU32[(base >> 2) + 2] = desc.flags || 0;
+                mod.HEAPU32[(base >> 2) + 3] = desc.name ? namePtr : 0;
+            });
+            return mod._heap_define_regions(descs.length ? ptr : 0, descs.length);
+        } finally {
+            mod._free(ptr);
+        }
+    }
+
     getRegionCount() {
         if (!this.initialized) throw new Error('Module not initialized');
         if (this.currentHeap !== 5) return 0;
@@ -288,9 +1043,75 @@ class HeapWrapper {
         return 0;
     }
 
+    decodeLogEntry(logPtr) {
+        const HEAPU8 = this.currentModule.HEAPU8;
+        const HEAPU32 = this.currentModule.HEAPU32;
+        const idx = logPtr >> 2;
+        
+        const log = {
+            seq: HEAPU32[idx],
+            allocationId: HEAPU32[idx + 1],
+            size: HEAPU32[idx + 2],
+            offset: HEAPU32[idx + 3],
+            timestamp: HEAPU32[idx + 4],
+            action: LOG_ACTIONS[HEAPU8[logPtr + 20]] || 'UNKNOWN',
+            success: HEAPU8[logPtr + 21],
+            regionId: HEAPU8[logPtr + 22],
+            flags: HEAPU8[logPtr + 23]
+        };
+        
+        if (this.currentHeap === 5 && log.regionId !== 0xFF) {
+            log.regionName = this.regionName(log.regionId);
+        }
+        return log;
+    }
+
+    // Number of log events overwritten in the ring before being read
+    getLogLost() {
+        if (!this.initialized) throw new Error('Module not initialized');
+        return this.currentModule._get_log_lost ? this.currentModule._get_log_lost() : 0;
+    }
+
+    // Only pulls events newer than the last call; entries the ring no longer
+    // holds (overwritten, cleared or re-initialised) are dropped from the cache
     getLogs() {
         if (!this.initialized) throw new Error('Module not initialized');
         
+        const mod = this.currentModule;
+        if (mod._get_log_since) {
+            try {
+                const cache = this.logCache[this.currentHeap] || { entries: [], lastSeq: 0 };
+                this.logCache[this.currentHeap] = cache;
+                
+                const count = mod._get_log_count();
+                if (count === 0) {
+                    cache.entries = [];
+                    return cache.entries;
+                }
+                
+                const firstSeq = mod.HEAPU32[mod._get_log_entry(0) >> 2];
+                const entries = cache.entries.filter(log => log.seq >= firstSeq);
+                
+                const outPtr = mod._malloc(count * LOG_ENTRY_SIZE);
+                try {
+                    const n = mod._get_log_since(cache.lastSeq, outPtr, count);
+                    for (let i = 0; i < n; i++) {
+                        entries.push(this.decodeLogEntry(outPtr + i * LOG_ENTRY_SIZE));
+                    }
+                } finally {
+                    mod._free(outPtr);
+                }
+                
+                if (entries.length > 0) cache.lastSeq = entries[entries.length - 1].seq;
+                cache.entries = entries;
+                return entries;
+            } catch (error) {
+                console.error('Error reading logs:', error);
+                return [];
+            }
+        }
+        
+        // Modules built before the ring-buffer log: char action[32] records
         try {
             const count = this.currentModule._get_log_count();
             const logs = [];
@@ -323,8 +1144,7 @@ class HeapWrapper {
                     
                     // Add region name for heap_5
                     if (this.currentHeap === 5 && log.regionId !== 0xFF) {
-                        const regionNames = ['FAST', 'DMA', 'UNCACHED'];
-                        log.regionName = regionNames[log.regionId] || `Region ${log.regionId}`;
+                        log.regionName = this.regionName(log.regionId);
                     }
                     
                     logs.push(log);
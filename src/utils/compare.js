@@ -0,0 +1,60 @@
+// src/utils/compare.js
+// Comparison runs: the same op tape replayed against several heaps at once,
+// one Web Worker per heap, so a run takes about as long as its slowest
+// allocator and the page stays responsive. Steps are packed once with
+// encodeOps(); each worker gets its own copy of the words. A generated
+// workload (utils/workloads.js) is sent as its config instead, and every
+// worker expands the same tape from it.
+
+import { encodeOps, HEAP_MODULES } from '../js/heap_module';
+
+// Every heap the page lists; one without a built module reports so in its row
+export const COMPARE_HEAPS = Object.keys(HEAP_MODULES).map(Number);
+
+// Starts the run and returns a handle:
+//   done        promise of { [heapType]: result or { error } } once every worker reported
+//   blocks(h)   promise of heap h's final blocks, read from its worker on request
+//   stop()      terminate the workers (pending promises never settle)
+// onProgress(heapType, done, total) follows each worker chunk by chunk.
+export const compareHeaps = (steps, { heaps = COMPARE_HEAPS, heapSize, maxBlocks = 0, workload, onProgress } = {}) => {
+    const tape = workload ? null : encodeOps(steps);
+    const workers = {};
+    const results = {};
+    const blockRequests = {};
+    
+    const done = Promise.all(heaps.map(heapType => new Promise(resolve => {
+        const worker = new Worker(new URL('../js/compare.worker.js', import.meta.url));
+        workers[heapType] = worker;
+        
+        worker.onmessage = ({ data }) => {
+            if (data.type === 'progress') {
+                if (onProgress) onProgress(heapType, data.done, data.total);
+            } else if (data.type === 'result') {
+                results[heapType] = data;
+                resolve();
+            } else if (data.type === 'blocks') {
+                const request = blockRequests[heapType];
+                delete blockRequests[heapType];
+                if (request) request(data.blocks);
+            } else if (data.type === 'error') {
+                results[heapType] = { heapType, error: data.message };
+                resolve();
+            }
+        };
+        worker.onerror = (event) => {
+            results[heapType] = { heapType, error: event.message || 'Worker failed' };
+            resolve();
+        };
+        worker.postMessage({ type: 'run', heapType, tape, workload, heapSize, maxBlocks });
+    }))).then(() => results);
+    
+    return {
+        done,
+        blocks: (heapType) => new Promise(resolve => {
+            if (!workers[heapType]) return resolve([]);
+            blockRequests[heapType] = resolve;
+            workers[heapType].postMessage({ type: 'blocks' });
+        }),
+        stop: () => Object.values(workers).forEach(worker => worker.terminate())
+    };
+};
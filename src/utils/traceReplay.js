@@ -0,0 +1,162 @@
+// src/utils/traceReplay.js
+// Streaming replay of binary allocation traces (format in c/heap_trace.h).
+// Bytes are pulled from a ReadableStream, cut into chunks of whole records and
+// each chunk is run through HeapWrapper.runBatch(), so only one chunk and the
+// map of live allocations are ever held in memory.
+
+export const TRACE_MAGIC = 0x43525448; // "HTRC"
+export const TRACE_VERSION = 1;
+export const TRACE_HEADER_SIZE = 16;
+export const TRACE_RECORD_SIZE = 12;
+
+const TRACE_MALLOC = 0;
+const TRACE_FREE = 1;
+const TRACE_RESET = 2;
+const DEFAULT_HEAP_SIZE = 65536;    // c/heap_limits.h, for resets that carry no size
+
+const readHeader = (bytes) => {
+    const view = new DataView(bytes.buffer, bytes.byteOffset, TRACE_HEADER_SIZE);
+    if (view.getUint32(0, true) !== TRACE_MAGIC ||
+        view.getUint16(4, true) !== TRACE_VERSION ||
+        view.getUint16(6, true) !== TRACE_RECORD_SIZE) {
+        throw new Error('Not a version 1 allocation trace');
+    }
+    return { heapSize: view.getUint32(8, true) };
+};
+
+const concat = (a, b) => {
+    if (a.length === 0) return b;
+    const out = new Uint8Array(a.length + b.length);
+    out.set(a, 0);
+    out.set(b, a.length);
+    return out;
+};
+
+// Replays `stream` (e.g. fetch(url).body or file.stream()) against the
+// current heap. Returns counters for the whole trace; onProgress gets the
+// same object after every chunk.
+export const replayTrace = async (heapModule, stream, { chunkRecords = 4096, onProgress } = {}) => {
+    const result = { records: 0, mallocs: 0, frees: 0, resets: 0, failures: 0, unmatched: 0 };
+    const live = new Map();       // trace id -> pointer, allocations from earlier chunks
+    let steps = [];
+    let batchIds = new Map();     // trace id -> slot in this chunk's runBatch() result
+
+    const flush = () => {
+        if (steps.length === 0) return;
+        const pointers = heapModule.runBatch(steps);
+        for (const [id, slot] of batchIds) {
+            if (pointers[slot]) live.set(id, pointers[slot]);
+        }
+        for (let slot = 0; slot < pointers.length; slot++) {
+            if (!pointers[slot]) result.failures++;
+        }
+        steps = [];
+        batchIds = new Map();
+    };
+
+    const replayRecords = (bytes, start, end) => {
+        const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.length);
+        let slot = 0;
+
+        for (let pos = start; pos + TRACE_RECORD_SIZE <= end; pos += TRACE_RECORD_SIZE) {
+            const kind = view.getUint8(pos);
+            const flags = view.getUint8(pos + 1);
+            const size = view.getUint32(pos + 4, true);
+            const id = view.getUint32(pos + 8, true);
+            result.records++;
+
+            if (kind === TRACE_MALLOC) {
+                result.mallocs++;
+                batchIds.set(id, slot++);
+                steps.push({ action: 'allocate', size, flags, keepSlot: true });
+            } else if (kind === TRACE_FREE) {
+                result.frees++;
+                if (batchIds.has(id)) {
+                    steps.push({ action: 'free', ptrIndex: batchIds.get(id) });
+                    batchIds.delete(id);
+                } else if (live.has(id)) {
+                    steps.push({ action: 'free', ptr: live.get(id) });
+                    live.delete(id);
+                } else {
+                    result.unmatched++;
+                }
+            } else if (kind === TRACE_RESET) {
+                result.resets++;
+                flush();
+                slot = 0;
+                live.clear();
+                // Re-initialise at the recorded size, as bench/replay.c does
+                heapModule.initHeap(size || DEFAULT_HEAP_SIZE);
+            }
+        }
+        flush();
+    };
+
+    const reader = stream.getReader();
+    let pending = new Uint8Array(0);
+    let header = null;
+
+    try {
+        for (;;) {
+            const { done, value } = await reader.read();
+            if (value) pending = concat(pending, value);
+
+            if (!header) {
+                if (pending.length < TRACE_HEADER_SIZE) {
+                    if (done) throw new Error('Trace is shorter than its header');
+                    continue;
+                }
+                header = readHeader(pending);
+                pending = pending.subarray(TRACE_HEADER_SIZE);
+            }
+
+            // Replay every whole chunk; a short tail waits for more bytes
+            const chunkBytes = chunkRecords * TRACE_RECORD_SIZE;
+            let pos = 0;
+            while (pending.length - pos >= chunkBytes ||
+                   (done && pending.length - pos >= TRACE_RECORD_SIZE)) {
+                const end = Math.min(pos + chunkBytes, pending.length);
+                replayRecords(pending, pos, end);
+                pos = end - ((end - pos) % TRACE_RECORD_SIZE);
+                if (onProgress) onProgress({ ...result, heapSize: header.heapSize });
+            }
+            pending = pending.slice(pos);
+
+            if (done) break;
+        }
+    } finally {
+        reader.releaseLock();
+    }
+
+    return { ...result, heapSize: header.heapSize };
+};
+// Whole trace (an ArrayBuffer or Uint8Array) as simulation steps for one op
+// tape, e.g. for compareHeaps(). Every malloc keeps its slot, so ptrIndex is
+// the malloc's ordinal. A tape cannot re-initialise the heap, so a reset
+// record frees everything still live instead.
+export const traceToSteps = (buffer) => {
+    const bytes = buffer instanceof Uint8Array ? buffer : new Uint8Array(buffer);
+    if (bytes.length < TRACE_HEADER_SIZE) throw new Error('Trace is shorter than its header');
+    const { heapSize } = readHeader(bytes);
+    const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.length);
+    const steps = [];
+    const live = new Map();       // trace id -> malloc ordinal
+    let mallocs = 0;
+
+    for (let pos = TRACE_HEADER_SIZE; pos + TRACE_RECORD_SIZE <= bytes.length; pos += TRACE_RECORD_SIZE) {
+        const kind = view.getUint8(pos);
+        const id = view.getUint32(pos + 8, true);
+
+        if (kind === TRACE_MALLOC) {
+            live.set(id, mallocs++);
+            steps.push({ action: 'allocate', size: view.getUint32(pos + 4, true), flags: view.getUint8(pos + 1), keepSlot: true });
+        } else if (kind === TRACE_FREE && live.has(id)) {
+            steps.push({ action: 'free', ptrIndex: live.get(id) });
+            live.delete(id);
+        } else if (kind === TRACE_RESET) {
+            for (const slot of live.values()) steps.push({ action: 'free', ptrIndex: slot });
+            live.clear();
+        }
+    }
+    return { steps, heapSize };
+};
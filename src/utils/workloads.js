@@ -0,0 +1,45 @@
+// src/utils/workloads.js
+// Generated workloads for comparison runs. Each config is expanded into an op
+// tape by the heap module's seeded generator (common_workload_generate in
+// heap_common.h), so the same config gives the same ops on every heap and in
+// the native bench (`bench -w`). Sizes are uniform, powerLaw, bimodal or
+// classes; lifetimes are lifo, fifo, random or longLived.
+export const WORKLOAD_OP_COUNTS = [100000, 1000000];
+
+export const getWorkloads = () => ({
+    churn: {
+        name: "Random Churn",
+        description: "Uniform sizes, frees in random order",
+        config: { sizes: 'uniform', lifetime: 'random', minSize: 8, maxSize: 512, maxLive: 128 }
+    },
+
+    powerLaw: {
+        name: "Power-Law Sizes",
+        description: "Mostly small requests with a long tail, freed oldest first",
+        config: { sizes: 'powerLaw', lifetime: 'fifo', minSize: 8, maxSize: 4096, shape: 120, maxLive: 128 }
+    },
+
+    bimodal: {
+        name: "Bimodal Stack",
+        description: "Small headers and large buffers, freed newest first",
+        config: { sizes: 'bimodal', lifetime: 'lifo', minSize: 16, maxSize: 2048, shape: 85, maxLive: 64 }
+    },
+
+    sizeClasses: {
+        name: "Size Classes",
+        description: "A few fixed object sizes, some kept for the whole run",
+        config: {
+            sizes: 'classes', lifetime: 'longLived', classes: [24, 40, 64, 120, 256],
+            longLivedPercent: 5, maxLive: 128
+        }
+    },
+
+    regionMix: {
+        name: "Region Flag Mix",
+        description: "Random churn with FAST and DMA requests (heap_5 regions)",
+        config: {
+            sizes: 'uniform', lifetime: 'random', minSize: 16, maxSize: 256, maxLive: 96,
+            flags: { fast: 30, dma: 20 }
+        }
+    }
+});